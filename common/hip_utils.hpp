@@ -25,8 +25,12 @@
 #ifndef HIP_UTILS_HPP
 #define HIP_UTILS_HPP
 
+#include <algorithm>
 #include <hip/hip_runtime.h>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <utility>
 
 /**
  * @brief Macro for checking HIP errors
@@ -79,4 +83,32 @@ private:
     hipEvent_t start_, stop_;
 };
 
+/**
+ * @brief Workgroups of a kernel resident at once on the current device (CU count × occupancy),
+ * queried once per device and kernel
+ *
+ * Sizes persistent grids, and cooperative grids whose workgroups synchronize with each other.
+ */
+inline int resident_grid_size(const void* kernel, int block_size)
+{
+    static std::mutex                                 mutex;
+    static std::map<std::pair<int, const void*>, int> cache;
+
+    int device;
+    HIP_CHECK(hipGetDevice(&device));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto [it, inserted] = cache.try_emplace({device, kernel}, 0);
+    if(inserted)
+    {
+        int cus;
+        int blocks_per_cu;
+        HIP_CHECK(hipDeviceGetAttribute(&cus, hipDeviceAttributeMultiprocessorCount, device));
+        HIP_CHECK(
+            hipOccupancyMaxActiveBlocksPerMultiprocessor(&blocks_per_cu, kernel, block_size, 0));
+        it->second = cus * std::max(blocks_per_cu, 1);
+    }
+    return it->second;
+}
+
 #endif // HIP_UTILS_HPP
@@ -175,6 +175,69 @@ private:
     std::vector<T> data_; ///< Pointer to matrix data
 };
 
+/**
+ * @brief Non-owning view of matrix data held elsewhere, such as a memory-mapped file
+ * @tparam T Data type of matrix elements (const for read-only views)
+ * @tparam Layout Matrix memory layout (row_major or col_major)
+ */
+template<class T, matrix_layout Layout = matrix_layout::row_major>
+class matrix_view
+{
+public:
+    using value_type                      = T;
+    static constexpr matrix_layout layout = Layout;
+
+    /**
+     * @brief Construct a view over m × n elements starting at data
+     * @param data Pointer to first element
+     * @param m Dimension of m
+     * @param n Dimension of n
+     */
+    matrix_view(T* data, size_t m, size_t n) : data_(data), m_(m), n_(n) {}
+
+    /**
+     * @brief View the whole of an owning matrix
+     * @param input Matrix to view
+     */
+    template<class U>
+    matrix_view(matrix<U, Layout>& input) : data_(input.data()), m_(input.m()), n_(input.n())
+    {}
+    template<class U>
+    matrix_view(const matrix<U, Layout>& input)
+        : data_(input.data()), m_(input.m()), n_(input.n())
+    {}
+
+    T& operator()(size_t i, size_t j) const
+    {
+        return data_[Layout == matrix_layout::row_major ? i * n_ + j : j * m_ + i];
+    }
+
+    T* data() const
+    {
+        return data_;
+    }
+
+    size_t m() const
+    {
+        return m_;
+    }
+
+    size_t n() const
+    {
+        return n_;
+    }
+
+    size_t size() const
+    {
+        return m_ * n_;
+    }
+
+private:
+    T*     data_; ///< First element, not owned
+    size_t m_; ///< Number of rows
+    size_t n_; ///< Number of columns
+};
+
 /**
  * @brief Initialize matrix with random values
  * @tparam T Matrix element type
@@ -0,0 +1,900 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIP_TENSOR_FILE_HPP
+#define HIP_TENSOR_FILE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <common/hip_utils.hpp>
+#include <common/matrix.hpp>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <hip/hip_fp16.h>
+#include <hip/hip_runtime.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Element types found in weight files
+ */
+enum class tensor_dtype
+{
+    f16,
+    bf16,
+    f32,
+    f64,
+    i8,
+    u8,
+    i32,
+    i64,
+    other ///< Listed but not viewable, e.g. BOOL
+};
+
+inline size_t tensor_dtype_size(tensor_dtype dtype)
+{
+    switch(dtype)
+    {
+        case tensor_dtype::f16:
+        case tensor_dtype::bf16: return 2;
+        case tensor_dtype::f32:
+        case tensor_dtype::i32: return 4;
+        case tensor_dtype::f64:
+        case tensor_dtype::i64: return 8;
+        case tensor_dtype::i8:
+        case tensor_dtype::u8: return 1;
+        default: return 0;
+    }
+}
+
+/**
+ * @brief The dtype a view of element type T requires
+ */
+template<class T>
+constexpr tensor_dtype tensor_dtype_of()
+{
+    using U = std::remove_const_t<T>;
+    if constexpr(std::is_same_v<U, half>)
+    {
+        return tensor_dtype::f16;
+    }
+    else if constexpr(std::is_same_v<U, float>)
+    {
+        return tensor_dtype::f32;
+    }
+    else if constexpr(std::is_same_v<U, double>)
+    {
+        return tensor_dtype::f64;
+    }
+    else if constexpr(std::is_same_v<U, int8_t>)
+    {
+        return tensor_dtype::i8;
+    }
+    else if constexpr(std::is_same_v<U, uint8_t>)
+    {
+        return tensor_dtype::u8;
+    }
+    else if constexpr(std::is_same_v<U, int32_t>)
+    {
+        return tensor_dtype::i32;
+    }
+    else
+    {
+        static_assert(std::is_same_v<U, int64_t>, "no tensor dtype for this element type");
+        return tensor_dtype::i64;
+    }
+}
+
+/**
+ * @brief A tensor stored in a file: offset and bytes are relative to the start of the mapping
+ */
+struct tensor_entry
+{
+    std::string         name;
+    tensor_dtype        dtype;
+    std::vector<size_t> shape;
+    size_t              offset;
+    size_t              bytes;
+    matrix_layout       layout; ///< Row-major (C order) unless a .npy says fortran_order
+};
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ */
+class mapped_file
+{
+public:
+    explicit mapped_file(const std::string& path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            throw std::runtime_error("cannot open " + path);
+        }
+        struct stat info;
+        if(::fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("cannot stat " + path);
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        if(size_ > 0)
+        {
+            void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data == MAP_FAILED)
+            {
+                ::close(fd);
+                throw std::runtime_error("cannot map " + path);
+            }
+            // Uploads read front to back, so let the kernel read ahead aggressively
+            ::madvise(data, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const std::byte*>(data);
+        }
+        ::close(fd);
+    }
+
+    mapped_file(const mapped_file&)            = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0))
+    {}
+
+    ~mapped_file()
+    {
+        if(data_ != nullptr)
+        {
+            ::munmap(const_cast<std::byte*>(data_), size_);
+        }
+    }
+
+    const std::byte* data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    const std::byte* data_ = nullptr;
+    size_t           size_ = 0;
+};
+
+namespace detail
+{
+
+/**
+ * @brief Just enough JSON for safetensors headers: objects, arrays, strings and integers
+ */
+class json_cursor
+{
+public:
+    json_cursor(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    char peek()
+    {
+        skip_space();
+        if(p_ == end_)
+        {
+            fail();
+        }
+        return *p_;
+    }
+
+    bool consume(char c)
+    {
+        if(peek() != c)
+        {
+            return false;
+        }
+        ++p_;
+        return true;
+    }
+
+    void expect(char c)
+    {
+        if(!consume(c))
+        {
+            fail();
+        }
+    }
+
+    std::string string()
+    {
+        expect('"');
+        std::string out;
+        while(p_ != end_ && *p_ != '"')
+        {
+            char c = *p_++;
+            if(c == '\\' && p_ != end_)
+            {
+                c = *p_++;
+                switch(c)
+                {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'u':
+                        {
+                            // Names are ASCII in practice; keep other code points as '?'
+                            if(end_ - p_ < 4 || !std::all_of(p_, p_ + 4, is_hex_digit))
+                            {
+                                fail();
+                            }
+                            const int code = std::stoi(std::string(p_, p_ + 4), nullptr, 16);
+                            c              = code < 0x80 ? static_cast<char>(code) : '?';
+                            p_ += 4;
+                            break;
+                        }
+                    default: break;
+                }
+            }
+            out.push_back(c);
+        }
+        expect('"');
+        return out;
+    }
+
+    size_t integer()
+    {
+        skip_space();
+        if(p_ == end_ || *p_ < '0' || *p_ > '9')
+        {
+            fail();
+        }
+        size_t value = 0;
+        while(p_ != end_ && *p_ >= '0' && *p_ <= '9')
+        {
+            value = value * 10 + (*p_++ - '0');
+        }
+        return value;
+    }
+
+    std::vector<size_t> integers()
+    {
+        std::vector<size_t> values;
+        expect('[');
+        if(!consume(']'))
+        {
+            do
+            {
+                values.push_back(integer());
+            } while(consume(','));
+            expect(']');
+        }
+        return values;
+    }
+
+    // Skip any value, such as the __metadata__ object
+    void skip()
+    {
+        const char c = peek();
+        if(c == '"')
+        {
+            string();
+        }
+        else if(c == '{' || c == '[')
+        {
+            const char close = c == '{' ? '}' : ']';
+            ++p_;
+            if(!consume(close))
+            {
+                do
+                {
+                    if(c == '{')
+                    {
+                        string();
+                        expect(':');
+                    }
+                    skip();
+                } while(consume(','));
+                expect(close);
+            }
+        }
+        else
+        {
+            while(p_ != end_ && *p_ != ',' && *p_ != '}' && *p_ != ']')
+            {
+                ++p_;
+            }
+        }
+    }
+
+private:
+    static bool is_hex_digit(char c)
+    {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+    }
+
+    void skip_space()
+    {
+        while(p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+        {
+            ++p_;
+        }
+    }
+
+    [[noreturn]] void fail()
+    {
+        throw std::runtime_error("malformed safetensors header");
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+inline tensor_dtype parse_safetensors_dtype(const std::string& dtype)
+{
+    if(dtype == "F16") return tensor_dtype::f16;
+    if(dtype == "BF16") return tensor_dtype::bf16;
+    if(dtype == "F32") return tensor_dtype::f32;
+    if(dtype == "F64") return tensor_dtype::f64;
+    if(dtype == "I8") return tensor_dtype::i8;
+    if(dtype == "U8") return tensor_dtype::u8;
+    if(dtype == "I32") return tensor_dtype::i32;
+    if(dtype == "I64") return tensor_dtype::i64;
+    return tensor_dtype::other;
+}
+
+inline const char* safetensors_dtype_name(tensor_dtype dtype)
+{
+    switch(dtype)
+    {
+        case tensor_dtype::f16: return "F16";
+        case tensor_dtype::bf16: return "BF16";
+        case tensor_dtype::f32: return "F32";
+        case tensor_dtype::f64: return "F64";
+        case tensor_dtype::i8: return "I8";
+        case tensor_dtype::u8: return "U8";
+        case tensor_dtype::i32: return "I32";
+        case tensor_dtype::i64: return "I64";
+        default: throw std::invalid_argument("dtype cannot be written");
+    }
+}
+
+inline tensor_dtype parse_npy_descr(const std::string& descr)
+{
+    if(descr.size() < 3 || descr[0] == '>')
+    {
+        throw std::runtime_error("unsupported .npy dtype " + descr);
+    }
+    const std::string kind = descr.substr(1);
+    if(kind == "f2") return tensor_dtype::f16;
+    if(kind == "f4") return tensor_dtype::f32;
+    if(kind == "f8") return tensor_dtype::f64;
+    if(kind == "i1") return tensor_dtype::i8;
+    if(kind == "u1") return tensor_dtype::u8;
+    if(kind == "i4") return tensor_dtype::i32;
+    if(kind == "i8") return tensor_dtype::i64;
+    return tensor_dtype::other;
+}
+
+inline const char* npy_descr(tensor_dtype dtype)
+{
+    switch(dtype)
+    {
+        case tensor_dtype::f16: return "<f2";
+        case tensor_dtype::f32: return "<f4";
+        case tensor_dtype::f64: return "<f8";
+        case tensor_dtype::i8: return "|i1";
+        case tensor_dtype::u8: return "|u1";
+        case tensor_dtype::i32: return "<i4";
+        case tensor_dtype::i64: return "<i8";
+        default: throw std::invalid_argument("dtype cannot be written to .npy");
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief A memory-mapped safetensors or .npy file whose tensors are viewed in place
+ *
+ * Views point straight into the mapping, so nothing is read until the data is touched and no
+ * copy is made on the host. The file must outlive its views.
+ */
+class tensor_file
+{
+public:
+    /**
+     * @brief Map a file; .npy files are recognized by their magic, anything else is parsed as
+     * safetensors
+     *
+     * @throws std::runtime_error if the file cannot be mapped or its header is malformed
+     */
+    explicit tensor_file(const std::string& path) : file_(path)
+    {
+        static constexpr char npy_magic[] = "\x93NUMPY";
+        if(file_.size() >= 6 && std::memcmp(file_.data(), npy_magic, 6) == 0)
+        {
+            parse_npy(path);
+        }
+        else
+        {
+            parse_safetensors();
+        }
+
+        for(const tensor_entry& entry : tensors_)
+        {
+            size_t elements = 1;
+            for(size_t extent : entry.shape)
+            {
+                elements *= extent;
+            }
+            const size_t element_size = tensor_dtype_size(entry.dtype);
+            if(entry.offset + entry.bytes > file_.size()
+               || (element_size != 0 && elements * element_size != entry.bytes))
+            {
+                throw std::runtime_error("tensor " + entry.name + " does not fit its data in "
+                                         + path);
+            }
+        }
+    }
+
+    const std::vector<tensor_entry>& tensors() const
+    {
+        return tensors_;
+    }
+
+    /**
+     * @throws std::out_of_range if there is no tensor of that name (a .npy holds one, named
+     * after the file's stem)
+     */
+    const tensor_entry& find(const std::string& name) const
+    {
+        for(const tensor_entry& entry : tensors_)
+        {
+            if(entry.name == name)
+            {
+                return entry;
+            }
+        }
+        throw std::out_of_range("no tensor named " + name);
+    }
+
+    const std::byte* data(const tensor_entry& entry) const
+    {
+        return file_.data() + entry.offset;
+    }
+
+    // Total bytes of the mapping
+    size_t size() const
+    {
+        return file_.size();
+    }
+
+    /**
+     * @brief Zero-copy view of a rank-1 or rank-2 tensor stored in layout L
+     *
+     * A rank-1 tensor is viewed as a single row.
+     *
+     * @throws std::invalid_argument if the dtype, rank or stored layout do not match
+     */
+    template<class T, matrix_layout L>
+    matrix_view<const T, L> view(const std::string& name) const
+    {
+        const tensor_entry& entry = checked<T>(name);
+        if(entry.layout != L)
+        {
+            throw std::invalid_argument("tensor " + name
+                                        + " is stored in the other layout; view it transposed");
+        }
+        const auto [m, n] = extents(entry);
+        return {reinterpret_cast<const T*>(data(entry)), m, n};
+    }
+
+    /**
+     * @brief Zero-copy view of the transpose of a rank-2 tensor, which is the same memory read
+     * in the other layout: a row-major out × in weight W is Wᵀ as a column-major in × out matrix
+     *
+     * @throws std::invalid_argument if the dtype or rank do not match, or the stored layout is
+     * already L
+     */
+    template<class T, matrix_layout L>
+    matrix_view<const T, L> view_transposed(const std::string& name) const
+    {
+        const tensor_entry& entry = checked<T>(name);
+        if(entry.layout == L)
+        {
+            throw std::invalid_argument("tensor " + name + " is stored in this layout; view it");
+        }
+        const auto [m, n] = extents(entry);
+        return {reinterpret_cast<const T*>(data(entry)), n, m};
+    }
+
+private:
+    template<class T>
+    const tensor_entry& checked(const std::string& name) const
+    {
+        const tensor_entry& entry = find(name);
+        if(entry.dtype != tensor_dtype_of<T>())
+        {
+            throw std::invalid_argument("tensor " + name + " has a different dtype");
+        }
+        if(entry.shape.empty() || entry.shape.size() > 2)
+        {
+            throw std::invalid_argument("tensor " + name + " is not a matrix");
+        }
+        return entry;
+    }
+
+    static std::pair<size_t, size_t> extents(const tensor_entry& entry)
+    {
+        return entry.shape.size() == 1 ? std::pair<size_t, size_t>{1, entry.shape[0]}
+                                       : std::pair<size_t, size_t>{entry.shape[0], entry.shape[1]};
+    }
+
+    void parse_safetensors()
+    {
+        uint64_t header = 0;
+        if(file_.size() < sizeof(header))
+        {
+            throw std::runtime_error("malformed safetensors header");
+        }
+        std::memcpy(&header, file_.data(), sizeof(header)); // Little-endian, as is the host
+        if(header > file_.size() - sizeof(header))
+        {
+            throw std::runtime_error("malformed safetensors header");
+        }
+
+        const char*         json = reinterpret_cast<const char*>(file_.data()) + sizeof(header);
+        detail::json_cursor cursor(json, json + header);
+        const size_t        base = sizeof(header) + header;
+
+        cursor.expect('{');
+        if(cursor.consume('}'))
+        {
+            return;
+        }
+        do
+        {
+            tensor_entry entry{cursor.string(), tensor_dtype::other, {}, 0, 0,
+                               matrix_layout::row_major};
+            cursor.expect(':');
+            if(entry.name == "__metadata__")
+            {
+                cursor.skip();
+                continue;
+            }
+
+            cursor.expect('{');
+            do
+            {
+                const std::string key = cursor.string();
+                cursor.expect(':');
+                if(key == "dtype")
+                {
+                    entry.dtype = detail::parse_safetensors_dtype(cursor.string());
+                }
+                else if(key == "shape")
+                {
+                    entry.shape = cursor.integers();
+                }
+                else if(key == "data_offsets")
+                {
+                    const std::vector<size_t> offsets = cursor.integers();
+                    if(offsets.size() != 2 || offsets[1] < offsets[0])
+                    {
+                        throw std::runtime_error("malformed safetensors header");
+                    }
+                    entry.offset = base + offsets[0];
+                    entry.bytes  = offsets[1] - offsets[0];
+                }
+                else
+                {
+                    cursor.skip();
+                }
+            } while(cursor.consume(','));
+            cursor.expect('}');
+            tensors_.push_back(std::move(entry));
+        } while(cursor.consume(','));
+        cursor.expect('}');
+    }
+
+    void parse_npy(const std::string& path)
+    {
+        // Magic, two version bytes, then a 2-byte (v1) or 4-byte (v2+) header length
+        if(file_.size() < 10)
+        {
+            throw std::runtime_error("malformed .npy header in " + path);
+        }
+        const std::byte* bytes   = file_.data();
+        const int        version = static_cast<int>(bytes[6]);
+        const size_t     prefix  = version == 1 ? 10 : 12;
+        if(file_.size() < prefix)
+        {
+            throw std::runtime_error("malformed .npy header in " + path);
+        }
+        uint32_t length = 0;
+        std::memcpy(&length, bytes + 8, version == 1 ? 2 : 4);
+        if(prefix + length > file_.size())
+        {
+            throw std::runtime_error("malformed .npy header in " + path);
+        }
+
+        // A Python dict literal: {'descr': '<f2', 'fortran_order': False, 'shape': (3, 4), }
+        const std::string header(reinterpret_cast<const char*>(bytes) + prefix, length);
+        auto              value = [&](const std::string& key)
+        {
+            const size_t at = header.find("'" + key + "'");
+            if(at == std::string::npos)
+            {
+                throw std::runtime_error("malformed .npy header in " + path);
+            }
+            return header.find_first_not_of(" :", at + key.size() + 2);
+        };
+
+        tensor_entry entry;
+        const size_t stem_begin = path.find_last_of('/') + 1;
+        entry.name              = path.substr(stem_begin, path.find_last_of('.') - stem_begin);
+
+        const size_t descr = value("descr") + 1;
+        entry.dtype  = detail::parse_npy_descr(
+            header.substr(descr, header.find('\'', descr) - descr));
+        entry.layout = header.compare(value("fortran_order"), 4, "True") == 0
+                           ? matrix_layout::col_major
+                           : matrix_layout::row_major;
+
+        size_t p = value("shape") + 1;
+        while(p < header.size() && header[p] != ')')
+        {
+            if(header[p] >= '0' && header[p] <= '9')
+            {
+                size_t end;
+                entry.shape.push_back(std::stoull(header.substr(p), &end));
+                p += end;
+            }
+            else
+            {
+                ++p;
+            }
+        }
+
+        entry.offset = prefix + length;
+        entry.bytes  = file_.size() - entry.offset;
+        tensors_.push_back(std::move(entry));
+    }
+
+    mapped_file               file_;
+    std::vector<tensor_entry> tensors_;
+};
+
+/**
+ * @brief A tensor to write, with its data on the host
+ */
+struct tensor_record
+{
+    std::string         name;
+    tensor_dtype        dtype;
+    std::vector<size_t> shape;
+    const void*         data;
+};
+
+/**
+ * @brief Write tensors (row-major) to a safetensors file
+ */
+inline void save_safetensors(const std::string& path, const std::vector<tensor_record>& tensors)
+{
+    std::string json = "{";
+    size_t      offset = 0;
+    for(const tensor_record& tensor : tensors)
+    {
+        size_t bytes = tensor_dtype_size(tensor.dtype);
+        json += (json.size() > 1 ? ",\"" : "\"") + tensor.name + "\":{\"dtype\":\""
+                + detail::safetensors_dtype_name(tensor.dtype) + "\",\"shape\":[";
+        for(size_t i = 0; i < tensor.shape.size(); ++i)
+        {
+            json += (i > 0 ? "," : "") + std::to_string(tensor.shape[i]);
+            bytes *= tensor.shape[i];
+        }
+        json += "],\"data_offsets\":[" + std::to_string(offset) + ","
+                + std::to_string(offset + bytes) + "]}";
+        offset += bytes;
+    }
+    json += "}";
+    // Pad the header so the data starts 8-byte aligned
+    json.append((8 - json.size() % 8) % 8, ' ');
+
+    std::ofstream  out(path, std::ios::binary);
+    const uint64_t header = json.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(json.data(), json.size());
+    for(const tensor_record& tensor : tensors)
+    {
+        size_t bytes = tensor_dtype_size(tensor.dtype);
+        for(size_t extent : tensor.shape)
+        {
+            bytes *= extent;
+        }
+        out.write(static_cast<const char*>(tensor.data), bytes);
+    }
+    if(!out)
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+/**
+ * @brief Write a matrix to a version 1 .npy file, in Fortran order if it is column-major
+ */
+template<class T, matrix_layout L>
+void save_npy(const std::string& path, const matrix<T, L>& input)
+{
+    std::string header = std::string("{'descr': '") + detail::npy_descr(tensor_dtype_of<T>())
+                         + "', 'fortran_order': "
+                         + (L == matrix_layout::col_major ? "True" : "False") + ", 'shape': ("
+                         + std::to_string(input.m()) + ", " + std::to_string(input.n()) + "), }";
+    // Pad with spaces and a newline so the data starts 64-byte aligned
+    header.append(63 - (10 + header.size()) % 64, ' ');
+    header.push_back('\n');
+
+    std::ofstream  out(path, std::ios::binary);
+    const uint16_t length = static_cast<uint16_t>(header.size());
+    out.write("\x93NUMPY\x01\x00", 8);
+    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.write(header.data(), header.size());
+    out.write(reinterpret_cast<const char*>(input.data()), input.size() * sizeof(T));
+    if(!out)
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+/**
+ * @brief Streams host memory to the device through two pinned staging buffers
+ *
+ * Copying one chunk into pinned memory (which also faults in a mapped file's pages) overlaps
+ * the DMA of the previous chunk, so a mapped tensor reaches the device with one host copy and
+ * without a pageable hipMemcpy. Throughput covers the whole path, host side included.
+ */
+class staged_uploader
+{
+public:
+    explicit staged_uploader(size_t chunk_bytes = size_t(64) << 20) : chunk_bytes_(chunk_bytes)
+    {
+        if(chunk_bytes_ == 0)
+        {
+            throw std::invalid_argument("staging chunks must not be empty");
+        }
+        HIP_CHECK(hipStreamCreateWithFlags(&stream_, hipStreamNonBlocking));
+        for(int slot = 0; slot < 2; ++slot)
+        {
+            HIP_CHECK(hipHostMalloc(&staging_[slot], chunk_bytes_, hipHostMallocDefault));
+            HIP_CHECK(hipEventCreate(&ready_[slot]));
+        }
+    }
+
+    staged_uploader(const staged_uploader&)            = delete;
+    staged_uploader& operator=(const staged_uploader&) = delete;
+
+    ~staged_uploader()
+    {
+        HIP_CHECK(hipStreamSynchronize(stream_));
+        for(int slot = 0; slot < 2; ++slot)
+        {
+            HIP_CHECK(hipHostFree(staging_[slot]));
+            HIP_CHECK(hipEventDestroy(ready_[slot]));
+        }
+        HIP_CHECK(hipStreamDestroy(stream_));
+    }
+
+    /**
+     * @brief Queue a copy of bytes from host src to device dst; src may be reused on return
+     */
+    void upload(void* dst, const void* src, size_t bytes)
+    {
+        if(!timing_)
+        {
+            timing_ = true;
+            start_  = std::chrono::steady_clock::now();
+        }
+        for(size_t offset = 0; offset < bytes; offset += chunk_bytes_)
+        {
+            const size_t chunk = std::min(chunk_bytes_, bytes - offset);
+
+            // Wait until the DMA that last read this staging buffer is done
+            HIP_CHECK(hipEventSynchronize(ready_[slot_]));
+            std::memcpy(staging_[slot_], static_cast<const char*>(src) + offset, chunk);
+            HIP_CHECK(hipMemcpyAsync(static_cast<char*>(dst) + offset,
+                                     staging_[slot_],
+                                     chunk,
+                                     hipMemcpyHostToDevice,
+                                     stream_));
+            HIP_CHECK(hipEventRecord(ready_[slot_], stream_));
+            slot_ = 1 - slot_;
+        }
+        bytes_ += bytes;
+    }
+
+    /**
+     * @brief Queue the upload of a tensor straight from its file mapping
+     */
+    void upload(void* dst, const tensor_file& file, const tensor_entry& entry)
+    {
+        upload(dst, file.data(entry), entry.bytes);
+    }
+
+    /**
+     * @brief Wait for all queued uploads and close the current throughput measurement
+     */
+    void synchronize()
+    {
+        HIP_CHECK(hipStreamSynchronize(stream_));
+        if(timing_)
+        {
+            seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_)
+                            .count();
+            timing_ = false;
+        }
+    }
+
+    size_t bytes() const
+    {
+        return bytes_;
+    }
+
+    // Bytes over wall-clock seconds from the first upload to synchronize, across measurements
+    double throughput_gbps() const
+    {
+        return seconds_ > 0.0 ? bytes_ / seconds_ * 1e-9 : 0.0;
+    }
+
+    void reset_statistics()
+    {
+        synchronize();
+        bytes_   = 0;
+        seconds_ = 0.0;
+    }
+
+    hipStream_t stream() const
+    {
+        return stream_;
+    }
+
+private:
+    size_t      chunk_bytes_;
+    hipStream_t stream_;
+    void*       staging_[2];
+    hipEvent_t  ready_[2];
+    int         slot_    = 0;
+    size_t      bytes_   = 0;
+    double      seconds_ = 0.0;
+    bool        timing_  = false;
+
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif // HIP_TENSOR_FILE_HPP
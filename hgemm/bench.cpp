@@ -23,10 +23,16 @@
  */
 
 #include <benchmark/benchmark.h>
+#include <chrono>
 #include <common/hip_utils.hpp>
 #include <common/matrix.hpp>
+#include <common/tensor_file.hpp>
+#include <filesystem>
+#include <fstream>
 #include <hgemm.hpp>
 #include <iomanip>
+#include <memory>
+#include <numeric>
 
 template<kernel_type K_TYPE>
 struct layout_selector
@@ -61,6 +67,22 @@ struct layout_selector<kernel_type::rocblas>
     static constexpr matrix_layout c_layout = matrix_layout::col_major;
 };
 
+template<>
+struct layout_selector<kernel_type::rocblas_ex>
+{
+    static constexpr matrix_layout a_layout = matrix_layout::col_major;
+    static constexpr matrix_layout b_layout = matrix_layout::row_major;
+    static constexpr matrix_layout c_layout = matrix_layout::col_major;
+};
+
+template<>
+struct layout_selector<kernel_type::rocblas_ex_tuned>
+{
+    static constexpr matrix_layout a_layout = matrix_layout::col_major;
+    static constexpr matrix_layout b_layout = matrix_layout::row_major;
+    static constexpr matrix_layout c_layout = matrix_layout::col_major;
+};
+
 template<kernel_type K_TYPE>
 void run_benchmark(benchmark::State& state, size_t M, size_t N, size_t K)
 {
@@ -90,7 +112,7 @@ void run_benchmark(benchmark::State& state, size_t M, size_t N, size_t K)
 
     gpu_timer timer;
 
-    if(K_TYPE == kernel_type::rocblas)
+    if(is_rocblas_kernel(K_TYPE))
     {
         init_rocblas();
     }
@@ -123,7 +145,7 @@ void run_benchmark(benchmark::State& state, size_t M, size_t N, size_t K)
     state.counters["TFLOPS"] = total_tflops / state.iterations();
     state.SetBytesProcessed(state.iterations() * ((M * K) + (K * N) + (M * N)) * sizeof(half));
 
-    if(K_TYPE == kernel_type::rocblas)
+    if(is_rocblas_kernel(K_TYPE))
     {
         cleanup_rocblas();
     }
@@ -135,6 +157,783 @@ void run_benchmark(benchmark::State& state, size_t M, size_t N, size_t K)
     HIP_CHECK(hipFree(d_C));
 }
 
+/**
+ * @brief Benchmarks the batched tiny-matrix kernel, reporting problems per second
+ */
+void run_batched_benchmark(benchmark::State& state, size_t M, size_t N, size_t K, size_t batch)
+{
+    matrix<half, matrix_layout::row_major> h_A(batch * M, K);
+    matrix<half, matrix_layout::col_major> h_B(K, batch * N);
+
+    init_matrix(h_A);
+    init_matrix(h_B);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+
+    half *d_A, *d_B, *d_C;
+    HIP_CHECK(hipMalloc(&d_A, h_A.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_B, h_B.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_C, batch * M * N * sizeof(half)));
+    HIP_CHECK(hipMemcpy(d_A, h_A.data(), h_A.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemcpy(d_B, h_B.data(), h_B.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipDeviceSynchronize());
+
+    gpu_timer timer;
+
+    // Warmup only
+    for(int i = 0; i < 5; ++i)
+    {
+        hgemm_batched_gpu(d_C, d_A, d_B, M, N, K, batch, stream);
+        HIP_CHECK(hipPeekAtLastError());
+    }
+    HIP_CHECK(hipDeviceSynchronize());
+
+    double total_tflops   = 0.0;
+    double total_problems = 0.0;
+    double total_flops    = 2.0 * M * N * K * batch;
+
+    for(auto _ : state)
+    {
+        timer.start(stream);
+        hgemm_batched_gpu(d_C, d_A, d_B, M, N, K, batch, stream);
+        HIP_CHECK(hipPeekAtLastError());
+        float elapsed_time = timer.stop(stream);
+        HIP_CHECK(hipDeviceSynchronize());
+
+        double seconds = elapsed_time / 1000.0;
+        state.SetIterationTime(seconds);
+        total_tflops += (total_flops / seconds) * 1e-12;
+        total_problems += batch / seconds;
+    }
+
+    state.counters["TFLOPS"]     = total_tflops / state.iterations();
+    state.counters["Problems/s"] = total_problems / state.iterations();
+    state.SetBytesProcessed(state.iterations() * batch * ((M * K) + (K * N) + (M * N))
+                            * sizeof(half));
+
+    HIP_CHECK(hipStreamDestroy(stream));
+    HIP_CHECK(hipFree(d_A));
+    HIP_CHECK(hipFree(d_B));
+    HIP_CHECK(hipFree(d_C));
+}
+
+#define CREATE_BATCHED_BENCHMARK(M, N, K, BATCH)                                            \
+    benchmark::RegisterBenchmark("{hgemm:batched,m:" #M ",n:" #N ",k:" #K ",batch:" #BATCH "}", \
+                                 run_batched_benchmark,                                     \
+                                 M,                                                         \
+                                 N,                                                         \
+                                 K,                                                         \
+                                 BATCH)
+
+/**
+ * @brief Benchmarks the Strassen–Winograd driver, reporting effective TFLOPS from the 2MNK count
+ */
+template<kernel_type K_TYPE>
+void run_strassen_benchmark(benchmark::State& state, size_t M, size_t N, size_t K, size_t crossover)
+{
+    matrix<half, layout_selector<K_TYPE>::a_layout> h_A(M, K);
+    matrix<half, layout_selector<K_TYPE>::b_layout> h_B(K, N);
+
+    init_matrix(h_A);
+    init_matrix(h_B);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+
+    half *d_A, *d_B, *d_C;
+
+    void* d_ws;
+    HIP_CHECK(hipMalloc(&d_A, h_A.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_B, h_B.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_C, M * N * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_ws, std::max<size_t>(strassen_workspace_size(M, N, K, crossover), 1)));
+    HIP_CHECK(hipMemcpy(d_A, h_A.data(), h_A.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemcpy(d_B, h_B.data(), h_B.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipDeviceSynchronize());
+
+    gpu_timer timer;
+
+    // Warmup only
+    for(int i = 0; i < 5; ++i)
+    {
+        hgemm_strassen_gpu<K_TYPE>(d_C, d_A, d_B, M, N, K, crossover, d_ws, stream);
+        HIP_CHECK(hipPeekAtLastError());
+    }
+    HIP_CHECK(hipDeviceSynchronize());
+
+    double total_tflops = 0.0;
+    double total_flops  = 2.0 * M * N * K; // Effective rate, not the flops actually executed
+
+    for(auto _ : state)
+    {
+        timer.start(stream);
+        hgemm_strassen_gpu<K_TYPE>(d_C, d_A, d_B, M, N, K, crossover, d_ws, stream);
+        HIP_CHECK(hipPeekAtLastError());
+        float elapsed_time = timer.stop(stream);
+        HIP_CHECK(hipDeviceSynchronize());
+
+        double seconds = elapsed_time / 1000.0;
+        state.SetIterationTime(seconds);
+        total_tflops += (total_flops / seconds) * 1e-12;
+    }
+
+    state.counters["TFLOPS"] = total_tflops / state.iterations();
+    state.counters["levels"] = strassen_levels(M, N, K, crossover);
+
+    HIP_CHECK(hipStreamDestroy(stream));
+    HIP_CHECK(hipFree(d_A));
+    HIP_CHECK(hipFree(d_B));
+    HIP_CHECK(hipFree(d_C));
+    HIP_CHECK(hipFree(d_ws));
+}
+
+#define CREATE_STRASSEN_BENCHMARK(K_TYPE, M, N, K, CROSSOVER)                              \
+    benchmark::RegisterBenchmark("{hgemm:strassen_" #K_TYPE ",m:" #M ",n:" #N ",k:" #K \
+                                 ",crossover:" #CROSSOVER "}",                              \
+                                 run_strassen_benchmark<K_TYPE>,                            \
+                                 M,                                                         \
+                                 N,                                                         \
+                                 K,                                                         \
+                                 CROSSOVER)
+
+/**
+ * @brief Benchmarks loading a safetensors file to the device, either zero-copy through the mapping
+ * and pinned staging, or by reading into a vector, copying into a matrix and a pageable hipMemcpy
+ *
+ * Both paths read through the page cache, which the first iteration warms.
+ */
+void run_load_benchmark(benchmark::State& state, size_t rows, size_t cols, bool staged)
+{
+    const std::string path
+        = (std::filesystem::temp_directory_path() / "hgemm_load_bench.safetensors").string();
+    {
+        matrix<half, matrix_layout::row_major> weight(rows, cols);
+        init_matrix(weight);
+        save_safetensors(path, {{"weight", tensor_dtype::f16, {rows, cols}, weight.data()}});
+    }
+    const size_t bytes = rows * cols * sizeof(half);
+
+    half* d_weight;
+    HIP_CHECK(hipMalloc(&d_weight, bytes));
+
+    staged_uploader uploader;
+    double          total_gbps = 0.0;
+    for(auto _ : state)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if(staged)
+        {
+            tensor_file file(path);
+            uploader.upload(d_weight, file, file.find("weight"));
+            uploader.synchronize();
+        }
+        else
+        {
+            std::ifstream     in(path, std::ios::binary);
+            std::vector<char> contents(std::filesystem::file_size(path));
+            in.read(contents.data(), contents.size());
+
+            uint64_t header;
+            std::memcpy(&header, contents.data(), sizeof(header));
+            std::vector<half> values(rows * cols);
+            std::memcpy(values.data(), contents.data() + sizeof(header) + header, bytes);
+            matrix<half, matrix_layout::row_major> weight(rows, cols);
+            weight.set_data(values);
+            HIP_CHECK(hipMemcpy(d_weight, weight.data(), bytes, hipMemcpyHostToDevice));
+        }
+        const double seconds
+            = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        state.SetIterationTime(seconds);
+        total_gbps += bytes / seconds * 1e-9;
+    }
+
+    state.counters["GB/s"] = total_gbps / state.iterations();
+    state.SetBytesProcessed(state.iterations() * bytes);
+
+    HIP_CHECK(hipFree(d_weight));
+    std::filesystem::remove(path);
+}
+
+#define CREATE_LOAD_BENCHMARK(PATH, STAGED, ROWS, COLS)                                    \
+    benchmark::RegisterBenchmark("{load:" #PATH ",rows:" #ROWS ",cols:" #COLS "}",         \
+                                 run_load_benchmark,                                       \
+                                 ROWS,                                                     \
+                                 COLS,                                                     \
+                                 STAGED)
+
+/**
+ * @brief Measures the host cost of enqueueing one GEMM, through hgemm_gpu or a prebuilt plan
+ *
+ * Only the time spent in the calls is reported, the queued kernels are drained outside the
+ * timed region. Shapes should be small so that the launch queue never fills.
+ */
+void run_launch_overhead_benchmark(
+    benchmark::State& state, size_t M, size_t N, size_t K, bool planned)
+{
+    constexpr int calls = 64;
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+
+    half *d_A, *d_B, *d_C;
+    HIP_CHECK(hipMalloc(&d_A, M * K * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_B, K * N * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_C, M * N * sizeof(half)));
+
+    const hgemm_plan plan(
+        M, N, K, matrix_layout::col_major, matrix_layout::row_major, matrix_layout::row_major);
+
+    // Warmup only
+    for(int i = 0; i < calls; ++i)
+    {
+        execute_hgemm(plan, {d_C, d_A, d_B}, stream);
+        hgemm_gpu<kernel_type::wmma_opt_4>(d_C, d_A, d_B, M, N, K, stream);
+    }
+    HIP_CHECK(hipStreamSynchronize(stream));
+
+    double total_us = 0.0;
+    for(auto _ : state)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < calls; ++i)
+        {
+            if(planned)
+            {
+                execute_hgemm(plan, {d_C, d_A, d_B}, stream);
+            }
+            else
+            {
+                hgemm_gpu<kernel_type::wmma_opt_4>(d_C, d_A, d_B, M, N, K, stream);
+            }
+        }
+        const double seconds
+            = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        HIP_CHECK(hipStreamSynchronize(stream));
+
+        state.SetIterationTime(seconds);
+        total_us += seconds * 1e6 / calls;
+    }
+
+    state.counters["us/call"] = total_us / state.iterations();
+
+    HIP_CHECK(hipStreamDestroy(stream));
+    HIP_CHECK(hipFree(d_A));
+    HIP_CHECK(hipFree(d_B));
+    HIP_CHECK(hipFree(d_C));
+}
+
+#define CREATE_LAUNCH_OVERHEAD_BENCHMARK(PATH, PLANNED, M, N, K)                       \
+    benchmark::RegisterBenchmark("{launch:" #PATH ",m:" #M ",n:" #N ",k:" #K "}",      \
+                                 run_launch_overhead_benchmark,                        \
+                                 M,                                                    \
+                                 N,                                                    \
+                                 K,                                                    \
+                                 PLANNED)
+
+/**
+ * @brief Benchmarks a causal (window = 0) or sliding-window masked GEMM of S × S scores
+ *
+ * TFLOPS is the dense-equivalent rate 2·S²·K / t, the dense kernel on the same shape is timed
+ * for the speedup counter.
+ */
+template<kernel_type K_TYPE>
+void run_masked_benchmark(benchmark::State& state, size_t S, size_t K, int64_t window)
+{
+    matrix<half, layout_selector<K_TYPE>::a_layout> h_A(S, K);
+    matrix<half, layout_selector<K_TYPE>::b_layout> h_B(K, S);
+
+    init_matrix(h_A);
+    init_matrix(h_B);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+
+    half *d_A, *d_B, *d_C;
+    HIP_CHECK(hipMalloc(&d_A, h_A.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_B, h_B.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_C, S * S * sizeof(half)));
+    HIP_CHECK(hipMemcpy(d_A, h_A.data(), h_A.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemcpy(d_B, h_B.data(), h_B.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipDeviceSynchronize());
+
+    const masked_hgemm<K_TYPE> gemm(S, S, K, attention_band{0, window});
+    gpu_timer                  timer;
+
+    // Warmup only
+    for(int i = 0; i < 5; ++i)
+    {
+        gemm.execute(d_C, d_A, d_B, stream);
+        hgemm_gpu<K_TYPE>(d_C, d_A, d_B, S, S, K, stream);
+        HIP_CHECK(hipPeekAtLastError());
+    }
+    HIP_CHECK(hipDeviceSynchronize());
+
+    constexpr int dense_runs = 10;
+    timer.start(stream);
+    for(int i = 0; i < dense_runs; ++i)
+    {
+        hgemm_gpu<K_TYPE>(d_C, d_A, d_B, S, S, K, stream);
+    }
+    const double dense_seconds = timer.stop(stream) / 1000.0 / dense_runs;
+
+    double total_tflops  = 0.0;
+    double total_seconds = 0.0;
+    double total_flops   = 2.0 * S * S * K; // Dense-equivalent, not the flops actually executed
+
+    for(auto _ : state)
+    {
+        timer.start(stream);
+        gemm.execute(d_C, d_A, d_B, stream);
+        HIP_CHECK(hipPeekAtLastError());
+        float elapsed_time = timer.stop(stream);
+        HIP_CHECK(hipDeviceSynchronize());
+
+        double seconds = elapsed_time / 1000.0;
+        state.SetIterationTime(seconds);
+        total_tflops += (total_flops / seconds) * 1e-12;
+        total_seconds += seconds;
+    }
+
+    state.counters["TFLOPS"]        = total_tflops / state.iterations();
+    state.counters["tile_fraction"] = gemm.tile_fraction();
+    state.counters["vs_dense"]      = dense_seconds / (total_seconds / state.iterations());
+
+    HIP_CHECK(hipStreamDestroy(stream));
+    HIP_CHECK(hipFree(d_A));
+    HIP_CHECK(hipFree(d_B));
+    HIP_CHECK(hipFree(d_C));
+}
+
+#define CREATE_MASKED_BENCHMARK(K_TYPE, S, K, WINDOW)                                      \
+    benchmark::RegisterBenchmark("{hgemm:masked_" #K_TYPE ",s:" #S ",k:" #K                \
+                                 ",window:" #WINDOW "}",                                    \
+                                 run_masked_benchmark<K_TYPE>,                              \
+                                 S,                                                         \
+                                 K,                                                         \
+                                 WINDOW)
+
+/**
+ * @brief Benchmarks split-KV decode attention, reporting the bandwidth of the K and V reads
+ */
+void run_decode_benchmark(benchmark::State& state, size_t heads, size_t G, size_t S, size_t D)
+{
+    matrix<half, matrix_layout::row_major> h_Q(heads * G, D);
+    matrix<half, matrix_layout::row_major> h_KV(heads * S, D);
+
+    init_matrix(h_Q);
+    init_matrix(h_KV);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+
+    half *d_Q, *d_K, *d_V, *d_O;
+    void* d_ws;
+    HIP_CHECK(hipMalloc(&d_Q, h_Q.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_K, h_KV.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_V, h_KV.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_O, h_Q.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_ws, decode_attention_workspace_size(heads, G, S, D)));
+    HIP_CHECK(hipMemcpy(d_Q, h_Q.data(), h_Q.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemcpy(d_K, h_KV.data(), h_KV.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemcpy(d_V, h_KV.data(), h_KV.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipDeviceSynchronize());
+
+    const float scale = 1.0f / std::sqrt(static_cast<float>(D));
+    gpu_timer   timer;
+
+    // Warmup only
+    for(int i = 0; i < 5; ++i)
+    {
+        decode_attention_gpu(d_O, d_Q, d_K, d_V, heads, G, S, D, scale, d_ws, stream);
+        HIP_CHECK(hipPeekAtLastError());
+    }
+    HIP_CHECK(hipDeviceSynchronize());
+
+    const double kv_bytes   = 2.0 * heads * S * D * sizeof(half);
+    double       total_gbps = 0.0;
+
+    for(auto _ : state)
+    {
+        timer.start(stream);
+        decode_attention_gpu(d_O, d_Q, d_K, d_V, heads, G, S, D, scale, d_ws, stream);
+        HIP_CHECK(hipPeekAtLastError());
+        float elapsed_time = timer.stop(stream);
+        HIP_CHECK(hipDeviceSynchronize());
+
+        double seconds = elapsed_time / 1000.0;
+        state.SetIterationTime(seconds);
+        total_gbps += kv_bytes / seconds * 1e-9;
+    }
+
+    const size_t split_len    = decode_attention_split_len(heads, S);
+    state.counters["KV_GB/s"] = total_gbps / state.iterations();
+    state.counters["splits"]  = (S + split_len - 1) / split_len;
+    state.SetBytesProcessed(state.iterations() * kv_bytes);
+
+    HIP_CHECK(hipStreamDestroy(stream));
+    HIP_CHECK(hipFree(d_Q));
+    HIP_CHECK(hipFree(d_K));
+    HIP_CHECK(hipFree(d_V));
+    HIP_CHECK(hipFree(d_O));
+    HIP_CHECK(hipFree(d_ws));
+}
+
+#define CREATE_DECODE_BENCHMARK(HEADS, G, S, D)                                            \
+    benchmark::RegisterBenchmark("{decode:split_kv,heads:" #HEADS ",g:" #G ",s:" #S        \
+                                 ",d:" #D "}",                                              \
+                                 run_decode_benchmark,                                      \
+                                 HEADS,                                                     \
+                                 G,                                                         \
+                                 S,                                                         \
+                                 D)
+
+/**
+ * @brief Benchmarks Q·Kᵀ and P·V on a paged KV-cache with shuffled pages against contiguous K/V
+ */
+template<kernel_type K_TYPE, int PAGE_SIZE>
+void run_paged_benchmark(benchmark::State& state, size_t M, size_t S, size_t D)
+{
+    const size_t pages = (S + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    matrix<half, matrix_layout::col_major> h_Q(M, D);
+    matrix<half, matrix_layout::col_major> h_P(M, S);
+    matrix<half, matrix_layout::row_major> h_pool(pages * PAGE_SIZE, D);
+
+    init_matrix(h_Q);
+    init_matrix(h_P);
+    init_matrix(h_pool);
+
+    std::vector<int32_t> table(pages);
+    std::iota(table.begin(), table.end(), 0);
+    std::shuffle(table.begin(), table.end(), std::mt19937(73));
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+
+    half *   d_Q, *d_P, *d_K, *d_V, *d_S, *d_O;
+    int32_t* d_table;
+    HIP_CHECK(hipMalloc(&d_Q, h_Q.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_P, h_P.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_K, h_pool.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_V, h_pool.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_S, M * S * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_O, M * D * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_table, pages * sizeof(int32_t)));
+    HIP_CHECK(hipMemcpy(d_Q, h_Q.data(), h_Q.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemcpy(d_P, h_P.data(), h_P.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(
+        hipMemcpy(d_K, h_pool.data(), h_pool.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(
+        hipMemcpy(d_V, h_pool.data(), h_pool.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(
+        hipMemcpy(d_table, table.data(), pages * sizeof(int32_t), hipMemcpyHostToDevice));
+    HIP_CHECK(hipDeviceSynchronize());
+
+    // Single-head pages: keys are D × PAGE_SIZE, values PAGE_SIZE × D
+    const int64_t      page_stride = static_cast<int64_t>(PAGE_SIZE) * D;
+    const paged_layout key_layout{d_table, page_stride, PAGE_SIZE, h_pool.size()};
+    const paged_layout value_layout{d_table, page_stride, static_cast<int64_t>(D), h_pool.size()};
+
+    auto paged = [&]()
+    {
+        paged_scores_gpu<K_TYPE, PAGE_SIZE>(d_S, d_Q, d_K, M, S, D, key_layout, stream);
+        paged_values_gpu<K_TYPE, PAGE_SIZE>(d_O, d_P, d_V, M, S, D, value_layout, stream);
+    };
+    auto contiguous = [&]()
+    {
+        hgemm_gpu<K_TYPE>(d_S, d_Q, d_K, M, S, D, stream);
+        hgemm_gpu<K_TYPE>(d_O, d_P, d_V, M, D, S, stream);
+    };
+    gpu_timer timer;
+
+    // Warmup only
+    for(int i = 0; i < 5; ++i)
+    {
+        paged();
+        contiguous();
+        HIP_CHECK(hipPeekAtLastError());
+    }
+    HIP_CHECK(hipDeviceSynchronize());
+
+    constexpr int contiguous_runs = 10;
+    timer.start(stream);
+    for(int i = 0; i < contiguous_runs; ++i)
+    {
+        contiguous();
+    }
+    const double contiguous_seconds = timer.stop(stream) / 1000.0 / contiguous_runs;
+
+    double total_tflops  = 0.0;
+    double total_seconds = 0.0;
+    double total_flops   = 4.0 * M * S * D;
+
+    for(auto _ : state)
+    {
+        timer.start(stream);
+        paged();
+        HIP_CHECK(hipPeekAtLastError());
+        float elapsed_time = timer.stop(stream);
+        HIP_CHECK(hipDeviceSynchronize());
+
+        double seconds = elapsed_time / 1000.0;
+        state.SetIterationTime(seconds);
+        total_tflops += (total_flops / seconds) * 1e-12;
+        total_seconds += seconds;
+    }
+
+    state.counters["TFLOPS"]        = total_tflops / state.iterations();
+    state.counters["vs_contiguous"] = contiguous_seconds / (total_seconds / state.iterations());
+
+    HIP_CHECK(hipStreamDestroy(stream));
+    HIP_CHECK(hipFree(d_Q));
+    HIP_CHECK(hipFree(d_P));
+    HIP_CHECK(hipFree(d_K));
+    HIP_CHECK(hipFree(d_V));
+    HIP_CHECK(hipFree(d_S));
+    HIP_CHECK(hipFree(d_O));
+    HIP_CHECK(hipFree(d_table));
+}
+
+#define CREATE_PAGED_BENCHMARK(K_TYPE, PAGE_SIZE, M, S, D)                                 \
+    benchmark::RegisterBenchmark("{hgemm:paged_" #K_TYPE ",page:" #PAGE_SIZE ",m:" #M      \
+                                 ",s:" #S ",d:" #D "}",                                     \
+                                 run_paged_benchmark<K_TYPE, PAGE_SIZE>,                    \
+                                 M,                                                         \
+                                 S,                                                         \
+                                 D)
+
+/**
+ * @brief Benchmarks the segmented multi-LoRA shrink/expand pair on equal segments, one adapter
+ * each, against launching the same kernels once per adapter
+ */
+void run_lora_benchmark(benchmark::State& state, size_t T, size_t segments, size_t H, size_t rank)
+{
+    matrix<half, matrix_layout::row_major> h_X(T, H);
+    matrix<half, matrix_layout::row_major> h_W(segments * rank, H);
+
+    init_matrix(h_X);
+    init_matrix(h_W);
+
+    std::vector<int32_t> starts(segments + 1);
+    std::vector<int32_t> adapters(segments);
+    for(size_t s = 0; s <= segments; ++s)
+    {
+        starts[s] = static_cast<int32_t>(s * T / segments);
+    }
+    std::iota(adapters.begin(), adapters.end(), 0);
+
+    const lora_segmented                         lora(starts, adapters, H, H, rank);
+    std::vector<std::unique_ptr<lora_segmented>> per_adapter;
+    size_t                                       workspace_size = lora.workspace_size();
+    for(size_t s = 0; s < segments; ++s)
+    {
+        const std::vector<int32_t> segment = {0, starts[s + 1] - starts[s]};
+        per_adapter.push_back(
+            std::make_unique<lora_segmented>(segment, std::vector<int32_t>{0}, H, H, rank));
+        workspace_size = std::max(workspace_size, per_adapter.back()->workspace_size());
+    }
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+
+    // Shrink (rank × H) and expand (H × rank) weights have the same size
+    half *d_X, *d_A, *d_B, *d_Y;
+    void* d_ws;
+    HIP_CHECK(hipMalloc(&d_X, h_X.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_A, h_W.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_B, h_W.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_Y, h_X.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_ws, workspace_size));
+    HIP_CHECK(hipMemcpy(d_X, h_X.data(), h_X.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemcpy(d_A, h_W.data(), h_W.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemcpy(d_B, h_W.data(), h_W.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemset(d_Y, 0, h_X.size() * sizeof(half)));
+    HIP_CHECK(hipDeviceSynchronize());
+
+    auto grouped = [&]()
+    {
+        for(size_t s = 0; s < segments; ++s)
+        {
+            const size_t row    = starts[s];
+            const size_t weight = s * rank * H;
+            per_adapter[s]->execute(
+                d_Y + row * H, d_X + row * H, d_A + weight, d_B + weight, 1.0f, d_ws, stream);
+        }
+    };
+    gpu_timer timer;
+
+    // Warmup only
+    for(int i = 0; i < 5; ++i)
+    {
+        lora.execute(d_Y, d_X, d_A, d_B, 1.0f, d_ws, stream);
+        grouped();
+        HIP_CHECK(hipPeekAtLastError());
+    }
+    HIP_CHECK(hipDeviceSynchronize());
+
+    constexpr int grouped_runs = 10;
+    timer.start(stream);
+    for(int i = 0; i < grouped_runs; ++i)
+    {
+        grouped();
+    }
+    const double grouped_seconds = timer.stop(stream) / 1000.0 / grouped_runs;
+
+    double total_tflops  = 0.0;
+    double total_seconds = 0.0;
+    double total_flops   = 4.0 * T * H * rank;
+
+    for(auto _ : state)
+    {
+        timer.start(stream);
+        lora.execute(d_Y, d_X, d_A, d_B, 1.0f, d_ws, stream);
+        HIP_CHECK(hipPeekAtLastError());
+        float elapsed_time = timer.stop(stream);
+        HIP_CHECK(hipDeviceSynchronize());
+
+        double seconds = elapsed_time / 1000.0;
+        state.SetIterationTime(seconds);
+        total_tflops += (total_flops / seconds) * 1e-12;
+        total_seconds += seconds;
+    }
+
+    state.counters["TFLOPS"]         = total_tflops / state.iterations();
+    state.counters["splits"]         = lora.splits();
+    state.counters["vs_per_adapter"] = grouped_seconds / (total_seconds / state.iterations());
+
+    HIP_CHECK(hipStreamDestroy(stream));
+    HIP_CHECK(hipFree(d_X));
+    HIP_CHECK(hipFree(d_A));
+    HIP_CHECK(hipFree(d_B));
+    HIP_CHECK(hipFree(d_Y));
+    HIP_CHECK(hipFree(d_ws));
+}
+
+#define CREATE_LORA_BENCHMARK(T, SEGMENTS, H, RANK)                                        \
+    benchmark::RegisterBenchmark("{lora:segmented,t:" #T ",segments:" #SEGMENTS ",h:" #H  \
+                                 ",rank:" #RANK "}",                                        \
+                                 run_lora_benchmark,                                        \
+                                 T,                                                         \
+                                 SEGMENTS,                                                  \
+                                 H,                                                         \
+                                 RANK)
+
+/**
+ * @brief Benchmarks a bucketed GEMM on a stream of random batch sizes up to max_m against
+ * launching each exact shape, reporting how well the default buckets fit the traffic
+ */
+void run_bucket_benchmark(benchmark::State& state, size_t max_m, size_t N, size_t K)
+{
+    matrix<half, matrix_layout::col_major> h_A(max_m, K);
+    matrix<half, matrix_layout::row_major> h_B(K, N);
+
+    init_matrix(h_A);
+    init_matrix(h_B);
+
+    std::mt19937                          gen(75);
+    std::uniform_int_distribution<size_t> dist(1, max_m);
+    std::vector<size_t>                   batches(64);
+    for(size_t& m : batches)
+    {
+        m = dist(gen);
+    }
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+
+    half *d_A, *d_B, *d_C;
+    HIP_CHECK(hipMalloc(&d_A, h_A.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_B, h_B.size() * sizeof(half)));
+    HIP_CHECK(hipMalloc(&d_C, max_m * N * sizeof(half)));
+    HIP_CHECK(hipMemcpy(d_A, h_A.data(), h_A.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipMemcpy(d_B, h_B.data(), h_B.size() * sizeof(half), hipMemcpyHostToDevice));
+    HIP_CHECK(hipDeviceSynchronize());
+
+    bucketed_hgemm gemm(default_m_buckets(max_m),
+                        N,
+                        K,
+                        matrix_layout::col_major,
+                        matrix_layout::row_major,
+                        matrix_layout::row_major);
+
+    // Every batch reads the leading rows of A, with ld = M
+    auto bucketed = [&]()
+    {
+        for(size_t m : batches)
+        {
+            gemm.execute({d_C, d_A, d_B}, m, stream);
+        }
+    };
+    auto exact = [&]()
+    {
+        for(size_t m : batches)
+        {
+            hgemm_gpu<kernel_type::wmma_opt_4>(d_C, d_A, d_B, m, N, K, stream);
+        }
+    };
+    gpu_timer timer;
+
+    // Warmup only, which also builds and tunes every bucket plan
+    for(int i = 0; i < 5; ++i)
+    {
+        bucketed();
+        exact();
+        HIP_CHECK(hipPeekAtLastError());
+    }
+    HIP_CHECK(hipDeviceSynchronize());
+    gemm.reset_stats();
+
+    constexpr int exact_runs = 10;
+    timer.start(stream);
+    for(int i = 0; i < exact_runs; ++i)
+    {
+        exact();
+    }
+    const double exact_seconds = timer.stop(stream) / 1000.0 / exact_runs;
+
+    double total_tflops  = 0.0;
+    double total_seconds = 0.0;
+    double total_flops   = 0.0;
+    for(size_t m : batches)
+    {
+        total_flops += 2.0 * m * N * K;
+    }
+
+    for(auto _ : state)
+    {
+        timer.start(stream);
+        bucketed();
+        HIP_CHECK(hipPeekAtLastError());
+        float elapsed_time = timer.stop(stream);
+        HIP_CHECK(hipDeviceSynchronize());
+
+        double seconds = elapsed_time / 1000.0;
+        state.SetIterationTime(seconds);
+        total_tflops += (total_flops / seconds) * 1e-12;
+        total_seconds += seconds;
+    }
+
+    const bucket_stats stats = gemm.stats();
+
+    state.counters["TFLOPS"]   = total_tflops / state.iterations();
+    state.counters["hit_rate"] = stats.hit_rate();
+    state.counters["fill"]     = stats.fill();
+    state.counters["vs_exact"] = exact_seconds / (total_seconds / state.iterations());
+
+    HIP_CHECK(hipStreamDestroy(stream));
+    HIP_CHECK(hipFree(d_A));
+    HIP_CHECK(hipFree(d_B));
+    HIP_CHECK(hipFree(d_C));
+}
+
+#define CREATE_BUCKET_BENCHMARK(MAX_M, N, K)                                               \
+    benchmark::RegisterBenchmark("{hgemm:bucketed,max_m:" #MAX_M ",n:" #N ",k:" #K "}",    \
+                                 run_bucket_benchmark,                                      \
+                                 MAX_M,                                                     \
+                                 N,                                                         \
+                                 K)
+
 #define CREATE_BENCHMARK(K_TYPE, M, N, K)                                          \
     benchmark::RegisterBenchmark("{hgemm:" #K_TYPE ",m:" #M ",n:" #N ",k:" #K "}", \
                                  run_benchmark<K_TYPE>,                            \
@@ -165,9 +964,39 @@ int main(int argc, char* argv[])
            BENCHMARK_SIZE(kernel_type::wmma_prefetch),
            BENCHMARK_SIZE(kernel_type::wmma_opt_1),
            BENCHMARK_SIZE(kernel_type::wmma_opt_2),
+           BENCHMARK_SIZE(kernel_type::wmma_opt_2_wgp),
            BENCHMARK_SIZE(kernel_type::wmma_opt_3),
+           BENCHMARK_SIZE(kernel_type::wmma_opt_3_wgp),
            BENCHMARK_SIZE(kernel_type::wmma_opt_4),
-           BENCHMARK_SIZE(kernel_type::rocblas)};
+           BENCHMARK_SIZE(kernel_type::wmma_opt_4_wgp),
+           BENCHMARK_SIZE(kernel_type::wmma_opt_4_persistent),
+#ifdef HGEMM_HAS_ROCWMMA
+           BENCHMARK_SIZE(kernel_type::rocwmma),
+#endif
+           BENCHMARK_SIZE(kernel_type::rocblas),
+           BENCHMARK_SIZE(kernel_type::rocblas_ex),
+           BENCHMARK_SIZE(kernel_type::rocblas_ex_tuned),
+           CREATE_BATCHED_BENCHMARK(16, 16, 16, 262144),
+           CREATE_BATCHED_BENCHMARK(32, 32, 32, 65536),
+           CREATE_BATCHED_BENCHMARK(64, 64, 64, 16384),
+           CREATE_STRASSEN_BENCHMARK(kernel_type::wmma_opt_4_wgp, 16384, 16384, 16384, 8192),
+           CREATE_STRASSEN_BENCHMARK(kernel_type::wmma_opt_4_wgp, 16384, 16384, 16384, 4096),
+           CREATE_STRASSEN_BENCHMARK(kernel_type::wmma_opt_4_wgp, 32768, 32768, 32768, 8192),
+           CREATE_LOAD_BENCHMARK(mmap_staged, true, 16384, 16384),
+           CREATE_LOAD_BENCHMARK(read_copy, false, 16384, 16384),
+           CREATE_LAUNCH_OVERHEAD_BENCHMARK(hgemm_gpu, false, 256, 256, 256),
+           CREATE_LAUNCH_OVERHEAD_BENCHMARK(plan, true, 256, 256, 256),
+           CREATE_MASKED_BENCHMARK(kernel_type::wmma_opt_4_wgp, 8192, 128, 0),
+           CREATE_MASKED_BENCHMARK(kernel_type::wmma_opt_4_wgp, 16384, 128, 0),
+           CREATE_MASKED_BENCHMARK(kernel_type::wmma_opt_4_wgp, 16384, 128, 4096),
+           CREATE_DECODE_BENCHMARK(1, 1, 131072, 128),
+           CREATE_DECODE_BENCHMARK(8, 4, 131072, 128),
+           CREATE_DECODE_BENCHMARK(32, 1, 8192, 128),
+           CREATE_PAGED_BENCHMARK(kernel_type::wmma_opt_4_wgp, 256, 1024, 32768, 128),
+           CREATE_PAGED_BENCHMARK(kernel_type::wmma_opt_4_wgp, 32, 1024, 32768, 128),
+           CREATE_LORA_BENCHMARK(64, 64, 4096, 16),
+           CREATE_LORA_BENCHMARK(1024, 16, 4096, 64),
+           CREATE_BUCKET_BENCHMARK(4096, 4096, 4096)};
 
     // Use manual timing
     for(auto& b : benchmarks)
@@ -25,38 +25,531 @@
 #ifndef HIP_HGEMM_HPP
 #define HIP_HGEMM_HPP
 
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <common/matrix.hpp>
+#include <kernels/bucket.hpp>
+#include <kernels/chain.hpp>
+#include <kernels/contraction.hpp>
+#include <kernels/decode.hpp>
+#include <kernels/distance.hpp>
+#include <kernels/expression.hpp>
+#include <kernels/lora.hpp>
+#include <kernels/masked.hpp>
+#include <kernels/paged.hpp>
+#include <kernels/parallel.hpp>
+#include <kernels/plan.hpp>
+#include <kernels/quantize.hpp>
+#include <kernels/reduce.hpp>
 #include <kernels/rocblas.hpp>
+#include <kernels/rocwmma.hpp>
 #include <kernels/shared.hpp>
+#include <kernels/strassen.hpp>
+#include <kernels/topk.hpp>
 #include <kernels/wmma.hpp>
+#include <kernels/wmma_batched.hpp>
 #include <kernels/wmma_opt_1.hpp>
 #include <kernels/wmma_opt_2.hpp>
 #include <kernels/wmma_opt_3.hpp>
+#include <kernels/wmma_opt_4.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+#include <kernels/wmma_opt_4_persistent.hpp>
 #include <kernels/wmma_prefetch.hpp>
 #include <kernels/wmma_shared.hpp>
 #include <kernels/wmma_shared_warp.hpp>
 #include <kernels/wmma_shared_warp_buf.hpp>
 #include <kernels/wmma_shared_warp_buf_vec.hpp>
 #include <kernels/wmma_shared_warp_vec.hpp>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief CPU reference implementation with a prologue and an epilogue
+ *
+ * Evaluates the same expression trees as the fused GPU kernels (built with host pointers). The
+ * prologue result is rounded to half, matching the kernels which stage transformed A in LDS, and
+ * so is the accumulator before the epilogue, matching their fp16 accumulators.
+ * A and B may be owning matrices or matrix_views, e.g. of memory-mapped weights.
+ */
+template<matrix_layout L1, class MatA, class MatB, class Prologue, class Epilogue>
+void hgemm_cpu(matrix<half, L1>& C,
+               const MatA&       A,
+               const MatB&       B,
+               const Prologue&   prologue,
+               const Epilogue&   epilogue)
+{
+    for(size_t i = 0; i < C.m(); ++i)
+    {
+        for(size_t j = 0; j < C.n(); ++j)
+        {
+            float acc = 0.0f;
+            for(size_t k = 0; k < A.n(); ++k)
+            {
+                const half a = static_cast<half>(prologue(static_cast<float>(A(i, k)), i, k));
+                acc += static_cast<float>(a) * static_cast<float>(B(k, j));
+            }
+            const float rounded = static_cast<float>(static_cast<half>(acc));
+            C(i, j)             = static_cast<half>(epilogue(rounded, i, j));
+        }
+    }
+}
+
+/**
+ * @brief CPU reference implementation with an epilogue
+ */
+template<matrix_layout L1, class MatA, class MatB, class Epilogue>
+void hgemm_cpu(matrix<half, L1>& C, const MatA& A, const MatB& B, const Epilogue& epilogue)
+{
+    hgemm_cpu(C, A, B, prologue_input{}, epilogue);
+}
 
 /**
  * @brief CPU reference implementation
  */
+template<matrix_layout L1, class MatA, class MatB>
+void hgemm_cpu(matrix<half, L1>& C, const MatA& A, const MatB& B)
+{
+    hgemm_cpu(C, A, B, epilogue_acc{});
+}
+
+/**
+ * @brief CPU reference of the batched tiny-matrix GEMM
+ *
+ * The packed operands are viewed as single matrices: problem p uses rows [p × M, (p + 1) × M)
+ * of A and C, and columns [p × N, (p + 1) × N) of B.
+ *
+ * @param[out] C     (batch × M) × N output
+ * @param[in]  A     (batch × M) × K input
+ * @param[in]  B     K × (batch × N) input
+ * @param[in]  batch Number of problems
+ */
 template<matrix_layout L1, matrix_layout L2, matrix_layout L3>
-void hgemm_cpu(matrix<half, L1>& C, const matrix<half, L2>& A, const matrix<half, L3>& B)
+void hgemm_batched_cpu(matrix<half, L1>&       C,
+                       const matrix<half, L2>& A,
+                       const matrix<half, L3>& B,
+                       size_t                  batch)
+{
+    const size_t M = C.m() / batch;
+    const size_t N = C.n();
+    for(size_t p = 0; p < batch; ++p)
+    {
+        for(size_t i = p * M; i < (p + 1) * M; ++i)
+        {
+            for(size_t j = 0; j < N; ++j)
+            {
+                float acc = 0.0f;
+                for(size_t k = 0; k < A.n(); ++k)
+                {
+                    acc += static_cast<float>(A(i, k)) * static_cast<float>(B(k, p * N + j));
+                }
+                C(i, j) = static_cast<half>(acc);
+            }
+        }
+    }
+}
+
+/**
+ * @brief CPU reference of decode attention, O = softmax(scale · Q·Kᵀ)·V per head
+ *
+ * @param[out] O     (heads × G) × D output
+ * @param[in]  Q     (heads × G) × D queries
+ * @param[in]  K     (heads × S) × D keys
+ * @param[in]  V     (heads × S) × D values
+ * @param[in]  heads Number of KV heads
+ * @param[in]  scale Softmax scale
+ */
+template<matrix_layout L>
+void decode_attention_cpu(matrix<half, L>&       O,
+                          const matrix<half, L>& Q,
+                          const matrix<half, L>& K,
+                          const matrix<half, L>& V,
+                          size_t                 heads,
+                          float                  scale)
+{
+    const size_t G = Q.m() / heads;
+    const size_t S = K.m() / heads;
+    const size_t D = Q.n();
+
+    std::vector<float> scores(S);
+    for(size_t h = 0; h < heads; ++h)
+    {
+        for(size_t g = h * G; g < (h + 1) * G; ++g)
+        {
+            float max_score = -std::numeric_limits<float>::infinity();
+            for(size_t s = 0; s < S; ++s)
+            {
+                float acc = 0.0f;
+                for(size_t d = 0; d < D; ++d)
+                {
+                    acc += static_cast<float>(Q(g, d)) * static_cast<float>(K(h * S + s, d));
+                }
+                scores[s] = acc * scale;
+                max_score = std::max(max_score, scores[s]);
+            }
+
+            float sum = 0.0f;
+            for(size_t s = 0; s < S; ++s)
+            {
+                scores[s] = std::exp(scores[s] - max_score);
+                sum += scores[s];
+            }
+
+            for(size_t d = 0; d < D; ++d)
+            {
+                float acc = 0.0f;
+                for(size_t s = 0; s < S; ++s)
+                {
+                    acc += scores[s] * static_cast<float>(V(h * S + s, d));
+                }
+                O(g, d) = static_cast<half>(acc / sum);
+            }
+        }
+    }
+}
+
+/**
+ * @brief CPU reference of the segmented multi-LoRA GEMMs, Y += scale · X · Aᵀ · Bᵀ per segment
+ *
+ * U = X · Aᵀ is rounded to half between the two products, as in the device kernels.
+ *
+ * @param[in,out] Y        T × H_out base output
+ * @param[in]     X        T × H_in input rows
+ * @param[in]     A        (adapters × rank) × H_in shrink weights
+ * @param[in]     B        (adapters × H_out) × rank expand weights
+ * @param[in]     starts   Segment boundaries, segment s covers rows [starts[s], starts[s + 1])
+ * @param[in]     adapters Adapter index per segment, negative for rows without an adapter
+ * @param[in]     scale    LoRA scaling
+ */
+template<matrix_layout L>
+void lora_segmented_cpu(matrix<half, L>&            Y,
+                        const matrix<half, L>&      X,
+                        const matrix<half, L>&      A,
+                        const matrix<half, L>&      B,
+                        const std::vector<int32_t>& starts,
+                        const std::vector<int32_t>& adapters,
+                        float                       scale)
 {
+    const size_t rank  = B.n();
+    const size_t H_in  = X.n();
+    const size_t H_out = Y.n();
+
+    std::vector<half> u(rank);
+    for(size_t s = 0; s < adapters.size(); ++s)
+    {
+        if(adapters[s] < 0)
+        {
+            continue;
+        }
+        const size_t a = static_cast<size_t>(adapters[s]);
+        for(size_t t = starts[s]; t < static_cast<size_t>(starts[s + 1]); ++t)
+        {
+            for(size_t r = 0; r < rank; ++r)
+            {
+                float acc = 0.0f;
+                for(size_t k = 0; k < H_in; ++k)
+                {
+                    acc += static_cast<float>(X(t, k)) * static_cast<float>(A(a * rank + r, k));
+                }
+                u[r] = static_cast<half>(acc);
+            }
+            for(size_t j = 0; j < H_out; ++j)
+            {
+                float acc = 0.0f;
+                for(size_t r = 0; r < rank; ++r)
+                {
+                    acc += static_cast<float>(u[r]) * static_cast<float>(B(a * H_out + j, r));
+                }
+                Y(t, j) = static_cast<half>(static_cast<float>(Y(t, j)) + scale * acc);
+            }
+        }
+    }
+}
+
+/**
+ * @brief CPU reference backend of the lazy matrix expressions
+ *
+ * Follows the device evaluation plan: a fusable expression applies its epilogue to the
+ * accumulator (rounded to half, like the kernels' fp16 accumulators), while in the fallback every
+ * product is rounded to half before the elementwise remainder.
+ */
+class host_expr_backend
+{
+public:
+    template<matrix_layout L>
+    const half* pointer(const matrix<half, L>& m) const
+    {
+        return m.data();
+    }
+
+    template<matrix_layout L>
+    const half* pointer(const device_matrix<L>&) const
+    {
+        static_assert(L != L, "Device matrices cannot be used in a host expression");
+        return nullptr;
+    }
+
+    template<class Dst, class Product, class Tree>
+    void fused(Dst& dst, const Product& product, const Tree& tree)
+    {
+        hgemm_cpu(dst, *product.lhs.mat, *product.rhs.mat, tree);
+    }
+
+    template<class Dst, class Tree>
+    void elementwise(Dst& dst, const Tree& tree)
+    {
+        for(size_t i = 0; i < dst.m(); ++i)
+        {
+            for(size_t j = 0; j < dst.n(); ++j)
+            {
+                dst(i, j) = static_cast<half>(tree(0.0f, i, j));
+            }
+        }
+    }
+
+    template<class Product>
+    const half* materialize(const Product& product)
+    {
+        const expr_shape shape = shape_of(product);
+        auto&            dst   = temps_.emplace_back(shape.rows, shape.cols);
+        with_matrix(product.lhs,
+                    [&](const auto& a)
+                    { with_matrix(product.rhs, [&](const auto& b) { hgemm_cpu(dst, a, b); }); });
+        return dst.data();
+    }
+
+private:
+    // Call f with the matrix of a leaf, or with a temporary holding the evaluated expression
+    template<class E, class F>
+    void with_matrix(const E& e, F&& f)
+    {
+        if constexpr(is_expr_leaf<E>)
+        {
+            f(*e.mat);
+        }
+        else
+        {
+            const expr_shape shape = shape_of(e);
+            auto&            temp  = temps_.emplace_back(shape.rows, shape.cols);
+            evaluate_expr(*this, temp, e);
+            f(temp);
+        }
+    }
+
+    // A deque keeps the temporaries in place as it grows
+    std::deque<matrix<half, matrix_layout::row_major>> temps_;
+};
+
+/**
+ * @brief Evaluate an expression over host matrices with the CPU reference backend
+ */
+template<matrix_expression E>
+void assign(matrix<half, matrix_layout::row_major>& dst, const E& expr)
+{
+    host_expr_backend backend;
+    evaluate_expr(backend, dst, as_expr(expr));
+}
+
+/**
+ * @brief CPU reference quantization, defining the exact rounding of hgemm_quantized_gpu
+ *
+ * @param[in]  C           fp16 GEMM output
+ * @param[in]  granularity Scale granularity
+ * @param[in]  tile_n      Width of the N tiles (block_n of the kernel)
+ * @param[out] Q           M × N row-major quantized output
+ * @param[out] scales      M per-row scales, or M × ceil(N / tile_n) tile scales
+ */
+template<class T, matrix_layout L>
+void quantize_cpu(const matrix<half, L>& C,
+                  quant_granularity      granularity,
+                  size_t                 tile_n,
+                  std::vector<T>&        Q,
+                  std::vector<float>&    scales)
+{
+    constexpr float qmax = quant_traits<T>::qmax;
+
+    // Every element is quantized once, from fp16, with the scale of its tile or row
+    const bool   per_row = granularity == quant_granularity::per_row;
+    const size_t width   = per_row ? C.n() : tile_n;
+    const size_t groups  = (C.n() + width - 1) / width;
+
+    Q.resize(C.m() * C.n());
+    scales.resize(C.m() * groups);
+    for(size_t i = 0; i < C.m(); ++i)
+    {
+        for(size_t t = 0; t < groups; ++t)
+        {
+            const size_t col_end = std::min(C.n(), (t + 1) * width);
+
+            float absmax = 0.0f;
+            for(size_t j = t * width; j < col_end; ++j)
+            {
+                absmax = std::max(absmax, std::abs(static_cast<float>(C(i, j))));
+            }
+
+            const float inv_scale  = absmax > 0.0f ? qmax / absmax : 0.0f;
+            scales[i * groups + t] = absmax / qmax;
+            for(size_t j = t * width; j < col_end; ++j)
+            {
+                Q[i * C.n() + j] = quant_traits<T>::encode(static_cast<float>(C(i, j)) * inv_scale);
+            }
+        }
+    }
+}
+
+/**
+ * @brief CPU brute-force reference of the per-row top-k of C
+ *
+ * Uses the same ordering as hgemm_topk_gpu: descending score, ties by ascending column index,
+ * missing entries padded with (-inf, -1).
+ */
+template<matrix_layout L>
+void topk_cpu(const matrix<half, L>& C,
+              size_t                 k,
+              std::vector<float>&    scores,
+              std::vector<int>&      indices)
+{
+    scores.assign(C.m() * k, -std::numeric_limits<float>::infinity());
+    indices.assign(C.m() * k, -1);
+
+    std::vector<std::pair<float, int>> row(C.n());
     for(size_t i = 0; i < C.m(); ++i)
     {
         for(size_t j = 0; j < C.n(); ++j)
         {
-            float acc = 0.0f;
+            row[j] = {static_cast<float>(C(i, j)), static_cast<int>(j)};
+        }
+        const size_t count = std::min(k, C.n());
+        std::partial_sort(row.begin(),
+                          row.begin() + count,
+                          row.end(),
+                          [](const auto& a, const auto& b)
+                          { return topk_before(a.first, a.second, b.first, b.second); });
+        for(size_t j = 0; j < count; ++j)
+        {
+            scores[i * k + j]  = row[j].first;
+            indices[i * k + j] = row[j].second;
+        }
+    }
+}
+
+/**
+ * @brief CPU reference of the pairwise L2 distances between the rows of A and columns of B
+ *
+ * @param[out] D         M × N distances, computed directly as sum_k (a - b)²
+ * @param[in]  A         Points as rows
+ * @param[in]  B         Points as columns
+ * @param[in]  take_sqrt Whether to emit ||a - b|| instead of ||a - b||²
+ */
+template<matrix_layout L1, matrix_layout L2, matrix_layout L3>
+void l2_distance_cpu(matrix<half, L1>&       D,
+                     const matrix<half, L2>& A,
+                     const matrix<half, L3>& B,
+                     bool                    take_sqrt)
+{
+    for(size_t i = 0; i < D.m(); ++i)
+    {
+        for(size_t j = 0; j < D.n(); ++j)
+        {
+            double dist = 0.0;
             for(size_t k = 0; k < A.n(); ++k)
             {
-                acc += static_cast<float>(A(i, k)) * static_cast<float>(B(k, j));
+                const double diff = static_cast<double>(A(i, k)) - static_cast<double>(B(k, j));
+                dist += diff * diff;
+            }
+            D(i, j) = static_cast<half>(take_sqrt ? std::sqrt(dist) : dist);
+        }
+    }
+}
+
+/**
+ * @brief CPU reference of a two-operand einsum over strided half tensors, accumulating in fp32
+ */
+inline void contraction_cpu(const std::string&   text,
+                            half*                out,
+                            const tensor_layout& out_layout,
+                            const half*          lhs,
+                            const tensor_layout& lhs_layout,
+                            const half*          rhs,
+                            const tensor_layout& rhs_layout)
+{
+    const contraction_spec spec = parse_contraction(text);
+
+    // Every index with its size, output indices first and contracted indices last
+    const std::string   indices = spec.out + spec.k;
+    std::vector<size_t> sizes;
+    for(char c : indices)
+    {
+        const size_t pos = spec.lhs.find(c);
+        sizes.push_back(pos != std::string::npos ? lhs_layout.shape[pos]
+                                                 : rhs_layout.shape[spec.rhs.find(c)]);
+    }
+
+    auto offset = [&](const std::string& operand,
+                      const tensor_layout& layout,
+                      const std::vector<size_t>& index)
+    {
+        int64_t o = 0;
+        for(size_t i = 0; i < operand.size(); ++i)
+        {
+            o += static_cast<int64_t>(index[indices.find(operand[i])]) * layout.stride(i);
+        }
+        return o;
+    };
+
+    size_t out_count = 1;
+    size_t k_count   = 1;
+    for(size_t i = 0; i < indices.size(); ++i)
+    {
+        (i < spec.out.size() ? out_count : k_count) *= sizes[i];
+    }
+
+    std::vector<size_t> index(indices.size(), 0);
+    for(size_t e = 0; e < out_count; ++e)
+    {
+        size_t rem = e;
+        for(size_t i = spec.out.size(); i-- > 0;)
+        {
+            index[i] = rem % sizes[i];
+            rem /= sizes[i];
+        }
+
+        float acc = 0.0f;
+        for(size_t k = 0; k < k_count; ++k)
+        {
+            rem = k;
+            for(size_t i = indices.size(); i-- > spec.out.size();)
+            {
+                index[i] = rem % sizes[i];
+                rem /= sizes[i];
             }
-            C(i, j) = static_cast<half>(acc);
+            acc += static_cast<float>(lhs[offset(spec.lhs, lhs_layout, index)])
+                   * static_cast<float>(rhs[offset(spec.rhs, rhs_layout, index)]);
+        }
+        out[offset(spec.out, out_layout, index)] = static_cast<half>(acc);
+    }
+}
+
+/**
+ * @brief Relative Frobenius-norm error ||result - reference|| / ||reference||
+ */
+template<matrix_layout L>
+double relative_error(const matrix<half, L>& result, const matrix<half, L>& reference)
+{
+    double diff = 0.0;
+    double norm = 0.0;
+    for(size_t i = 0; i < result.m(); ++i)
+    {
+        for(size_t j = 0; j < result.n(); ++j)
+        {
+            const double ref = static_cast<double>(reference(i, j));
+            const double d   = static_cast<double>(result(i, j)) - ref;
+            diff += d * d;
+            norm += ref * ref;
         }
     }
+    return norm > 0.0 ? std::sqrt(diff / norm) : std::sqrt(diff);
 }
 
 /**
@@ -0,0 +1,323 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef HIP_BUCKET_HPP
+#define HIP_BUCKET_HPP
+
+#include <algorithm>
+#include <common/hip_utils.hpp>
+#include <common/matrix.hpp>
+#include <hip/hip_runtime.h>
+#include <kernels/common.hpp>
+#include <kernels/plan.hpp>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Traffic counters of a bucketed_hgemm
+ */
+struct bucket_stats
+{
+    size_t hits        = 0; // Calls served by an existing bucket plan
+    size_t misses      = 0; // Calls that built (and possibly tuned) a bucket plan
+    size_t overflows   = 0; // Calls with M above the largest configured bucket
+    size_t rows        = 0; // Sum of M over all calls
+    size_t padded_rows = 0; // Sum of (bucket - M) over all calls
+
+    double hit_rate() const
+    {
+        const size_t calls = hits + misses;
+        return calls == 0 ? 0.0 : static_cast<double>(hits) / calls;
+    }
+
+    // Fraction of the launched rows that carry data
+    double fill() const
+    {
+        return rows == 0 ? 0.0 : static_cast<double>(rows) / (rows + padded_rows);
+    }
+};
+
+/**
+ * @brief Buckets at the row granularity of the wmma_opt_4 tiles, up to max_m
+ *
+ * The kernels launch whole 256-row tiles, so any finer bucket would run the same grid with fewer
+ * predicated rows and only add plans.
+ */
+inline std::vector<size_t> default_m_buckets(size_t max_m)
+{
+    constexpr size_t    step = wmma_config<kernel_type::wmma_opt_4>::block_m;
+    std::vector<size_t> buckets;
+    for(size_t m = step; m < max_m + step; m += step)
+    {
+        buckets.push_back(m);
+    }
+    return buckets;
+}
+
+/**
+ * @brief GEMMs with a varying number of rows M, e.g. the token count of a serving batch
+ *
+ * M is rounded up to the smallest configured bucket, and each bucket keeps one hgemm_plan
+ * (built on first use) whose kernel can be tuned on that first call. Calls run the bucket's plan
+ * on the actual M, so the padded rows are never read or written: their loads are zero-filled and
+ * their stores predicated away. M above the largest bucket rounds up to the tile size instead
+ * and is counted as an overflow.
+ *
+ * The object owns its plans and must outlive any work it has enqueued. Calls may come from
+ * several threads; a call that builds a plan holds the lock while it does. Plans that pack A or
+ * B keep one packing workspace per (bucket, stream), so calls on different streams never share
+ * one while calls on the same stream are ordered by it.
+ */
+class bucketed_hgemm
+{
+public:
+    /**
+     * @param buckets  Row counts to round M up to
+     * @param N        Number of columns in matrices B and C
+     * @param K        Number of columns in matrix A/rows in matrix B
+     * @param a_layout Layout of A
+     * @param b_layout Layout of B
+     * @param c_layout Layout of C
+     * @param tune     Time wmma_opt_4 and wmma_opt_4_wgp on the first call of each bucket and
+     *                 keep the faster, otherwise always use wmma_opt_4
+     * @throws std::invalid_argument if there are no buckets, a bucket is zero, or N or K is zero
+     */
+    bucketed_hgemm(std::vector<size_t> buckets,
+                   size_t              N,
+                   size_t              K,
+                   matrix_layout       a_layout,
+                   matrix_layout       b_layout,
+                   matrix_layout       c_layout,
+                   bool                tune = true)
+        : buckets_(std::move(buckets))
+        , N_(N)
+        , K_(K)
+        , a_layout_(a_layout)
+        , b_layout_(b_layout)
+        , c_layout_(c_layout)
+        , tune_(tune)
+    {
+        std::sort(buckets_.begin(), buckets_.end());
+        buckets_.erase(std::unique(buckets_.begin(), buckets_.end()), buckets_.end());
+        if(buckets_.empty() || buckets_.front() == 0 || N == 0 || K == 0)
+        {
+            throw std::invalid_argument("Bucketed GEMMs need positive buckets, N and K");
+        }
+    }
+
+    bucketed_hgemm(const bucketed_hgemm&)            = delete;
+    bucketed_hgemm& operator=(const bucketed_hgemm&) = delete;
+
+    ~bucketed_hgemm()
+    {
+        for(const auto& entry : workspaces_)
+        {
+            if(entry.second != nullptr)
+            {
+                HIP_CHECK(hipFree(entry.second));
+            }
+        }
+    }
+
+    /**
+     * @brief Bucket serving M rows
+     */
+    size_t bucket_for(size_t M) const
+    {
+        const auto it = std::lower_bound(buckets_.begin(), buckets_.end(), M);
+        if(it != buckets_.end())
+        {
+            return *it;
+        }
+        constexpr size_t step = wmma_config<kernel_type::wmma_opt_4>::block_m;
+        return (M + step - 1) / step * step;
+    }
+
+    /**
+     * @brief Computes C = A × B for M rows of A and C
+     *
+     * @param ptrs   Device pointers in the configured layouts, with M rows in A and C
+     * @param M      Rows of A and C
+     * @param stream HIP stream to execute kernels
+     * @throws std::invalid_argument if M is zero
+     */
+    void execute(const hgemm_operands& ptrs, size_t M, hipStream_t& stream)
+    {
+        if(M == 0)
+        {
+            throw std::invalid_argument("Bucketed GEMMs need at least one row");
+        }
+
+        const size_t      bucket    = bucket_for(M);
+        const hgemm_plan* plan      = nullptr;
+        half*             workspace = nullptr;
+        bool              built     = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.rows += M;
+            stats_.padded_rows += bucket - M;
+            stats_.overflows += M > buckets_.back() ? 1 : 0;
+            ++calls_[bucket];
+
+            auto it = plans_.find(bucket);
+            if(it != plans_.end())
+            {
+                ++stats_.hits;
+                plan = it->second.get();
+            }
+            else
+            {
+                ++stats_.misses;
+                built = true;
+                plan  = plans_.emplace(bucket, build_plan(bucket, ptrs, M, stream))
+                            .first->second.get();
+            }
+
+            // The stream that built the plan keeps the plan's own workspace (nullptr)
+            const auto key   = std::make_pair(bucket, stream);
+            auto       entry = workspaces_.find(key);
+            if(entry == workspaces_.end())
+            {
+                if(!built && plan->workspace_size() > 0)
+                {
+                    HIP_CHECK(hipMalloc(&workspace, plan->workspace_size()));
+                }
+                entry = workspaces_.emplace(key, workspace).first;
+            }
+            workspace = entry->second;
+        }
+        execute_hgemm(*plan, ptrs, M, workspace, stream);
+    }
+
+    bucket_stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    /**
+     * @brief Calls per bucket (including overflow buckets) since construction or the last reset
+     */
+    std::map<size_t, size_t> bucket_calls() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return calls_;
+    }
+
+    /**
+     * @brief Clears the counters; plans and tuning results are kept
+     */
+    void reset_stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_ = {};
+        calls_.clear();
+    }
+
+    /**
+     * @brief Kernel chosen for a bucket
+     * @throws std::out_of_range if the bucket has not been used yet
+     */
+    kernel_type bucket_kernel(size_t bucket) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return plans_.at(bucket)->kernel();
+    }
+
+    const std::vector<size_t>& buckets() const
+    {
+        return buckets_;
+    }
+
+private:
+    std::unique_ptr<hgemm_plan> make_plan(size_t bucket, kernel_type kernel) const
+    {
+        return std::make_unique<hgemm_plan>(
+            bucket, N_, K_, a_layout_, b_layout_, c_layout_, kernel);
+    }
+
+    // Tuning runs both candidates on the caller's operands, which the call then overwrites
+    std::unique_ptr<hgemm_plan> build_plan(size_t                bucket,
+                                           const hgemm_operands& ptrs,
+                                           size_t                M,
+                                           hipStream_t&          stream) const
+    {
+        if(!tune_)
+        {
+            return make_plan(bucket, kernel_type::wmma_opt_4);
+        }
+
+        constexpr int warmup     = 1;
+        constexpr int iterations = 3;
+
+        gpu_timer                   timer;
+        std::unique_ptr<hgemm_plan> best;
+        float                       best_time = std::numeric_limits<float>::max();
+        for(kernel_type kernel : {kernel_type::wmma_opt_4, kernel_type::wmma_opt_4_wgp})
+        {
+            std::unique_ptr<hgemm_plan> plan = make_plan(bucket, kernel);
+            for(int i = 0; i < warmup; ++i)
+            {
+                execute_hgemm(*plan, ptrs, M, nullptr, stream);
+            }
+
+            timer.start(stream);
+            for(int i = 0; i < iterations; ++i)
+            {
+                execute_hgemm(*plan, ptrs, M, nullptr, stream);
+            }
+            const float elapsed = timer.stop(stream);
+
+            if(elapsed < best_time)
+            {
+                best_time = elapsed;
+                best      = std::move(plan);
+            }
+        }
+        return best;
+    }
+
+    std::vector<size_t> buckets_;
+    size_t              N_;
+    size_t              K_;
+    matrix_layout       a_layout_;
+    matrix_layout       b_layout_;
+    matrix_layout       c_layout_;
+    bool                tune_;
+
+    mutable std::mutex                              mutex_;
+    std::map<size_t, std::unique_ptr<hgemm_plan>>   plans_;
+    std::map<std::pair<size_t, hipStream_t>, half*> workspaces_; // nullptr: the plan's own
+    std::map<size_t, size_t>                        calls_;
+    bucket_stats                                    stats_;
+};
+
+#endif // HIP_BUCKET_HPP
@@ -0,0 +1,394 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_BUFFER_HPP
+#define HIP_BUFFER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <kernels/common.hpp>
+#include <type_traits>
+
+typedef int int32x4 __attribute__((ext_vector_type(4)));
+
+// Third dword of an RDNA3 raw buffer descriptor: 32-bit format, OOB_SELECT = raw (3)
+constexpr uint32_t buffer_rsrc_config = 0x31004000;
+
+/**
+ * @brief Buffer resource descriptor for an operand
+ *
+ * Describes a raw (stride 0) buffer of num_records bytes starting at base. Any access whose
+ * bytes lie at or beyond num_records is out of bounds: loads return zero and stores are dropped
+ * by the hardware. Kernels predicate accesses by replacing the offset with num_records, which
+ * turns bounds checks into a single select instead of a branch.
+ */
+struct buffer_resource
+{
+    const void* base;
+    uint32_t    num_records;
+    uint32_t    config;
+};
+
+/**
+ * @brief Create a buffer descriptor covering num_elements elements of an operand
+ * @param base         Pointer to the first element of the operand
+ * @param num_elements Operand extent in elements (clamped to the 32-bit byte range)
+ * @return Buffer descriptor
+ */
+template<class T>
+__host__ __device__ __forceinline__ buffer_resource make_buffer_resource(const T* base,
+                                                                         size_t   num_elements)
+{
+    const size_t bytes = num_elements * sizeof(T);
+    return {base,
+            static_cast<uint32_t>(bytes > UINT32_MAX ? UINT32_MAX : bytes),
+            buffer_rsrc_config};
+}
+
+/**
+ * @brief Byte offset to use for an access that may be out of bounds
+ * @param valid       Whether the access is in bounds
+ * @param byte_offset Byte offset of the access
+ * @param rsrc        Buffer descriptor
+ * @return byte_offset if valid, otherwise an offset the hardware treats as out of bounds
+ */
+__host__ __device__ __forceinline__ uint32_t buffer_offset(bool                   valid,
+                                                           uint32_t               byte_offset,
+                                                           const buffer_resource& rsrc)
+{
+    return valid ? byte_offset : rsrc.num_records;
+}
+
+#if defined(__HIP_DEVICE_COMPILE__)
+__device__ int32x4 llvm_amdgcn_raw_buffer_load_b128(int32x4 rsrc,
+                                                    int32_t voffset,
+                                                    int32_t soffset,
+                                                    int32_t aux)
+    __asm("llvm.amdgcn.raw.buffer.load.v4i32");
+
+__device__ int16_t llvm_amdgcn_raw_buffer_load_b16(int32x4 rsrc,
+                                                   int32_t voffset,
+                                                   int32_t soffset,
+                                                   int32_t aux)
+    __asm("llvm.amdgcn.raw.buffer.load.i16");
+
+__device__ void llvm_amdgcn_raw_buffer_store_b128(
+    int32x4 vdata, int32x4 rsrc, int32_t voffset, int32_t soffset, int32_t aux)
+    __asm("llvm.amdgcn.raw.buffer.store.v4i32");
+
+__device__ void llvm_amdgcn_raw_buffer_store_b16(
+    int16_t vdata, int32x4 rsrc, int32_t voffset, int32_t soffset, int32_t aux)
+    __asm("llvm.amdgcn.raw.buffer.store.i16");
+
+/**
+ * @brief Pack a buffer descriptor into the 128-bit SGPR form expected by buffer instructions
+ */
+__device__ __forceinline__ int32x4 pack_buffer_resource(const buffer_resource& rsrc)
+{
+    const uint64_t address = reinterpret_cast<uint64_t>(rsrc.base);
+
+    int32x4 packed;
+    packed[0] = __builtin_amdgcn_readfirstlane(static_cast<int>(address & 0xFFFFFFFF));
+    packed[1] = __builtin_amdgcn_readfirstlane(static_cast<int>((address >> 32) & 0xFFFF));
+    packed[2] = __builtin_amdgcn_readfirstlane(static_cast<int>(rsrc.num_records));
+    packed[3] = __builtin_amdgcn_readfirstlane(static_cast<int>(rsrc.config));
+    return packed;
+}
+#endif
+
+/**
+ * @brief Raw buffer load of a 2 or 16 byte value
+ *
+ * On the device this is a single buffer_load instruction. On the host it emulates the
+ * hardware range check, returning zero when any byte of the access is out of bounds.
+ *
+ * @param rsrc        Buffer descriptor
+ * @param byte_offset Byte offset from the descriptor base
+ * @return Loaded value, or zero if out of bounds
+ */
+template<class T>
+__host__ __device__ __forceinline__ T buffer_load(const buffer_resource& rsrc, uint32_t byte_offset)
+{
+    static_assert(sizeof(T) == 2 || sizeof(T) == 16, "Only 16-bit and 128-bit loads are supported");
+#if defined(__HIP_DEVICE_COMPILE__)
+    if constexpr(sizeof(T) == 16)
+    {
+        return __builtin_bit_cast(
+            T,
+            llvm_amdgcn_raw_buffer_load_b128(pack_buffer_resource(rsrc), byte_offset, 0, 0));
+    }
+    else
+    {
+        return __builtin_bit_cast(
+            T,
+            llvm_amdgcn_raw_buffer_load_b16(pack_buffer_resource(rsrc), byte_offset, 0, 0));
+    }
+#else
+    T value = {};
+    if(static_cast<uint64_t>(byte_offset) + sizeof(T) <= rsrc.num_records)
+    {
+        std::memcpy(&value, static_cast<const char*>(rsrc.base) + byte_offset, sizeof(T));
+    }
+    return value;
+#endif
+}
+
+/**
+ * @brief Raw buffer store of a 2 or 16 byte value
+ *
+ * On the device this is a single buffer_store instruction. On the host it emulates the
+ * hardware range check, dropping the store when any byte of the access is out of bounds.
+ *
+ * @param value       Value to store
+ * @param rsrc        Buffer descriptor
+ * @param byte_offset Byte offset from the descriptor base
+ */
+template<class T>
+__host__ __device__ __forceinline__ void
+    buffer_store(const T& value, const buffer_resource& rsrc, uint32_t byte_offset)
+{
+    static_assert(sizeof(T) == 2 || sizeof(T) == 16,
+                  "Only 16-bit and 128-bit stores are supported");
+#if defined(__HIP_DEVICE_COMPILE__)
+    if constexpr(sizeof(T) == 16)
+    {
+        llvm_amdgcn_raw_buffer_store_b128(__builtin_bit_cast(int32x4, value),
+                                          pack_buffer_resource(rsrc),
+                                          byte_offset,
+                                          0,
+                                          0);
+    }
+    else
+    {
+        llvm_amdgcn_raw_buffer_store_b16(__builtin_bit_cast(int16_t, value),
+                                         pack_buffer_resource(rsrc),
+                                         byte_offset,
+                                         0,
+                                         0);
+    }
+#else
+    if(static_cast<uint64_t>(byte_offset) + sizeof(T) <= rsrc.num_records)
+    {
+        std::memcpy(const_cast<char*>(static_cast<const char*>(rsrc.base)) + byte_offset,
+                    &value,
+                    sizeof(T));
+    }
+#endif
+}
+
+/**
+ * @brief Load WIDTH consecutive halves, zero-filling the elements at or beyond valid
+ *
+ * The 32-bit indexed path uses buffer loads, where every 128-bit chunk is either fully loaded
+ * or fully zeroed by the hardware; only a chunk straddling the edge falls back to 16-bit loads.
+ * The 64-bit indexed path cannot be described by a 32-bit descriptor and uses plain loads.
+ *
+ * @tparam WIDTH   Number of halves to load (multiple of 8)
+ * @tparam index_t Type used for global memory offsets
+ * @param[out] dst    Destination (shared memory or registers)
+ * @param[in]  rsrc   Buffer descriptor of the operand
+ * @param[in]  offset Element offset from the descriptor base
+ * @param[in]  valid  Number of in-bounds elements starting at offset (may be <= 0)
+ */
+template<int WIDTH, class index_t>
+__host__ __device__ __forceinline__ void
+    load_vector(half* dst, const buffer_resource& rsrc, index_t offset, index_t valid)
+{
+    static_assert(WIDTH % 8 == 0, "Vector width must be a multiple of 128 bits");
+    const half* src = static_cast<const half*>(rsrc.base) + offset;
+
+#pragma unroll
+    for(int c = 0; c < WIDTH; c += 8)
+    {
+        const index_t chunk_valid = valid - c;
+        half8         chunk;
+
+        if constexpr(std::is_same_v<index_t, int>)
+        {
+            const uint32_t byte_offset = static_cast<uint32_t>(offset + c) * sizeof(half);
+            if(chunk_valid >= 8 || chunk_valid <= 0)
+            {
+                chunk = buffer_load<half8>(rsrc, buffer_offset(chunk_valid > 0, byte_offset, rsrc));
+            }
+            else
+            {
+                for(int v = 0; v < 8; ++v)
+                {
+                    chunk[v] = buffer_load<half>(
+                        rsrc,
+                        buffer_offset(v < chunk_valid, byte_offset + v * sizeof(half), rsrc));
+                }
+            }
+        }
+        else
+        {
+            if(chunk_valid >= 8)
+            {
+                chunk = *reinterpret_cast<const half8*>(src + c);
+            }
+            else
+            {
+                for(int v = 0; v < 8; ++v)
+                {
+                    chunk[v] = v < chunk_valid ? src[c + v] : static_cast<half>(0.0f);
+                }
+            }
+        }
+
+        *reinterpret_cast<half8*>(dst + c) = chunk;
+    }
+}
+
+/**
+ * @brief Gather WIDTH halves stride elements apart, zero-filling the elements at or beyond valid
+ *
+ * The strided counterpart of load_vector for operands whose vector elements are not contiguous
+ * in memory. Every element is a separate 16-bit load, so it is much slower than load_vector.
+ *
+ * @tparam WIDTH   Number of halves to load (multiple of 8)
+ * @tparam index_t Type used for global memory offsets
+ * @param[out] dst    Destination (shared memory or registers)
+ * @param[in]  rsrc   Buffer descriptor of the operand
+ * @param[in]  offset Element offset of the first element from the descriptor base
+ * @param[in]  stride Distance between consecutive elements, in elements
+ * @param[in]  valid  Number of in-bounds elements starting at offset (may be <= 0)
+ */
+template<int WIDTH, class index_t>
+__host__ __device__ __forceinline__ void load_vector_strided(
+    half* dst, const buffer_resource& rsrc, index_t offset, index_t stride, index_t valid)
+{
+    static_assert(WIDTH % 8 == 0, "Vector width must be a multiple of 128 bits");
+    const half* src = static_cast<const half*>(rsrc.base) + offset;
+
+#pragma unroll
+    for(int c = 0; c < WIDTH; c += 8)
+    {
+        half8 chunk;
+        for(int v = 0; v < 8; ++v)
+        {
+            const index_t element = static_cast<index_t>(c + v) * stride;
+            if constexpr(std::is_same_v<index_t, int>)
+            {
+                const uint32_t byte_offset = static_cast<uint32_t>(offset + element) * sizeof(half);
+                chunk[v]
+                    = buffer_load<half>(rsrc, buffer_offset(c + v < valid, byte_offset, rsrc));
+            }
+            else
+            {
+                chunk[v] = c + v < valid ? src[element] : static_cast<half>(0.0f);
+            }
+        }
+
+        *reinterpret_cast<half8*>(dst + c) = chunk;
+    }
+}
+
+/**
+ * @brief Store WIDTH consecutive halves, dropping the elements at or beyond valid
+ *
+ * @tparam WIDTH   Number of halves to store (multiple of 8)
+ * @tparam index_t Type used for global memory offsets
+ * @param[in] src    Source values
+ * @param[in] rsrc   Buffer descriptor of the operand
+ * @param[in] offset Element offset from the descriptor base
+ * @param[in] valid  Number of in-bounds elements starting at offset (may be <= 0)
+ */
+template<int WIDTH, class index_t>
+__host__ __device__ __forceinline__ void
+    store_vector(const half* src, const buffer_resource& rsrc, index_t offset, index_t valid)
+{
+    static_assert(WIDTH % 8 == 0, "Vector width must be a multiple of 128 bits");
+    half* dst = const_cast<half*>(static_cast<const half*>(rsrc.base)) + offset;
+
+#pragma unroll
+    for(int c = 0; c < WIDTH; c += 8)
+    {
+        const index_t chunk_valid = valid - c;
+        const half8   chunk       = *reinterpret_cast<const half8*>(src + c);
+
+        if constexpr(std::is_same_v<index_t, int>)
+        {
+            const uint32_t byte_offset = static_cast<uint32_t>(offset + c) * sizeof(half);
+            if(chunk_valid >= 8 || chunk_valid <= 0)
+            {
+                buffer_store(chunk, rsrc, buffer_offset(chunk_valid > 0, byte_offset, rsrc));
+            }
+            else
+            {
+                for(int v = 0; v < 8; ++v)
+                {
+                    buffer_store(
+                        static_cast<half>(chunk[v]),
+                        rsrc,
+                        buffer_offset(v < chunk_valid, byte_offset + v * sizeof(half), rsrc));
+                }
+            }
+        }
+        else
+        {
+            if(chunk_valid >= 8)
+            {
+                *reinterpret_cast<half8*>(dst + c) = chunk;
+            }
+            else
+            {
+                for(int v = 0; v < chunk_valid; ++v)
+                {
+                    dst[c + v] = chunk[v];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Store a single half, dropping it if it is out of bounds
+ *
+ * @tparam index_t Type used for global memory offsets
+ * @param[in] value  Value to store
+ * @param[in] rsrc   Buffer descriptor of the operand
+ * @param[in] offset Element offset from the descriptor base
+ * @param[in] valid  Whether the element is in bounds
+ */
+template<class index_t>
+__host__ __device__ __forceinline__ void
+    store_scalar(half value, const buffer_resource& rsrc, index_t offset, bool valid)
+{
+    if constexpr(std::is_same_v<index_t, int>)
+    {
+        buffer_store(value,
+                     rsrc,
+                     buffer_offset(valid, static_cast<uint32_t>(offset) * sizeof(half), rsrc));
+    }
+    else
+    {
+        if(valid)
+        {
+            const_cast<half*>(static_cast<const half*>(rsrc.base))[offset] = value;
+        }
+    }
+}
+
+#endif // HIP_BUFFER_HPP
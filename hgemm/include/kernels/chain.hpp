@@ -0,0 +1,428 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIP_CHAIN_HPP
+#define HIP_CHAIN_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <common/hip_utils.hpp>
+#include <common/matrix.hpp>
+#include <hip/hip_runtime.h>
+#include <kernels/contraction.hpp>
+#include <kernels/epilogue.hpp>
+#include <kernels/wmma_opt_4.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @brief Estimated run time of GEMMs and copies, used to order matrix chains
+ *
+ * GEMMs are charged for their dimensions padded up to the kernel's block tiles, which is what
+ * makes matrix-vector steps far more expensive than their FLOP count suggests.
+ */
+struct gemm_cost_model
+{
+    double tile_m         = 1.0;
+    double tile_n         = 1.0;
+    double tile_k         = 1.0;
+    double peak_tflops    = 1.0;
+    double bandwidth_gbps = 1.0;
+    double launch_us      = 0.0;
+
+    double gemm_us(size_t M, size_t N, size_t K) const
+    {
+        auto pad = [](size_t x, double tile) { return std::ceil(x / tile) * tile; };
+        return launch_us
+               + 2.0 * pad(M, tile_m) * pad(N, tile_n) * pad(K, tile_k) / (peak_tflops * 1e6);
+    }
+
+    double copy_us(size_t rows, size_t cols) const
+    {
+        return launch_us + 2.0 * rows * cols * sizeof(half) / (bandwidth_gbps * 1e3);
+    }
+
+    /**
+     * @brief Model of a wmma_opt_4-style kernel from its block tiles, with typical RDNA3 rates
+     */
+    template<kernel_type K_TYPE>
+    static gemm_cost_model for_kernel()
+    {
+        using config = wmma_config<K_TYPE>;
+        return {config::block_m, config::block_n, config::block_k, 80.0, 800.0, 5.0};
+    }
+};
+
+/**
+ * @brief A matrix of a chain, read as the left factor in column-major or right factor in row-major
+ */
+struct chain_input
+{
+    size_t        rows;
+    size_t        cols;
+    matrix_layout layout;
+};
+
+/**
+ * @brief A matrix produced or consumed by a chain plan
+ */
+struct chain_value
+{
+    int           input  = -1; // Index of the chain input, or -1
+    bool          output = false; // The chain's row-major result
+    size_t        offset = 0; // Arena offset in elements, for intermediates
+    size_t        rows   = 0;
+    size_t        cols   = 0;
+    matrix_layout layout = matrix_layout::row_major;
+};
+
+/**
+ * @brief One kernel launch of a chain plan: dst = lhs × rhs (+ dst), or dst = src relaid out
+ */
+struct chain_step
+{
+    bool transpose  = false; // Copy lhs into dst's layout, rhs unused
+    bool accumulate = false; // Add the existing dst, fused into the GEMM epilogue
+    int  dst        = -1;
+    int  lhs        = -1;
+    int  rhs        = -1;
+};
+
+/**
+ * @brief Evaluation order of a sum of matrix chains
+ */
+struct chain_plan
+{
+    std::vector<chain_value> values; // The chain inputs come first, in order
+    std::vector<chain_step>  steps;
+    double                   cost_us         = 0.0;
+    double                   written_cost_us = 0.0; // Left to right, as written
+    size_t                   arena_size      = 0; // In bytes
+    size_t                   rows            = 0;
+    size_t                   cols            = 0;
+};
+
+/**
+ * @brief Order a sum of matrix chains, such as A·B·C·x or X·W + X·L·R
+ *
+ * Each term is ordered by the classic O(n³) dynamic program over its dimensions, costing every
+ * product with the model. A factor is read column-major on the left and row-major on the right,
+ * so an input in the wrong layout for its position is charged a transpose, while intermediates
+ * are produced directly in the layout their consumer needs by exchanging the operand roles.
+ * Terms after the first accumulate into the result through the GEMM epilogue.
+ *
+ * @param inputs Matrices referenced by the terms
+ * @param terms  Each term lists, in order, at least two input indices to multiply
+ * @param model  Cost model of the kernel
+ *
+ * @throws std::invalid_argument on mismatched dimensions
+ */
+inline chain_plan plan_chain(const std::vector<chain_input>&         inputs,
+                             const std::vector<std::vector<size_t>>& terms,
+                             const gemm_cost_model&                  model)
+{
+    chain_plan plan;
+    for(size_t i = 0; i < inputs.size(); ++i)
+    {
+        chain_value value;
+        value.input  = static_cast<int>(i);
+        value.rows   = inputs[i].rows;
+        value.cols   = inputs[i].cols;
+        value.layout = inputs[i].layout;
+        plan.values.push_back(value);
+    }
+
+    if(terms.empty())
+    {
+        throw std::invalid_argument("matrix chain needs at least one term");
+    }
+    for(const auto& term : terms)
+    {
+        if(term.size() < 2)
+        {
+            throw std::invalid_argument("every matrix chain term needs at least two factors");
+        }
+        for(size_t t = 0; t < term.size(); ++t)
+        {
+            if(term[t] >= inputs.size()
+               || (t > 0 && inputs[term[t - 1]].cols != inputs[term[t]].rows))
+            {
+                throw std::invalid_argument("matrix chain dimensions do not agree");
+            }
+        }
+        if(inputs[term.front()].rows != inputs[terms[0].front()].rows
+           || inputs[term.back()].cols != inputs[terms[0].back()].cols)
+        {
+            throw std::invalid_argument("matrix chain terms have different shapes");
+        }
+    }
+
+    chain_value output;
+    output.output = true;
+    output.rows   = inputs[terms[0].front()].rows;
+    output.cols   = inputs[terms[0].back()].cols;
+    plan.values.push_back(output);
+    plan.rows = output.rows;
+    plan.cols = output.cols;
+
+    const int output_id = static_cast<int>(plan.values.size()) - 1;
+
+    // First-fit arena allocation of intermediates, which are freed once consumed
+    std::vector<std::pair<size_t, size_t>> live; // (offset, elements), sorted by offset
+    size_t                                 peak = 0;
+    auto allocate = [&](size_t elements)
+    {
+        size_t offset = 0;
+        auto   it     = live.begin();
+        for(; it != live.end() && it->first < offset + elements; ++it)
+        {
+            offset = std::max(offset, it->first + it->second);
+        }
+        live.insert(it, {offset, elements});
+        peak = std::max(peak, offset + elements);
+        return offset;
+    };
+    auto release = [&](int id)
+    {
+        const chain_value& value = plan.values[id];
+        if(value.input < 0 && !value.output)
+        {
+            live.erase(std::find_if(live.begin(),
+                                    live.end(),
+                                    [&](const auto& block)
+                                    { return block.first == value.offset; }));
+        }
+    };
+    auto intermediate = [&](size_t rows, size_t cols, matrix_layout layout)
+    {
+        chain_value value;
+        value.rows   = rows;
+        value.cols   = cols;
+        value.layout = layout;
+        value.offset = allocate(rows * cols);
+        plan.values.push_back(value);
+        return static_cast<int>(plan.values.size()) - 1;
+    };
+
+    for(size_t t = 0; t < terms.size(); ++t)
+    {
+        const std::vector<size_t>& term = terms[t];
+        const size_t               n    = term.size();
+
+        // Matrix i of the term is dims[i] × dims[i + 1]
+        std::vector<size_t> dims(n + 1);
+        for(size_t i = 0; i < n; ++i)
+        {
+            dims[i] = inputs[term[i]].rows;
+        }
+        dims[n] = inputs[term.back()].cols;
+
+        auto leaf_us = [&](size_t i, matrix_layout required)
+        {
+            return inputs[term[i]].layout == required ? 0.0 : model.copy_us(dims[i], dims[i + 1]);
+        };
+
+        std::vector<std::vector<double>> cost(n, std::vector<double>(n, 0.0));
+        std::vector<std::vector<size_t>> split(n, std::vector<size_t>(n, 0));
+        for(size_t length = 2; length <= n; ++length)
+        {
+            for(size_t i = 0; i + length <= n; ++i)
+            {
+                const size_t j = i + length - 1;
+                cost[i][j]     = std::numeric_limits<double>::infinity();
+                for(size_t k = i; k < j; ++k)
+                {
+                    const double lhs = k == i ? leaf_us(i, matrix_layout::col_major) : cost[i][k];
+                    const double rhs
+                        = k + 1 == j ? leaf_us(j, matrix_layout::row_major) : cost[k + 1][j];
+                    const double c = lhs + rhs + model.gemm_us(dims[i], dims[j + 1], dims[k + 1]);
+                    if(c < cost[i][j])
+                    {
+                        cost[i][j]  = c;
+                        split[i][j] = k;
+                    }
+                }
+            }
+        }
+        plan.cost_us += cost[0][n - 1];
+
+        // The order as written, for comparison
+        double written = leaf_us(0, matrix_layout::col_major);
+        for(size_t k = 1; k < n; ++k)
+        {
+            written += leaf_us(k, matrix_layout::row_major)
+                       + model.gemm_us(dims[0], dims[k + 1], dims[k]);
+        }
+        plan.written_cost_us += written;
+
+        // Emit the steps in post-order, producing each value in its consumer's layout
+        auto emit = [&](auto& self, size_t i, size_t j, matrix_layout required, bool root) -> int
+        {
+            if(i == j)
+            {
+                const int id = static_cast<int>(term[i]);
+                if(plan.values[id].layout == required)
+                {
+                    return id;
+                }
+                const int dst = intermediate(dims[i], dims[i + 1], required);
+                plan.steps.push_back({true, false, dst, id, -1});
+                return dst;
+            }
+
+            const size_t k   = split[i][j];
+            const int    lhs = self(self, i, k, matrix_layout::col_major, false);
+            const int    rhs = self(self, k + 1, j, matrix_layout::row_major, false);
+            const int dst = root ? output_id : intermediate(dims[i], dims[j + 1], required);
+            plan.steps.push_back({false, root && t > 0, dst, lhs, rhs});
+            release(lhs);
+            release(rhs);
+            return dst;
+        };
+        emit(emit, 0, n - 1, matrix_layout::row_major, true);
+    }
+
+    plan.arena_size = peak * sizeof(half);
+    return plan;
+}
+
+/**
+ * @brief Device memory reused across chain executions, grown on demand
+ */
+class gemm_arena
+{
+public:
+    gemm_arena() = default;
+
+    gemm_arena(const gemm_arena&)            = delete;
+    gemm_arena& operator=(const gemm_arena&) = delete;
+
+    ~gemm_arena()
+    {
+        if(data_ != nullptr)
+        {
+            HIP_CHECK(hipFree(data_));
+        }
+    }
+
+    /**
+     * @brief Get at least bytes of device memory, reallocating only when it must grow
+     */
+    half* reserve(size_t bytes)
+    {
+        if(bytes > capacity_)
+        {
+            if(data_ != nullptr)
+            {
+                HIP_CHECK(hipFree(data_));
+            }
+            HIP_CHECK(hipMalloc(&data_, bytes));
+            capacity_ = bytes;
+        }
+        return static_cast<half*>(data_);
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    void*  data_     = nullptr;
+    size_t capacity_ = 0;
+};
+
+/**
+ * @brief Run a chain plan with hgemm_gpu
+ *
+ * @tparam K_TYPE wmma_opt_4_wgp (or wmma_opt_4 under -mcumode), which provide the accumulating
+ *                epilogue
+ * @param plan    Plan from plan_chain
+ * @param out     plan.rows × plan.cols row-major result
+ * @param inputs  Device pointers of the chain inputs, in the planned layouts
+ * @param arena   Arena for the intermediates
+ * @param stream  HIP stream to execute kernels
+ */
+template<kernel_type K_TYPE>
+__host__ void execute_chain(const chain_plan&         plan,
+                            half*                     out,
+                            const std::vector<half*>& inputs,
+                            gemm_arena&               arena,
+                            hipStream_t&              stream)
+{
+    half* base    = arena.reserve(std::max<size_t>(plan.arena_size, 1));
+    auto  pointer = [&](int id)
+    {
+        const chain_value& value = plan.values[id];
+        return value.output ? out : value.input >= 0 ? inputs[value.input] : base + value.offset;
+    };
+
+    for(const chain_step& step : plan.steps)
+    {
+        const chain_value& dst = plan.values[step.dst];
+        const chain_value& lhs = plan.values[step.lhs];
+
+        if(step.transpose)
+        {
+            operand_plan copy;
+            copy.sizes = {dst.rows, dst.cols};
+            copy.strides
+                = lhs.layout == matrix_layout::row_major
+                      ? std::vector<int64_t>{static_cast<int64_t>(lhs.cols), 1}
+                      : std::vector<int64_t>{1, static_cast<int64_t>(lhs.rows)};
+            copy.packed
+                = dst.layout == matrix_layout::row_major
+                      ? std::vector<int64_t>{static_cast<int64_t>(dst.cols), 1}
+                      : std::vector<int64_t>{1, static_cast<int64_t>(dst.rows)};
+            launch_operand_copy(pointer(step.dst), pointer(step.lhs), copy, true, stream);
+            continue;
+        }
+
+        const size_t M = dst.rows;
+        const size_t N = dst.cols;
+        const size_t K = lhs.cols;
+        if(step.accumulate)
+        {
+            const auto epilogue
+                = epilogue_add(epilogue_acc{}, epilogue_matrix{out, static_cast<int64_t>(N)});
+            hgemm_gpu<K_TYPE>(out, pointer(step.lhs), pointer(step.rhs), M, N, K, epilogue, stream);
+        }
+        else if(dst.layout == matrix_layout::row_major)
+        {
+            hgemm_gpu<K_TYPE>(
+                pointer(step.dst), pointer(step.lhs), pointer(step.rhs), M, N, K, stream);
+        }
+        else
+        {
+            // A column-major product is the row-major C^T = rhs^T × lhs^T, whose operands are
+            // the same buffers read in the opposite roles
+            hgemm_gpu<K_TYPE>(
+                pointer(step.dst), pointer(step.rhs), pointer(step.lhs), N, M, K, stream);
+        }
+    }
+}
+
+#endif // HIP_CHAIN_HPP
@@ -25,7 +25,11 @@
 #ifndef HIP_KERNEL_HPP
 #define HIP_KERNEL_HPP
 
+#include <cstdint>
 #include <hip/hip_fp16.h>
+#include <limits>
+#include <stdexcept>
+#include <string>
 #include <type_traits>
 
 // Enum to choose between shared memory and WMMA-based kernel implementation
@@ -41,11 +45,27 @@ enum class kernel_type
     wmma_prefetch,
     wmma_opt_1,
     wmma_opt_2,
+    wmma_opt_2_wgp,
     wmma_opt_3,
+    wmma_opt_3_wgp,
     wmma_opt_4,
-    rocblas
+    wmma_opt_4_wgp,
+    wmma_opt_4_persistent,
+    rocwmma,
+    rocblas,
+    rocblas_ex,
+    rocblas_ex_tuned
 };
 
+/**
+ * @brief Whether a kernel type is served by rocBLAS (needs init_rocblas, column-major C)
+ */
+constexpr bool is_rocblas_kernel(kernel_type type)
+{
+    return type == kernel_type::rocblas || type == kernel_type::rocblas_ex
+           || type == kernel_type::rocblas_ex_tuned;
+}
+
 // Tile size used for wmma kernel
 constexpr int wmma_tile = 16;
 
@@ -61,10 +81,37 @@ typedef float float16 __attribute__((ext_vector_type(16)));
 template<kernel_type KT>
 struct wmma_config;
 
+/**
+ * @brief LDS budget of the WGP-mode builds (wmma_opt_2_wgp, wmma_opt_3_wgp, wmma_opt_4_wgp)
+ *
+ * In CU mode a workgroup is restricted to the LDS and scheduling resources of a single CU.
+ * In WGP mode the workgroups resident on a WGP share its 128 KB of LDS. The WGP builds are sized
+ * for two workgroups per WGP, each taking 64 KB (the most a single workgroup may allocate on
+ * RDNA3), so one workgroup can still compute while the other waits at a barrier.
+ */
+struct wgp_lds_budget
+{
+    static constexpr int wgp_lds_bytes       = 128 * 1024;
+    static constexpr int workgroups_per_wgp  = 2;
+    static constexpr int workgroup_lds_bytes = wgp_lds_bytes / workgroups_per_wgp;
+
+    /**
+     * @brief Largest block_k whose double-buffered A and B tiles fit a workgroup's share
+     */
+    static constexpr int block_k(int block_m, int block_n)
+    {
+        return workgroup_lds_bytes / (2 * (block_m + block_n) * static_cast<int>(sizeof(half)));
+    }
+};
+
 /**
  * Kernel Definition for half-precision GEMM.
  *
- * @tparam K_TYPE The type of kernel
+ * The index type is not deduced from the arguments, so launchers passing size_t dimensions
+ * get the 32-bit kernel unless they explicitly request the 64-bit one.
+ *
+ * @tparam K_TYPE  The type of kernel
+ * @tparam index_t Type used for global memory offsets (int or int64_t)
  * @param C       Output matrix
  * @param A       Input matrix A
  * @param B       Input matrix B
@@ -72,8 +119,90 @@ struct wmma_config;
  * @param N       Number of columns in matrices B and C
  * @param K       Number of columns in matrix A/rows in matrix B
  */
-template<kernel_type K_TYPE>
-__global__ void kernel_hgemm(half* C, const half* A, const half* B, int M, int N, int K);
+template<kernel_type K_TYPE, class index_t = int>
+__global__ void kernel_hgemm(half*                           C,
+                             const half*                     A,
+                             const half*                     B,
+                             std::type_identity_t<index_t> M,
+                             std::type_identity_t<index_t> N,
+                             std::type_identity_t<index_t> K);
+
+/**
+ * @brief Index type policy for global memory addressing
+ *
+ * Kernels use 32-bit offsets by default, as these need fewer registers and cheaper
+ * multiplies. The 64-bit type is only selected when an operand does not fit in 2^31 elements.
+ *
+ * @tparam WIDE Whether 64-bit addressing is required
+ */
+template<bool WIDE>
+struct index_policy
+{
+    using type = int;
+};
+
+template<>
+struct index_policy<true>
+{
+    using type = int64_t;
+};
+
+/**
+ * @brief Check whether any operand of an M × N × K GEMM exceeds the 32-bit index range
+ * @param M Number of rows in matrices A and C
+ * @param N Number of columns in matrices B and C
+ * @param K Number of columns in matrix A/rows in matrix B
+ * @return  true if 64-bit addressing is required
+ */
+inline bool requires_64bit_index(size_t M, size_t N, size_t K)
+{
+    constexpr size_t limit = static_cast<size_t>(std::numeric_limits<int>::max());
+    return (M * K) > limit || (K * N) > limit || (M * N) > limit || M > limit || N > limit
+           || K > limit;
+}
+
+/**
+ * @brief Reject a GEMM that needs 64-bit offsets on a kernel that only has 32-bit ones
+ *
+ * The step-by-step kernels (shared through wmma_opt_3) keep plain int arithmetic for
+ * readability, so their launchers call this instead of silently wrapping offsets.
+ *
+ * @param name Kernel name used in the error message
+ * @param M    Number of rows in matrices A and C
+ * @param N    Number of columns in matrices B and C
+ * @param K    Number of columns in matrix A/rows in matrix B
+ * @throws std::invalid_argument if requires_64bit_index(M, N, K)
+ */
+inline void require_32bit_index(const char* name, size_t M, size_t N, size_t K)
+{
+    if(requires_64bit_index(M, N, K))
+    {
+        throw std::invalid_argument(std::string(name)
+                                    + " uses 32-bit offsets and needs every operand below 2^31 "
+                                      "elements; use wmma_opt_4 or rocwmma instead");
+    }
+}
+
+/**
+ * @brief Offset of element (row, col) in a row-major matrix with leading dimension ld
+ *
+ * All operands are promoted to index_t before multiplying, so the 64-bit instantiation
+ * cannot overflow even when row and col come from 32-bit tile coordinates.
+ */
+template<class index_t>
+__host__ __device__ __forceinline__ index_t row_major_offset(index_t row, index_t col, index_t ld)
+{
+    return row * ld + col;
+}
+
+/**
+ * @brief Offset of element (row, col) in a column-major matrix with leading dimension ld
+ */
+template<class index_t>
+__host__ __device__ __forceinline__ index_t col_major_offset(index_t row, index_t col, index_t ld)
+{
+    return col * ld + row;
+}
 
 /**
  * @brief Helper function for swizzled tile mapping
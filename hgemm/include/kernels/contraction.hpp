@@ -0,0 +1,665 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIP_CONTRACTION_HPP
+#define HIP_CONTRACTION_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <hip/hip_runtime.h>
+#include <kernels/common.hpp>
+#include <kernels/wmma_batched.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Shape and element strides of a half tensor, in the index order of its einsum operand
+ *
+ * Empty strides mean a packed row-major tensor (last index contiguous).
+ */
+struct tensor_layout
+{
+    std::vector<size_t>  shape;
+    std::vector<int64_t> strides;
+
+    int64_t stride(size_t i) const
+    {
+        if(!strides.empty())
+        {
+            return strides[i];
+        }
+        int64_t s = 1;
+        for(size_t j = i + 1; j < shape.size(); ++j)
+        {
+            s *= static_cast<int64_t>(shape[j]);
+        }
+        return s;
+    }
+};
+
+/**
+ * @brief Indices of a two-operand einsum spec such as "bhqd,bhkd->bhqk"
+ */
+struct contraction_spec
+{
+    std::string lhs;
+    std::string rhs;
+    std::string out;
+
+    std::string batch; // In lhs, rhs and out, in output order
+    std::string m; // In lhs and out only, in output order
+    std::string n; // In rhs and out only, in output order
+    std::string k; // In lhs and rhs only, in lhs order
+};
+
+/**
+ * @brief Parse and classify an explicit two-operand einsum spec
+ *
+ * Indices are single letters and whitespace is ignored. Repeated indices within an operand
+ * (diagonals) and indices summed out of a single operand are rejected, as they are not GEMMs.
+ *
+ * @throws std::invalid_argument on malformed or unsupported specs
+ */
+inline contraction_spec parse_contraction(const std::string& text)
+{
+    std::string spec;
+    for(char c : text)
+    {
+        if(!std::isspace(static_cast<unsigned char>(c)))
+        {
+            spec += c;
+        }
+    }
+
+    const size_t comma = spec.find(',');
+    const size_t arrow = spec.find("->");
+    if(comma == std::string::npos || arrow == std::string::npos || comma > arrow
+       || spec.find(',', comma + 1) != std::string::npos)
+    {
+        throw std::invalid_argument("einsum spec must have the form \"lhs,rhs->out\": " + text);
+    }
+
+    contraction_spec result;
+    result.lhs = spec.substr(0, comma);
+    result.rhs = spec.substr(comma + 1, arrow - comma - 1);
+    result.out = spec.substr(arrow + 2);
+
+    for(const std::string* operand : {&result.lhs, &result.rhs, &result.out})
+    {
+        for(size_t i = 0; i < operand->size(); ++i)
+        {
+            const char c = (*operand)[i];
+            if(!std::isalpha(static_cast<unsigned char>(c)))
+            {
+                throw std::invalid_argument("einsum indices must be letters: " + text);
+            }
+            if(operand->find(c, i + 1) != std::string::npos)
+            {
+                throw std::invalid_argument("repeated einsum index within an operand: " + text);
+            }
+        }
+    }
+
+    auto in = [](const std::string& s, char c) { return s.find(c) != std::string::npos; };
+    for(char c : result.out)
+    {
+        const bool l = in(result.lhs, c);
+        const bool r = in(result.rhs, c);
+        if(l && r)
+        {
+            result.batch += c;
+        }
+        else if(l)
+        {
+            result.m += c;
+        }
+        else if(r)
+        {
+            result.n += c;
+        }
+        else
+        {
+            throw std::invalid_argument("output index missing from the inputs: " + text);
+        }
+    }
+    for(char c : result.lhs)
+    {
+        if(!in(result.out, c))
+        {
+            if(!in(result.rhs, c))
+            {
+                throw std::invalid_argument("index summed out of a single operand: " + text);
+            }
+            result.k += c;
+        }
+    }
+    for(char c : result.rhs)
+    {
+        if(!in(result.out, c) && !in(result.lhs, c))
+        {
+            throw std::invalid_argument("index summed out of a single operand: " + text);
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief GEMM kernels a contraction can be mapped onto
+ */
+enum class contraction_backend
+{
+    // A single wmma_opt_4 launch, batch entries on blockIdx.z: A column-major, B row-major,
+    // C row-major
+    opt_4,
+    // A single hgemm_batched_gpu launch: A row-major, B column-major, C row-major, M, N <= 64
+    batched
+};
+
+// Highest tensor rank handled by the strided copy kernel
+constexpr int contraction_max_rank = 8;
+
+/**
+ * @brief How one operand is presented to the GEMM
+ *
+ * The operand's indices are listed in the canonical order the kernel reads them in (batch
+ * indices first). When its strides do not match a packed tensor in that order, it is copied
+ * to (or, for the output, from) a packed buffer in the workspace.
+ */
+struct operand_plan
+{
+    std::vector<size_t>  sizes; // Canonical order, outer to inner
+    std::vector<int64_t> strides; // Strides of the user's tensor, canonical order
+    std::vector<int64_t> packed; // Strides of the packed tensor, canonical order
+    bool                 copy             = false;
+    size_t               workspace_offset = 0; // In elements
+
+    size_t elements() const
+    {
+        size_t count = 1;
+        for(size_t s : sizes)
+        {
+            count *= s;
+        }
+        return count;
+    }
+
+    // Strides of the batch indices in whichever tensor the GEMM reads
+    int64_t batch_stride(size_t i) const
+    {
+        return copy ? packed[i] : strides[i];
+    }
+};
+
+/**
+ * @brief A contraction mapped onto a GEMM backend, reusable for any tensors of the same layouts
+ */
+struct contraction_plan
+{
+    contraction_backend backend = contraction_backend::opt_4;
+    // The transposed product C^T = rhs^T × lhs^T is computed, so rhs feeds A and lhs feeds B
+    bool                swapped = false;
+    size_t              M       = 1;
+    size_t              N       = 1;
+    size_t              K       = 1;
+    std::vector<size_t> batch_sizes;
+    operand_plan        a;
+    operand_plan        b;
+    operand_plan        c;
+    size_t              copied_elements = 0;
+    size_t              workspace_size  = 0; // In bytes
+
+    size_t batch() const
+    {
+        size_t count = 1;
+        for(size_t s : batch_sizes)
+        {
+            count *= s;
+        }
+        return count;
+    }
+};
+
+/**
+ * @brief Lay out one operand in the given canonical index order, deciding whether it needs a copy
+ *
+ * @param order        Canonical index order, outer to inner
+ * @param num_batch    Number of leading batch indices in order
+ * @param packed_batch Whether the backend also needs the batch indices packed
+ */
+inline operand_plan plan_operand(const std::string&   order,
+                                 size_t               num_batch,
+                                 bool                 packed_batch,
+                                 const std::string&   indices,
+                                 const tensor_layout& layout,
+                                 size_t&              workspace)
+{
+    if(order.size() > contraction_max_rank)
+    {
+        throw std::invalid_argument("einsum operands are limited to rank 8");
+    }
+
+    operand_plan plan;
+    plan.sizes.resize(order.size());
+    plan.strides.resize(order.size());
+    plan.packed.resize(order.size());
+
+    int64_t packed = 1;
+    for(size_t i = order.size(); i-- > 0;)
+    {
+        const size_t pos = indices.find(order[i]);
+        plan.sizes[i]    = layout.shape[pos];
+        plan.strides[i]  = layout.stride(pos);
+        plan.packed[i]   = packed;
+        packed *= static_cast<int64_t>(plan.sizes[i]);
+    }
+
+    for(size_t i = packed_batch ? 0 : num_batch; i < order.size(); ++i)
+    {
+        // The stride of a unit index is never used
+        if(plan.sizes[i] != 1 && plan.strides[i] != plan.packed[i])
+        {
+            plan.copy = true;
+        }
+    }
+
+    if(plan.copy)
+    {
+        plan.workspace_offset = workspace;
+        workspace += plan.elements();
+    }
+    return plan;
+}
+
+/**
+ * @brief Map a contraction onto the GEMM backends, preferring the mapping that copies least
+ *
+ * Both operand roles (C, or C^T with lhs and rhs exchanged) are tried on each backend. Within
+ * the M, N and batch groups indices follow the output order, and within K the lhs order, so
+ * e.g. "bhqd,bhkd->bhqk" on packed tensors maps onto the batched kernel without any copy.
+ *
+ * @throws std::invalid_argument on malformed specs or mismatched shapes
+ */
+inline contraction_plan plan_contraction(const std::string&   text,
+                                         const tensor_layout& lhs,
+                                         const tensor_layout& rhs,
+                                         const tensor_layout& out)
+{
+    const contraction_spec spec = parse_contraction(text);
+
+    const std::pair<const std::string*, const tensor_layout*> operands[]
+        = {{&spec.lhs, &lhs}, {&spec.rhs, &rhs}, {&spec.out, &out}};
+    for(const auto& [indices, layout] : operands)
+    {
+        if(layout->shape.size() != indices->size()
+           || (!layout->strides.empty() && layout->strides.size() != indices->size()))
+        {
+            throw std::invalid_argument("einsum operand rank does not match its layout: " + text);
+        }
+    }
+
+    auto size_of = [&](char c)
+    {
+        size_t size = 0;
+        for(const auto& [indices, layout] : operands)
+        {
+            const size_t pos = indices->find(c);
+            if(pos != std::string::npos)
+            {
+                if(size != 0 && layout->shape[pos] != size)
+                {
+                    throw std::invalid_argument("einsum index sizes disagree: " + text);
+                }
+                size = layout->shape[pos];
+            }
+        }
+        return size;
+    };
+    auto product = [&](const std::string& group)
+    {
+        size_t p = 1;
+        for(char c : group)
+        {
+            p *= size_of(c);
+        }
+        return p;
+    };
+
+    bool             found = false;
+    size_t           best_cost = 0;
+    contraction_plan best;
+
+    for(contraction_backend backend : {contraction_backend::batched, contraction_backend::opt_4})
+    {
+        for(bool swapped : {false, true})
+        {
+            const std::string& rows = swapped ? spec.n : spec.m;
+            const std::string& cols = swapped ? spec.m : spec.n;
+
+            contraction_plan plan;
+            plan.backend = backend;
+            plan.swapped = swapped;
+            plan.M       = product(rows);
+            plan.N       = product(cols);
+            plan.K       = product(spec.k);
+            for(char c : spec.batch)
+            {
+                plan.batch_sizes.push_back(size_of(c));
+            }
+
+            const bool batched = backend == contraction_backend::batched;
+            if(batched
+               && (plan.M > batched_config::max_dim || plan.N > batched_config::max_dim))
+            {
+                continue;
+            }
+
+            const std::string& a_indices = swapped ? spec.rhs : spec.lhs;
+            const std::string& b_indices = swapped ? spec.lhs : spec.rhs;
+            const std::string  a_order   = spec.batch + (batched ? rows + spec.k : spec.k + rows);
+            const std::string  b_order   = spec.batch + (batched ? cols + spec.k : spec.k + cols);
+            const std::string  c_order   = spec.batch + rows + cols;
+            const size_t       num_batch = spec.batch.size();
+
+            size_t workspace = 0;
+            plan.a = plan_operand(a_order, num_batch, batched, a_indices, swapped ? rhs : lhs,
+                                  workspace);
+            plan.b = plan_operand(b_order, num_batch, batched, b_indices, swapped ? lhs : rhs,
+                                  workspace);
+            plan.c = plan_operand(c_order, num_batch, batched, spec.out, out, workspace);
+            plan.copied_elements = workspace;
+            plan.workspace_size  = workspace * sizeof(half);
+
+            if(!found || plan.copied_elements < best_cost)
+            {
+                found     = true;
+                best_cost = plan.copied_elements;
+                best      = std::move(plan);
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Plans keyed by spec and operand layouts, so repeated contractions skip planning
+ */
+class contraction_cache
+{
+public:
+    const contraction_plan& get(const std::string&   spec,
+                                const tensor_layout& lhs,
+                                const tensor_layout& rhs,
+                                const tensor_layout& out)
+    {
+        std::ostringstream key;
+        key << spec;
+        for(const tensor_layout* layout : {&lhs, &rhs, &out})
+        {
+            key << '|';
+            for(size_t i = 0; i < layout->shape.size(); ++i)
+            {
+                key << layout->shape[i] << ':' << layout->stride(i) << ',';
+            }
+        }
+
+        auto it = plans_.find(key.str());
+        if(it != plans_.end())
+        {
+            ++hits_;
+            return it->second;
+        }
+        ++misses_;
+        return plans_.emplace(key.str(), plan_contraction(spec, lhs, rhs, out)).first->second;
+    }
+
+    size_t hits() const
+    {
+        return hits_;
+    }
+
+    size_t misses() const
+    {
+        return misses_;
+    }
+
+private:
+    std::unordered_map<std::string, contraction_plan> plans_;
+    size_t                                            hits_   = 0;
+    size_t                                            misses_ = 0;
+};
+
+/**
+ * @brief Sizes and both sides' strides of a strided tensor copy, passed by value to the kernel
+ */
+struct strided_copy_desc
+{
+    int     rank;
+    int64_t size[contraction_max_rank];
+    int64_t dst_stride[contraction_max_rank];
+    int64_t src_stride[contraction_max_rank];
+};
+
+/**
+ * @brief Copy between two strided layouts of the same tensor
+ *
+ * Elements are visited in the canonical order, in which the packed side is contiguous.
+ */
+inline __global__ void
+    kernel_strided_copy(half* dst, const half* src, strided_copy_desc desc, size_t count)
+{
+    for(size_t e = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x; e < count;
+        e += static_cast<size_t>(gridDim.x) * blockDim.x)
+    {
+        int64_t rem        = static_cast<int64_t>(e);
+        int64_t dst_offset = 0;
+        int64_t src_offset = 0;
+        for(int d = desc.rank - 1; d >= 0; --d)
+        {
+            const int64_t i = rem % desc.size[d];
+            rem /= desc.size[d];
+            dst_offset += i * desc.dst_stride[d];
+            src_offset += i * desc.src_stride[d];
+        }
+        dst[dst_offset] = src[src_offset];
+    }
+}
+
+/**
+ * @brief Launch a copy of an operand between the user's layout and its packed layout
+ *
+ * @param to_packed Whether to copy into the packed layout (inputs) or out of it (output)
+ */
+inline __host__ void launch_operand_copy(
+    half* dst, const half* src, const operand_plan& plan, bool to_packed, hipStream_t& stream)
+{
+    strided_copy_desc desc = {};
+    desc.rank              = static_cast<int>(plan.sizes.size());
+    for(int d = 0; d < desc.rank; ++d)
+    {
+        desc.size[d]       = static_cast<int64_t>(plan.sizes[d]);
+        desc.dst_stride[d] = to_packed ? plan.packed[d] : plan.strides[d];
+        desc.src_stride[d] = to_packed ? plan.strides[d] : plan.packed[d];
+    }
+
+    const size_t count = plan.elements();
+    const dim3   grid_dim(static_cast<unsigned int>(std::min<size_t>((count + 255) / 256, 65536)));
+    kernel_strided_copy<<<grid_dim, dim3(256), 0, stream>>>(dst, src, desc, count);
+}
+
+/**
+ * @brief Batch sizes and the batch strides of A, B and C, passed by value to the kernel
+ */
+struct contraction_batch_desc
+{
+    int     rank;
+    int64_t size[contraction_max_rank];
+    int64_t a_stride[contraction_max_rank];
+    int64_t b_stride[contraction_max_rank];
+    int64_t c_stride[contraction_max_rank];
+};
+
+/**
+ * @brief wmma_opt_4 kernel computing every batch entry of a contraction in one launch
+ *
+ * blockIdx.x selects the output tile and blockIdx.z the batch entry, whose operand offsets are
+ * decoded from the batch multi-index. Batches beyond the grid's z extent are visited in strides.
+ */
+template<kernel_type K_TYPE, class index_t>
+__global__ void __launch_bounds__(warp_size* wmma_config<K_TYPE>::total_warps)
+    kernel_hgemm_contraction(half*                         C,
+                             const half*                   A,
+                             const half*                   B,
+                             std::type_identity_t<index_t> M,
+                             std::type_identity_t<index_t> N,
+                             std::type_identity_t<index_t> K,
+                             contraction_batch_desc        desc,
+                             int64_t                       batch)
+{
+    for(int64_t p = blockIdx.z; p < batch; p += gridDim.z)
+    {
+        int64_t rem      = p;
+        int64_t a_offset = 0;
+        int64_t b_offset = 0;
+        int64_t c_offset = 0;
+        for(int d = desc.rank - 1; d >= 0; --d)
+        {
+            const int64_t i = rem % desc.size[d];
+            rem /= desc.size[d];
+            a_offset += i * desc.a_stride[d];
+            b_offset += i * desc.b_stride[d];
+            c_offset += i * desc.c_stride[d];
+        }
+
+        wmma_opt_4_impl<K_TYPE, index_t>(
+            C + c_offset, A + a_offset, B + b_offset, M, N, K, prologue_input{}, epilogue_acc{});
+
+        // The next batch entry's loads reuse the LDS of this one
+        __syncthreads();
+    }
+}
+
+/**
+ * @brief Launch kernel_hgemm_contraction for the GEMMs of an opt_4 plan
+ */
+template<kernel_type K_TYPE>
+__host__ void launch_hgemm_contraction(
+    half* C, const half* A, const half* B, const contraction_plan& plan, hipStream_t& stream)
+{
+    using config = wmma_config<K_TYPE>;
+
+    const int64_t batch = static_cast<int64_t>(plan.batch());
+    if(plan.M == 0 || plan.N == 0 || batch == 0)
+    {
+        return;
+    }
+
+    contraction_batch_desc desc = {};
+    desc.rank                   = static_cast<int>(plan.batch_sizes.size());
+    for(int d = 0; d < desc.rank; ++d)
+    {
+        desc.size[d]     = static_cast<int64_t>(plan.batch_sizes[d]);
+        desc.a_stride[d] = plan.a.batch_stride(d);
+        desc.b_stride[d] = plan.b.batch_stride(d);
+        desc.c_stride[d] = plan.c.batch_stride(d);
+    }
+
+    const int  grid_m = (plan.M + config::block_m - 1) / config::block_m;
+    const int  grid_n = (plan.N + config::block_n - 1) / config::block_n;
+    const dim3 grid_dim(
+        grid_m * grid_n, 1, static_cast<unsigned int>(std::min<int64_t>(batch, 65535)));
+    const dim3 block_dim(warp_size * config::total_warps);
+
+    if(requires_64bit_index(plan.M, plan.N, plan.K))
+    {
+        kernel_hgemm_contraction<K_TYPE, index_policy<true>::type>
+            <<<grid_dim, block_dim, 0, stream>>>(C, A, B, plan.M, plan.N, plan.K, desc, batch);
+    }
+    else
+    {
+        kernel_hgemm_contraction<K_TYPE, int>
+            <<<grid_dim, block_dim, 0, stream>>>(C, A, B, plan.M, plan.N, plan.K, desc, batch);
+    }
+}
+
+/**
+ * @brief Run a planned contraction
+ *
+ * @tparam K_TYPE  Kernel used by the opt_4 backend, 'kernel_type::wmma_opt_4_wgp', or
+ *                 'kernel_type::wmma_opt_4' in a translation unit built with -mcumode
+ * @param plan      Plan from plan_contraction or contraction_cache
+ * @param out       Output tensor in the planned layout
+ * @param lhs       Left operand in the planned layout
+ * @param rhs       Right operand in the planned layout
+ * @param workspace plan.workspace_size bytes (may be nullptr when zero)
+ * @param stream    HIP stream to execute kernels
+ */
+template<kernel_type K_TYPE>
+__host__ void execute_contraction(const contraction_plan& plan,
+                                  half*                   out,
+                                  const half*             lhs,
+                                  const half*             rhs,
+                                  void*                   workspace,
+                                  hipStream_t&            stream)
+{
+    static_assert(K_TYPE == kernel_type::wmma_opt_4 || K_TYPE == kernel_type::wmma_opt_4_wgp,
+                  "The opt_4 backend runs on the wmma_opt_4 kernels");
+
+    half*       ws    = static_cast<half*>(workspace);
+    const half* a_src = plan.swapped ? rhs : lhs;
+    const half* b_src = plan.swapped ? lhs : rhs;
+
+    // The kernels never write A or B, they only lack const in their signatures
+    half* a = plan.a.copy ? ws + plan.a.workspace_offset : const_cast<half*>(a_src);
+    half* b = plan.b.copy ? ws + plan.b.workspace_offset : const_cast<half*>(b_src);
+    half* c = plan.c.copy ? ws + plan.c.workspace_offset : out;
+
+    if(plan.a.copy)
+    {
+        launch_operand_copy(a, a_src, plan.a, true, stream);
+    }
+    if(plan.b.copy)
+    {
+        launch_operand_copy(b, b_src, plan.b, true, stream);
+    }
+
+    if(plan.backend == contraction_backend::batched)
+    {
+        hgemm_batched_gpu(c, a, b, plan.M, plan.N, plan.K, plan.batch(), stream);
+    }
+    else
+    {
+        launch_hgemm_contraction<K_TYPE>(c, a, b, plan, stream);
+    }
+
+    if(plan.c.copy)
+    {
+        launch_operand_copy(out, c, plan.c, false, stream);
+    }
+}
+
+#endif // HIP_CONTRACTION_HPP
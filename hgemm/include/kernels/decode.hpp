@@ -0,0 +1,349 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_DECODE_HPP
+#define HIP_DECODE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <hip/hip_runtime.h>
+#include <kernels/common.hpp>
+#include <stdexcept>
+
+/**
+ * Split-KV decode attention (flash-decoding)
+ *
+ * During decoding each KV head sees a handful of query rows (one token, or the G query heads of
+ * a GQA group) against a cache of S keys and values, so a GEMM-shaped kernel would only occupy
+ * as many workgroups as there are heads. Here the sequence is instead split into chunks of
+ * split_len keys, each handled by one warp: scores Q·Kᵀ and the update O += P·V run on 16 keys
+ * at a time with the fp32-accumulating WMMA, under an online softmax (running row max and sum).
+ * Every warp writes its unnormalised O with the row max and sum to a workspace, and a reduction
+ * kernel rescales and combines the partials of all splits.
+ *
+ * Layouts, with the heads stacked along the rows (all row-major):
+ *   Q, O: (heads × G) × D    K, V: (heads × S) × D
+ */
+
+constexpr int decode_warps = 4;
+
+/**
+ * @brief Per-warp pass over one KV split, writing unnormalised partial results
+ *
+ * @tparam HEAD_DIM Head dimension D (multiple of 16)
+ * @param partial_o  (heads × splits × G) × D unnormalised outputs
+ * @param partial_ml (heads × splits × G) × 2 running row max and sum (of exp2 scores)
+ * @param scale_log2 Softmax scale multiplied by log2(e)
+ */
+template<int HEAD_DIM>
+__global__ void __launch_bounds__(warp_size* decode_warps)
+    kernel_decode_attention_split(float*      partial_o,
+                                  float*      partial_ml,
+                                  const half* Q,
+                                  const half* K,
+                                  const half* V,
+                                  int         G,
+                                  int         S,
+                                  int         split_len,
+                                  int         splits,
+                                  float       scale_log2)
+{
+    static_assert(HEAD_DIM % wmma_tile == 0, "The head dimension must be a multiple of 16");
+    constexpr int d_tiles   = HEAD_DIM / wmma_tile;
+    constexpr int half_warp = warp_size / 2;
+
+    // Per-warp staging: the 16 values of each key block, and P transposed into A-operand rows
+    __shared__ half lds_v[decode_warps][wmma_tile * HEAD_DIM];
+    __shared__ half lds_p[decode_warps][wmma_tile * wmma_tile];
+
+    const int warp_id      = threadIdx.x / warp_size;
+    const int lane_id      = threadIdx.x % warp_size;
+    const int half_warp_id = lane_id / half_warp;
+    const int half_lane    = lane_id % half_warp;
+
+    const int split = blockIdx.x * decode_warps + warp_id;
+    const int head  = blockIdx.y;
+    if(split >= splits)
+    {
+        return;
+    }
+
+    Q += static_cast<size_t>(head) * G * HEAD_DIM;
+    K += static_cast<size_t>(head) * S * HEAD_DIM;
+    V += static_cast<size_t>(head) * S * HEAD_DIM;
+
+    // Query fragments (A operand): lane row half_lane, padding rows are zero
+    half16 q_frag[d_tiles];
+    for(int t = 0; t < d_tiles; ++t)
+    {
+        q_frag[t] = half_lane < G ? *reinterpret_cast<const half16*>(
+                        Q + static_cast<size_t>(half_lane) * HEAD_DIM + t * wmma_tile)
+                                  : half16{};
+    }
+
+    // Each lane tracks rows i * 2 + half_warp_id of the accumulators
+    float8 o_acc[d_tiles] = {};
+    float  row_max[wmma_tile / 2];
+    float  row_sum[wmma_tile / 2];
+    for(int i = 0; i < wmma_tile / 2; ++i)
+    {
+        row_max[i] = -INFINITY;
+        row_sum[i] = 0.0f;
+    }
+
+    const int key_begin = split * split_len;
+    const int key_end   = min(key_begin + split_len, S);
+    for(int key0 = key_begin; key0 < key_end; key0 += wmma_tile)
+    {
+        // Stage V for this block with coalesced 128-bit loads while the scores are computed
+        for(int v = lane_id * 8; v < wmma_tile * HEAD_DIM; v += warp_size * 8)
+        {
+            const int key = key0 + v / HEAD_DIM;
+            *reinterpret_cast<half8*>(&lds_v[warp_id][v])
+                = key < key_end ? *reinterpret_cast<const half8*>(
+                      V + static_cast<size_t>(key) * HEAD_DIM + v % HEAD_DIM)
+                                : half8{};
+        }
+
+        // Scores (B operand Kᵀ): lane column half_lane is key key0 + half_lane
+        const int    key   = key0 + half_lane;
+        const bool   valid = key < key_end;
+        float8       s     = {};
+        const half*  k_row = K + static_cast<size_t>(key) * HEAD_DIM;
+        for(int t = 0; t < d_tiles; ++t)
+        {
+            const half16 k_frag
+                = valid ? *reinterpret_cast<const half16*>(k_row + t * wmma_tile) : half16{};
+            s = __builtin_amdgcn_wmma_f32_16x16x16_f16_w32(q_frag[t], k_frag, s);
+        }
+
+        // Online softmax over the 16 keys held by the half warp
+#pragma unroll
+        for(int i = 0; i < wmma_tile / 2; ++i)
+        {
+            const float x     = valid ? s[i] * scale_log2 : -INFINITY;
+            float       x_max = x;
+            for(int offset = half_warp / 2; offset > 0; offset /= 2)
+            {
+                x_max = fmaxf(x_max, __shfl_xor(x_max, offset, half_warp));
+            }
+
+            // Every block holds at least one valid key, so m_new is finite
+            const float m_new = fmaxf(row_max[i], x_max);
+            const float alpha = exp2f(row_max[i] - m_new);
+            const float p     = exp2f(x - m_new);
+
+            float p_sum = p;
+            for(int offset = half_warp / 2; offset > 0; offset /= 2)
+            {
+                p_sum += __shfl_xor(p_sum, offset, half_warp);
+            }
+            row_sum[i] = row_sum[i] * alpha + p_sum;
+            row_max[i] = m_new;
+
+            for(int t = 0; t < d_tiles; ++t)
+            {
+                o_acc[t][i] *= alpha;
+            }
+            lds_p[warp_id][(i * 2 + half_warp_id) * wmma_tile + half_lane] = static_cast<half>(p);
+        }
+
+        // A wavefront's LDS accesses complete in order, so the warp can read back its own
+        // staging without a workgroup barrier
+        const half16 p_frag
+            = *reinterpret_cast<const half16*>(&lds_p[warp_id][half_lane * wmma_tile]);
+        for(int t = 0; t < d_tiles; ++t)
+        {
+            // B operand V: lane column half_lane is dimension t * 16 + half_lane
+            half16 v_frag;
+            for(int k = 0; k < wmma_tile; ++k)
+            {
+                v_frag[k] = lds_v[warp_id][k * HEAD_DIM + t * wmma_tile + half_lane];
+            }
+            o_acc[t] = __builtin_amdgcn_wmma_f32_16x16x16_f16_w32(p_frag, v_frag, o_acc[t]);
+        }
+    }
+
+    const size_t base = (static_cast<size_t>(head) * splits + split) * G;
+    for(int i = 0; i < wmma_tile / 2; ++i)
+    {
+        const int row = i * 2 + half_warp_id;
+        if(row < G)
+        {
+            for(int t = 0; t < d_tiles; ++t)
+            {
+                partial_o[(base + row) * HEAD_DIM + t * wmma_tile + half_lane] = o_acc[t][i];
+            }
+            if(half_lane == 0)
+            {
+                partial_ml[(base + row) * 2]     = row_max[i];
+                partial_ml[(base + row) * 2 + 1] = row_sum[i];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Combines the partials of all splits, one workgroup per (query row, head) and one
+ * thread per dimension
+ */
+inline __global__ void kernel_decode_attention_reduce(half*        O,
+                                                      const float* partial_o,
+                                                      const float* partial_ml,
+                                                      int          G,
+                                                      int          D,
+                                                      int          splits)
+{
+    const int row  = blockIdx.x;
+    const int head = blockIdx.y;
+    const int d    = threadIdx.x;
+
+    const size_t base = static_cast<size_t>(head) * splits * G + row;
+
+    float m = -INFINITY;
+    for(int s = 0; s < splits; ++s)
+    {
+        m = fmaxf(m, partial_ml[(base + static_cast<size_t>(s) * G) * 2]);
+    }
+
+    float sum = 0.0f;
+    float acc = 0.0f;
+    for(int s = 0; s < splits; ++s)
+    {
+        const size_t i = base + static_cast<size_t>(s) * G;
+        const float  w = exp2f(partial_ml[i * 2] - m);
+        sum += partial_ml[i * 2 + 1] * w;
+        acc += partial_o[i * D + d] * w;
+    }
+
+    O[(static_cast<size_t>(head) * G + row) * D + d] = static_cast<half>(acc / sum);
+}
+
+/**
+ * @brief Keys per split used when none is given: enough splits for about 2048 warps over all
+ * heads, but never fewer than 64 keys per warp
+ */
+inline size_t decode_attention_split_len(size_t heads, size_t S)
+{
+    constexpr size_t target_warps = 2048;
+    const size_t     per_warp     = (S * heads + target_warps - 1) / target_warps;
+    return std::max<size_t>(64, (per_warp + wmma_tile - 1) / wmma_tile * wmma_tile);
+}
+
+/**
+ * @brief Workspace required by decode_attention_gpu, in bytes
+ */
+inline size_t decode_attention_workspace_size(
+    size_t heads, size_t G, size_t S, size_t D, size_t split_len = 0)
+{
+    if(split_len == 0)
+    {
+        split_len = decode_attention_split_len(heads, S);
+    }
+    const size_t splits = (S + split_len - 1) / split_len;
+    return heads * splits * G * (D + 2) * sizeof(float);
+}
+
+/**
+ * Function Definition for split-KV decode attention
+ *
+ * Computes O = softmax(scale · Q·Kᵀ)·V for every head, with all keys visible.
+ *
+ * @param O         (heads × G) × D output
+ * @param Q         (heads × G) × D queries
+ * @param K         (heads × S) × D key cache
+ * @param V         (heads × S) × D value cache
+ * @param heads     Number of KV heads
+ * @param G         Query rows per KV head, at most 16
+ * @param S         Cached sequence length
+ * @param D         Head dimension, 64, 128 or 256
+ * @param scale     Softmax scale, usually 1 / sqrt(D)
+ * @param workspace Device workspace of decode_attention_workspace_size() bytes
+ * @param stream    HIP stream to execute kernels
+ * @param split_len Keys per warp, a multiple of 16 (0 selects decode_attention_split_len)
+ * @throws std::invalid_argument for unsupported shapes
+ */
+inline void decode_attention_gpu(half*        O,
+                                 const half*  Q,
+                                 const half*  K,
+                                 const half*  V,
+                                 size_t       heads,
+                                 size_t       G,
+                                 size_t       S,
+                                 size_t       D,
+                                 float        scale,
+                                 void*        workspace,
+                                 hipStream_t& stream,
+                                 size_t       split_len = 0)
+{
+    if(heads == 0 || S == 0 || G == 0 || G > wmma_tile)
+    {
+        throw std::invalid_argument(
+            "Decode attention needs 1 to 16 query rows per head and a non-empty cache");
+    }
+    if(split_len == 0)
+    {
+        split_len = decode_attention_split_len(heads, S);
+    }
+    if(split_len % wmma_tile != 0)
+    {
+        throw std::invalid_argument("Decode attention splits must be a multiple of 16 keys");
+    }
+
+    const int   splits     = static_cast<int>((S + split_len - 1) / split_len);
+    float*      partial_o  = static_cast<float*>(workspace);
+    float*      partial_ml = partial_o + heads * splits * G * D;
+    const float scale_log2 = scale * 1.4426950409f; // log2(e)
+
+    dim3 grid_dim((splits + decode_warps - 1) / decode_warps, heads);
+    dim3 block_dim(warp_size * decode_warps);
+
+    auto launch = [&](auto kernel)
+    {
+        kernel<<<grid_dim, block_dim, 0, stream>>>(partial_o,
+                                                   partial_ml,
+                                                   Q,
+                                                   K,
+                                                   V,
+                                                   static_cast<int>(G),
+                                                   static_cast<int>(S),
+                                                   static_cast<int>(split_len),
+                                                   splits,
+                                                   scale_log2);
+    };
+
+    switch(D)
+    {
+        case 64: launch(kernel_decode_attention_split<64>); break;
+        case 128: launch(kernel_decode_attention_split<128>); break;
+        case 256: launch(kernel_decode_attention_split<256>); break;
+        default: throw std::invalid_argument("Decode attention supports D = 64, 128 or 256");
+    }
+
+    kernel_decode_attention_reduce<<<dim3(G, heads), dim3(D), 0, stream>>>(
+        O, partial_o, partial_ml, static_cast<int>(G), static_cast<int>(D), splits);
+}
+
+#endif // HIP_DECODE_HPP
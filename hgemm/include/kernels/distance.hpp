@@ -0,0 +1,296 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_DISTANCE_HPP
+#define HIP_DISTANCE_HPP
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <hip/hip_runtime.h>
+#include <kernels/buffer.hpp>
+#include <kernels/epilogue.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+
+/**
+ * Pairwise L2 distances
+ *
+ * For k-means and kNN, D(i, j) = ||a_i||² + ||b_j||² - 2 a_i · b_j for the rows a_i of A and
+ * the columns b_j of B. The distance epilogue asks the kernel for operand norms, which the
+ * wmma_opt_4 loaders accumulate in fp32 from the A and B vectors they already stage to LDS, and
+ * combines them with the accumulators when storing. It can also emit the per-row argmin (e.g.
+ * the k-means assignment) through per-tile partials and a small merge pass, in which case D
+ * need not be stored at all.
+ *
+ * The dot products are accumulated in fp16 like every other kernel of this sample, so the
+ * distances carry fp16 cancellation error when points are close relative to their norms.
+ */
+
+/**
+ * @brief Whether (d1, i1) ranks before (d2, i2) for argmin: smaller distance, then smaller index
+ */
+__host__ __device__ __forceinline__ bool argmin_before(float d1, int i1, float d2, int i2)
+{
+    return d1 < d2 || (d1 == d2 && i1 < i2);
+}
+
+/**
+ * @brief L2 distance epilogue
+ */
+struct epilogue_l2_distance
+{
+    using tile_store_tag    = void;
+    using operand_norms_tag = void;
+
+    half*  D; // Row-major M × N distances, nullptr to skip
+    float* argmin_dist; // M × tiles_n partial minimum distances, nullptr to skip the argmin
+    int*   argmin_index; // M × tiles_n partial argmin column indices
+    int    tiles_n; // Number of N tiles (ceil(N / block_n))
+    bool   take_sqrt; // Emit ||a - b|| instead of ||a - b||²
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t, index_t) const
+    {
+        return acc;
+    }
+
+    template<class config, class index_t>
+    __device__ __forceinline__ void
+        store_tile(const half16 (&c_frags)[config::warp_tile_m][config::warp_tile_n],
+                   half*   lds,
+                   index_t block_row,
+                   index_t block_col,
+                   index_t M,
+                   index_t N) const
+    {
+        const int     tid          = threadIdx.x;
+        const int     warp_id      = tid / warp_size;
+        const int     warp_col     = warp_id % config::warps_n;
+        const int     warp_m_base  = (warp_id / config::warps_n) * config::warp_tile_m * wmma_tile;
+        const int     warp_n_base  = warp_col * config::warp_tile_n * wmma_tile;
+        constexpr int half_warp    = warp_size / 2;
+        const int     half_warp_id = (tid % warp_size) / half_warp;
+        const int     half_lane    = tid % half_warp;
+
+        // Norms left by the kernel, followed by one argmin candidate per warp and row
+        const float* a_norms  = reinterpret_cast<const float*>(lds);
+        const float* b_norms  = a_norms + config::block_m;
+        float*       lds_dist = reinterpret_cast<float*>(lds) + config::block_m + config::block_n;
+        int*         lds_index
+            = reinterpret_cast<int*>(lds_dist + config::warps_n * config::block_m);
+
+        const buffer_resource rsrc_d = make_buffer_resource(D, static_cast<size_t>(M) * N);
+
+        for(int wm = 0; wm < config::warp_tile_m; ++wm)
+        {
+#pragma unroll
+            for(int i = 0; i < wmma_tile / 2; ++i)
+            {
+                const int     row_local = warp_m_base + wm * wmma_tile + i * 2 + half_warp_id;
+                const index_t row       = block_row + row_local;
+
+                float best_dist  = __builtin_huge_valf();
+                int   best_index = INT_MAX;
+                for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                {
+                    const int     col_local = warp_n_base + wn * wmma_tile + half_lane;
+                    const index_t col       = block_col + col_local;
+                    const float   dot       = static_cast<float>(c_frags[wm][wn][i * 2]);
+
+                    float dist = fmaxf(a_norms[row_local] + b_norms[col_local] - 2.0f * dot, 0.0f);
+                    dist       = take_sqrt ? sqrtf(dist) : dist;
+
+                    const half stored = static_cast<half>(dist);
+                    if(D != nullptr)
+                    {
+                        store_scalar<index_t>(stored,
+                                              rsrc_d,
+                                              row_major_offset<index_t>(row, col, N),
+                                              row < M && col < N);
+                    }
+                    // Rank the values as stored, so the argmin agrees with D
+                    if(col < N && argmin_before(static_cast<float>(stored),
+                                                static_cast<int>(col),
+                                                best_dist,
+                                                best_index))
+                    {
+                        best_dist  = static_cast<float>(stored);
+                        best_index = static_cast<int>(col);
+                    }
+                }
+
+                if(argmin_dist != nullptr)
+                {
+                    for(int offset = half_warp / 2; offset > 0; offset /= 2)
+                    {
+                        const float other_dist  = __shfl_xor(best_dist, offset, half_warp);
+                        const int   other_index = __shfl_xor(best_index, offset, half_warp);
+                        if(argmin_before(other_dist, other_index, best_dist, best_index))
+                        {
+                            best_dist  = other_dist;
+                            best_index = other_index;
+                        }
+                    }
+                    if(half_lane == 0)
+                    {
+                        lds_dist[warp_col * config::block_m + row_local]  = best_dist;
+                        lds_index[warp_col * config::block_m + row_local] = best_index;
+                    }
+                }
+            }
+        }
+
+        if(argmin_dist == nullptr)
+        {
+            return;
+        }
+        __syncthreads();
+
+        // Combine the warp candidates of each row in a fixed order
+        const int tile_n = block_col / config::block_n;
+        for(int r = tid; r < config::block_m; r += blockDim.x)
+        {
+            const index_t row = block_row + r;
+            if(row < M)
+            {
+                float best_dist  = lds_dist[r];
+                int   best_index = lds_index[r];
+                for(int w = 1; w < config::warps_n; ++w)
+                {
+                    const float dist  = lds_dist[w * config::block_m + r];
+                    const int   index = lds_index[w * config::block_m + r];
+                    if(argmin_before(dist, index, best_dist, best_index))
+                    {
+                        best_dist  = dist;
+                        best_index = index;
+                    }
+                }
+                argmin_dist[row * tiles_n + tile_n]  = best_dist;
+                argmin_index[row * tiles_n + tile_n] = best_index;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Merge the per-tile argmin candidates of every row
+ *
+ * @param[out] argmin     M column indices of the nearest column of B
+ * @param[out] min_dist   M distances to it (may be nullptr)
+ * @param[in]  part_dist  M × tiles_n partial minimum distances
+ * @param[in]  part_index M × tiles_n partial argmin indices
+ */
+inline __global__ void kernel_argmin_merge(int*         argmin,
+                                           float*       min_dist,
+                                           const float* part_dist,
+                                           const int*   part_index,
+                                           size_t       M,
+                                           int          tiles_n)
+{
+    for(size_t row = size_t(blockIdx.x) * blockDim.x + threadIdx.x; row < M;
+        row += size_t(gridDim.x) * blockDim.x)
+    {
+        float best_dist  = part_dist[row * tiles_n];
+        int   best_index = part_index[row * tiles_n];
+        for(int t = 1; t < tiles_n; ++t)
+        {
+            const float dist  = part_dist[row * tiles_n + t];
+            const int   index = part_index[row * tiles_n + t];
+            if(argmin_before(dist, index, best_dist, best_index))
+            {
+                best_dist  = dist;
+                best_index = index;
+            }
+        }
+        argmin[row] = best_index;
+        if(min_dist != nullptr)
+        {
+            min_dist[row] = best_dist;
+        }
+    }
+}
+
+/**
+ * @brief Workspace required by hgemm_l2_distance_gpu for the argmin, in bytes
+ */
+template<kernel_type K_TYPE>
+size_t distance_workspace_size(size_t M, size_t N)
+{
+    const size_t tiles_n = (N + wmma_config<K_TYPE>::block_n - 1) / wmma_config<K_TYPE>::block_n;
+    return M * tiles_n * (sizeof(float) + sizeof(int));
+}
+
+/**
+ * Function Definition for the pairwise L2 distance GEMM
+ *
+ * @tparam K_TYPE   The type of kernel, 'kernel_type::wmma_opt_4_wgp' (wmma_opt_4 under -mcumode)
+ * @param D         M × N distances (row-major), or nullptr to only compute the argmin
+ * @param argmin    M indices of the nearest column of B per row, or nullptr to skip
+ * @param min_dist  M distances to the nearest column (may be nullptr)
+ * @param A         Points as rows of A (stored in column-major format)
+ * @param B         Points as columns of B (stored in row-major format)
+ * @param M         Number of rows in matrix A
+ * @param N         Number of columns in matrix B
+ * @param K         Dimension of the points
+ * @param take_sqrt Whether to emit ||a - b|| instead of ||a - b||²
+ * @param workspace Device workspace of distance_workspace_size() bytes (argmin only)
+ * @param stream    HIP stream to execute kernel
+ */
+template<kernel_type K_TYPE>
+__host__ void hgemm_l2_distance_gpu(half*        D,
+                                    int*         argmin,
+                                    float*       min_dist,
+                                    half*        A,
+                                    half*        B,
+                                    size_t       M,
+                                    size_t       N,
+                                    size_t       K,
+                                    bool         take_sqrt,
+                                    void*        workspace,
+                                    hipStream_t& stream)
+{
+    const int tiles_n = (N + wmma_config<K_TYPE>::block_n - 1) / wmma_config<K_TYPE>::block_n;
+
+    float* part_dist  = argmin != nullptr ? static_cast<float*>(workspace) : nullptr;
+    int*   part_index = argmin != nullptr ? reinterpret_cast<int*>(part_dist + M * tiles_n)
+                                          : nullptr;
+
+    epilogue_l2_distance epilogue{D, part_dist, part_index, tiles_n, take_sqrt};
+    hgemm_gpu<K_TYPE>(nullptr, A, B, M, N, K, epilogue, stream);
+
+    if(argmin != nullptr)
+    {
+        constexpr int block_size = 256;
+        const int     grid_size  = std::min<size_t>((M + block_size - 1) / block_size, 1024);
+        kernel_argmin_merge<<<grid_size, block_size, 0, stream>>>(argmin,
+                                                                  min_dist,
+                                                                  part_dist,
+                                                                  part_index,
+                                                                  M,
+                                                                  tiles_n);
+    }
+}
+
+#endif // HIP_DISTANCE_HPP
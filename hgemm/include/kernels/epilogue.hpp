@@ -0,0 +1,327 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_EPILOGUE_HPP
+#define HIP_EPILOGUE_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <hip/hip_runtime.h>
+#include <kernels/common.hpp>
+#include <type_traits>
+
+/**
+ * Compile-time epilogue expression trees
+ *
+ * An epilogue is a tree of small functors evaluated on every accumulator before it is stored.
+ * Each node is called as node(acc, row, col) with the fp16 accumulator widened to fp32 and the
+ * global output coordinates, and returns the fp32 value to pass to its parent. Leaves either
+ * forward the accumulator, return a constant, or load from an auxiliary tensor; inner nodes apply
+ * elementwise operators. Trees are plain aggregates passed by value as kernel arguments, so the
+ * same tree runs on the device (with device pointers) and on the host (with host pointers).
+ *
+ * Example: C = relu(alpha * (A × B) + bias[col])
+ * @code
+ * auto epi = epilogue_relu(epilogue_add(epilogue_mul(epilogue_acc{}, epilogue_scalar{alpha}),
+ *                                       epilogue_col_vector{d_bias}));
+ * hgemm_gpu<kernel_type::wmma_opt_4_wgp>(d_C, d_A, d_B, M, N, K, epi, stream);
+ * @endcode
+ */
+
+/**
+ * @brief Leaf returning the GEMM accumulator
+ */
+struct epilogue_acc
+{
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t, index_t) const
+    {
+        return acc;
+    }
+};
+
+/**
+ * @brief Leaf returning a runtime constant (e.g. alpha)
+ */
+struct epilogue_scalar
+{
+    float value;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float, index_t, index_t) const
+    {
+        return value;
+    }
+};
+
+/**
+ * @brief Leaf loading one value per output row (length M vector, e.g. a per-token scale)
+ */
+struct epilogue_row_vector
+{
+    const half* data;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float, index_t row, index_t) const
+    {
+        return static_cast<float>(data[row]);
+    }
+};
+
+/**
+ * @brief Leaf loading one value per output column (length N vector, e.g. a bias)
+ */
+struct epilogue_col_vector
+{
+    const half* data;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float, index_t, index_t col) const
+    {
+        return static_cast<float>(data[col]);
+    }
+};
+
+/**
+ * @brief Leaf loading from a row-major M × N auxiliary matrix (e.g. a residual)
+ */
+struct epilogue_matrix
+{
+    const half* data;
+    int64_t     ld;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float, index_t row, index_t col) const
+    {
+        return static_cast<float>(data[row_major_offset<index_t>(row, col, ld)]);
+    }
+};
+
+/**
+ * @brief Leaf loading from a strided auxiliary tensor, where zero strides broadcast
+ *
+ * Covers row- and column-major matrices as well as row and column vectors with one node type,
+ * for trees whose operand shapes are only known at run time.
+ */
+struct epilogue_strided
+{
+    const half* data;
+    int64_t     row_stride;
+    int64_t     col_stride;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float, index_t row, index_t col) const
+    {
+        return static_cast<float>(data[static_cast<int64_t>(row) * row_stride
+                                       + static_cast<int64_t>(col) * col_stride]);
+    }
+};
+
+/**
+ * @brief Inner node applying a unary operator to its child
+ */
+template<class Op, class Child>
+struct epilogue_unary
+{
+    Op    op;
+    Child child;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t row, index_t col) const
+    {
+        return op(child(acc, row, col));
+    }
+};
+
+/**
+ * @brief Inner node applying a binary operator to its two children
+ */
+template<class Op, class Lhs, class Rhs>
+struct epilogue_binary
+{
+    Op  op;
+    Lhs lhs;
+    Rhs rhs;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t row, index_t col) const
+    {
+        return op(lhs(acc, row, col), rhs(acc, row, col));
+    }
+};
+
+/**
+ * @brief Inner node rounding its child through type T (e.g. to match an fp16 intermediate)
+ */
+template<class T, class Child>
+struct epilogue_cast
+{
+    Child child;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t row, index_t col) const
+    {
+        return static_cast<float>(static_cast<T>(child(acc, row, col)));
+    }
+};
+
+// Elementwise operators
+struct op_add
+{
+    __host__ __device__ __forceinline__ float operator()(float a, float b) const
+    {
+        return a + b;
+    }
+};
+
+struct op_sub
+{
+    __host__ __device__ __forceinline__ float operator()(float a, float b) const
+    {
+        return a - b;
+    }
+};
+
+struct op_mul
+{
+    __host__ __device__ __forceinline__ float operator()(float a, float b) const
+    {
+        return a * b;
+    }
+};
+
+struct op_relu
+{
+    __host__ __device__ __forceinline__ float operator()(float x) const
+    {
+        return x > 0.0f ? x : 0.0f;
+    }
+};
+
+struct op_gelu
+{
+    // tanh approximation
+    __host__ __device__ __forceinline__ float operator()(float x) const
+    {
+        constexpr float k0 = 0.7978845608f; // sqrt(2 / pi)
+        constexpr float k1 = 0.044715f;
+        return 0.5f * x * (1.0f + tanhf(k0 * (x + k1 * x * x * x)));
+    }
+};
+
+struct op_silu
+{
+    __host__ __device__ __forceinline__ float operator()(float x) const
+    {
+        return x / (1.0f + expf(-x));
+    }
+};
+
+struct op_clamp
+{
+    float lo;
+    float hi;
+
+    __host__ __device__ __forceinline__ float operator()(float x) const
+    {
+        return x < lo ? lo : (x > hi ? hi : x);
+    }
+};
+
+// Builders for readable tree construction
+template<class Lhs, class Rhs>
+__host__ __device__ epilogue_binary<op_add, Lhs, Rhs> epilogue_add(Lhs lhs, Rhs rhs)
+{
+    return {op_add{}, lhs, rhs};
+}
+
+template<class Lhs, class Rhs>
+__host__ __device__ epilogue_binary<op_sub, Lhs, Rhs> epilogue_sub(Lhs lhs, Rhs rhs)
+{
+    return {op_sub{}, lhs, rhs};
+}
+
+template<class Lhs, class Rhs>
+__host__ __device__ epilogue_binary<op_mul, Lhs, Rhs> epilogue_mul(Lhs lhs, Rhs rhs)
+{
+    return {op_mul{}, lhs, rhs};
+}
+
+template<class Child>
+__host__ __device__ epilogue_unary<op_relu, Child> epilogue_relu(Child child)
+{
+    return {op_relu{}, child};
+}
+
+template<class Child>
+__host__ __device__ epilogue_unary<op_gelu, Child> epilogue_gelu(Child child)
+{
+    return {op_gelu{}, child};
+}
+
+template<class Child>
+__host__ __device__ epilogue_unary<op_silu, Child> epilogue_silu(Child child)
+{
+    return {op_silu{}, child};
+}
+
+template<class Child>
+__host__ __device__ epilogue_unary<op_clamp, Child> epilogue_clamp(Child child, float lo, float hi)
+{
+    return {op_clamp{lo, hi}, child};
+}
+
+template<class T, class Child>
+__host__ __device__ epilogue_cast<T, Child> epilogue_cast_to(Child child)
+{
+    return {child};
+}
+
+/**
+ * @brief Whether an epilogue is the identity, in which case kernels skip evaluating it
+ */
+template<class Epilogue>
+constexpr bool is_identity_epilogue = std::is_same_v<Epilogue, epilogue_acc>;
+
+/**
+ * @brief Whether an epilogue replaces the store stage of a kernel
+ *
+ * Such epilogues declare a tile_store_tag and provide
+ * store_tile<config, index_t>(c_frags, lds, block_row, block_col, M, N), which is called by every
+ * thread of the workgroup after the elementwise part (operator()) has been applied.
+ */
+template<class Epilogue>
+constexpr bool has_tile_store = requires { typename Epilogue::tile_store_tag; };
+
+/**
+ * @brief Whether an epilogue needs the squared norms of the A rows and B columns of its tile
+ *
+ * Kernels accumulate them while staging A and B and leave them in LDS as floats (rows of A at
+ * [0, block_m), columns of B at [block_m, block_m + block_n)) before calling store_tile.
+ */
+template<class Epilogue>
+constexpr bool needs_operand_norms = requires { typename Epilogue::operand_norms_tag; };
+
+#endif // HIP_EPILOGUE_HPP
@@ -0,0 +1,697 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIP_EXPRESSION_HPP
+#define HIP_EXPRESSION_HPP
+
+#include <algorithm>
+#include <common/hip_utils.hpp>
+#include <common/matrix.hpp>
+#include <hip/hip_runtime.h>
+#include <kernels/contraction.hpp>
+#include <kernels/epilogue.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Lazy matrix expressions
+ *
+ * Arithmetic on matrix and device_matrix builds an expression tree instead of computing
+ * anything; assign() then compiles the whole tree. An expression with a single product of two
+ * matrices, such as relu(A * B + bias) * scale, becomes one fused GEMM whose epilogue is the
+ * rest of the tree. Anything else falls back to materializing each product with its own GEMM
+ * and evaluating the remainder with one elementwise kernel. Host matrices are evaluated with
+ * the CPU reference (see hgemm.hpp) following the same plan.
+ *
+ * In elementwise operations, 1 × N and M × 1 operands broadcast over rows and columns. Leaves
+ * refer to their matrices, so an expression must be assigned within the full-expression that
+ * builds it.
+ *
+ * @code
+ * device_matrix<matrix_layout::col_major> A(M, K);
+ * device_matrix<matrix_layout::row_major> B(K, N), bias(1, N), C(M, N);
+ * assign(C, relu(A * B + bias) * 0.5f, stream);
+ * @endcode
+ */
+
+/**
+ * @brief Owning device buffer of half values with the shape API of matrix
+ */
+template<matrix_layout Layout = matrix_layout::row_major>
+class device_matrix
+{
+public:
+    device_matrix(size_t m, size_t n) : m_(m), n_(n)
+    {
+        HIP_CHECK(hipMalloc(&data_, std::max<size_t>(m * n, 1) * sizeof(half)));
+    }
+
+    explicit device_matrix(const matrix<half, Layout>& host) : device_matrix(host.m(), host.n())
+    {
+        HIP_CHECK(hipMemcpy(data_, host.data(), size() * sizeof(half), hipMemcpyHostToDevice));
+    }
+
+    device_matrix(const device_matrix&)            = delete;
+    device_matrix& operator=(const device_matrix&) = delete;
+
+    device_matrix(device_matrix&& other) noexcept
+        : m_(other.m_), n_(other.n_), data_(std::exchange(other.data_, nullptr))
+    {}
+
+    ~device_matrix()
+    {
+        if(data_ != nullptr)
+        {
+            HIP_CHECK(hipFree(data_));
+        }
+    }
+
+    /**
+     * @brief Copy the contents to a host matrix of the same shape and layout
+     */
+    void copy_to(matrix<half, Layout>& host) const
+    {
+        HIP_CHECK(hipMemcpy(host.data(), data_, size() * sizeof(half), hipMemcpyDeviceToHost));
+    }
+
+    half* data()
+    {
+        return data_;
+    }
+
+    const half* data() const
+    {
+        return data_;
+    }
+
+    size_t m() const
+    {
+        return m_;
+    }
+
+    size_t n() const
+    {
+        return n_;
+    }
+
+    size_t size() const
+    {
+        return m_ * n_;
+    }
+
+    static constexpr matrix_layout layout = Layout;
+
+private:
+    size_t m_;
+    size_t n_;
+    half*  data_ = nullptr;
+};
+
+// Expression nodes
+template<class Mat>
+struct expr_leaf
+{
+    const Mat* mat;
+};
+
+struct expr_scalar
+{
+    float value;
+};
+
+template<class Lhs, class Rhs>
+struct expr_product
+{
+    Lhs lhs;
+    Rhs rhs;
+};
+
+template<class Op, class Child>
+struct expr_unary
+{
+    Op    op;
+    Child child;
+};
+
+template<class Op, class Lhs, class Rhs>
+struct expr_binary
+{
+    Op  op;
+    Lhs lhs;
+    Rhs rhs;
+};
+
+template<class T>
+constexpr bool is_matrix_operand = false;
+
+template<matrix_layout L>
+constexpr bool is_matrix_operand<matrix<half, L>> = true;
+
+template<matrix_layout L>
+constexpr bool is_matrix_operand<device_matrix<L>> = true;
+
+template<class T>
+constexpr bool is_expr_node = false;
+
+template<class Mat>
+constexpr bool is_expr_node<expr_leaf<Mat>> = true;
+
+template<>
+constexpr bool is_expr_node<expr_scalar> = true;
+
+template<class Lhs, class Rhs>
+constexpr bool is_expr_node<expr_product<Lhs, Rhs>> = true;
+
+template<class Op, class Child>
+constexpr bool is_expr_node<expr_unary<Op, Child>> = true;
+
+template<class Op, class Lhs, class Rhs>
+constexpr bool is_expr_node<expr_binary<Op, Lhs, Rhs>> = true;
+
+/**
+ * @brief A matrix or an expression over matrices
+ */
+template<class T>
+concept matrix_expression
+    = is_matrix_operand<std::remove_cvref_t<T>> || is_expr_node<std::remove_cvref_t<T>>;
+
+template<matrix_expression T>
+auto as_expr(const T& x)
+{
+    if constexpr(is_matrix_operand<T>)
+    {
+        return expr_leaf<T>{&x};
+    }
+    else
+    {
+        return x;
+    }
+}
+
+template<class T>
+using expr_t = decltype(as_expr(std::declval<const T&>()));
+
+// Matrix product
+template<matrix_expression Lhs, matrix_expression Rhs>
+expr_product<expr_t<Lhs>, expr_t<Rhs>> operator*(const Lhs& lhs, const Rhs& rhs)
+{
+    return {as_expr(lhs), as_expr(rhs)};
+}
+
+// Elementwise operators, with scalars on either side
+#define HGEMM_EXPR_BINARY_OPERATOR(SYMBOL, OP)                                                 \
+    template<matrix_expression Lhs, matrix_expression Rhs>                                     \
+    expr_binary<OP, expr_t<Lhs>, expr_t<Rhs>> operator SYMBOL(const Lhs& lhs, const Rhs& rhs) \
+    {                                                                                          \
+        return {OP{}, as_expr(lhs), as_expr(rhs)};                                             \
+    }                                                                                          \
+    template<matrix_expression Lhs>                                                            \
+    expr_binary<OP, expr_t<Lhs>, expr_scalar> operator SYMBOL(const Lhs& lhs, float rhs)      \
+    {                                                                                          \
+        return {OP{}, as_expr(lhs), expr_scalar{rhs}};                                         \
+    }                                                                                          \
+    template<matrix_expression Rhs>                                                            \
+    expr_binary<OP, expr_scalar, expr_t<Rhs>> operator SYMBOL(float lhs, const Rhs& rhs)      \
+    {                                                                                          \
+        return {OP{}, expr_scalar{lhs}, as_expr(rhs)};                                         \
+    }
+
+HGEMM_EXPR_BINARY_OPERATOR(+, op_add)
+HGEMM_EXPR_BINARY_OPERATOR(-, op_sub)
+
+#undef HGEMM_EXPR_BINARY_OPERATOR
+
+template<matrix_expression Lhs>
+expr_binary<op_mul, expr_t<Lhs>, expr_scalar> operator*(const Lhs& lhs, float rhs)
+{
+    return {op_mul{}, as_expr(lhs), expr_scalar{rhs}};
+}
+
+template<matrix_expression Rhs>
+expr_binary<op_mul, expr_scalar, expr_t<Rhs>> operator*(float lhs, const Rhs& rhs)
+{
+    return {op_mul{}, expr_scalar{lhs}, as_expr(rhs)};
+}
+
+/**
+ * @brief Elementwise product (operator* is the matrix product)
+ */
+template<matrix_expression Lhs, matrix_expression Rhs>
+expr_binary<op_mul, expr_t<Lhs>, expr_t<Rhs>> hadamard(const Lhs& lhs, const Rhs& rhs)
+{
+    return {op_mul{}, as_expr(lhs), as_expr(rhs)};
+}
+
+template<matrix_expression Child>
+expr_unary<op_relu, expr_t<Child>> relu(const Child& child)
+{
+    return {op_relu{}, as_expr(child)};
+}
+
+template<matrix_expression Child>
+expr_unary<op_gelu, expr_t<Child>> gelu(const Child& child)
+{
+    return {op_gelu{}, as_expr(child)};
+}
+
+template<matrix_expression Child>
+expr_unary<op_silu, expr_t<Child>> silu(const Child& child)
+{
+    return {op_silu{}, as_expr(child)};
+}
+
+template<matrix_expression Child>
+expr_unary<op_clamp, expr_t<Child>> clamp(const Child& child, float lo, float hi)
+{
+    return {op_clamp{lo, hi}, as_expr(child)};
+}
+
+/**
+ * @brief Number of matrix products in an expression
+ */
+template<class E>
+constexpr int product_count = 0;
+
+template<class Lhs, class Rhs>
+constexpr int product_count<expr_product<Lhs, Rhs>>
+    = 1 + product_count<Lhs> + product_count<Rhs>;
+
+template<class Op, class Child>
+constexpr int product_count<expr_unary<Op, Child>> = product_count<Child>;
+
+template<class Op, class Lhs, class Rhs>
+constexpr int product_count<expr_binary<Op, Lhs, Rhs>> = product_count<Lhs> + product_count<Rhs>;
+
+template<class E>
+constexpr bool is_expr_leaf = false;
+
+template<class Mat>
+constexpr bool is_expr_leaf<expr_leaf<Mat>> = true;
+
+template<class E>
+constexpr bool is_expr_product = false;
+
+template<class Lhs, class Rhs>
+constexpr bool is_expr_product<expr_product<Lhs, Rhs>> = true;
+
+/**
+ * @brief Storage order of a host or device matrix
+ */
+template<class Mat>
+constexpr matrix_layout layout_of = Mat::layout;
+
+template<matrix_layout L>
+constexpr matrix_layout layout_of<matrix<half, L>> = L;
+
+/**
+ * @brief Number of products of two matrices, the only ones a GEMM can read directly
+ */
+template<class E>
+constexpr int leaf_product_count = 0;
+
+template<class Lhs, class Rhs>
+constexpr int leaf_product_count<expr_product<Lhs, Rhs>> = is_expr_leaf<Lhs> && is_expr_leaf<Rhs>;
+
+template<class Op, class Child>
+constexpr int leaf_product_count<expr_unary<Op, Child>> = leaf_product_count<Child>;
+
+template<class Op, class Lhs, class Rhs>
+constexpr int leaf_product_count<expr_binary<Op, Lhs, Rhs>>
+    = leaf_product_count<Lhs> + leaf_product_count<Rhs>;
+
+/**
+ * @brief Whether an expression compiles to a single GEMM with the rest as its epilogue
+ */
+template<class E>
+constexpr bool is_fusable_expr = product_count<E> == 1 && leaf_product_count<E> == 1;
+
+struct expr_shape
+{
+    size_t rows;
+    size_t cols;
+};
+
+/**
+ * @brief Shape of an expression, checking products and broadcasts
+ *
+ * @throws std::invalid_argument on incompatible shapes
+ */
+template<class E>
+expr_shape shape_of(const E& e)
+{
+    if constexpr(is_expr_leaf<E>)
+    {
+        return {e.mat->m(), e.mat->n()};
+    }
+    else if constexpr(std::is_same_v<E, expr_scalar>)
+    {
+        return {1, 1};
+    }
+    else if constexpr(is_expr_product<E>)
+    {
+        const expr_shape lhs = shape_of(e.lhs);
+        const expr_shape rhs = shape_of(e.rhs);
+        if(lhs.cols != rhs.rows)
+        {
+            throw std::invalid_argument("matrix product dimensions do not agree");
+        }
+        return {lhs.rows, rhs.cols};
+    }
+    else if constexpr(requires { e.child; })
+    {
+        return shape_of(e.child);
+    }
+    else
+    {
+        const expr_shape lhs   = shape_of(e.lhs);
+        const expr_shape rhs   = shape_of(e.rhs);
+        auto             merge = [](size_t a, size_t b)
+        {
+            if(a != b && a != 1 && b != 1)
+            {
+                throw std::invalid_argument("elementwise operand shapes do not broadcast");
+            }
+            return a == 1 ? b : a;
+        };
+        return {merge(lhs.rows, rhs.rows), merge(lhs.cols, rhs.cols)};
+    }
+}
+
+/**
+ * @brief The single product of a fusable expression
+ */
+template<class E>
+const auto& find_product(const E& e)
+{
+    if constexpr(is_expr_product<E>)
+    {
+        return e;
+    }
+    else if constexpr(requires { e.child; })
+    {
+        return find_product(e.child);
+    }
+    else if constexpr(product_count<decltype(e.lhs)> == 1)
+    {
+        return find_product(e.lhs);
+    }
+    else
+    {
+        return find_product(e.rhs);
+    }
+}
+
+/**
+ * @brief Epilogue leaf reading a matrix broadcast to the output shape
+ */
+inline epilogue_strided
+    broadcast_leaf(const half* data, size_t rows, size_t cols, matrix_layout layout, expr_shape out)
+{
+    const bool    row_major  = layout == matrix_layout::row_major;
+    const int64_t row_stride = row_major ? static_cast<int64_t>(cols) : 1;
+    const int64_t col_stride = row_major ? 1 : static_cast<int64_t>(rows);
+    return {data,
+            rows == 1 && out.rows != 1 ? 0 : row_stride,
+            cols == 1 && out.cols != 1 ? 0 : col_stride};
+}
+
+/**
+ * @brief Translate an expression into an epilogue tree for the given backend
+ *
+ * @tparam FUSE Whether the (single) product is the GEMM accumulator; otherwise every product
+ *              is materialized by the backend and read like any other matrix
+ */
+template<bool FUSE, class Backend, class E>
+auto to_epilogue(const E& e, Backend& backend, expr_shape out)
+{
+    if constexpr(is_expr_leaf<E>)
+    {
+        return broadcast_leaf(backend.pointer(*e.mat),
+                              e.mat->m(),
+                              e.mat->n(),
+                              layout_of<std::remove_cvref_t<decltype(*e.mat)>>,
+                              out);
+    }
+    else if constexpr(std::is_same_v<E, expr_scalar>)
+    {
+        return epilogue_scalar{e.value};
+    }
+    else if constexpr(requires { e.child; })
+    {
+        auto child = to_epilogue<FUSE>(e.child, backend, out);
+        return epilogue_unary<decltype(e.op), decltype(child)>{e.op, child};
+    }
+    else if constexpr(requires { e.op; })
+    {
+        auto lhs = to_epilogue<FUSE>(e.lhs, backend, out);
+        auto rhs = to_epilogue<FUSE>(e.rhs, backend, out);
+        return epilogue_binary<decltype(e.op), decltype(lhs), decltype(rhs)>{e.op, lhs, rhs};
+    }
+    else if constexpr(FUSE)
+    {
+        return epilogue_acc{};
+    }
+    else
+    {
+        const expr_shape shape = shape_of(e);
+        return broadcast_leaf(
+            backend.materialize(e), shape.rows, shape.cols, matrix_layout::row_major, out);
+    }
+}
+
+/**
+ * @brief Evaluate an expression into dst with a backend (device_expr_backend or the CPU one)
+ */
+template<class Backend, class Dst, class E>
+void evaluate_expr(Backend& backend, Dst& dst, const E& e)
+{
+    const expr_shape shape = shape_of(e);
+    if(shape.rows != dst.m() || shape.cols != dst.n())
+    {
+        throw std::invalid_argument("expression shape does not match its destination");
+    }
+
+    if constexpr(is_fusable_expr<E>)
+    {
+        // The accumulator only covers the output when the product is not itself broadcast
+        const expr_shape product = shape_of(find_product(e));
+        if(product.rows == shape.rows && product.cols == shape.cols)
+        {
+            backend.fused(dst, find_product(e), to_epilogue<true>(e, backend, shape));
+            return;
+        }
+    }
+    backend.elementwise(dst, to_epilogue<false>(e, backend, shape));
+}
+
+/**
+ * @brief Elementwise evaluation of an epilogue tree without a GEMM (the accumulator is zero)
+ */
+template<class Tree>
+__global__ void kernel_elementwise(half* C, Tree tree, int64_t M, int64_t N)
+{
+    for(int64_t e = static_cast<int64_t>(blockIdx.x) * blockDim.x + threadIdx.x; e < M * N;
+        e += static_cast<int64_t>(gridDim.x) * blockDim.x)
+    {
+        C[e] = static_cast<half>(tree(0.0f, e / N, e % N));
+    }
+}
+
+/**
+ * @brief Non-owning view of a row-major device temporary, with the shape API of matrix
+ */
+struct device_matrix_view
+{
+    half*  ptr;
+    size_t rows;
+    size_t cols;
+
+    half* data() const
+    {
+        return ptr;
+    }
+
+    size_t m() const
+    {
+        return rows;
+    }
+
+    size_t n() const
+    {
+        return cols;
+    }
+
+    static constexpr matrix_layout layout = matrix_layout::row_major;
+};
+
+/**
+ * @brief Device backend: products run on K_TYPE, which reads A column-major and B row-major
+ *
+ * Temporaries live until the backend is destroyed at the end of assign().
+ */
+template<kernel_type K_TYPE>
+class device_expr_backend
+{
+public:
+    explicit device_expr_backend(hipStream_t& stream) : stream_(stream) {}
+
+    device_expr_backend(const device_expr_backend&)            = delete;
+    device_expr_backend& operator=(const device_expr_backend&) = delete;
+
+    ~device_expr_backend()
+    {
+        for(half* temp : temps_)
+        {
+            HIP_CHECK(hipFree(temp));
+        }
+    }
+
+    template<matrix_layout L>
+    const half* pointer(const device_matrix<L>& m) const
+    {
+        return m.data();
+    }
+
+    template<matrix_layout L>
+    const half* pointer(const matrix<half, L>&) const
+    {
+        static_assert(L != L, "Host matrices cannot be used in a device expression");
+        return nullptr;
+    }
+
+    template<class Dst, class Product, class Tree>
+    void fused(Dst& dst, const Product& product, const Tree& tree)
+    {
+        const expr_shape lhs = shape_of(product.lhs);
+        const expr_shape rhs = shape_of(product.rhs);
+        hgemm_gpu<K_TYPE>(dst.data(),
+                          operand(product.lhs, matrix_layout::col_major),
+                          operand(product.rhs, matrix_layout::row_major),
+                          lhs.rows,
+                          rhs.cols,
+                          lhs.cols,
+                          tree,
+                          stream_);
+    }
+
+    template<class Dst, class Tree>
+    void elementwise(Dst& dst, const Tree& tree)
+    {
+        const size_t count = dst.m() * dst.n();
+        const dim3   grid_dim(
+            static_cast<unsigned int>(std::min<size_t>((count + 255) / 256, 65536)));
+        kernel_elementwise<<<grid_dim, dim3(256), 0, stream_>>>(
+            dst.data(), tree, static_cast<int64_t>(dst.m()), static_cast<int64_t>(dst.n()));
+    }
+
+    /**
+     * @brief Run a product on its own into a row-major temporary
+     */
+    template<class Product>
+    const half* materialize(const Product& product)
+    {
+        const expr_shape lhs = shape_of(product.lhs);
+        const expr_shape rhs = shape_of(product.rhs);
+        half*            dst = allocate(lhs.rows * rhs.cols);
+        hgemm_gpu<K_TYPE>(dst,
+                          operand(product.lhs, matrix_layout::col_major),
+                          operand(product.rhs, matrix_layout::row_major),
+                          lhs.rows,
+                          rhs.cols,
+                          lhs.cols,
+                          stream_);
+        return dst;
+    }
+
+private:
+    half* allocate(size_t elements)
+    {
+        half* temp;
+        HIP_CHECK(hipMalloc(&temp, std::max<size_t>(elements, 1) * sizeof(half)));
+        temps_.push_back(temp);
+        return temp;
+    }
+
+    /**
+     * @brief A GEMM operand in the required layout, evaluating or transposing it as needed
+     */
+    template<class E>
+    half* operand(const E& e, matrix_layout required)
+    {
+        const expr_shape shape = shape_of(e);
+        const half*      data;
+        matrix_layout    layout;
+        if constexpr(is_expr_leaf<E>)
+        {
+            data   = pointer(*e.mat);
+            layout = layout_of<std::remove_cvref_t<decltype(*e.mat)>>;
+        }
+        else
+        {
+            device_matrix_view view{allocate(shape.rows * shape.cols), shape.rows, shape.cols};
+            evaluate_expr(*this, view, e);
+            data   = view.data();
+            layout = matrix_layout::row_major;
+        }
+
+        // Vectors read the same in either layout
+        if(layout == required || shape.rows == 1 || shape.cols == 1)
+        {
+            // The kernels never write A or B, they only lack const in their signatures
+            return const_cast<half*>(data);
+        }
+
+        operand_plan copy;
+        copy.sizes   = {shape.rows, shape.cols};
+        copy.strides = layout == matrix_layout::row_major
+                           ? std::vector<int64_t>{static_cast<int64_t>(shape.cols), 1}
+                           : std::vector<int64_t>{1, static_cast<int64_t>(shape.rows)};
+        copy.packed  = layout == matrix_layout::row_major
+                           ? std::vector<int64_t>{1, static_cast<int64_t>(shape.rows)}
+                           : std::vector<int64_t>{static_cast<int64_t>(shape.cols), 1};
+        half* transposed = allocate(shape.rows * shape.cols);
+        launch_operand_copy(transposed, data, copy, true, stream_);
+        return transposed;
+    }
+
+    hipStream_t&       stream_;
+    std::vector<half*> temps_;
+};
+
+/**
+ * @brief Evaluate an expression over device matrices into a row-major device matrix
+ *
+ * @tparam K_TYPE wmma_opt_4_wgp (or wmma_opt_4 under -mcumode), which provide the fused epilogue
+ */
+template<kernel_type K_TYPE = kernel_type::wmma_opt_4_wgp, matrix_expression E>
+void assign(device_matrix<matrix_layout::row_major>& dst, const E& expr, hipStream_t& stream)
+{
+    device_expr_backend<K_TYPE> backend(stream);
+    evaluate_expr(backend, dst, as_expr(expr));
+}
+
+#endif // HIP_EXPRESSION_HPP
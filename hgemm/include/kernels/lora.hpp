@@ -0,0 +1,489 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef HIP_LORA_HPP
+#define HIP_LORA_HPP
+
+#include <algorithm>
+#include <common/hip_utils.hpp>
+#include <cstdint>
+#include <hip/hip_runtime.h>
+#include <kernels/common.hpp>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Segmented multi-LoRA GEMMs (shrink/expand, as in punica's SGMV)
+ *
+ * A batch of T rows is split into contiguous segments, each multiplying against its own
+ * low-rank adapter: Y[rows of s] += scale · X[rows of s] · Aᵀ[a] · Bᵀ[a] with a = adapter of s.
+ * Instead of one launch per adapter, both steps run as single launches over a table of 16-row
+ * tiles, each tile lying inside one segment and carrying its adapter index.
+ *
+ * - shrink: U = X · Aᵀ, N = rank ≤ 64, so a workgroup covers all ranks of its tile with the
+ *   fp32-accumulating WMMA and K = H_in is split across warps and workgroups. Every split
+ *   writes fp32 partials to the workspace.
+ * - expand: Y += scale · U · Bᵀ, K = rank, each warp sums the shrink partials of its tile
+ *   into the A operand once and sweeps lora_expand_tiles column tiles of H_out, adding the
+ *   result to the base output in place.
+ *
+ * Layouts (all row-major, weights in the [out][in] layout of a linear layer):
+ *   X: T × H_in    Y: T × H_out    A: (adapters × rank) × H_in    B: (adapters × H_out) × rank
+ */
+
+constexpr int lora_warps        = 4;
+constexpr int lora_expand_tiles = 4;
+constexpr int lora_max_rank     = 64;
+
+/**
+ * @brief Up to 16 consecutive rows of one segment, all multiplied by the same adapter
+ */
+struct lora_tile
+{
+    int32_t row;
+    int32_t rows;
+    int32_t adapter;
+};
+
+/**
+ * @brief Split a segmented batch into 16-row tiles
+ *
+ * @param starts   Segment boundaries, segment s covers rows [starts[s], starts[s + 1])
+ * @param adapters Adapter index per segment, negative for rows without an adapter
+ * @return Tiles of every segment with an adapter, in row order
+ * @throws std::invalid_argument if the boundaries are not non-decreasing from 0
+ */
+inline std::vector<lora_tile> plan_lora_tiles(const std::vector<int32_t>& starts,
+                                              const std::vector<int32_t>& adapters)
+{
+    if(starts.size() != adapters.size() + 1 || starts.front() != 0
+       || !std::is_sorted(starts.begin(), starts.end()))
+    {
+        throw std::invalid_argument(
+            "LoRA segments need non-decreasing boundaries from 0, one more than adapters");
+    }
+
+    std::vector<lora_tile> tiles;
+    for(size_t s = 0; s < adapters.size(); ++s)
+    {
+        if(adapters[s] < 0)
+        {
+            continue;
+        }
+        for(int32_t row = starts[s]; row < starts[s + 1]; row += wmma_tile)
+        {
+            tiles.push_back({row, std::min<int32_t>(wmma_tile, starts[s + 1] - row), adapters[s]});
+        }
+    }
+    return tiles;
+}
+
+/**
+ * @brief Shrink step, one workgroup per (tile, K split)
+ *
+ * @tparam RANK_TILES Rank padded to 16-column tiles
+ * @param partial splits × T × (16 · RANK_TILES) fp32 partials of U
+ */
+template<int RANK_TILES>
+__global__ void __launch_bounds__(warp_size* lora_warps)
+    kernel_lora_shrink(float*           partial,
+                       const half*      X,
+                       const half*      A,
+                       const lora_tile* tiles,
+                       int              T,
+                       int              H_in,
+                       int              rank,
+                       int              split_len)
+{
+    constexpr int rank_pad  = RANK_TILES * wmma_tile;
+    constexpr int half_warp = warp_size / 2;
+
+    __shared__ float lds_acc[lora_warps][wmma_tile * rank_pad];
+
+    const int warp_id      = threadIdx.x / warp_size;
+    const int lane_id      = threadIdx.x % warp_size;
+    const int half_warp_id = lane_id / half_warp;
+    const int half_lane    = lane_id % half_warp;
+
+    const lora_tile tile  = tiles[blockIdx.x];
+    const int       split = blockIdx.y;
+
+    // A operand: lane row half_lane of the tile, B operand: lane column half_lane of each rank
+    // tile, i.e. row t * 16 + half_lane of the adapter's A
+    const bool   row_valid = half_lane < tile.rows;
+    const half*  x_row     = X + static_cast<size_t>(tile.row + half_lane) * H_in;
+    const half*  a_rows    = A + static_cast<size_t>(tile.adapter) * rank * H_in;
+
+    float8 acc[RANK_TILES] = {};
+
+    const int k_end = min((split + 1) * split_len, H_in);
+    for(int k0 = split * split_len + warp_id * wmma_tile; k0 < k_end; k0 += lora_warps * wmma_tile)
+    {
+        const half16 x_frag
+            = row_valid ? *reinterpret_cast<const half16*>(x_row + k0) : half16{};
+#pragma unroll
+        for(int t = 0; t < RANK_TILES; ++t)
+        {
+            const int    r      = t * wmma_tile + half_lane;
+            const half16 a_frag = r < rank ? *reinterpret_cast<const half16*>(
+                                      a_rows + static_cast<size_t>(r) * H_in + k0)
+                                           : half16{};
+            acc[t] = __builtin_amdgcn_wmma_f32_16x16x16_f16_w32(x_frag, a_frag, acc[t]);
+        }
+    }
+
+    // Sum the warps' slices of K in a fixed order
+#pragma unroll
+    for(int t = 0; t < RANK_TILES; ++t)
+    {
+        for(int i = 0; i < wmma_tile / 2; ++i)
+        {
+            lds_acc[warp_id][(i * 2 + half_warp_id) * rank_pad + t * wmma_tile + half_lane]
+                = acc[t][i];
+        }
+    }
+    __syncthreads();
+
+    for(int e = threadIdx.x; e < tile.rows * rank_pad; e += blockDim.x)
+    {
+        float sum = 0.0f;
+        for(int w = 0; w < lora_warps; ++w)
+        {
+            sum += lds_acc[w][e];
+        }
+        partial[(static_cast<size_t>(split) * T + tile.row) * rank_pad + e] = sum;
+    }
+}
+
+/**
+ * @brief Expand step, one workgroup per (tile, lora_warps · lora_expand_tiles column tiles)
+ *
+ * @tparam RANK_TILES Rank padded to 16-column tiles
+ */
+template<int RANK_TILES>
+__global__ void __launch_bounds__(warp_size* lora_warps)
+    kernel_lora_expand(half*            Y,
+                       const float*     partial,
+                       const half*      B,
+                       const lora_tile* tiles,
+                       int              T,
+                       int              H_out,
+                       int              rank,
+                       int              splits,
+                       float            scale)
+{
+    constexpr int rank_pad  = RANK_TILES * wmma_tile;
+    constexpr int half_warp = warp_size / 2;
+
+    const int warp_id      = threadIdx.x / warp_size;
+    const int lane_id      = threadIdx.x % warp_size;
+    const int half_warp_id = lane_id / half_warp;
+    const int half_lane    = lane_id % half_warp;
+
+    const lora_tile tile     = tiles[blockIdx.x];
+    const int       col_base = (blockIdx.y * lora_warps + warp_id) * lora_expand_tiles * wmma_tile;
+    if(col_base >= H_out)
+    {
+        return;
+    }
+
+    // A operand: row half_lane of U, summed over the shrink splits
+    half16 u_frag[RANK_TILES] = {};
+    if(half_lane < tile.rows)
+    {
+        const float* u_row = partial + static_cast<size_t>(tile.row + half_lane) * rank_pad;
+#pragma unroll
+        for(int t = 0; t < RANK_TILES; ++t)
+        {
+            float u[wmma_tile] = {};
+            for(int s = 0; s < splits; ++s)
+            {
+                const float* src = u_row + static_cast<size_t>(s) * T * rank_pad + t * wmma_tile;
+                for(int k = 0; k < wmma_tile; ++k)
+                {
+                    u[k] += src[k];
+                }
+            }
+            for(int k = 0; k < wmma_tile; ++k)
+            {
+                u_frag[t][k] = static_cast<half>(u[k]);
+            }
+        }
+    }
+
+    const half* b_rows = B + static_cast<size_t>(tile.adapter) * H_out * rank;
+    for(int c = 0; c < lora_expand_tiles; ++c)
+    {
+        const int col = col_base + c * wmma_tile;
+        if(col >= H_out)
+        {
+            break;
+        }
+
+        // B operand: lane column half_lane is row col + half_lane of the adapter's B
+        const half* b_row = b_rows + static_cast<size_t>(col + half_lane) * rank;
+        float8      acc   = {};
+#pragma unroll
+        for(int t = 0; t < RANK_TILES; ++t)
+        {
+            half16 b_frag;
+            if(rank % wmma_tile == 0)
+            {
+                b_frag = *reinterpret_cast<const half16*>(b_row + t * wmma_tile);
+            }
+            else
+            {
+                for(int k = 0; k < wmma_tile; ++k)
+                {
+                    const int r = t * wmma_tile + k;
+                    b_frag[k]   = r < rank ? b_row[r] : static_cast<half>(0.0f);
+                }
+            }
+            acc = __builtin_amdgcn_wmma_f32_16x16x16_f16_w32(u_frag[t], b_frag, acc);
+        }
+
+        // Tiles own disjoint rows, so the base output is updated without atomics
+        for(int i = 0; i < wmma_tile / 2; ++i)
+        {
+            const int row = i * 2 + half_warp_id;
+            if(row < tile.rows)
+            {
+                half& y = Y[static_cast<size_t>(tile.row + row) * H_out + col + half_lane];
+                y       = static_cast<half>(static_cast<float>(y) + scale * acc[i]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Segmented multi-LoRA GEMM pair over a fixed batch layout
+ *
+ * The object owns the device tile table, which is built once per batch layout and reused for
+ * every layer, and must outlive any work it has enqueued.
+ */
+class lora_segmented
+{
+public:
+    /**
+     * @param starts   Segment boundaries, segment s covers rows [starts[s], starts[s + 1])
+     * @param adapters Adapter index per segment, negative for rows without an adapter
+     * @param H_in     Input features (multiple of 16)
+     * @param H_out    Output features (multiple of 16)
+     * @param rank     Adapter rank, 1 to 64
+     * @throws std::invalid_argument for unsupported shapes or segments
+     */
+    lora_segmented(const std::vector<int32_t>& starts,
+                   const std::vector<int32_t>& adapters,
+                   size_t                      H_in,
+                   size_t                      H_out,
+                   size_t                      rank)
+        : T_(starts.empty() ? 0 : starts.back())
+        , H_in_(H_in)
+        , H_out_(H_out)
+        , rank_(rank)
+        , tiles_(plan_lora_tiles(starts, adapters))
+    {
+        if(rank == 0 || rank > lora_max_rank)
+        {
+            throw std::invalid_argument("LoRA kernels support ranks 1 to 64");
+        }
+        if(H_in == 0 || H_out == 0 || H_in % wmma_tile != 0 || H_out % wmma_tile != 0)
+        {
+            throw std::invalid_argument("LoRA feature sizes must be non-zero multiples of 16");
+        }
+
+        // Split H_in until there are about 512 workgroups, keeping at least 256 columns each
+        constexpr size_t target_groups = 512;
+        constexpr size_t k_step        = lora_warps * wmma_tile;
+        const size_t     max_splits    = std::max<size_t>(1, H_in / 256);
+        const size_t     want_splits
+            = tiles_.empty() ? 1 : (target_groups + tiles_.size() - 1) / tiles_.size();
+        const size_t splits = std::clamp<size_t>(want_splits, 1, max_splits);
+        split_len_          = ((H_in + splits - 1) / splits + k_step - 1) / k_step * k_step;
+        splits_             = (H_in + split_len_ - 1) / split_len_;
+
+        if(!tiles_.empty())
+        {
+            HIP_CHECK(hipMalloc(&d_tiles_, tiles_.size() * sizeof(lora_tile)));
+            HIP_CHECK(hipMemcpy(d_tiles_,
+                                tiles_.data(),
+                                tiles_.size() * sizeof(lora_tile),
+                                hipMemcpyHostToDevice));
+        }
+    }
+
+    lora_segmented(const lora_segmented&)            = delete;
+    lora_segmented& operator=(const lora_segmented&) = delete;
+
+    ~lora_segmented()
+    {
+        if(d_tiles_ != nullptr)
+        {
+            HIP_CHECK(hipFree(d_tiles_));
+        }
+    }
+
+    /**
+     * @brief Workspace required by shrink and expand, in bytes
+     */
+    size_t workspace_size() const
+    {
+        return splits_ * T_ * rank_tiles() * wmma_tile * sizeof(float);
+    }
+
+    /**
+     * @brief U = X · Aᵀ per segment, left as fp32 partials in the workspace
+     *
+     * @param X         T × H_in input rows
+     * @param A         (adapters × rank) × H_in shrink weights
+     * @param workspace Device workspace of workspace_size() bytes
+     * @param stream    HIP stream to execute kernel
+     */
+    void shrink(const half* X, const half* A, void* workspace, hipStream_t& stream) const
+    {
+        if(tiles_.empty())
+        {
+            return;
+        }
+
+        dim3 grid_dim(tiles_.size(), splits_);
+        dim3 block_dim(warp_size * lora_warps);
+
+        auto launch = [&](auto kernel)
+        {
+            kernel<<<grid_dim, block_dim, 0, stream>>>(static_cast<float*>(workspace),
+                                                       X,
+                                                       A,
+                                                       d_tiles_,
+                                                       static_cast<int>(T_),
+                                                       static_cast<int>(H_in_),
+                                                       static_cast<int>(rank_),
+                                                       static_cast<int>(split_len_));
+        };
+
+        switch(rank_tiles())
+        {
+            case 1: launch(kernel_lora_shrink<1>); break;
+            case 2: launch(kernel_lora_shrink<2>); break;
+            case 3: launch(kernel_lora_shrink<3>); break;
+            default: launch(kernel_lora_shrink<4>); break;
+        }
+    }
+
+    /**
+     * @brief Y += scale · U · Bᵀ per segment, reading U from the workspace filled by shrink
+     *
+     * @param Y         T × H_out base output, updated in place (rows without adapter untouched)
+     * @param B         (adapters × H_out) × rank expand weights
+     * @param scale     LoRA scaling (alpha / rank)
+     * @param workspace Workspace passed to shrink
+     * @param stream    HIP stream to execute kernel
+     */
+    void expand(half*        Y,
+                const half*  B,
+                float        scale,
+                const void*  workspace,
+                hipStream_t& stream) const
+    {
+        if(tiles_.empty())
+        {
+            return;
+        }
+
+        constexpr size_t cols_per_group = lora_warps * lora_expand_tiles * wmma_tile;
+
+        dim3 grid_dim(tiles_.size(), (H_out_ + cols_per_group - 1) / cols_per_group);
+        dim3 block_dim(warp_size * lora_warps);
+
+        auto launch = [&](auto kernel)
+        {
+            kernel<<<grid_dim, block_dim, 0, stream>>>(Y,
+                                                       static_cast<const float*>(workspace),
+                                                       B,
+                                                       d_tiles_,
+                                                       static_cast<int>(T_),
+                                                       static_cast<int>(H_out_),
+                                                       static_cast<int>(rank_),
+                                                       static_cast<int>(splits_),
+                                                       scale);
+        };
+
+        switch(rank_tiles())
+        {
+            case 1: launch(kernel_lora_expand<1>); break;
+            case 2: launch(kernel_lora_expand<2>); break;
+            case 3: launch(kernel_lora_expand<3>); break;
+            default: launch(kernel_lora_expand<4>); break;
+        }
+    }
+
+    /**
+     * @brief Y += scale · X · Aᵀ · Bᵀ per segment (shrink followed by expand)
+     */
+    void execute(half*        Y,
+                 const half*  X,
+                 const half*  A,
+                 const half*  B,
+                 float        scale,
+                 void*        workspace,
+                 hipStream_t& stream) const
+    {
+        shrink(X, A, workspace, stream);
+        expand(Y, B, scale, workspace, stream);
+    }
+
+    const std::vector<lora_tile>& tiles() const
+    {
+        return tiles_;
+    }
+
+    size_t splits() const
+    {
+        return splits_;
+    }
+
+    size_t split_len() const
+    {
+        return split_len_;
+    }
+
+private:
+    size_t rank_tiles() const
+    {
+        return (rank_ + wmma_tile - 1) / wmma_tile;
+    }
+
+    size_t                 T_;
+    size_t                 H_in_;
+    size_t                 H_out_;
+    size_t                 rank_;
+    std::vector<lora_tile> tiles_;
+    size_t                 split_len_ = 0;
+    size_t                 splits_    = 1;
+    lora_tile*             d_tiles_   = nullptr;
+};
+
+#endif // HIP_LORA_HPP
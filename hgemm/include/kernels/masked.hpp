@@ -0,0 +1,293 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_MASKED_HPP
+#define HIP_MASKED_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <common/hip_utils.hpp>
+#include <cstdint>
+#include <hip/hip_runtime.h>
+#include <kernels/common.hpp>
+#include <kernels/epilogue.hpp>
+#include <kernels/prologue.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Band of kept output elements for causal and sliding-window attention scores
+ *
+ * Element (row, col) is kept when row + diagonal - window < col <= row + diagonal. diagonal = 0
+ * is the causal mask of square scores, diagonal = N - M aligns the last query with the last key
+ * when M new queries attend to N cached keys. window = 0 keeps every earlier key, otherwise each
+ * row keeps its window most recent keys.
+ */
+struct attention_band
+{
+    int64_t diagonal = 0;
+    int64_t window   = 0;
+
+    __host__ __device__ __forceinline__ bool contains(int64_t row, int64_t col) const
+    {
+        const int64_t d = col - row;
+        return d <= diagonal && (window <= 0 || d > diagonal - window);
+    }
+
+    /**
+     * @brief Whether any element of rows [r0, r1) × columns [c0, c1) is kept
+     *
+     * col - row takes every value in [c0 - r1 + 1, c1 - 1 - r0] on the block.
+     */
+    bool intersects(int64_t r0, int64_t r1, int64_t c0, int64_t c1) const
+    {
+        return c0 - (r1 - 1) <= diagonal && (window <= 0 || (c1 - 1) - r0 > diagonal - window);
+    }
+
+    /**
+     * @brief Whether every element of rows [r0, r1) × columns [c0, c1) is kept
+     */
+    bool covers(int64_t r0, int64_t r1, int64_t c0, int64_t c1) const
+    {
+        return (c1 - 1) - r0 <= diagonal && (window <= 0 || c0 - (r1 - 1) > diagonal - window);
+    }
+};
+
+/**
+ * @brief Epilogue node replacing elements outside an attention_band with a constant
+ */
+template<class Child>
+struct epilogue_band_mask
+{
+    Child          child;
+    attention_band band;
+    float          masked_value;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t row, index_t col) const
+    {
+        return band.contains(row, col) ? child(acc, row, col) : masked_value;
+    }
+};
+
+template<class Child>
+__host__ __device__ epilogue_band_mask<Child>
+    epilogue_mask(Child child, attention_band band, float masked_value = -INFINITY)
+{
+    return {child, band, masked_value};
+}
+
+/**
+ * @brief Output tiles of a banded GEMM
+ */
+struct band_tiles
+{
+    std::vector<uint32_t> order; // (block row, block column) packed 16:16, row by row
+    size_t                partial     = 0; // Launched tiles straddling an edge of the band
+    size_t                dense_tiles = 0; // Tiles of the unmasked GEMM
+};
+
+/**
+ * @brief Enumerate the BLOCK_M × BLOCK_N output tiles that intersect a band
+ *
+ * @throws std::invalid_argument if the tile grid does not fit the 16-bit table entries
+ */
+template<int BLOCK_M, int BLOCK_N>
+band_tiles plan_band_tiles(size_t M, size_t N, const attention_band& band)
+{
+    const size_t grid_m = (M + BLOCK_M - 1) / BLOCK_M;
+    const size_t grid_n = (N + BLOCK_N - 1) / BLOCK_N;
+    if(grid_m >= (1 << 16) || grid_n >= (1 << 16))
+    {
+        throw std::invalid_argument("Masked GEMM tile grid exceeds 65535 tiles per dimension");
+    }
+
+    band_tiles tiles;
+    tiles.dense_tiles = grid_m * grid_n;
+    for(size_t tm = 0; tm < grid_m; ++tm)
+    {
+        const int64_t r0 = static_cast<int64_t>(tm * BLOCK_M);
+        const int64_t r1 = std::min<int64_t>(r0 + BLOCK_M, M);
+        for(size_t tn = 0; tn < grid_n; ++tn)
+        {
+            const int64_t c0 = static_cast<int64_t>(tn * BLOCK_N);
+            const int64_t c1 = std::min<int64_t>(c0 + BLOCK_N, N);
+            if(!band.intersects(r0, r1, c0, c1))
+            {
+                continue;
+            }
+            tiles.order.push_back((static_cast<uint32_t>(tm) << 16) | static_cast<uint32_t>(tn));
+            tiles.partial += band.covers(r0, r1, c0, c1) ? 0 : 1;
+        }
+    }
+    return tiles;
+}
+
+/**
+ * @brief wmma_opt_4 kernel launched over a tile table, with a fused epilogue
+ */
+template<kernel_type K_TYPE, class index_t, class Epilogue>
+__global__ void __launch_bounds__(warp_size* wmma_config<K_TYPE>::total_warps)
+    kernel_hgemm_masked(half*                         C,
+                        const half*                   A,
+                        const half*                   B,
+                        std::type_identity_t<index_t> M,
+                        std::type_identity_t<index_t> N,
+                        std::type_identity_t<index_t> K,
+                        Epilogue                      epilogue,
+                        const uint32_t*               tiles)
+{
+    wmma_opt_4_impl<K_TYPE, index_t>(C, A, B, M, N, K, prologue_input{}, epilogue, tiles);
+}
+
+/**
+ * @brief GEMM restricted to an attention band, e.g. causal or sliding-window QKᵀ scores
+ *
+ * Only the tiles intersecting the band are launched, so a causal square mask runs roughly half
+ * of the dense tiles and a narrow window far fewer. Elements of launched tiles that fall outside
+ * the band are set to masked_value by the epilogue; tiles entirely outside the band are not
+ * written at all, so consumers must either skip them or pre-fill C.
+ *
+ * The object owns the device tile table and must outlive any work it has enqueued.
+ *
+ * @tparam K_TYPE 'kernel_type::wmma_opt_4_wgp', or 'kernel_type::wmma_opt_4' under -mcumode
+ */
+template<kernel_type K_TYPE>
+class masked_hgemm
+{
+    static_assert(K_TYPE == kernel_type::wmma_opt_4 || K_TYPE == kernel_type::wmma_opt_4_wgp,
+                  "Masked GEMMs are only supported by the wmma_opt_4 kernels");
+    using config = wmma_config<K_TYPE>;
+
+public:
+    /**
+     * @param M            Number of rows in matrices A and C (queries)
+     * @param N            Number of columns in matrices B and C (keys)
+     * @param K            Number of columns in matrix A/rows in matrix B (head dimension)
+     * @param band         Kept elements of C
+     * @param masked_value Value written to masked elements of launched tiles
+     */
+    masked_hgemm(size_t         M,
+                 size_t         N,
+                 size_t         K,
+                 attention_band band,
+                 float          masked_value = -INFINITY)
+        : M_(M)
+        , N_(N)
+        , K_(K)
+        , band_(band)
+        , masked_value_(masked_value)
+        , tiles_(plan_band_tiles<config::block_m, config::block_n>(M, N, band))
+    {
+        if(!tiles_.order.empty())
+        {
+            HIP_CHECK(hipMalloc(&d_tiles_, tiles_.order.size() * sizeof(uint32_t)));
+            HIP_CHECK(hipMemcpy(d_tiles_,
+                                tiles_.order.data(),
+                                tiles_.order.size() * sizeof(uint32_t),
+                                hipMemcpyHostToDevice));
+        }
+    }
+
+    masked_hgemm(const masked_hgemm&)            = delete;
+    masked_hgemm& operator=(const masked_hgemm&) = delete;
+
+    ~masked_hgemm()
+    {
+        if(d_tiles_ != nullptr)
+        {
+            HIP_CHECK(hipFree(d_tiles_));
+        }
+    }
+
+    /**
+     * @brief Computes C = mask(epilogue(A × B)) on the launched tiles
+     *
+     * @param C        Output matrix (row-major)
+     * @param A        Input matrix A (column-major)
+     * @param B        Input matrix B (row-major)
+     * @param epilogue Applied to kept elements before masking (e.g. the softmax scale)
+     * @param stream   HIP stream to execute kernel
+     */
+    template<class Epilogue = epilogue_acc>
+    void execute(half*           C,
+                 const half*     A,
+                 const half*     B,
+                 hipStream_t&    stream,
+                 const Epilogue& epilogue = {}) const
+    {
+        if(tiles_.order.empty())
+        {
+            return;
+        }
+
+        const auto masked = epilogue_mask(epilogue, band_, masked_value_);
+        using Masked      = std::decay_t<decltype(masked)>;
+
+        dim3 grid_dim(tiles_.order.size());
+        dim3 block_dim(warp_size * config::total_warps);
+        if(requires_64bit_index(M_, N_, K_))
+        {
+            kernel_hgemm_masked<K_TYPE, index_policy<true>::type, Masked>
+                <<<grid_dim, block_dim, 0, stream>>>(C, A, B, M_, N_, K_, masked, d_tiles_);
+        }
+        else
+        {
+            kernel_hgemm_masked<K_TYPE, int, Masked>
+                <<<grid_dim, block_dim, 0, stream>>>(C, A, B, M_, N_, K_, masked, d_tiles_);
+        }
+    }
+
+    /**
+     * @brief Launched tiles over tiles of the dense GEMM
+     */
+    double tile_fraction() const
+    {
+        return static_cast<double>(tiles_.order.size()) / tiles_.dense_tiles;
+    }
+
+    const band_tiles& tiles() const
+    {
+        return tiles_;
+    }
+
+    const attention_band& band() const
+    {
+        return band_;
+    }
+
+private:
+    size_t         M_;
+    size_t         N_;
+    size_t         K_;
+    attention_band band_;
+    float          masked_value_;
+    band_tiles     tiles_;
+    uint32_t*      d_tiles_ = nullptr;
+};
+
+#endif // HIP_MASKED_HPP
@@ -0,0 +1,345 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+
+#ifndef HIP_PAGED_HPP
+#define HIP_PAGED_HPP
+
+#include <common/hip_utils.hpp>
+#include <cstdint>
+#include <hip/hip_runtime.h>
+#include <kernels/buffer.hpp>
+#include <kernels/common.hpp>
+#include <kernels/epilogue.hpp>
+#include <kernels/prologue.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * @brief Placement of one sequence in a paged KV-cache pool
+ *
+ * Page p of the sequence is pool page block_table[p], which starts page_stride elements after
+ * the previous pool page. Within a page, consecutive rows are ld elements apart. For a pool laid
+ * out as [pages][page_size][heads][head_dim], head h uses the pool pointer offset by h * head_dim,
+ * ld = heads * head_dim and page_stride = page_size * ld.
+ */
+struct paged_layout
+{
+    const int32_t* block_table   = nullptr; // Device table with one pool page per sequence page
+    int64_t        page_stride   = 0;
+    int64_t        ld            = 0;
+    size_t         pool_elements = 0; // Extent of the pool from the pool pointer, in elements
+};
+
+/**
+ * @brief B loader reading values from pages of PAGE_SIZE tokens
+ *
+ * B(row, col) is channel col of token row, stored at row row % PAGE_SIZE of page
+ * block_table[row / PAGE_SIZE]. Used for P·V, where K runs over tokens. PAGE_SIZE must be a
+ * multiple of block_k so that every K-block of the kernel lies in a single page.
+ */
+template<int PAGE_SIZE>
+struct b_loader_paged_rows
+{
+    paged_layout layout;
+
+    __host__ __device__ __forceinline__ buffer_resource resource(const half* B,
+                                                                 size_t,
+                                                                 size_t) const
+    {
+        return make_buffer_resource(B, layout.pool_elements);
+    }
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ index_t offset(index_t row, index_t col, index_t) const
+    {
+        // Rows past K stay inside the last page of the sequence, see the class comment
+        const index_t page = layout.block_table[row / PAGE_SIZE];
+        return page * static_cast<index_t>(layout.page_stride)
+               + (row % PAGE_SIZE) * static_cast<index_t>(layout.ld) + col;
+    }
+
+    template<int WIDTH, class index_t>
+    __host__ __device__ __forceinline__ void
+        load(half* dst, const buffer_resource& rsrc, index_t offset, index_t valid) const
+    {
+        load_vector<WIDTH, index_t>(dst, rsrc, offset, valid);
+    }
+};
+
+/**
+ * @brief B loader reading transposed keys from pages of PAGE_SIZE tokens
+ *
+ * B(row, col) is channel row of token col, stored at row row, column col % PAGE_SIZE of page
+ * block_table[col / PAGE_SIZE] (pages hold Kᵀ, channels × tokens). Used for Q·Kᵀ, where N
+ * runs over tokens. PAGE_SIZE must be a multiple of vector_width so that no loader vector
+ * straddles two pages; with PAGE_SIZE = block_n each output tile reads a single page.
+ */
+template<int PAGE_SIZE>
+struct b_loader_paged_cols
+{
+    paged_layout layout;
+
+    __host__ __device__ __forceinline__ buffer_resource resource(const half* B,
+                                                                 size_t,
+                                                                 size_t) const
+    {
+        return make_buffer_resource(B, layout.pool_elements);
+    }
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ index_t offset(index_t row, index_t col, index_t N) const
+    {
+        // Columns of the last tile may run past the block table; their loads are masked anyway
+        const index_t page = col < N ? layout.block_table[col / PAGE_SIZE] : 0;
+        return page * static_cast<index_t>(layout.page_stride)
+               + row * static_cast<index_t>(layout.ld) + col % PAGE_SIZE;
+    }
+
+    template<int WIDTH, class index_t>
+    __host__ __device__ __forceinline__ void
+        load(half* dst, const buffer_resource& rsrc, index_t offset, index_t valid) const
+    {
+        load_vector<WIDTH, index_t>(dst, rsrc, offset, valid);
+    }
+};
+
+/**
+ * @brief B loader reading keys from token-major pages of PAGE_SIZE tokens
+ *
+ * B(row, col) is channel row of token col, stored at row col % PAGE_SIZE, column row of page
+ * block_table[col / PAGE_SIZE] (pages hold K, tokens × channels, like the value pages). Used for
+ * Q·Kᵀ on a cache written in its natural layout. The tokens of a loader vector are ld elements
+ * apart, so every element is gathered with its own load; PAGE_SIZE must be a multiple of
+ * vector_width so that no loader vector straddles two pages.
+ */
+template<int PAGE_SIZE>
+struct b_loader_paged_token_major
+{
+    paged_layout layout;
+
+    __host__ __device__ __forceinline__ buffer_resource resource(const half* B,
+                                                                 size_t,
+                                                                 size_t) const
+    {
+        return make_buffer_resource(B, layout.pool_elements);
+    }
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ index_t offset(index_t row, index_t col, index_t N) const
+    {
+        // Columns of the last tile may run past the block table; their loads are masked anyway
+        const index_t page = col < N ? layout.block_table[col / PAGE_SIZE] : 0;
+        return page * static_cast<index_t>(layout.page_stride)
+               + (col % PAGE_SIZE) * static_cast<index_t>(layout.ld) + row;
+    }
+
+    template<int WIDTH, class index_t>
+    __host__ __device__ __forceinline__ void
+        load(half* dst, const buffer_resource& rsrc, index_t offset, index_t valid) const
+    {
+        load_vector_strided<WIDTH, index_t>(
+            dst, rsrc, offset, static_cast<index_t>(layout.ld), valid);
+    }
+};
+
+/**
+ * @brief Layout of the tokens in the key pages of a paged KV-cache
+ */
+enum class paged_key_layout
+{
+    transposed, // D × PAGE_SIZE per head: contiguous tokens, vectorized loads
+    token_major // PAGE_SIZE × D per head, like the value pages: gathered loads
+};
+
+/**
+ * @brief wmma_opt_4 kernel reading B through a paged loader, with a fused epilogue
+ */
+template<kernel_type K_TYPE, class index_t, class Epilogue, class BLoader>
+__global__ void __launch_bounds__(warp_size* wmma_config<K_TYPE>::total_warps)
+    kernel_hgemm_paged(half*                         C,
+                       const half*                   A,
+                       const half*                   B,
+                       std::type_identity_t<index_t> M,
+                       std::type_identity_t<index_t> N,
+                       std::type_identity_t<index_t> K,
+                       Epilogue                      epilogue,
+                       BLoader                       b_loader)
+{
+    wmma_opt_4_impl<K_TYPE, index_t>(
+        C, A, B, M, N, K, prologue_input{}, epilogue, nullptr, b_loader);
+}
+
+/**
+ * @brief Launch kernel_hgemm_paged, widening offsets when the GEMM or the pool needs it
+ */
+template<kernel_type K_TYPE, class Epilogue, class BLoader>
+__host__ void launch_hgemm_paged(half*           C,
+                                 const half*     A,
+                                 const half*     pool,
+                                 size_t          M,
+                                 size_t          N,
+                                 size_t          K,
+                                 const BLoader&  b_loader,
+                                 const Epilogue& epilogue,
+                                 hipStream_t&    stream)
+{
+    static_assert(K_TYPE == kernel_type::wmma_opt_4 || K_TYPE == kernel_type::wmma_opt_4_wgp,
+                  "Paged GEMMs are only supported by the wmma_opt_4 kernels");
+    using config = wmma_config<K_TYPE>;
+
+    if(M == 0 || N == 0)
+    {
+        return;
+    }
+
+    const int grid_m = (M + config::block_m - 1) / config::block_m;
+    const int grid_n = (N + config::block_n - 1) / config::block_n;
+
+    dim3 grid_dim(grid_m * grid_n);
+    dim3 block_dim(warp_size * config::total_warps);
+
+    constexpr size_t limit = static_cast<size_t>(std::numeric_limits<int>::max());
+    if(requires_64bit_index(M, N, K) || b_loader.layout.pool_elements > limit)
+    {
+        kernel_hgemm_paged<K_TYPE, index_policy<true>::type, Epilogue, BLoader>
+            <<<grid_dim, block_dim, 0, stream>>>(C, A, pool, M, N, K, epilogue, b_loader);
+    }
+    else
+    {
+        kernel_hgemm_paged<K_TYPE, int, Epilogue, BLoader>
+            <<<grid_dim, block_dim, 0, stream>>>(C, A, pool, M, N, K, epilogue, b_loader);
+    }
+}
+
+/**
+ * @brief Attention scores against a paged key cache, C = epilogue(Q × Kᵀ)
+ *
+ * By default the key pages must be written transposed, D × PAGE_SIZE per head, so that the
+ * loaders read contiguous tokens. Pass paged_key_layout::token_major for pages written
+ * PAGE_SIZE × D per head like the value pages; the keys are then gathered one element at a
+ * time, which costs bandwidth on long sequences.
+ *
+ * @tparam K_TYPE    'kernel_type::wmma_opt_4_wgp', or 'kernel_type::wmma_opt_4' under -mcumode
+ * @tparam PAGE_SIZE Tokens per page, a multiple of the kernel's vector_width
+ * @tparam KEYS      Layout of the key pages
+ * @param C        M × S scores (row-major)
+ * @param Q        M × D queries (column-major)
+ * @param keys     Key pool; each page holds D × PAGE_SIZE transposed keys, or PAGE_SIZE × D keys
+ *                 for paged_key_layout::token_major
+ * @param M        Number of queries
+ * @param S        Number of tokens in the sequence (ceil(S / PAGE_SIZE) table entries)
+ * @param D        Head dimension
+ * @param layout   Placement of the sequence in the pool (ld >= PAGE_SIZE when transposed,
+ *                 ld >= D when token-major)
+ * @param stream   HIP stream to execute kernel
+ * @param epilogue Applied to every score (e.g. the softmax scale)
+ *
+ * @throws std::invalid_argument if a page row cannot hold PAGE_SIZE tokens (transposed) or D
+ * channels (token-major)
+ */
+template<kernel_type      K_TYPE,
+         int              PAGE_SIZE,
+         paged_key_layout KEYS = paged_key_layout::transposed,
+         class Epilogue        = epilogue_acc>
+__host__ void paged_scores_gpu(half*               C,
+                               const half*         Q,
+                               const half*         keys,
+                               size_t              M,
+                               size_t              S,
+                               size_t              D,
+                               const paged_layout& layout,
+                               hipStream_t&        stream,
+                               const Epilogue&     epilogue = {})
+{
+    static_assert(PAGE_SIZE % wmma_config<K_TYPE>::vector_width == 0,
+                  "Key pages must hold a whole number of loader vectors");
+    if constexpr(KEYS == paged_key_layout::token_major)
+    {
+        if(layout.ld < static_cast<int64_t>(D))
+        {
+            throw std::invalid_argument("Key page rows must hold D channels");
+        }
+        launch_hgemm_paged<K_TYPE>(
+            C, Q, keys, M, S, D, b_loader_paged_token_major<PAGE_SIZE>{layout}, epilogue, stream);
+    }
+    else
+    {
+        if(layout.ld < PAGE_SIZE)
+        {
+            throw std::invalid_argument("Key page rows must hold PAGE_SIZE tokens");
+        }
+        launch_hgemm_paged<K_TYPE>(
+            C, Q, keys, M, S, D, b_loader_paged_cols<PAGE_SIZE>{layout}, epilogue, stream);
+    }
+}
+
+/**
+ * @brief Attention output against a paged value cache, O = epilogue(P × V)
+ *
+ * @tparam K_TYPE    'kernel_type::wmma_opt_4_wgp', or 'kernel_type::wmma_opt_4' under -mcumode
+ * @tparam PAGE_SIZE Tokens per page, a multiple of the kernel's block_k
+ * @param O        M × D output (row-major)
+ * @param P        M × S probabilities (column-major)
+ * @param values   Value pool; each page holds PAGE_SIZE × D values
+ * @param M        Number of queries
+ * @param S        Number of tokens in the sequence (ceil(S / PAGE_SIZE) table entries)
+ * @param D        Head dimension
+ * @param layout   Placement of the sequence in the pool (ld >= D)
+ * @param stream   HIP stream to execute kernel
+ * @param epilogue Applied to every output element
+ *
+ * @throws std::invalid_argument if a page row cannot hold D channels
+ */
+template<kernel_type K_TYPE, int PAGE_SIZE, class Epilogue = epilogue_acc>
+__host__ void paged_values_gpu(half*               O,
+                               const half*         P,
+                               const half*         values,
+                               size_t              M,
+                               size_t              S,
+                               size_t              D,
+                               const paged_layout& layout,
+                               hipStream_t&        stream,
+                               const Epilogue&     epilogue = {})
+{
+    static_assert(PAGE_SIZE % wmma_config<K_TYPE>::block_k == 0,
+                  "Value pages must hold a whole number of K-blocks");
+    if(layout.ld < static_cast<int64_t>(D))
+    {
+        throw std::invalid_argument("Value page rows must hold D channels");
+    }
+    if(S == 0)
+    {
+        // An empty sequence has no block table entry for the loaders to resolve
+        HIP_CHECK(hipMemsetAsync(O, 0, M * D * sizeof(half), stream));
+        return;
+    }
+    launch_hgemm_paged<K_TYPE>(
+        O, P, values, M, D, S, b_loader_paged_rows<PAGE_SIZE>{layout}, epilogue, stream);
+}
+
+#endif // HIP_PAGED_HPP
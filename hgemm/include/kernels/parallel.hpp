@@ -0,0 +1,769 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIP_PARALLEL_HPP
+#define HIP_PARALLEL_HPP
+
+#include <algorithm>
+#include <common/hip_utils.hpp>
+#include <cstring>
+#include <exception>
+#include <hip/hip_runtime.h>
+#include <kernels/chain.hpp>
+#include <kernels/common.hpp>
+#include <kernels/wmma_opt_4.hpp>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/**
+ * Tensor-parallel GEMM across several devices
+ *
+ * A plan lists the buffers each device holds and three phases of work: scatter copies of A and
+ * B panels from the home device (device 0, which holds the user's A, B and C), one local GEMM
+ * per device, and gather copies of the C panels back home, optionally followed by a reduction
+ * of split-K partials. All copies are 2D (width contiguous elements, height rows with pitches),
+ * so they map onto hipMemcpy2DAsync between peers. Row, column and 2D partitions are all
+ * block-cyclic: device (p, q) of a grid_rows × grid_cols grid owns the row blocks i with
+ * i % grid_rows == p and the column blocks j with j % grid_cols == q, and packs them into one
+ * local GEMM.
+ */
+
+enum class partition_kind
+{
+    rows,
+    cols,
+    block_cyclic,
+    split_k
+};
+
+// Indices of the user's buffers on the home device
+constexpr int parallel_buffer_a = 0;
+constexpr int parallel_buffer_b = 1;
+constexpr int parallel_buffer_c = 2;
+
+struct parallel_buffer
+{
+    int    device;
+    size_t elements;
+};
+
+/**
+ * @brief 2D copy of height rows of width elements, all offsets and pitches in elements
+ */
+struct parallel_copy
+{
+    int    src;
+    int    dst;
+    size_t src_offset;
+    size_t dst_offset;
+    size_t src_pitch;
+    size_t dst_pitch;
+    size_t width;
+    size_t height;
+};
+
+/**
+ * @brief A local GEMM: A column-major M × K, B row-major K × N and C row-major M × N
+ */
+struct parallel_gemm
+{
+    int    device;
+    int    a;
+    size_t a_offset;
+    int    b;
+    size_t b_offset;
+    int    c;
+    size_t c_offset;
+    size_t M;
+    size_t N;
+    size_t K;
+};
+
+/**
+ * @brief Communication rates, on top of the per-device GEMM model
+ */
+struct parallel_cost_model
+{
+    gemm_cost_model gemm = gemm_cost_model::for_kernel<kernel_type::wmma_opt_4>();
+    double          link_gbps       = 50.0; // Peer-to-peer bandwidth of one link
+    double          link_latency_us = 10.0; // Per copy
+};
+
+struct parallel_plan
+{
+    partition_kind kind       = partition_kind::rows;
+    int            devices    = 1;
+    int            grid_rows  = 1;
+    int            grid_cols  = 1;
+    size_t         block_m    = 0;
+    size_t         block_n    = 0;
+    size_t         M          = 0;
+    size_t         N          = 0;
+    size_t         K          = 0;
+
+    std::vector<parallel_buffer> buffers; // The first three are the user's A, B and C
+    std::vector<parallel_copy>   scatter;
+    std::vector<parallel_gemm>   gemms;
+    std::vector<parallel_copy>   gather;
+    int    reduce_buffer = -1; // Split-K partials, as reduce_slices consecutive M × N slices
+    int    reduce_slices = 0;
+
+    size_t peer_bytes = 0; // Bytes copied between different devices
+    double cost_us    = 0.0;
+};
+
+/**
+ * @brief Estimate a plan's run time: the slowest device (receive, compute, send), or the home
+ * device's links if they are the bottleneck, followed by any reduction
+ */
+inline void estimate_parallel_cost(parallel_plan& plan, const parallel_cost_model& model)
+{
+    std::vector<double> device_us(plan.devices, 0.0);
+    double              home_us = 0.0;
+
+    plan.peer_bytes = 0;
+    for(const auto* phase : {&plan.scatter, &plan.gather})
+    {
+        for(const parallel_copy& copy : *phase)
+        {
+            const int src = plan.buffers[copy.src].device;
+            const int dst = plan.buffers[copy.dst].device;
+            if(src == dst)
+            {
+                device_us[dst] += model.gemm.copy_us(copy.height, copy.width);
+                continue;
+            }
+            const size_t bytes = copy.width * copy.height * sizeof(half);
+            const double us    = model.link_latency_us + bytes / (model.link_gbps * 1e3);
+            plan.peer_bytes += bytes;
+            device_us[src == 0 ? dst : src] += us;
+            home_us += us;
+        }
+    }
+    for(const parallel_gemm& gemm : plan.gemms)
+    {
+        device_us[gemm.device] += model.gemm.gemm_us(gemm.M, gemm.N, gemm.K);
+    }
+
+    plan.cost_us = std::max(home_us, *std::max_element(device_us.begin(), device_us.end()));
+    if(plan.reduce_slices > 0)
+    {
+        plan.cost_us += model.gemm.copy_us(plan.reduce_slices * plan.M, plan.N);
+    }
+}
+
+/**
+ * @brief Block-cyclic plan over a grid_rows × grid_cols device grid
+ *
+ * @throws std::invalid_argument if the grid or blocks are empty
+ */
+inline parallel_plan plan_block_cyclic(size_t                     M,
+                                       size_t                     N,
+                                       size_t                     K,
+                                       int                        grid_rows,
+                                       int                        grid_cols,
+                                       size_t                     block_m,
+                                       size_t                     block_n,
+                                       const parallel_cost_model& model)
+{
+    if(grid_rows < 1 || grid_cols < 1 || block_m == 0 || block_n == 0)
+    {
+        throw std::invalid_argument("block-cyclic partition needs a non-empty grid and blocks");
+    }
+
+    parallel_plan plan;
+    plan.kind      = grid_cols == 1   ? partition_kind::rows
+                     : grid_rows == 1 ? partition_kind::cols
+                                      : partition_kind::block_cyclic;
+    plan.devices   = grid_rows * grid_cols;
+    plan.grid_rows = grid_rows;
+    plan.grid_cols = grid_cols;
+    plan.block_m   = block_m;
+    plan.block_n   = block_n;
+    plan.M         = M;
+    plan.N         = N;
+    plan.K         = K;
+    plan.buffers   = {{0, M * K}, {0, K * N}, {0, M * N}};
+
+    auto add_buffer = [&](int device, size_t elements)
+    {
+        plan.buffers.push_back({device, elements});
+        return static_cast<int>(plan.buffers.size()) - 1;
+    };
+
+    // Blocks owned by one grid coordinate, as (global start, size)
+    auto owned = [](size_t extent, size_t block, int grid, int coord)
+    {
+        std::vector<std::pair<size_t, size_t>> blocks;
+        for(size_t start = coord * block; start < extent; start += grid * block)
+        {
+            blocks.push_back({start, std::min(block, extent - start)});
+        }
+        return blocks;
+    };
+
+    for(int p = 0; p < grid_rows; ++p)
+    {
+        const auto row_blocks = owned(M, block_m, grid_rows, p);
+        size_t     m_local    = 0;
+        for(const auto& block : row_blocks)
+        {
+            m_local += block.second;
+        }
+
+        for(int q = 0; q < grid_cols; ++q)
+        {
+            const int  device     = p * grid_cols + q;
+            const auto col_blocks = owned(N, block_n, grid_cols, q);
+            size_t     n_local    = 0;
+            for(const auto& block : col_blocks)
+            {
+                n_local += block.second;
+            }
+            if(m_local == 0 || n_local == 0 || K == 0)
+            {
+                continue;
+            }
+
+            // A panel: with one grid row the blocks concatenate to A itself
+            int a = parallel_buffer_a;
+            if(grid_rows > 1 || device != 0)
+            {
+                a = add_buffer(device, m_local * K);
+                if(grid_rows == 1)
+                {
+                    plan.scatter.push_back({parallel_buffer_a, a, 0, 0, M * K, M * K, M * K, 1});
+                }
+                size_t local = 0;
+                for(size_t i = 0; grid_rows > 1 && i < row_blocks.size(); ++i)
+                {
+                    // Column-major: every column of the block is contiguous
+                    const auto [start, size] = row_blocks[i];
+                    plan.scatter.push_back(
+                        {parallel_buffer_a, a, start, local, M, m_local, size, K});
+                    local += size;
+                }
+            }
+
+            int b = parallel_buffer_b;
+            if(grid_cols > 1 || device != 0)
+            {
+                b = add_buffer(device, K * n_local);
+                if(grid_cols == 1)
+                {
+                    plan.scatter.push_back({parallel_buffer_b, b, 0, 0, K * N, K * N, K * N, 1});
+                }
+                size_t local = 0;
+                for(size_t j = 0; grid_cols > 1 && j < col_blocks.size(); ++j)
+                {
+                    // Row-major: every row of the block is contiguous
+                    const auto [start, size] = col_blocks[j];
+                    plan.scatter.push_back(
+                        {parallel_buffer_b, b, start, local, N, n_local, size, K});
+                    local += size;
+                }
+            }
+
+            int c = parallel_buffer_c;
+            if(plan.devices > 1 || device != 0)
+            {
+                c                = add_buffer(device, m_local * n_local);
+                size_t local_row = 0;
+                for(const auto& [row, rows] : row_blocks)
+                {
+                    size_t local_col = 0;
+                    for(const auto& [col, cols] : col_blocks)
+                    {
+                        plan.gather.push_back({c,
+                                               parallel_buffer_c,
+                                               local_row * n_local + local_col,
+                                               row * N + col,
+                                               n_local,
+                                               N,
+                                               cols,
+                                               rows});
+                        local_col += cols;
+                    }
+                    local_row += rows;
+                }
+            }
+
+            plan.gemms.push_back({device, a, 0, b, 0, c, 0, m_local, n_local, K});
+        }
+    }
+
+    estimate_parallel_cost(plan, model);
+    return plan;
+}
+
+/**
+ * @brief Split-K plan: each device multiplies a slice of K and the partials are summed at home
+ */
+inline parallel_plan
+    plan_split_k(size_t M, size_t N, size_t K, int devices, const parallel_cost_model& model)
+{
+    if(devices < 1)
+    {
+        throw std::invalid_argument("split-K partition needs at least one device");
+    }
+
+    parallel_plan plan;
+    plan.kind          = partition_kind::split_k;
+    plan.devices       = devices;
+    plan.M             = M;
+    plan.N             = N;
+    plan.K             = K;
+    plan.buffers       = {{0, M * K}, {0, K * N}, {0, M * N}, {0, devices * M * N}};
+    plan.reduce_buffer = 3;
+    plan.reduce_slices = devices;
+
+    // Slices are multiples of the WMMA depth, so that only the last one is partial
+    const size_t per_device = (K + devices - 1) / devices;
+    const size_t slice      = (per_device + wmma_tile - 1) / wmma_tile * wmma_tile;
+    for(int d = 0; d < devices; ++d)
+    {
+        const size_t k0 = std::min(K, d * slice);
+        const size_t kd = std::min(K, k0 + slice) - k0;
+
+        // The slices of column-major A and row-major B are contiguous, and read in place at home
+        if(d == 0)
+        {
+            plan.gemms.push_back({0,
+                                  parallel_buffer_a,
+                                  k0 * M,
+                                  parallel_buffer_b,
+                                  k0 * N,
+                                  plan.reduce_buffer,
+                                  0,
+                                  M,
+                                  N,
+                                  kd});
+            continue;
+        }
+
+        plan.buffers.push_back({d, M * kd});
+        plan.buffers.push_back({d, kd * N});
+        plan.buffers.push_back({d, M * N});
+        const int a = static_cast<int>(plan.buffers.size()) - 3;
+        const int b = a + 1;
+        const int c = a + 2;
+        if(kd > 0)
+        {
+            plan.scatter.push_back({parallel_buffer_a, a, k0 * M, 0, M * kd, M * kd, M * kd, 1});
+            plan.scatter.push_back({parallel_buffer_b, b, k0 * N, 0, kd * N, kd * N, kd * N, 1});
+        }
+        plan.gemms.push_back({d, a, 0, b, 0, c, 0, M, N, kd});
+        plan.gather.push_back({c, plan.reduce_buffer, 0, d * M * N, M * N, M * N, M * N, 1});
+    }
+
+    estimate_parallel_cost(plan, model);
+    return plan;
+}
+
+/**
+ * @brief Cheapest plan under the model among row, column, 2D block-cyclic and split-K
+ * partitions of an M × N × K GEMM over the given number of devices
+ */
+inline parallel_plan plan_parallel_gemm(
+    size_t M, size_t N, size_t K, int devices, const parallel_cost_model& model)
+{
+    auto ceil_size = [](size_t a, size_t b) { return (a + b - 1) / b; };
+
+    parallel_plan best = plan_split_k(M, N, K, devices, model);
+    auto          keep = [&](parallel_plan&& plan)
+    {
+        if(plan.cost_us < best.cost_us)
+        {
+            best = std::move(plan);
+        }
+    };
+
+    for(int grid_rows = 1; grid_rows <= devices; ++grid_rows)
+    {
+        if(devices % grid_rows != 0)
+        {
+            continue;
+        }
+        const int grid_cols = devices / grid_rows;
+
+        // One block per device, or smaller blocks dealt cyclically for balance
+        for(size_t blocks_per_device : {1, 2, 4})
+        {
+            const size_t block_m = ceil_size(M, grid_rows * blocks_per_device);
+            const size_t block_n = ceil_size(N, grid_cols * blocks_per_device);
+            if(block_m == 0 || block_n == 0)
+            {
+                continue;
+            }
+            keep(plan_block_cyclic(M, N, K, grid_rows, grid_cols, block_m, block_n, model));
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Sum slices consecutive partial results of count elements into C
+ */
+inline __global__ void
+    kernel_sum_slices(half* C, const half* partials, int slices, size_t count)
+{
+    for(size_t e = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x; e < count;
+        e += static_cast<size_t>(gridDim.x) * blockDim.x)
+    {
+        float sum = 0.0f;
+        for(int s = 0; s < slices; ++s)
+        {
+            sum += static_cast<float>(partials[s * count + e]);
+        }
+        C[e] = static_cast<half>(sum);
+    }
+}
+
+/**
+ * @brief Executes parallel plans on a group of HIP devices, one stream per device
+ *
+ * Device ids may repeat, which runs several logical devices of a plan on one GPU.
+ */
+template<kernel_type K_TYPE>
+class device_group
+{
+public:
+    explicit device_group(std::vector<int> ids) : ids_(std::move(ids))
+    {
+        int current;
+        HIP_CHECK(hipGetDevice(&current));
+        for(int id : ids_)
+        {
+            HIP_CHECK(hipSetDevice(id));
+            hipStream_t stream;
+            HIP_CHECK(hipStreamCreate(&stream));
+            streams_.push_back(stream);
+            for(int peer : ids_)
+            {
+                int can_access = 0;
+                if(peer != id && hipDeviceCanAccessPeer(&can_access, id, peer) == hipSuccess
+                   && can_access)
+                {
+                    // Already enabled is fine, as ids may repeat
+                    (void)hipDeviceEnablePeerAccess(peer, 0);
+                }
+            }
+        }
+        HIP_CHECK(hipSetDevice(current));
+    }
+
+    device_group(const device_group&)            = delete;
+    device_group& operator=(const device_group&) = delete;
+
+    ~device_group()
+    {
+        for(hipStream_t stream : streams_)
+        {
+            HIP_CHECK(hipStreamDestroy(stream));
+        }
+    }
+
+    /**
+     * @brief Run a plan with A, B and C resident on the first device of the group
+     */
+    void execute(const parallel_plan& plan, half* C, const half* A, const half* B)
+    {
+        if(plan.devices > static_cast<int>(ids_.size()))
+        {
+            throw std::invalid_argument("plan needs more devices than the group has");
+        }
+
+        int current;
+        HIP_CHECK(hipGetDevice(&current));
+
+        std::vector<half*> buffers(plan.buffers.size(), nullptr);
+        buffers[parallel_buffer_a] = const_cast<half*>(A);
+        buffers[parallel_buffer_b] = const_cast<half*>(B);
+        buffers[parallel_buffer_c] = C;
+        for(size_t i = parallel_buffer_c + 1; i < buffers.size(); ++i)
+        {
+            HIP_CHECK(hipSetDevice(ids_[plan.buffers[i].device]));
+            HIP_CHECK(hipMalloc(&buffers[i], std::max<size_t>(plan.buffers[i].elements, 1)
+                                                 * sizeof(half)));
+        }
+
+        run_copies(plan, plan.scatter, buffers);
+        synchronize(plan.devices);
+
+        for(const parallel_gemm& gemm : plan.gemms)
+        {
+            HIP_CHECK(hipSetDevice(ids_[gemm.device]));
+            hgemm_gpu<K_TYPE>(buffers[gemm.c] + gemm.c_offset,
+                              buffers[gemm.a] + gemm.a_offset,
+                              buffers[gemm.b] + gemm.b_offset,
+                              gemm.M,
+                              gemm.N,
+                              gemm.K,
+                              streams_[gemm.device]);
+        }
+        synchronize(plan.devices);
+
+        run_copies(plan, plan.gather, buffers);
+        synchronize(plan.devices);
+
+        if(plan.reduce_slices > 0)
+        {
+            HIP_CHECK(hipSetDevice(ids_[0]));
+            const size_t count = plan.M * plan.N;
+            const dim3   grid_dim(
+                static_cast<unsigned int>(std::min<size_t>((count + 255) / 256, 65536)));
+            kernel_sum_slices<<<grid_dim, dim3(256), 0, streams_[0]>>>(
+                C, buffers[plan.reduce_buffer], plan.reduce_slices, count);
+            HIP_CHECK(hipStreamSynchronize(streams_[0]));
+        }
+
+        for(size_t i = parallel_buffer_c + 1; i < buffers.size(); ++i)
+        {
+            HIP_CHECK(hipFree(buffers[i]));
+        }
+        HIP_CHECK(hipSetDevice(current));
+    }
+
+private:
+    void run_copies(const parallel_plan&              plan,
+                    const std::vector<parallel_copy>& copies,
+                    const std::vector<half*>&         buffers)
+    {
+        for(const parallel_copy& copy : copies)
+        {
+            // Issued on the receiving device's stream
+            const int device = plan.buffers[copy.dst].device;
+            HIP_CHECK(hipSetDevice(ids_[device]));
+            HIP_CHECK(hipMemcpy2DAsync(buffers[copy.dst] + copy.dst_offset,
+                                       copy.dst_pitch * sizeof(half),
+                                       buffers[copy.src] + copy.src_offset,
+                                       copy.src_pitch * sizeof(half),
+                                       copy.width * sizeof(half),
+                                       copy.height,
+                                       hipMemcpyDefault,
+                                       streams_[device]));
+        }
+    }
+
+    void synchronize(int devices)
+    {
+        for(int d = 0; d < devices; ++d)
+        {
+            HIP_CHECK(hipStreamSynchronize(streams_[d]));
+        }
+    }
+
+    std::vector<int>         ids_;
+    std::vector<hipStream_t> streams_;
+};
+
+/**
+ * @brief Executes parallel plans on simulated devices: CPU threads with per-device memory
+ *
+ * Every GEMM runs on its device's thread and may only touch that device's buffers, and copies
+ * are the only traffic between devices, so a plan that executes here partitions correctly.
+ * The local GEMMs accumulate in fp32 in the order of hgemm_cpu, so row, column and 2D plans
+ * reproduce the CPU reference exactly.
+ */
+class simulated_devices
+{
+public:
+    explicit simulated_devices(int count) : count_(count) {}
+
+    /**
+     * @brief Run a plan with host A (column-major), B (row-major) and C (row-major)
+     *
+     * @throws std::logic_error if a GEMM reads memory of another device
+     */
+    void execute(const parallel_plan& plan, half* C, const half* A, const half* B)
+    {
+        if(plan.devices > count_)
+        {
+            throw std::invalid_argument("plan needs more devices than are simulated");
+        }
+        for(const parallel_gemm& gemm : plan.gemms)
+        {
+            for(int buffer : {gemm.a, gemm.b, gemm.c})
+            {
+                if(plan.buffers[buffer].device != gemm.device)
+                {
+                    throw std::logic_error("simulated GEMM reads memory of another device");
+                }
+            }
+        }
+
+        std::vector<std::vector<half>> memory(plan.buffers.size());
+        std::vector<half*>             buffers(plan.buffers.size(), nullptr);
+        buffers[parallel_buffer_a] = const_cast<half*>(A);
+        buffers[parallel_buffer_b] = const_cast<half*>(B);
+        buffers[parallel_buffer_c] = C;
+
+        device_bytes_.assign(count_, 0);
+        for(size_t i = parallel_buffer_c + 1; i < buffers.size(); ++i)
+        {
+            memory[i].resize(plan.buffers[i].elements);
+            buffers[i] = memory[i].data();
+            device_bytes_[plan.buffers[i].device] += plan.buffers[i].elements * sizeof(half);
+        }
+
+        peer_bytes_ = 0;
+        run_copies(plan, plan.scatter, buffers);
+
+        for_each_device(plan.devices,
+                        [&](int device)
+                        {
+                            for(const parallel_gemm& gemm : plan.gemms)
+                            {
+                                if(gemm.device == device)
+                                {
+                                    run_gemm(gemm, buffers);
+                                }
+                            }
+                        });
+
+        run_copies(plan, plan.gather, buffers);
+
+        if(plan.reduce_slices > 0)
+        {
+            const size_t count    = plan.M * plan.N;
+            const half*  partials = buffers[plan.reduce_buffer];
+            for(size_t e = 0; e < count; ++e)
+            {
+                float sum = 0.0f;
+                for(int s = 0; s < plan.reduce_slices; ++s)
+                {
+                    sum += static_cast<float>(partials[s * count + e]);
+                }
+                C[e] = static_cast<half>(sum);
+            }
+        }
+    }
+
+    // Bytes moved between different devices by the last execution
+    size_t peer_bytes() const
+    {
+        return peer_bytes_;
+    }
+
+    // Bytes allocated on a device by the last execution, excluding the user's buffers
+    size_t device_bytes(int device) const
+    {
+        return device_bytes_[device];
+    }
+
+private:
+    // Runs f on one thread per device and rethrows the first failure once all have joined
+    template<class F>
+    static void for_each_device(int devices, F&& f)
+    {
+        std::vector<std::exception_ptr> errors(devices);
+        std::vector<std::thread>         threads;
+        for(int d = 0; d < devices; ++d)
+        {
+            threads.emplace_back(
+                [&f, &errors, d]
+                {
+                    try
+                    {
+                        f(d);
+                    }
+                    catch(...)
+                    {
+                        errors[d] = std::current_exception();
+                    }
+                });
+        }
+        for(std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        for(const std::exception_ptr& error : errors)
+        {
+            if(error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    void run_copies(const parallel_plan&              plan,
+                    const std::vector<parallel_copy>& copies,
+                    const std::vector<half*>&         buffers)
+    {
+        for(const parallel_copy& copy : copies)
+        {
+            if(plan.buffers[copy.src].device != plan.buffers[copy.dst].device)
+            {
+                peer_bytes_ += copy.width * copy.height * sizeof(half);
+            }
+        }
+
+        // Receiving devices copy concurrently
+        for_each_device(plan.devices,
+                        [&](int device)
+                        {
+                            for(const parallel_copy& copy : copies)
+                            {
+                                if(plan.buffers[copy.dst].device != device)
+                                {
+                                    continue;
+                                }
+                                for(size_t r = 0; r < copy.height; ++r)
+                                {
+                                    std::memcpy(
+                                        buffers[copy.dst] + copy.dst_offset + r * copy.dst_pitch,
+                                        buffers[copy.src] + copy.src_offset + r * copy.src_pitch,
+                                        copy.width * sizeof(half));
+                                }
+                            }
+                        });
+    }
+
+    static void run_gemm(const parallel_gemm& gemm, const std::vector<half*>& buffers)
+    {
+        const half* A = buffers[gemm.a] + gemm.a_offset;
+        const half* B = buffers[gemm.b] + gemm.b_offset;
+        half*       C = buffers[gemm.c] + gemm.c_offset;
+        for(size_t i = 0; i < gemm.M; ++i)
+        {
+            for(size_t j = 0; j < gemm.N; ++j)
+            {
+                float acc = 0.0f;
+                for(size_t k = 0; k < gemm.K; ++k)
+                {
+                    acc += static_cast<float>(A[k * gemm.M + i])
+                           * static_cast<float>(B[k * gemm.N + j]);
+                }
+                C[i * gemm.N + j] = static_cast<half>(acc);
+            }
+        }
+    }
+
+    int                 count_;
+    size_t              peer_bytes_ = 0;
+    std::vector<size_t> device_bytes_;
+};
+
+#endif // HIP_PARALLEL_HPP
@@ -0,0 +1,427 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIP_PLAN_HPP
+#define HIP_PLAN_HPP
+
+#include <algorithm>
+#include <common/hip_utils.hpp>
+#include <common/matrix.hpp>
+#include <hip/hip_runtime.h>
+#include <kernels/common.hpp>
+#include <kernels/contraction.hpp>
+#include <kernels/wmma_opt_4.hpp>
+#include <stdexcept>
+#include <utility>
+
+/**
+ * @brief Device pointers of one GEMM, in the layouts given to the plan
+ */
+struct hgemm_operands
+{
+    half*       C;
+    const half* A;
+    const half* B;
+};
+
+/**
+ * @brief Fill a tile-order table with the Hilbert mapping of the wmma_opt_4 kernels
+ */
+template<int BLOCK_M, int BLOCK_N>
+__global__ void kernel_tile_order(uint32_t* table, int grid_m, int grid_n)
+{
+    const int tile_id = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tile_id < grid_m * grid_n)
+    {
+        int block_row, block_col;
+        hilbert_tile_mapping<BLOCK_M, BLOCK_N>(tile_id, grid_m, grid_n, &block_row, &block_col);
+        table[tile_id] = (static_cast<uint32_t>(block_row / BLOCK_M) << 16)
+                         | static_cast<uint32_t>(block_col / BLOCK_N);
+    }
+}
+
+/**
+ * @brief Everything a GEMM launch needs, resolved once per (shape, layouts, kernel)
+ *
+ * Like an FFT plan, construction does the work that hgemm_gpu repeats on every call (grid and
+ * block dimensions, index width, tile order) plus the layout handling around the kernel: a
+ * column-major C is produced as a row-major Cᵀ by swapping the operand roles, and an A or B in
+ * the layout the kernel does not read is transposed into the plan's workspace. Constant
+ * operands such as weights can be packed once with prepack_a/prepack_b. execute_hgemm then
+ * only issues the launches.
+ *
+ * The plan owns its device memory and must outlive any work it has enqueued. Packing calls
+ * share the plan's workspace, so calls enqueued on different streams must each pass a
+ * workspace of their own to execute_hgemm.
+ */
+class hgemm_plan
+{
+public:
+    /**
+     * @throws std::invalid_argument if a dimension is zero or the kernel is not a wmma_opt_4
+     * variant
+     */
+    hgemm_plan(size_t        M,
+               size_t        N,
+               size_t        K,
+               matrix_layout a_layout,
+               matrix_layout b_layout,
+               matrix_layout c_layout,
+               kernel_type   kernel = kernel_type::wmma_opt_4)
+        : M_(M), N_(N), K_(K), kernel_(kernel)
+    {
+        if(M == 0 || N == 0 || K == 0)
+        {
+            throw std::invalid_argument("GEMM plan dimensions must be positive");
+        }
+        if(kernel != kernel_type::wmma_opt_4 && kernel != kernel_type::wmma_opt_4_wgp)
+        {
+            throw std::invalid_argument("GEMM plans are only available for the wmma_opt_4 kernels");
+        }
+
+        // Both roles need the same layouts: column-major A and row-major B
+        swapped_ = c_layout == matrix_layout::col_major;
+        pack_a_  = a_layout != matrix_layout::col_major;
+        pack_b_  = b_layout != matrix_layout::row_major;
+
+        const size_t rows = swapped_ ? N : M;
+        const size_t cols = swapped_ ? M : N;
+        index64_          = requires_64bit_index(M, N, K);
+
+        // Both configurations use the same block size
+        using config  = wmma_config<kernel_type::wmma_opt_4>;
+        const int grid_m = static_cast<int>((rows + config::block_m - 1) / config::block_m);
+        const int grid_n = static_cast<int>((cols + config::block_n - 1) / config::block_n);
+        grid_dim_        = dim3(grid_m * grid_n);
+        block_dim_       = dim3(warp_size * config::total_warps);
+
+        // Row-major A (M × K) to column-major, and column-major B (K × N) to row-major
+        a_copy_ = transpose_desc(K, M, 1, K, M);
+        b_copy_ = transpose_desc(K, N, 1, K, N);
+
+        workspace_size_ = ((pack_a_ ? M * K : 0) + (pack_b_ ? K * N : 0)) * sizeof(half);
+        if(workspace_size_ > 0)
+        {
+            HIP_CHECK(hipMalloc(&workspace_, workspace_size_));
+        }
+
+        // The table packs tile coordinates into 16 bits each
+        if(grid_m < (1 << 16) && grid_n < (1 << 16))
+        {
+            const int tiles = grid_m * grid_n;
+            HIP_CHECK(hipMalloc(&tile_order_, tiles * sizeof(uint32_t)));
+            kernel_tile_order<config::block_m, config::block_n>
+                <<<dim3((tiles + 255) / 256), dim3(256)>>>(tile_order_, grid_m, grid_n);
+            HIP_CHECK(hipPeekAtLastError());
+            HIP_CHECK(hipDeviceSynchronize());
+        }
+    }
+
+    hgemm_plan(const hgemm_plan&)            = delete;
+    hgemm_plan& operator=(const hgemm_plan&) = delete;
+
+    hgemm_plan(hgemm_plan&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    hgemm_plan& operator=(hgemm_plan&& other) noexcept
+    {
+        std::swap(M_, other.M_);
+        std::swap(N_, other.N_);
+        std::swap(K_, other.K_);
+        std::swap(kernel_, other.kernel_);
+        std::swap(swapped_, other.swapped_);
+        std::swap(pack_a_, other.pack_a_);
+        std::swap(pack_b_, other.pack_b_);
+        std::swap(index64_, other.index64_);
+        std::swap(grid_dim_, other.grid_dim_);
+        std::swap(block_dim_, other.block_dim_);
+        std::swap(a_copy_, other.a_copy_);
+        std::swap(b_copy_, other.b_copy_);
+        std::swap(workspace_size_, other.workspace_size_);
+        std::swap(workspace_, other.workspace_);
+        std::swap(tile_order_, other.tile_order_);
+        std::swap(prepacked_a_, other.prepacked_a_);
+        std::swap(prepacked_b_, other.prepacked_b_);
+        return *this;
+    }
+
+    ~hgemm_plan()
+    {
+        for(void* p : {static_cast<void*>(workspace_),
+                       static_cast<void*>(tile_order_),
+                       static_cast<void*>(prepacked_a_),
+                       static_cast<void*>(prepacked_b_)})
+        {
+            if(p != nullptr)
+            {
+                HIP_CHECK(hipFree(p));
+            }
+        }
+    }
+
+    /**
+     * @brief Pack a constant A once; execute_hgemm then ignores the A pointer it is given
+     */
+    void prepack_a(const half* A, hipStream_t& stream)
+    {
+        prepack(prepacked_a_, A, M_ * K_, pack_a_, a_copy_, stream);
+    }
+
+    /**
+     * @brief Pack a constant B once; execute_hgemm then ignores the B pointer it is given
+     */
+    void prepack_b(const half* B, hipStream_t& stream)
+    {
+        prepack(prepacked_b_, B, K_ * N_, pack_b_, b_copy_, stream);
+    }
+
+    size_t M() const
+    {
+        return M_;
+    }
+
+    size_t N() const
+    {
+        return N_;
+    }
+
+    size_t K() const
+    {
+        return K_;
+    }
+
+    kernel_type kernel() const
+    {
+        return kernel_;
+    }
+
+    // Whether C is computed as Cᵀ with the operand roles swapped
+    bool swapped() const
+    {
+        return swapped_;
+    }
+
+    dim3 grid_dim() const
+    {
+        return grid_dim_;
+    }
+
+    dim3 block_dim() const
+    {
+        return block_dim_;
+    }
+
+    // Bytes of device workspace the plan allocated for packing A and B on every call
+    size_t workspace_size() const
+    {
+        return workspace_size_;
+    }
+
+    friend void execute_hgemm(const hgemm_plan&     plan,
+                              const hgemm_operands& ptrs,
+                              size_t                M,
+                              half*                 workspace,
+                              hipStream_t&          stream);
+
+private:
+    // Copy over (outer, inner) indices, with the destination contiguous along inner
+    static strided_copy_desc transpose_desc(
+        size_t outer, size_t inner, size_t src_outer, size_t src_inner, size_t dst_outer)
+    {
+        strided_copy_desc desc = {};
+        desc.rank              = 2;
+        desc.size[0]           = static_cast<int64_t>(outer);
+        desc.size[1]           = static_cast<int64_t>(inner);
+        desc.dst_stride[0]     = static_cast<int64_t>(dst_outer);
+        desc.dst_stride[1]     = 1;
+        desc.src_stride[0]     = static_cast<int64_t>(src_outer);
+        desc.src_stride[1]     = static_cast<int64_t>(src_inner);
+        return desc;
+    }
+
+    static void launch_pack(half*                    dst,
+                            const half*              src,
+                            const strided_copy_desc& desc,
+                            size_t                   count,
+                            hipStream_t&             stream)
+    {
+        const dim3 grid_dim(
+            static_cast<unsigned int>(std::min<size_t>((count + 255) / 256, 65536)));
+        kernel_strided_copy<<<grid_dim, dim3(256), 0, stream>>>(dst, src, desc, count);
+    }
+
+    static void prepack(half*&                   storage,
+                        const half*              src,
+                        size_t                   count,
+                        bool                     transpose,
+                        const strided_copy_desc& desc,
+                        hipStream_t&             stream)
+    {
+        if(storage == nullptr)
+        {
+            HIP_CHECK(hipMalloc(&storage, count * sizeof(half)));
+        }
+        if(transpose)
+        {
+            launch_pack(storage, src, desc, count, stream);
+        }
+        else
+        {
+            HIP_CHECK(hipMemcpyAsync(
+                storage, src, count * sizeof(half), hipMemcpyDeviceToDevice, stream));
+        }
+    }
+
+    size_t      M_       = 0;
+    size_t      N_       = 0;
+    size_t      K_       = 0;
+    kernel_type kernel_  = kernel_type::wmma_opt_4;
+    bool        swapped_ = false;
+    bool        pack_a_  = false;
+    bool        pack_b_  = false;
+    bool        index64_ = false;
+    dim3        grid_dim_;
+    dim3        block_dim_;
+
+    strided_copy_desc a_copy_ = {};
+    strided_copy_desc b_copy_ = {};
+
+    size_t    workspace_size_ = 0;
+    half*     workspace_      = nullptr;
+    uint32_t* tile_order_     = nullptr;
+    half*     prepacked_a_    = nullptr;
+    half*     prepacked_b_    = nullptr;
+};
+
+/**
+ * @brief Run a plan on the first M rows of its shape, e.g. a batch padded up to a bucket
+ *
+ * The grid and tile order stay those of plan.M(); A and C are addressed with M rows, so the
+ * kernels zero-fill the loads of the padded rows and predicate their stores away.
+ *
+ * @param plan   Plan for the shape and layouts of ptrs
+ * @param ptrs   Device pointers in the layouts given to the plan, with M rows in A and C
+ * @param M         Rows of A and C, at most plan.M()
+ * @param workspace Device memory of plan.workspace_size() bytes for packing A and B, or nullptr
+ *                  to use the plan's own
+ * @param stream    HIP stream to execute kernels
+ * @throws std::invalid_argument if M is zero, exceeds plan.M(), or differs from the rows of a
+ * prepacked A
+ */
+inline void execute_hgemm(const hgemm_plan&     plan,
+                          const hgemm_operands& ptrs,
+                          size_t                M,
+                          half*                 workspace,
+                          hipStream_t&          stream)
+{
+    if(M == 0 || M > plan.M_ || (plan.prepacked_a_ != nullptr && M != plan.M_))
+    {
+        throw std::invalid_argument("GEMM rows must be positive and fit the plan");
+    }
+
+    if(workspace == nullptr)
+    {
+        workspace = plan.workspace_;
+    }
+
+    const half* a = ptrs.A;
+    const half* b = ptrs.B;
+    if(plan.prepacked_a_ != nullptr)
+    {
+        a = plan.prepacked_a_;
+    }
+    else if(plan.pack_a_)
+    {
+        const strided_copy_desc a_copy
+            = M == plan.M_ ? plan.a_copy_ : hgemm_plan::transpose_desc(plan.K_, M, 1, plan.K_, M);
+        hgemm_plan::launch_pack(workspace, a, a_copy, M * plan.K_, stream);
+        a = workspace;
+    }
+    if(plan.prepacked_b_ != nullptr)
+    {
+        b = plan.prepacked_b_;
+    }
+    else if(plan.pack_b_)
+    {
+        half* packed = workspace + (plan.pack_a_ ? plan.M_ * plan.K_ : 0);
+        hgemm_plan::launch_pack(packed, b, plan.b_copy_, plan.K_ * plan.N_, stream);
+        b = packed;
+    }
+
+    // Row-major Cᵀ = Bᵀ · Aᵀ reads row-major B as column-major Bᵀ and column-major A as
+    // row-major Aᵀ
+    const half* kernel_a = plan.swapped_ ? b : a;
+    const half* kernel_b = plan.swapped_ ? a : b;
+    const size_t rows    = plan.swapped_ ? plan.N_ : M;
+    const size_t cols    = plan.swapped_ ? M : plan.N_;
+
+    auto launch = [&](auto kernel, auto index)
+    {
+        using index_t = decltype(index);
+        kernel<<<plan.grid_dim_, plan.block_dim_, 0, stream>>>(ptrs.C,
+                                                               kernel_a,
+                                                               kernel_b,
+                                                               static_cast<index_t>(rows),
+                                                               static_cast<index_t>(cols),
+                                                               static_cast<index_t>(plan.K_),
+                                                               plan.tile_order_);
+    };
+
+    if(plan.kernel_ == kernel_type::wmma_opt_4_wgp)
+    {
+        if(plan.index64_)
+        {
+            launch(kernel_hgemm_ordered<kernel_type::wmma_opt_4_wgp, int64_t>, int64_t{});
+        }
+        else
+        {
+            launch(kernel_hgemm_ordered<kernel_type::wmma_opt_4_wgp, int>, int{});
+        }
+    }
+    else if(plan.index64_)
+    {
+        launch(kernel_hgemm_ordered<kernel_type::wmma_opt_4, int64_t>, int64_t{});
+    }
+    else
+    {
+        launch(kernel_hgemm_ordered<kernel_type::wmma_opt_4, int>, int{});
+    }
+}
+
+/**
+ * @brief Run a plan: at most two packing launches and the GEMM, with no host-side arithmetic
+ * beyond choosing pointers
+ *
+ * @param plan   Plan for the shape and layouts of ptrs
+ * @param ptrs   Device pointers in the layouts given to the plan
+ * @param stream HIP stream to execute kernels
+ */
+inline void execute_hgemm(const hgemm_plan& plan, const hgemm_operands& ptrs, hipStream_t& stream)
+{
+    execute_hgemm(plan, ptrs, plan.M(), nullptr, stream);
+}
+
+#endif // HIP_PLAN_HPP
@@ -0,0 +1,179 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_PROLOGUE_HPP
+#define HIP_PROLOGUE_HPP
+
+#include <hip/hip_runtime.h>
+#include <kernels/buffer.hpp>
+#include <kernels/epilogue.hpp>
+
+/**
+ * Prologue transforms on A
+ *
+ * A prologue is applied to A while it is staged from global memory to LDS, so normalization or
+ * dequantization no longer needs a separate pass writing a transformed copy of A. Prologues are
+ * built from the same expression nodes as epilogues (see kernels/epilogue.hpp): the accumulator
+ * leaf stands for the loaded element of A, and (row, col) index A as (m, k). Row vectors are
+ * therefore per-row (length M) and column vectors per-column (length K) parameters.
+ *
+ * Example: C = (A * inv_rms[m] * gamma[k]) × B
+ * @code
+ * auto pro = prologue_rms_norm(d_inv_rms, d_gamma);
+ * hgemm_gpu<kernel_type::wmma_opt_4_wgp>(d_C, d_A, d_B, M, N, K, pro, epilogue_acc{}, stream);
+ * @endcode
+ */
+
+/**
+ * @brief Leaf returning the element of A that was loaded
+ */
+using prologue_input = epilogue_acc;
+
+/**
+ * @brief RMSNorm scaling: A(m, k) * inv_rms[m] * gamma[k]
+ * @param inv_rms Per-row reciprocal RMS (length M)
+ * @param gamma   Per-column weight (length K)
+ */
+__host__ __device__ inline auto prologue_rms_norm(const half* inv_rms, const half* gamma)
+{
+    return epilogue_mul(epilogue_mul(prologue_input{}, epilogue_row_vector{inv_rms}),
+                        epilogue_col_vector{gamma});
+}
+
+/**
+ * @brief Per-row (per-token) dequantization: (A(m, k) - zero_point[m]) * scale[m]
+ * @param scale      Per-row scale (length M)
+ * @param zero_point Per-row zero-point (length M)
+ */
+__host__ __device__ inline auto prologue_dequant_rows(const half* scale, const half* zero_point)
+{
+    return epilogue_mul(epilogue_sub(prologue_input{}, epilogue_row_vector{zero_point}),
+                        epilogue_row_vector{scale});
+}
+
+/**
+ * @brief Per-column (per-channel) dequantization: (A(m, k) - zero_point[k]) * scale[k]
+ * @param scale      Per-column scale (length K)
+ * @param zero_point Per-column zero-point (length K)
+ */
+__host__ __device__ inline auto prologue_dequant_cols(const half* scale, const half* zero_point)
+{
+    return epilogue_mul(epilogue_sub(prologue_input{}, epilogue_col_vector{zero_point}),
+                        epilogue_col_vector{scale});
+}
+
+/**
+ * @brief Load WIDTH consecutive rows of one column of A and apply a prologue to them
+ *
+ * Elements at or beyond valid are left as the zero padding produced by load_vector, so the
+ * prologue (and any auxiliary tensors it reads) is only evaluated inside A.
+ *
+ * @tparam WIDTH    Number of halves to load (multiple of 8)
+ * @tparam index_t  Type used for global memory offsets
+ * @tparam Prologue Prologue expression tree
+ * @param[out] dst      Destination (shared memory)
+ * @param[in]  rsrc     Buffer descriptor of A
+ * @param[in]  offset   Element offset from the descriptor base
+ * @param[in]  valid    Number of in-bounds elements starting at offset (may be <= 0)
+ * @param[in]  row      Row of A of the first element
+ * @param[in]  col      Column of A of all elements
+ * @param[in]  prologue Prologue applied to each element
+ */
+template<int WIDTH, class index_t, class Prologue>
+__host__ __device__ __forceinline__ void load_vector_prologue(half*                  dst,
+                                                              const buffer_resource& rsrc,
+                                                              index_t                offset,
+                                                              index_t                valid,
+                                                              index_t                row,
+                                                              index_t                col,
+                                                              const Prologue&        prologue)
+{
+    if constexpr(is_identity_epilogue<Prologue>)
+    {
+        load_vector<WIDTH, index_t>(dst, rsrc, offset, valid);
+    }
+    else
+    {
+        // Transform in registers so each LDS location is written once
+        alignas(16) half values[WIDTH];
+        load_vector<WIDTH, index_t>(values, rsrc, offset, valid);
+
+#pragma unroll
+        for(int v = 0; v < WIDTH; ++v)
+        {
+            if(v < valid)
+            {
+                const float value = static_cast<float>(values[v]);
+                values[v]         = static_cast<half>(prologue(value, row + v, col));
+            }
+        }
+
+#pragma unroll
+        for(int c = 0; c < WIDTH; c += 8)
+        {
+            *reinterpret_cast<half8*>(dst + c) = *reinterpret_cast<const half8*>(values + c);
+        }
+    }
+}
+
+/**
+ * @brief Load WIDTH consecutive halves to LDS and accumulate their squares
+ *
+ * Used by distance epilogues to compute the norms of the A rows and B columns from the data
+ * already staged by the loaders, instead of in a separate pass over A and B.
+ *
+ * @tparam WIDTH   Number of halves to load (multiple of 8)
+ * @tparam index_t Type used for global memory offsets
+ * @param[out]    dst    Destination (shared memory)
+ * @param[in]     rsrc   Buffer descriptor of the operand
+ * @param[in]     offset Element offset from the descriptor base
+ * @param[in]     valid  Number of in-bounds elements starting at offset (may be <= 0)
+ * @param[in,out] norms  Running sums of squares, one per element of the vector
+ */
+template<int WIDTH, class index_t>
+__host__ __device__ __forceinline__ void load_vector_norms(half*                  dst,
+                                                           const buffer_resource& rsrc,
+                                                           index_t                offset,
+                                                           index_t                valid,
+                                                           float (&norms)[WIDTH])
+{
+    alignas(16) half values[WIDTH];
+    load_vector<WIDTH, index_t>(values, rsrc, offset, valid);
+
+#pragma unroll
+    for(int v = 0; v < WIDTH; ++v)
+    {
+        const float value = static_cast<float>(values[v]);
+        norms[v] += value * value;
+    }
+
+#pragma unroll
+    for(int c = 0; c < WIDTH; c += 8)
+    {
+        *reinterpret_cast<half8*>(dst + c) = *reinterpret_cast<const half8*>(values + c);
+    }
+}
+
+#endif // HIP_PROLOGUE_HPP
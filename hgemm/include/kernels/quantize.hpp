@@ -0,0 +1,471 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_QUANTIZE_HPP
+#define HIP_QUANTIZE_HPP
+
+#include <cmath>
+#include <common/hip_utils.hpp>
+#include <cstdint>
+#include <hip/hip_cooperative_groups.h>
+#include <hip/hip_runtime.h>
+#include <kernels/epilogue.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+#include <stdexcept>
+
+/**
+ * Quantized outputs
+ *
+ * The quantization epilogue replaces the fp16 store of the wmma_opt_4 kernels with an int8 or
+ * fp8 (E4M3) store plus fp32 scales, so the next quantized layer can consume the GEMM output
+ * directly. Values are dequantized as x = q * scale, with scale = absmax / qmax.
+ *
+ * Rounding is defined as follows (and mirrored exactly by quantize_cpu in hgemm.hpp):
+ * - absmax is taken over the fp16 output values (after any elementwise epilogue)
+ * - scale = absmax / qmax and inv_scale = qmax / absmax in fp32 (both 0 when absmax is 0)
+ * - int8: q = clamp(rint(x * inv_scale), -127, 127), rounding half to even
+ * - fp8:  q = e4m3(x * inv_scale), rounding half to even and saturating to ±448
+ *
+ * Per-tile granularity uses one scale per (row, block_n-wide N tile). Per-row granularity needs
+ * the absmax of the whole row, which spans the workgroups of a row of tiles. The per-row kernel
+ * is a cooperative launch of at most the resident workgroups: each workgroup folds its tile
+ * maxima into M per-row maxima with atomics, waits at a grid barrier, and then quantizes its
+ * accumulators, still in registers, with the final row scale. Neither granularity writes an fp16
+ * copy of C. When the tiles outnumber the resident workgroups, the kernel computes them in
+ * rounds of whole rows of tiles, with one barrier per round.
+ */
+enum class quant_granularity
+{
+    per_row,
+    per_tile
+};
+
+/**
+ * @brief 8-bit floating point value in the OCP E4M3 (FN) format
+ */
+struct fp8_e4m3
+{
+    uint8_t bits;
+};
+
+/**
+ * @brief Convert fp32 to E4M3, rounding half to even and saturating to ±448
+ */
+__host__ __device__ inline uint8_t float_to_e4m3(float x)
+{
+    const uint8_t sign = x < 0.0f ? 0x80 : 0x00;
+    const float   a    = fabsf(x);
+
+    if(a != a)
+    {
+        return 0x7F; // NaN
+    }
+    if(a >= 448.0f)
+    {
+        return sign | 0x7E;
+    }
+    if(a < 0.015625f)
+    {
+        // Subnormal range, steps of 2^-9 (rounding up to 8 yields the smallest normal)
+        return sign | static_cast<uint8_t>(rintf(a * 512.0f));
+    }
+
+    int exp;
+    frexpf(a, &exp);
+    exp -= 1; // a = 1.m * 2^exp, exp in [-6, 8]
+
+    int mant = static_cast<int>(rintf(ldexpf(a, 3 - exp))); // in [8, 16]
+    if(mant == 16)
+    {
+        mant = 8;
+        ++exp;
+    }
+    return sign | static_cast<uint8_t>(((exp + 7) << 3) | (mant - 8));
+}
+
+/**
+ * @brief Convert E4M3 to fp32
+ */
+__host__ __device__ inline float e4m3_to_float(uint8_t bits)
+{
+    const float sign = (bits & 0x80) ? -1.0f : 1.0f;
+    const int   exp  = (bits >> 3) & 0xF;
+    const int   mant = bits & 0x7;
+
+    if((bits & 0x7F) == 0x7F)
+    {
+        return NAN;
+    }
+    if(exp == 0)
+    {
+        return sign * ldexpf(static_cast<float>(mant), -9);
+    }
+    return sign * ldexpf(static_cast<float>(8 + mant), exp - 10);
+}
+
+/**
+ * @brief Encoding of a quantized output type
+ */
+template<class T>
+struct quant_traits;
+
+template<>
+struct quant_traits<int8_t>
+{
+    static constexpr float qmax = 127.0f;
+
+    __host__ __device__ static int8_t encode(float x)
+    {
+        return static_cast<int8_t>(rintf(fminf(fmaxf(x, -qmax), qmax)));
+    }
+
+    __host__ __device__ static float decode(int8_t q)
+    {
+        return static_cast<float>(q);
+    }
+};
+
+template<>
+struct quant_traits<fp8_e4m3>
+{
+    static constexpr float qmax = 448.0f;
+
+    __host__ __device__ static fp8_e4m3 encode(float x)
+    {
+        return {float_to_e4m3(x)};
+    }
+
+    __host__ __device__ static float decode(fp8_e4m3 q)
+    {
+        return e4m3_to_float(q.bits);
+    }
+};
+
+/**
+ * @brief Quantization epilogue
+ *
+ * Applies the elementwise epilogue Child, then quantizes the workgroup's output tile. The tile
+ * absmax of each row is reduced across the half-wave with shuffles and across warps with LDS
+ * atomics, reusing the (now idle) staging buffer of the kernel. The per-row variant must run in
+ * kernel_hgemm_quantized_rows, whose workgroups all reach store_tile together.
+ *
+ * @tparam T           Quantized output type (int8_t or fp8_e4m3)
+ * @tparam GRANULARITY Scale granularity
+ * @tparam Child       Elementwise epilogue applied before quantization
+ */
+template<class T, quant_granularity GRANULARITY, class Child = epilogue_acc>
+struct epilogue_quantize
+{
+    using tile_store_tag = void;
+
+    T*        out; // M × N row-major quantized output
+    float*    scales; // per_tile: M × tiles_n scale of every (row, N tile); per_row: M scales
+    uint32_t* row_absmax; // per_row: M running maxima (fp32 bits), zero-initialized
+    int       tiles_n; // Number of N tiles (ceil(N / block_n))
+    Child     child;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t row, index_t col) const
+    {
+        return child(acc, row, col);
+    }
+
+    template<class config, class index_t>
+    __device__ __forceinline__ void
+        store_tile(const half16 (&c_frags)[config::warp_tile_m][config::warp_tile_n],
+                   half*   lds,
+                   index_t block_row,
+                   index_t block_col,
+                   index_t M,
+                   index_t N) const
+    {
+        constexpr float qmax = quant_traits<T>::qmax;
+
+        const int     tid          = threadIdx.x;
+        const int     warp_id      = tid / warp_size;
+        const int     warp_m_base  = (warp_id / config::warps_n) * config::warp_tile_m * wmma_tile;
+        const int     warp_n_base  = (warp_id % config::warps_n) * config::warp_tile_n * wmma_tile;
+        constexpr int half_warp    = warp_size / 2;
+        const int     half_warp_id = (tid % warp_size) / half_warp;
+        const int     half_lane    = tid % half_warp;
+
+        // Per-row tile absmax, stored as fp32 bits (non-negative floats order like integers)
+        uint32_t* row_max = reinterpret_cast<uint32_t*>(lds);
+        for(int r = tid; r < config::block_m; r += blockDim.x)
+        {
+            row_max[r] = 0;
+        }
+        __syncthreads();
+
+        for(int wm = 0; wm < config::warp_tile_m; ++wm)
+        {
+#pragma unroll
+            for(int i = 0; i < wmma_tile / 2; ++i)
+            {
+                // Elements outside C are zero, so they never raise the maximum
+                float value = 0.0f;
+                for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                {
+                    value = fmaxf(value, fabsf(static_cast<float>(c_frags[wm][wn][i * 2])));
+                }
+                for(int offset = half_warp / 2; offset > 0; offset /= 2)
+                {
+                    value = fmaxf(value, __shfl_xor(value, offset, half_warp));
+                }
+                if(half_lane == 0)
+                {
+                    atomicMax(&row_max[warp_m_base + wm * wmma_tile + i * 2 + half_warp_id],
+                              __float_as_uint(value));
+                }
+            }
+        }
+        __syncthreads();
+
+        if constexpr(GRANULARITY == quant_granularity::per_row)
+        {
+            // Fold the tile maxima into the row maxima and wait for every tile of the round
+            for(int r = tid; r < config::block_m; r += blockDim.x)
+            {
+                if(block_row + r < M)
+                {
+                    atomicMax(&row_absmax[block_row + r], row_max[r]);
+                }
+            }
+            cooperative_groups::this_grid().sync();
+
+            // Replace the tile maxima with the row maxima. Atomic reads skip the caches, which may
+            // hold maxima of neighbouring rows from an earlier round.
+            for(int r = tid; r < config::block_m; r += blockDim.x)
+            {
+                const index_t row = block_row + r;
+                row_max[r]        = row < M ? atomicMax(&row_absmax[row], 0u) : 0u;
+                if(row < M && block_col == 0)
+                {
+                    scales[row] = __uint_as_float(row_max[r]) / qmax;
+                }
+            }
+            __syncthreads();
+        }
+        else
+        {
+            // Publish the scales of this tile
+            const int tile_n = block_col / config::block_n;
+            for(int r = tid; r < config::block_m; r += blockDim.x)
+            {
+                const index_t row = block_row + r;
+                if(row < M)
+                {
+                    scales[row_major_offset<index_t>(row, tile_n, tiles_n)]
+                        = __uint_as_float(row_max[r]) / qmax;
+                }
+            }
+        }
+
+        // Quantize with the row or tile scale
+        for(int wm = 0; wm < config::warp_tile_m; ++wm)
+        {
+#pragma unroll
+            for(int i = 0; i < wmma_tile / 2; ++i)
+            {
+                const int     row_local = warp_m_base + wm * wmma_tile + i * 2 + half_warp_id;
+                const index_t row       = block_row + row_local;
+                const float   absmax    = __uint_as_float(row_max[row_local]);
+                const float   inv_scale = absmax > 0.0f ? qmax / absmax : 0.0f;
+
+                for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                {
+                    const index_t col = block_col + warp_n_base + wn * wmma_tile + half_lane;
+                    if(row < M && col < N)
+                    {
+                        const float value = static_cast<float>(c_frags[wm][wn][i * 2]);
+                        out[row_major_offset<index_t>(row, col, N)]
+                            = quant_traits<T>::encode(value * inv_scale);
+                    }
+                }
+            }
+        }
+    }
+};
+
+/**
+ * @brief wmma_opt_4 kernel with per-row quantized output
+ *
+ * Must be launched cooperatively with gridDim.x a multiple of the number of N tiles, or equal to
+ * the number of tiles, so that every round computes whole rows of tiles. Workgroups without a
+ * tile in the last round still take part in its grid barrier.
+ */
+template<kernel_type K_TYPE, class index_t, class Epilogue>
+__global__ void __launch_bounds__(warp_size* wmma_config<K_TYPE>::total_warps)
+    kernel_hgemm_quantized_rows(const half*                   A,
+                                const half*                   B,
+                                std::type_identity_t<index_t> M,
+                                std::type_identity_t<index_t> N,
+                                std::type_identity_t<index_t> K,
+                                Epilogue                      epilogue,
+                                int                           tiles)
+{
+    const int rounds = (tiles + gridDim.x - 1) / gridDim.x;
+    for(int round = 0; round < rounds; ++round)
+    {
+        const int tile = round * gridDim.x + blockIdx.x;
+        if(tile < tiles)
+        {
+            wmma_opt_4_impl<K_TYPE, index_t>(static_cast<half*>(nullptr),
+                                             A,
+                                             B,
+                                             M,
+                                             N,
+                                             K,
+                                             prologue_input{},
+                                             epilogue,
+                                             nullptr,
+                                             b_loader_dense{},
+                                             tile);
+
+            // The next tile's loads reuse the LDS still holding this tile's row maxima
+            __syncthreads();
+        }
+        else
+        {
+            cooperative_groups::this_grid().sync();
+        }
+    }
+}
+
+/**
+ * @brief Launch kernel_hgemm_quantized_rows on at most the resident workgroups
+ *
+ * @throws std::invalid_argument if a row of tiles does not fit in the resident workgroups
+ */
+template<kernel_type K_TYPE, class index_t, class Epilogue>
+__host__ void launch_hgemm_quantized_rows(half*           A,
+                                          half*           B,
+                                          size_t          M,
+                                          size_t          N,
+                                          size_t          K,
+                                          const Epilogue& epilogue,
+                                          hipStream_t&    stream)
+{
+    using config = wmma_config<K_TYPE>;
+
+    const int tiles_n = (N + config::block_n - 1) / config::block_n;
+    int       tiles   = ((M + config::block_m - 1) / config::block_m) * tiles_n;
+
+    const dim3 block_dim(warp_size * config::total_warps);
+    auto       kernel   = kernel_hgemm_quantized_rows<K_TYPE, index_t, Epilogue>;
+    const int  resident = resident_grid_size(reinterpret_cast<const void*>(kernel), block_dim.x);
+    if(tiles_n > resident)
+    {
+        throw std::invalid_argument(
+            "Per-row quantization needs a row of output tiles to be resident at once");
+    }
+    const dim3 grid_dim(tiles <= resident ? tiles : resident / tiles_n * tiles_n);
+
+    const half* a = A;
+    const half* b = B;
+    index_t     m = M;
+    index_t     n = N;
+    index_t     k = K;
+    Epilogue    e = epilogue;
+    void*       args[] = {&a, &b, &m, &n, &k, &e, &tiles};
+    HIP_CHECK(hipLaunchCooperativeKernel(
+        reinterpret_cast<const void*>(kernel), grid_dim, block_dim, args, 0, stream));
+}
+
+/**
+ * @brief Workspace required by hgemm_quantized_gpu, in bytes
+ */
+template<kernel_type K_TYPE>
+size_t quantize_workspace_size(size_t M, size_t, quant_granularity granularity)
+{
+    return granularity == quant_granularity::per_row ? M * sizeof(uint32_t) : 0;
+}
+
+/**
+ * Function Definition for a GEMM with quantized output
+ *
+ * Computes Q = quantize(A × B) on a wmma_opt_4 kernel in a single pass.
+ *
+ * @tparam K_TYPE      The type of kernel, 'kernel_type::wmma_opt_4_wgp' (wmma_opt_4 under -mcumode)
+ * @tparam T           Quantized output type (int8_t or fp8_e4m3)
+ * @param Q            Quantized output matrix (row-major M × N)
+ * @param scales       Output scales: M per-row scales, or M × ceil(N / block_n) tile scales
+ * @param A            Input matrix A (stored in column-major format)
+ * @param B            Input matrix B (stored in row-major format)
+ * @param M            Number of rows in matrices A and C
+ * @param N            Number of columns in matrices B and C
+ * @param K            Number of columns in matrix A/rows in matrix B
+ * @param granularity  Scale granularity
+ * @param workspace    Device workspace of quantize_workspace_size() bytes (M per-row maxima)
+ * @param stream       HIP stream to execute kernel
+ *
+ * @throws std::invalid_argument if per-row scales are requested and a row of block_n-wide tiles
+ * exceeds the workgroups the device can keep resident
+ */
+template<kernel_type K_TYPE, class T>
+__host__ void hgemm_quantized_gpu(T*                Q,
+                                  float*            scales,
+                                  half*             A,
+                                  half*             B,
+                                  size_t            M,
+                                  size_t            N,
+                                  size_t            K,
+                                  quant_granularity granularity,
+                                  void*             workspace,
+                                  hipStream_t&      stream)
+{
+    constexpr int block_n = wmma_config<K_TYPE>::block_n;
+    const int     tiles_n = (N + block_n - 1) / block_n;
+
+    if(granularity == quant_granularity::per_tile)
+    {
+        epilogue_quantize<T, quant_granularity::per_tile> epilogue{
+            Q, scales, nullptr, tiles_n, {}};
+        hgemm_gpu<K_TYPE>(nullptr, A, B, M, N, K, epilogue, stream);
+        return;
+    }
+
+    if(M == 0 || N == 0)
+    {
+        return;
+    }
+
+    uint32_t* row_absmax = static_cast<uint32_t*>(workspace);
+    HIP_CHECK(hipMemsetAsync(row_absmax, 0, M * sizeof(uint32_t), stream));
+
+    using epilogue_type = epilogue_quantize<T, quant_granularity::per_row>;
+    const epilogue_type epilogue{Q, scales, row_absmax, tiles_n, {}};
+    if(requires_64bit_index(M, N, K))
+    {
+        launch_hgemm_quantized_rows<K_TYPE, index_policy<true>::type>(
+            A, B, M, N, K, epilogue, stream);
+    }
+    else
+    {
+        launch_hgemm_quantized_rows<K_TYPE, int>(A, B, M, N, K, epilogue, stream);
+    }
+}
+
+#endif // HIP_QUANTIZE_HPP
@@ -0,0 +1,431 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_REDUCE_HPP
+#define HIP_REDUCE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <hip/hip_runtime.h>
+#include <kernels/buffer.hpp>
+#include <kernels/epilogue.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+
+/**
+ * Row/column reductions of the GEMM output
+ *
+ * The reduction epilogue emits per-row and per-column sum, max and sum of squares of C alongside
+ * (or instead of) the full C store, so softmax statistics or layer norms do not have to re-read
+ * C. Reductions see the fp16 values C would hold (after any elementwise epilogue).
+ *
+ * Each workgroup reduces its tile in registers (shuffles within a wave) and LDS (across warps)
+ * and writes one partial per row and column to a workspace. A tiny second pass folds the
+ * partials of all tiles in a fixed order, so results are deterministic without float atomics.
+ */
+
+// Reduction operators: identity, combination of two partials and per-element transform
+struct reduce_sum
+{
+    static constexpr float identity = 0.0f;
+
+    __host__ __device__ static float apply(float a, float b)
+    {
+        return a + b;
+    }
+
+    __host__ __device__ static float map(float x)
+    {
+        return x;
+    }
+};
+
+struct reduce_max
+{
+    static constexpr float identity = -__builtin_huge_valf();
+
+    __host__ __device__ static float apply(float a, float b)
+    {
+        return fmaxf(a, b);
+    }
+
+    __host__ __device__ static float map(float x)
+    {
+        return x;
+    }
+};
+
+struct reduce_sum_sq
+{
+    static constexpr float identity = 0.0f;
+
+    __host__ __device__ static float apply(float a, float b)
+    {
+        return a + b;
+    }
+
+    __host__ __device__ static float map(float x)
+    {
+        return x * x;
+    }
+};
+
+/**
+ * @brief Requested reduction outputs, nullptr entries are skipped
+ *
+ * Row outputs have M elements, column outputs N elements.
+ */
+struct reduce_outputs
+{
+    float* row_sum;
+    float* row_max;
+    float* row_sum_sq;
+    float* col_sum;
+    float* col_max;
+    float* col_sum_sq;
+};
+
+/**
+ * @brief Reduction epilogue
+ *
+ * Applies the elementwise epilogue Child, optionally stores C, and writes per-tile row and column
+ * partials of every requested reduction to the workspace.
+ *
+ * @tparam Child Elementwise epilogue applied before storing and reducing
+ */
+template<class Child = epilogue_acc>
+struct epilogue_reduce
+{
+    using tile_store_tag = void;
+
+    half*          C; // Row-major M × N output, nullptr to only emit the reductions
+    float*         workspace; // Per-tile partials, see reduce_workspace_size()
+    reduce_outputs outputs;
+    Child          child;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t row, index_t col) const
+    {
+        return child(acc, row, col);
+    }
+
+    template<class config, class index_t>
+    __device__ __forceinline__ void
+        store_tile(const half16 (&c_frags)[config::warp_tile_m][config::warp_tile_n],
+                   half*   lds,
+                   index_t block_row,
+                   index_t block_col,
+                   index_t M,
+                   index_t N) const
+    {
+        const int     tid          = threadIdx.x;
+        const int     warp_id      = tid / warp_size;
+        const int     warp_m_base  = (warp_id / config::warps_n) * config::warp_tile_m * wmma_tile;
+        const int     warp_n_base  = (warp_id % config::warps_n) * config::warp_tile_n * wmma_tile;
+        constexpr int half_warp    = warp_size / 2;
+        const int     half_warp_id = (tid % warp_size) / half_warp;
+        const int     half_lane    = tid % half_warp;
+
+        if(C != nullptr)
+        {
+            const buffer_resource rsrc_c = make_buffer_resource(C, static_cast<size_t>(M) * N);
+            for(int wm = 0; wm < config::warp_tile_m; wm++)
+            {
+                const index_t row_base = block_row + warp_m_base + wm * wmma_tile;
+                for(int wn = 0; wn < config::warp_tile_n; wn++)
+                {
+                    const index_t col = block_col + warp_n_base + wn * wmma_tile + half_lane;
+#pragma unroll
+                    for(int i = 0; i < wmma_tile / 2; ++i)
+                    {
+                        const index_t row = row_base + i * 2 + half_warp_id;
+                        store_scalar<index_t>(c_frags[wm][wn][i * 2],
+                                              rsrc_c,
+                                              row_major_offset<index_t>(row, col, N),
+                                              row < M && col < N);
+                    }
+                }
+            }
+        }
+
+        // Partials of row r of every tile are contiguous (index r * tiles_n + tile_n), as are
+        // the partials of column c (index c * tiles_m + tile_m)
+        const index_t tiles_m   = (M + config::block_m - 1) / config::block_m;
+        const index_t tiles_n   = (N + config::block_n - 1) / config::block_n;
+        float*        row_parts = workspace;
+        float*        col_parts = workspace + 3 * M * tiles_n;
+
+        reduce_tile<reduce_sum, config>(outputs.row_sum != nullptr,
+                                        outputs.col_sum != nullptr,
+                                        row_parts,
+                                        col_parts,
+                                        c_frags,
+                                        lds,
+                                        block_row,
+                                        block_col,
+                                        M,
+                                        N);
+        reduce_tile<reduce_max, config>(outputs.row_max != nullptr,
+                                        outputs.col_max != nullptr,
+                                        row_parts + M * tiles_n,
+                                        col_parts + N * tiles_m,
+                                        c_frags,
+                                        lds,
+                                        block_row,
+                                        block_col,
+                                        M,
+                                        N);
+        reduce_tile<reduce_sum_sq, config>(outputs.row_sum_sq != nullptr,
+                                           outputs.col_sum_sq != nullptr,
+                                           row_parts + 2 * M * tiles_n,
+                                           col_parts + 2 * N * tiles_m,
+                                           c_frags,
+                                           lds,
+                                           block_row,
+                                           block_col,
+                                           M,
+                                           N);
+    }
+
+private:
+    /**
+     * @brief Reduce one operator over the rows and/or columns of the tile
+     */
+    template<class Op, class config, class index_t>
+    __device__ __forceinline__ void
+        reduce_tile(bool    rows,
+                    bool    cols,
+                    float*  row_parts,
+                    float*  col_parts,
+                    const half16 (&c_frags)[config::warp_tile_m][config::warp_tile_n],
+                    half*   lds,
+                    index_t block_row,
+                    index_t block_col,
+                    index_t M,
+                    index_t N) const
+    {
+        if(!rows && !cols)
+        {
+            return;
+        }
+
+        const int     tid          = threadIdx.x;
+        const int     warp_id      = tid / warp_size;
+        const int     warp_row     = warp_id / config::warps_n;
+        const int     warp_col     = warp_id % config::warps_n;
+        const int     warp_m_base  = warp_row * config::warp_tile_m * wmma_tile;
+        const int     warp_n_base  = warp_col * config::warp_tile_n * wmma_tile;
+        constexpr int half_warp    = warp_size / 2;
+        const int     half_warp_id = (tid % warp_size) / half_warp;
+        const int     half_lane    = tid % half_warp;
+
+        // One partial per warp for every row (warps_n × block_m) and column (warps_m × block_n)
+        float* lds_rows = reinterpret_cast<float*>(lds);
+        float* lds_cols = lds_rows + config::warps_n * config::block_m;
+
+        // Elements outside C are replaced by the identity so they do not affect the result
+        auto element = [&](int wm, int wn, int i)
+        {
+            const index_t row = block_row + warp_m_base + wm * wmma_tile + i * 2 + half_warp_id;
+            const index_t col = block_col + warp_n_base + wn * wmma_tile + half_lane;
+            return row < M && col < N ? Op::map(static_cast<float>(c_frags[wm][wn][i * 2]))
+                                      : Op::identity;
+        };
+
+        if(rows)
+        {
+            for(int wm = 0; wm < config::warp_tile_m; ++wm)
+            {
+#pragma unroll
+                for(int i = 0; i < wmma_tile / 2; ++i)
+                {
+                    float value = Op::identity;
+                    for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                    {
+                        value = Op::apply(value, element(wm, wn, i));
+                    }
+                    // The 16 lanes of a half-wave hold the 16 columns of a row
+                    for(int offset = half_warp / 2; offset > 0; offset /= 2)
+                    {
+                        value = Op::apply(value, __shfl_xor(value, offset, half_warp));
+                    }
+                    if(half_lane == 0)
+                    {
+                        const int row_local = warp_m_base + wm * wmma_tile + i * 2 + half_warp_id;
+                        lds_rows[warp_col * config::block_m + row_local] = value;
+                    }
+                }
+            }
+        }
+
+        if(cols)
+        {
+            for(int wn = 0; wn < config::warp_tile_n; ++wn)
+            {
+                float value = Op::identity;
+                for(int wm = 0; wm < config::warp_tile_m; ++wm)
+                {
+#pragma unroll
+                    for(int i = 0; i < wmma_tile / 2; ++i)
+                    {
+                        value = Op::apply(value, element(wm, wn, i));
+                    }
+                }
+                // The two half-waves hold the even and odd rows of a column
+                value = Op::apply(value, __shfl_xor(value, half_warp, warp_size));
+                if(half_warp_id == 0)
+                {
+                    const int col_local = warp_n_base + wn * wmma_tile + half_lane;
+                    lds_cols[warp_row * config::block_n + col_local] = value;
+                }
+            }
+        }
+        __syncthreads();
+
+        const index_t tile_m  = block_row / config::block_m;
+        const index_t tile_n  = block_col / config::block_n;
+        const index_t tiles_m = (M + config::block_m - 1) / config::block_m;
+        const index_t tiles_n = (N + config::block_n - 1) / config::block_n;
+
+        // Combine the warp partials in a fixed order
+        for(int r = tid; rows && r < config::block_m; r += blockDim.x)
+        {
+            const index_t row = block_row + r;
+            if(row < M)
+            {
+                float value = Op::identity;
+                for(int w = 0; w < config::warps_n; ++w)
+                {
+                    value = Op::apply(value, lds_rows[w * config::block_m + r]);
+                }
+                row_parts[row * tiles_n + tile_n] = value;
+            }
+        }
+        for(int c = tid; cols && c < config::block_n; c += blockDim.x)
+        {
+            const index_t col = block_col + c;
+            if(col < N)
+            {
+                float value = Op::identity;
+                for(int w = 0; w < config::warps_m; ++w)
+                {
+                    value = Op::apply(value, lds_cols[w * config::block_n + c]);
+                }
+                col_parts[col * tiles_m + tile_m] = value;
+            }
+        }
+        __syncthreads();
+    }
+};
+
+/**
+ * @brief Fold the per-tile partials of each row or column, in tile order
+ *
+ * @tparam Op Reduction operator
+ * @param[out] out      Reduced values (count elements)
+ * @param[in]  partials Partials, tiles consecutive values per output
+ * @param[in]  count    Number of rows or columns
+ * @param[in]  tiles    Number of tiles along the reduced dimension
+ */
+template<class Op>
+__global__ void kernel_reduce_partials(float* out, const float* partials, size_t count, int tiles)
+{
+    for(size_t idx = size_t(blockIdx.x) * blockDim.x + threadIdx.x; idx < count;
+        idx += size_t(gridDim.x) * blockDim.x)
+    {
+        float value = Op::identity;
+        for(int t = 0; t < tiles; ++t)
+        {
+            value = Op::apply(value, partials[idx * tiles + t]);
+        }
+        out[idx] = value;
+    }
+}
+
+/**
+ * @brief Workspace required by hgemm_reduce_gpu, in bytes
+ */
+template<kernel_type K_TYPE>
+size_t reduce_workspace_size(size_t M, size_t N)
+{
+    using config         = wmma_config<K_TYPE>;
+    const size_t tiles_m = (M + config::block_m - 1) / config::block_m;
+    const size_t tiles_n = (N + config::block_n - 1) / config::block_n;
+    return 3 * (M * tiles_n + N * tiles_m) * sizeof(float);
+}
+
+/**
+ * Function Definition for a GEMM with row/column reduction side outputs
+ *
+ * @tparam K_TYPE   The type of kernel, 'kernel_type::wmma_opt_4_wgp' (wmma_opt_4 under -mcumode)
+ * @param C         Output matrix (row-major), or nullptr to only emit the reductions
+ * @param A         Input matrix A (stored in column-major format)
+ * @param B         Input matrix B (stored in row-major format)
+ * @param M         Number of rows in matrices A and C
+ * @param N         Number of columns in matrices B and C
+ * @param K         Number of columns in matrix A/rows in matrix B
+ * @param outputs   Requested reductions (device pointers, nullptr entries are skipped)
+ * @param workspace Device workspace of reduce_workspace_size() bytes
+ * @param stream    HIP stream to execute kernel
+ */
+template<kernel_type K_TYPE>
+__host__ void hgemm_reduce_gpu(half*                 C,
+                               half*                 A,
+                               half*                 B,
+                               size_t                M,
+                               size_t                N,
+                               size_t                K,
+                               const reduce_outputs& outputs,
+                               void*                 workspace,
+                               hipStream_t&          stream)
+{
+    using config         = wmma_config<K_TYPE>;
+    const size_t tiles_m = (M + config::block_m - 1) / config::block_m;
+    const size_t tiles_n = (N + config::block_n - 1) / config::block_n;
+
+    float* partials = static_cast<float*>(workspace);
+    hgemm_gpu<K_TYPE>(C, A, B, M, N, K, epilogue_reduce<>{C, partials, outputs, {}}, stream);
+
+    float* row_parts = partials;
+    float* col_parts = partials + 3 * M * tiles_n;
+
+    constexpr int block_size = 256;
+    auto          fold       = [&](auto op, float* out, const float* parts, size_t count, int tiles)
+    {
+        if(out != nullptr)
+        {
+            const int grid_size = std::min<size_t>((count + block_size - 1) / block_size, 1024);
+            kernel_reduce_partials<decltype(op)>
+                <<<grid_size, block_size, 0, stream>>>(out, parts, count, tiles);
+        }
+    };
+    fold(reduce_sum{}, outputs.row_sum, row_parts, M, tiles_n);
+    fold(reduce_max{}, outputs.row_max, row_parts + M * tiles_n, M, tiles_n);
+    fold(reduce_sum_sq{}, outputs.row_sum_sq, row_parts + 2 * M * tiles_n, M, tiles_n);
+    fold(reduce_sum{}, outputs.col_sum, col_parts, N, tiles_m);
+    fold(reduce_max{}, outputs.col_max, col_parts + N * tiles_m, N, tiles_m);
+    fold(reduce_sum_sq{}, outputs.col_sum_sq, col_parts + 2 * N * tiles_m, N, tiles_m);
+}
+
+#endif // HIP_REDUCE_HPP
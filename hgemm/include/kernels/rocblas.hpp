@@ -25,7 +25,11 @@
 #ifndef HIP_ROCBLAS_HPP
 #define HIP_ROCBLAS_HPP
 
+#include <cstdint>
 #include <kernels/common.hpp>
+
+// rocblas_gemm_ex_get_solutions is part of the beta API
+#define ROCBLAS_BETA_FEATURES_API
 #include <rocblas/rocblas.h>
 
 // Global rocBLAS handle
@@ -58,4 +62,83 @@ template<>
 __host__ void hgemm_gpu<kernel_type::rocblas>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream);
 
+/**
+ * @brief fp16 GEMM through rocblas_gemm_ex, on the same layouts as kernel_type::rocblas
+ *
+ * @param C        Output matrix (column-major)
+ * @param A        Input matrix A (column-major)
+ * @param B        Input matrix B (row-major)
+ * @param M        Number of rows in matrices A and C
+ * @param N        Number of columns in matrices B and C
+ * @param K        Number of columns in matrix A/rows in matrix B
+ * @param compute  Accumulation type, rocblas_datatype_f32_r or rocblas_datatype_f16_r
+ * @param solution Solution index from rocblas_gemm_ex_get_solutions, 0 for the default heuristic
+ * @param stream   HIP stream to execute on
+ */
+__host__ void rocblas_hgemm_ex(half*            C,
+                               const half*      A,
+                               const half*      B,
+                               size_t           M,
+                               size_t           N,
+                               size_t           K,
+                               rocblas_datatype compute,
+                               int32_t          solution,
+                               hipStream_t&     stream);
+
+/**
+ * @brief Fastest rocblas_gemm_ex solution for a shape and compute type
+ *
+ * The first call for a shape times every solution rocBLAS reports (C is overwritten); the
+ * winner is cached by (M, N, K, compute) and returned by later calls without launching anything.
+ *
+ * @return Solution index, 0 if no listed solution beat the default heuristic
+ */
+__host__ int32_t rocblas_tune_solution(half*            C,
+                                       const half*      A,
+                                       const half*      B,
+                                       size_t           M,
+                                       size_t           N,
+                                       size_t           K,
+                                       rocblas_datatype compute,
+                                       hipStream_t&     stream);
+
+/**
+ * @brief Number of shapes in the solution cache
+ */
+size_t rocblas_tuned_shapes();
+
+/**
+ * Function Definition for calling rocblas_gemm_ex with fp32 accumulation and the default
+ * solution
+ *
+ * @tparam K_TYPE The type of kernel, should be 'kernel_type::rocblas_ex'
+ * @param C       Output matrix
+ * @param A       Input matrix A
+ * @param B       Input matrix B
+ * @param M       Number of rows in matrices A and C
+ * @param N       Number of columns in matrices B and C
+ * @param K       Number of columns in matrix A/rows in matrix B
+ * @param stream  HIP stream to execute kernel
+ */
+template<>
+__host__ void hgemm_gpu<kernel_type::rocblas_ex>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream);
+
+/**
+ * Function Definition for calling rocblas_gemm_ex with fp32 accumulation and the per-shape
+ * tuned solution (tuned on first use)
+ *
+ * @tparam K_TYPE The type of kernel, should be 'kernel_type::rocblas_ex_tuned'
+ * @param C       Output matrix
+ * @param A       Input matrix A
+ * @param B       Input matrix B
+ * @param M       Number of rows in matrices A and C
+ * @param N       Number of columns in matrices B and C
+ * @param K       Number of columns in matrix A/rows in matrix B
+ * @param stream  HIP stream to execute kernel
+ */
+template<>
+__host__ void hgemm_gpu<kernel_type::rocblas_ex_tuned>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream);
+
 #endif // HIP_ROCBLAS_HPP
@@ -0,0 +1,314 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIP_STRASSEN_HPP
+#define HIP_STRASSEN_HPP
+
+#include <algorithm>
+#include <hip/hip_runtime.h>
+#include <kernels/epilogue.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+
+/**
+ * @brief Recursion cutoff below which the Strassen–Winograd driver calls the GEMM kernel directly
+ *
+ * The seven leaf products only beat the eight of a plain split once each leaf is large enough
+ * to run wmma_opt_4 at its peak, and every level adds rounding error.
+ */
+constexpr size_t strassen_default_crossover = 4096;
+
+/**
+ * @brief Epilogue of the Strassen–Winograd leaves: sign × acc + coef[0] × E0 + coef[1] × E1
+ *
+ * The addends are row-major matrices shaped like C (nullptr to skip). An addend may alias the
+ * output, as each element is read by the thread that later writes it.
+ */
+struct strassen_combine
+{
+    float       acc_sign  = 1.0f;
+    const half* addend[2] = {nullptr, nullptr};
+    float       coef[2]   = {0.0f, 0.0f};
+    int64_t     ld        = 0;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t row, index_t col) const
+    {
+        float value = acc_sign * acc;
+#pragma unroll
+        for(int i = 0; i < 2; ++i)
+        {
+            if(addend[i] != nullptr)
+            {
+                value += coef[i]
+                         * static_cast<float>(
+                             addend[i][row_major_offset<int64_t>(row, col, ld)]);
+            }
+        }
+        return value;
+    }
+};
+
+/**
+ * @brief Coefficients of the quadrants 11, 12, 21 and 22 in a packed operand
+ */
+struct strassen_quadrants
+{
+    float coef[4];
+};
+
+/**
+ * @brief Pack a signed sum of the quadrants of a rows × cols matrix into a dense half-size matrix
+ *
+ * The sum is formed in fp32 and rounded once, rather than once per Winograd addition.
+ *
+ * @tparam COL_MAJOR Storage order of both source and destination
+ */
+template<bool COL_MAJOR>
+__global__ void kernel_strassen_pack(
+    half* dst, const half* src, size_t rows, size_t cols, strassen_quadrants quadrants)
+{
+    const size_t h_rows = rows / 2;
+    const size_t h_cols = cols / 2;
+    const size_t count  = h_rows * h_cols;
+
+    for(size_t e = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x; e < count;
+        e += static_cast<size_t>(gridDim.x) * blockDim.x)
+    {
+        // Walk the destination in storage order so loads and stores are coalesced
+        const size_t r = COL_MAJOR ? e % h_rows : e / h_cols;
+        const size_t c = COL_MAJOR ? e / h_rows : e % h_cols;
+
+        float value = 0.0f;
+#pragma unroll
+        for(int q = 0; q < 4; ++q)
+        {
+            if(quadrants.coef[q] != 0.0f)
+            {
+                const size_t row = r + (q / 2) * h_rows;
+                const size_t col = c + (q % 2) * h_cols;
+                const size_t idx = COL_MAJOR ? col * rows + row : row * cols + col;
+                value += quadrants.coef[q] * static_cast<float>(src[idx]);
+            }
+        }
+        dst[e] = static_cast<half>(value);
+    }
+}
+
+/**
+ * @brief Scatter the Winograd quadrants of C into the row-major M × N output
+ *
+ * C11 = R11, C12 = R12, C21 = R21 and C22 = Y + Z, each then passed through the caller's
+ * combine so that an outer level's additions stay fused.
+ */
+inline __global__ void kernel_strassen_assemble(half*            C,
+                                                size_t           M,
+                                                size_t           N,
+                                                const half*      r11,
+                                                const half*      r12,
+                                                const half*      r21,
+                                                const half*      y,
+                                                const half*      z,
+                                                strassen_combine combine)
+{
+    const size_t h_m   = M / 2;
+    const size_t h_n   = N / 2;
+    const size_t count = M * N;
+
+    for(size_t e = static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x; e < count;
+        e += static_cast<size_t>(gridDim.x) * blockDim.x)
+    {
+        const size_t row = e / N;
+        const size_t col = e % N;
+        const size_t idx = (row % h_m) * h_n + (col % h_n);
+
+        float value;
+        if(row < h_m)
+        {
+            value = static_cast<float>(col < h_n ? r11[idx] : r12[idx]);
+        }
+        else if(col < h_n)
+        {
+            value = static_cast<float>(r21[idx]);
+        }
+        else
+        {
+            value = static_cast<float>(y[idx]) + static_cast<float>(z[idx]);
+        }
+        C[e] = static_cast<half>(
+            combine(value, static_cast<int64_t>(row), static_cast<int64_t>(col)));
+    }
+}
+
+/**
+ * @brief Whether an M × N × K GEMM is split further rather than run as a leaf
+ */
+inline bool strassen_splits(size_t M, size_t N, size_t K, size_t crossover)
+{
+    return std::min({M, N, K}) > crossover && M % 2 == 0 && N % 2 == 0 && K % 2 == 0;
+}
+
+/**
+ * @brief Number of recursion levels the driver uses for an M × N × K GEMM
+ */
+inline int strassen_levels(size_t M, size_t N, size_t K, size_t crossover)
+{
+    int levels = 0;
+    for(; strassen_splits(M, N, K, crossover); M /= 2, N /= 2, K /= 2)
+    {
+        ++levels;
+    }
+    return levels;
+}
+
+/**
+ * @brief Workspace required by hgemm_strassen_gpu, in bytes
+ *
+ * Each level needs one packed A and B operand plus six h_m × h_n products, and the levels are
+ * carved from the workspace as a stack.
+ */
+inline size_t strassen_workspace_size(size_t M, size_t N, size_t K, size_t crossover)
+{
+    size_t elements = 0;
+    for(; strassen_splits(M, N, K, crossover); M /= 2, N /= 2, K /= 2)
+    {
+        elements += (M / 2) * (K / 2) + (K / 2) * (N / 2) + 6 * (M / 2) * (N / 2);
+    }
+    return elements * sizeof(half);
+}
+
+/**
+ * @brief Grid for the elementwise Strassen kernels, capped since they loop over their range
+ */
+inline dim3 strassen_grid(size_t count)
+{
+    return dim3(static_cast<unsigned int>(std::min<size_t>((count + 255) / 256, 65536)));
+}
+
+/**
+ * @brief One level of the Strassen–Winograd recursion, computing combine(A × B) into C
+ */
+template<kernel_type K_TYPE>
+__host__ void strassen_recurse(half*                   C,
+                               half*                   A,
+                               half*                   B,
+                               size_t                  M,
+                               size_t                  N,
+                               size_t                  K,
+                               const strassen_combine& combine,
+                               size_t                  crossover,
+                               half*                   workspace,
+                               hipStream_t&            stream)
+{
+    if(!strassen_splits(M, N, K, crossover))
+    {
+        hgemm_gpu<K_TYPE>(C, A, B, M, N, K, combine, stream);
+        return;
+    }
+
+    const size_t h_m = M / 2;
+    const size_t h_n = N / 2;
+    const size_t h_k = K / 2;
+
+    half* a_op = workspace;
+    half* b_op = a_op + h_m * h_k;
+    half* x    = b_op + h_k * h_n;
+    half* y    = x + h_m * h_n;
+    half* z    = y + h_m * h_n;
+    half* r11  = z + h_m * h_n;
+    half* r12  = r11 + h_m * h_n;
+    half* r21  = r12 + h_m * h_n;
+    half* next = r21 + h_m * h_n;
+
+    const dim3 block_dim(256);
+
+    // A is column-major M × K and B row-major K × N, as expected by wmma_opt_4
+    auto product = [&](strassen_quadrants a, strassen_quadrants b, half* dst, strassen_combine c)
+    {
+        kernel_strassen_pack<true>
+            <<<strassen_grid(h_m * h_k), block_dim, 0, stream>>>(a_op, A, M, K, a);
+        kernel_strassen_pack<false>
+            <<<strassen_grid(h_k * h_n), block_dim, 0, stream>>>(b_op, B, K, N, b);
+        c.ld = static_cast<int64_t>(h_n);
+        strassen_recurse<K_TYPE>(dst, a_op, b_op, h_m, h_n, h_k, c, crossover, next, stream);
+    };
+
+    // Winograd's schedule of seven products, with the additions on C fused into the leaves:
+    // S1 = A21 + A22, S2 = S1 - A11, S3 = A11 - A21, S4 = A12 - S2
+    // T1 = B12 - B11, T2 = B22 - T1, T3 = B22 - B12, T4 = T2 - B21
+    // M1 = A11 B11 -> X
+    product({1, 0, 0, 0}, {1, 0, 0, 0}, x, {});
+    // C11 = M1 + M2, M2 = A12 B21
+    product({0, 1, 0, 0}, {0, 0, 1, 0}, r11, {1.0f, {x, nullptr}, {1.0f, 0.0f}});
+    // U2 = M1 + M6, M6 = S2 T2 (in place in X)
+    product({-1, 0, 1, 1}, {1, -1, 0, 1}, x, {1.0f, {x, nullptr}, {1.0f, 0.0f}});
+    // U3 = U2 + M7, M7 = S3 T3 -> Y
+    product({1, 0, -1, 0}, {0, -1, 0, 1}, y, {1.0f, {x, nullptr}, {1.0f, 0.0f}});
+    // M5 = S1 T1 -> Z
+    product({0, 0, 1, 1}, {-1, 1, 0, 0}, z, {});
+    // C12 = U2 + M5 + M3, M3 = S4 B22
+    product({1, 1, -1, -1}, {0, 0, 0, 1}, r12, {1.0f, {x, z}, {1.0f, 1.0f}});
+    // C21 = U3 - M4, M4 = A22 T4
+    product({0, 0, 0, 1}, {1, -1, -1, 1}, r21, {-1.0f, {y, nullptr}, {1.0f, 0.0f}});
+
+    // C22 = U3 + M5
+    kernel_strassen_assemble<<<strassen_grid(M * N), block_dim, 0, stream>>>(
+        C, M, N, r11, r12, r21, y, z, combine);
+}
+
+/**
+ * @brief Strassen–Winograd GEMM over the wmma_opt_4 kernels for very large problems
+ *
+ * Splits into quadrants while every dimension is even and larger than the crossover, running
+ * seven half-size products per level instead of eight. The leaves are plain hgemm_gpu calls
+ * with the Winograd additions on C fused into their epilogues; the additions on A and B are
+ * formed in fp32 while packing the leaf operands. Every level roughly doubles the error against
+ * an fp32 reference on random data, so the crossover should stay large.
+ *
+ * @tparam K_TYPE    wmma_opt_4_wgp, or wmma_opt_4 under -mcumode
+ * @param C          M × N row-major output
+ * @param A          M × K column-major input
+ * @param B          K × N row-major input
+ * @param M          Number of rows in matrices A and C
+ * @param N          Number of columns in matrices B and C
+ * @param K          Number of columns in matrix A/rows in matrix B
+ * @param crossover  Recursion stops once any dimension is at or below this size
+ * @param workspace  strassen_workspace_size(M, N, K, crossover) bytes
+ * @param stream     HIP stream to execute kernels
+ */
+template<kernel_type K_TYPE>
+__host__ void hgemm_strassen_gpu(half*        C,
+                                 half*        A,
+                                 half*        B,
+                                 size_t       M,
+                                 size_t       N,
+                                 size_t       K,
+                                 size_t       crossover,
+                                 void*        workspace,
+                                 hipStream_t& stream)
+{
+    strassen_recurse<K_TYPE>(
+        C, A, B, M, N, K, strassen_combine{}, crossover, static_cast<half*>(workspace), stream);
+}
+
+#endif // HIP_STRASSEN_HPP
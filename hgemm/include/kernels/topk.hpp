@@ -0,0 +1,327 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_TOPK_HPP
+#define HIP_TOPK_HPP
+
+#include <climits>
+#include <cstdint>
+#include <hip/hip_runtime.h>
+#include <kernels/epilogue.hpp>
+#include <kernels/wmma_opt_4_fused.hpp>
+
+/**
+ * Fused GEMM + per-row top-k
+ *
+ * For similarity search (queries × database^T) only the k best scores of each row are needed.
+ * The top-k epilogue replaces the store of C: each workgroup stages its tile in LDS one chunk
+ * of rows at a time, selects the top-k of every row with register-resident sorted lists merged
+ * across lanes with shuffles, and writes one list per (row, N tile) to a workspace. A merge pass
+ * then reduces the lists of all N tiles to the final (score, index) pairs. The workspace holds
+ * 8 * TOPK bytes per row and tile, against 2 * block_n bytes for the fp16 C it replaces.
+ *
+ * Ordering is by descending score, ties broken by ascending column index. Rows with fewer than
+ * k columns are padded with (-inf, -1). Scores are the fp16 values C would hold.
+ */
+
+/**
+ * @brief Whether (s1, i1) ranks before (s2, i2)
+ */
+__host__ __device__ __forceinline__ bool topk_before(float s1, int i1, float s2, int i2)
+{
+    return s1 > s2 || (s1 == s2 && i1 < i2);
+}
+
+/**
+ * @brief Initialize a top-k list to empty slots
+ */
+template<int TOPK>
+__host__ __device__ __forceinline__ void topk_init(float (&score)[TOPK], int (&index)[TOPK])
+{
+#pragma unroll
+    for(int j = 0; j < TOPK; ++j)
+    {
+        score[j] = -__builtin_huge_valf();
+        index[j] = INT_MAX;
+    }
+}
+
+/**
+ * @brief Insert a candidate into a sorted top-k list
+ *
+ * The candidate bubbles through the list with selects only, so the list stays in registers.
+ */
+template<int TOPK>
+__host__ __device__ __forceinline__ void
+    topk_insert(float (&score)[TOPK], int (&index)[TOPK], float s, int i)
+{
+    if(!topk_before(s, i, score[TOPK - 1], index[TOPK - 1]))
+    {
+        return;
+    }
+#pragma unroll
+    for(int j = 0; j < TOPK; ++j)
+    {
+        const bool  take = topk_before(s, i, score[j], index[j]);
+        const float ts   = score[j];
+        const int   ti   = index[j];
+        score[j]         = take ? s : ts;
+        index[j]         = take ? i : ti;
+        s                = take ? ts : s;
+        i                = take ? ti : i;
+    }
+}
+
+/**
+ * @brief Merge the top-k lists of GROUP consecutive lanes, leaving the result in every lane
+ */
+template<int TOPK, int GROUP>
+__device__ __forceinline__ void topk_merge_lanes(float (&score)[TOPK], int (&index)[TOPK])
+{
+#pragma unroll
+    for(int offset = GROUP / 2; offset > 0; offset /= 2)
+    {
+        float other_score[TOPK];
+        int   other_index[TOPK];
+#pragma unroll
+        for(int j = 0; j < TOPK; ++j)
+        {
+            other_score[j] = __shfl_xor(score[j], offset, GROUP);
+            other_index[j] = __shfl_xor(index[j], offset, GROUP);
+        }
+#pragma unroll
+        for(int j = 0; j < TOPK; ++j)
+        {
+            topk_insert(score, index, other_score[j], other_index[j]);
+        }
+    }
+}
+
+/**
+ * @brief Top-k epilogue
+ *
+ * @tparam TOPK  Number of results per row
+ * @tparam Child Elementwise epilogue applied to the scores before selection
+ */
+template<int TOPK, class Child = epilogue_acc>
+struct epilogue_topk
+{
+    using tile_store_tag = void;
+
+    float* scores; // M × tiles_n × TOPK partial scores
+    int*   indices; // M × tiles_n × TOPK partial column indices
+    int    tiles_n; // Number of N tiles (ceil(N / block_n))
+    Child  child;
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ float operator()(float acc, index_t row, index_t col) const
+    {
+        return child(acc, row, col);
+    }
+
+    template<class config, class index_t>
+    __device__ __forceinline__ void
+        store_tile(const half16 (&c_frags)[config::warp_tile_m][config::warp_tile_n],
+                   half*   lds,
+                   index_t block_row,
+                   index_t block_col,
+                   index_t M,
+                   index_t N) const
+    {
+        // Rows of the tile staged in LDS at once, and lanes cooperating on each row
+        constexpr int max_shared_elements = 2 * config::lds_size;
+        constexpr int rows_per_chunk      = max_shared_elements / config::block_n < config::block_m
+                                                ? max_shared_elements / config::block_n
+                                                : config::block_m;
+        constexpr int num_threads         = warp_size * config::total_warps;
+        constexpr int group               = num_threads / rows_per_chunk;
+        static_assert((group & (group - 1)) == 0 && group <= warp_size,
+                      "Lanes per row must be a power of two within a wave");
+
+        const int     tid          = threadIdx.x;
+        const int     warp_id      = tid / warp_size;
+        const int     warp_m_base  = (warp_id / config::warps_n) * config::warp_tile_m * wmma_tile;
+        const int     warp_n_base  = (warp_id % config::warps_n) * config::warp_tile_n * wmma_tile;
+        constexpr int half_warp    = warp_size / 2;
+        const int     half_warp_id = (tid % warp_size) / half_warp;
+        const int     half_lane    = tid % half_warp;
+        const int     tile_n       = block_col / config::block_n;
+
+        half* c_tile = lds;
+
+        for(int row_start = 0; row_start < config::block_m; row_start += rows_per_chunk)
+        {
+            // Step 1: Store the fragments of this chunk to shared memory
+            for(int wm = 0; wm < config::warp_tile_m; ++wm)
+            {
+                const int warp_m_local = warp_m_base + wm * wmma_tile - row_start;
+                if(warp_m_local < 0 || warp_m_local >= rows_per_chunk)
+                {
+                    continue;
+                }
+                for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                {
+#pragma unroll
+                    for(int i = 0; i < wmma_tile / 2; ++i)
+                    {
+                        const int row_local = warp_m_local + i * 2 + half_warp_id;
+                        const int col_local = warp_n_base + wn * wmma_tile + half_lane;
+                        c_tile[row_local * config::block_n + col_local] = c_frags[wm][wn][i * 2];
+                    }
+                }
+            }
+            __syncthreads();
+
+            // Step 2: Each group of lanes selects the top-k of one row
+            const int     row_local = tid / group;
+            const int     member    = tid % group;
+            const index_t row       = block_row + row_start + row_local;
+
+            float score[TOPK];
+            int   index[TOPK];
+            topk_init(score, index);
+
+            for(int col_local = member; col_local < config::block_n; col_local += group)
+            {
+                const index_t col = block_col + col_local;
+                if(col < N)
+                {
+                    topk_insert(score,
+                                index,
+                                static_cast<float>(c_tile[row_local * config::block_n + col_local]),
+                                static_cast<int>(col));
+                }
+            }
+            topk_merge_lanes<TOPK, group>(score, index);
+
+            if(member == 0 && row < M)
+            {
+                const index_t base = (row * tiles_n + tile_n) * TOPK;
+#pragma unroll
+                for(int j = 0; j < TOPK; ++j)
+                {
+                    scores[base + j]  = score[j];
+                    indices[base + j] = index[j];
+                }
+            }
+            __syncthreads();
+        }
+    }
+};
+
+/**
+ * @brief Merge the per-tile top-k lists of every row, one wave per row
+ *
+ * @tparam TOPK Number of results per row
+ * @param[out] out_scores   M × TOPK scores, descending
+ * @param[out] out_indices  M × TOPK column indices (-1 for empty slots)
+ * @param[in]  part_scores  M × tiles_n × TOPK partial scores
+ * @param[in]  part_indices M × tiles_n × TOPK partial indices
+ * @param[in]  tiles_n      Number of N tiles
+ */
+template<int TOPK>
+__global__ void kernel_topk_merge(float*       out_scores,
+                                  int*         out_indices,
+                                  const float* part_scores,
+                                  const int*   part_indices,
+                                  int          tiles_n)
+{
+    const size_t row  = blockIdx.x;
+    const int    lane = threadIdx.x;
+
+    float score[TOPK];
+    int   index[TOPK];
+    topk_init(score, index);
+
+    const size_t base = row * tiles_n * TOPK;
+    for(int c = lane; c < tiles_n * TOPK; c += warp_size)
+    {
+        topk_insert(score, index, part_scores[base + c], part_indices[base + c]);
+    }
+    topk_merge_lanes<TOPK, warp_size>(score, index);
+
+    if(lane == 0)
+    {
+#pragma unroll
+        for(int j = 0; j < TOPK; ++j)
+        {
+            out_scores[row * TOPK + j]  = score[j];
+            out_indices[row * TOPK + j] = index[j] == INT_MAX ? -1 : index[j];
+        }
+    }
+}
+
+/**
+ * @brief Workspace required by hgemm_topk_gpu, in bytes
+ */
+template<kernel_type K_TYPE, int TOPK>
+size_t topk_workspace_size(size_t M, size_t N)
+{
+    const size_t tiles_n = (N + wmma_config<K_TYPE>::block_n - 1) / wmma_config<K_TYPE>::block_n;
+    return M * tiles_n * TOPK * (sizeof(float) + sizeof(int));
+}
+
+/**
+ * Function Definition for a fused GEMM + per-row top-k
+ *
+ * Returns the TOPK largest entries of every row of A × B without materializing it.
+ *
+ * @tparam K_TYPE  The type of kernel, 'kernel_type::wmma_opt_4_wgp' (wmma_opt_4 under -mcumode)
+ * @tparam TOPK    Number of results per row (N must fit in int)
+ * @param scores    M × TOPK output scores, descending
+ * @param indices   M × TOPK output column indices (-1 for empty slots)
+ * @param A         Input matrix A, e.g. queries (stored in column-major format)
+ * @param B         Input matrix B, e.g. database^T (stored in row-major format)
+ * @param M         Number of rows in matrix A
+ * @param N         Number of columns in matrix B
+ * @param K         Number of columns in matrix A/rows in matrix B
+ * @param workspace Device workspace of topk_workspace_size() bytes
+ * @param stream    HIP stream to execute kernel
+ */
+template<kernel_type K_TYPE, int TOPK>
+__host__ void hgemm_topk_gpu(float*       scores,
+                             int*         indices,
+                             half*        A,
+                             half*        B,
+                             size_t       M,
+                             size_t       N,
+                             size_t       K,
+                             void*        workspace,
+                             hipStream_t& stream)
+{
+    static_assert(TOPK > 0 && TOPK <= 32, "TOPK must be in [1, 32]");
+    const int tiles_n = (N + wmma_config<K_TYPE>::block_n - 1) / wmma_config<K_TYPE>::block_n;
+
+    float* part_scores  = static_cast<float*>(workspace);
+    int*   part_indices = reinterpret_cast<int*>(part_scores + M * tiles_n * TOPK);
+
+    epilogue_topk<TOPK> epilogue{part_scores, part_indices, tiles_n, {}};
+    hgemm_gpu<K_TYPE>(nullptr, A, B, M, N, K, epilogue, stream);
+
+    kernel_topk_merge<TOPK>
+        <<<M, warp_size, 0, stream>>>(scores, indices, part_scores, part_indices, tiles_n);
+}
+
+#endif // HIP_TOPK_HPP
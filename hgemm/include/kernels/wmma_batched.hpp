@@ -0,0 +1,90 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HIP_WMMA_BATCHED_HPP
+#define HIP_WMMA_BATCHED_HPP
+
+#include <common/matrix.hpp>
+#include <kernels/common.hpp>
+
+/**
+ * @brief Configuration of the batched tiny-matrix kernel
+ *
+ * Each wave owns whole problems: the full C tile stays in registers for the length of K, so
+ * there is no LDS staging and no block-level synchronization. Blocks only group waves to keep
+ * the launch small.
+ */
+struct batched_config
+{
+    static constexpr int waves_per_block = 4;
+    // Largest M or N handled by a single wave (4 × 4 WMMA tiles, 16 half16 accumulators)
+    static constexpr int max_dim = 64;
+    // Upper bound on the grid, beyond which each wave loops over several problems
+    static constexpr int max_blocks = 1 << 16;
+};
+
+/**
+ * @brief Batched half-precision GEMM over many independent tiny problems
+ *
+ * Problem p computes C[p] = A[p] × B[p], with the problems packed back to back. A is row-major
+ * M × K and B column-major K × N, so a lane of a WMMA fragment reads one contiguous row of A
+ * or column of B, and C is row-major M × N (the same layouts as wmma_naive).
+ *
+ * @tparam TILE  Edge of the per-wave C tile (16, 32 or 64), which must cover M and N
+ * @param[out] C     batch × M × N output matrices
+ * @param[in]  A     batch × M × K input matrices
+ * @param[in]  B     batch × K × N input matrices
+ * @param[in]  M     Number of rows in each A and C
+ * @param[in]  N     Number of columns in each B and C
+ * @param[in]  K     Number of columns in each A/rows in each B
+ * @param[in]  batch Number of problems
+ */
+template<int TILE>
+__global__ void kernel_hgemm_batched(
+    half* C, const half* A, const half* B, int M, int N, int K, size_t batch);
+
+/**
+ * @brief Launch the batched tiny-matrix GEMM, picking the smallest per-wave tile covering M and N
+ *
+ * @param C      batch × M × N row-major output matrices
+ * @param A      batch × M × K row-major input matrices
+ * @param B      batch × K × N column-major input matrices
+ * @param M      Number of rows in each A and C (at most batched_config::max_dim)
+ * @param N      Number of columns in each B and C (at most batched_config::max_dim)
+ * @param K      Number of columns in each A/rows in each B
+ * @param batch  Number of problems
+ * @param stream HIP stream to execute kernel
+ *
+ * @throws std::invalid_argument if M or N exceeds batched_config::max_dim
+ */
+__host__ void hgemm_batched_gpu(half*        C,
+                                const half*  A,
+                                const half*  B,
+                                size_t       M,
+                                size_t       N,
+                                size_t       K,
+                                size_t       batch,
+                                hipStream_t& stream);
+
+#endif // HIP_WMMA_BATCHED_HPP
@@ -54,7 +54,44 @@ struct wmma_config<kernel_type::wmma_opt_2>
     static constexpr int vector_width = (sizeof(float16) / sizeof(half));
 };
 
-using config_o2 = wmma_config<kernel_type::wmma_opt_2>;
+/**
+ * @brief Configuration of the WGP-mode build of wmma_opt_2
+ *
+ * wmma_opt_2 already double-buffers 32-deep K tiles, which take 64 KB in CU mode, so the
+ * WGP LDS budget (see wgp_lds_budget) derives the same block_k. The two builds differ only in
+ * LDS mode: in WGP mode the waves of a workgroup may run on both CUs of the WGP.
+ */
+template<>
+struct wmma_config<kernel_type::wmma_opt_2_wgp>
+{
+    static constexpr int warps_m     = 4;
+    static constexpr int warps_n     = 4;
+    static constexpr int total_warps = warps_m * warps_n;
+
+    static constexpr int warp_tile_m = 4;
+    static constexpr int warp_tile_n = 4;
+
+    static constexpr int block_m = warps_m * warp_tile_m * wmma_tile; // 4*4*16 = 256
+    static constexpr int block_n = warps_n * warp_tile_n * wmma_tile; // 4*4*16 = 256
+
+    // Two buffers of A and B tiles per workgroup: 64 KB / (2 * (256 + 256) * 2 B) = 32
+    static constexpr int block_k = wgp_lds_budget::block_k(block_m, block_n);
+
+    // For A (stored column-major), each column has block_m elements.
+    static constexpr int lds_stride_A = block_m;
+    // For B (stored row-major), each row has block_n elements.
+    static constexpr int lds_stride_B = block_n;
+    // Total shared memory size: region for A plus region for B.
+    static constexpr int lds_size = (block_m * block_k) + (block_k * block_n);
+
+    // Vector loading configuration (512-bits = 4 128-bit loads)
+    using vector_type                 = float16;
+    static constexpr int vector_width = (sizeof(float16) / sizeof(half));
+
+    static_assert(2 * lds_size * sizeof(half) == wgp_lds_budget::workgroup_lds_bytes,
+                  "Double-buffered tiles must fill the workgroup's share of the WGP LDS");
+    static_assert(block_k % wmma_tile == 0, "block_k must be a multiple of the WMMA tile");
+};
 
 /**
  * @brief Half-precision GEMM using WMMA with shared memory, shared double buffering,
@@ -67,8 +104,9 @@ using config_o2 = wmma_config<kernel_type::wmma_opt_2>;
  * in parallel. The kernel also incorporates Hilbert-curve mapping for improved L2 cache locality.
  * This kernel also re-orders fragment loading to improve efficiency and uses
  * __launch_bounds__ to limit register pressure. -mcumode is also used to compile this kernel.
- * This kernel relies on buffer load/store instructions for better out-of-bounds access performance; if manual
- * boundary checking is enabled performance takes a hit (prefer wmma_opt_3 in such cases).
+ * Global loads and stores use raw buffer instructions with descriptors sized to each operand
+ * (see kernels/buffer.hpp), so out-of-bounds reads return zero and out-of-bounds writes are dropped
+ * by the hardware instead of being handled with branches.
  *
  * @tparam K_TYPE The type of kernel, should be 'kernel_type::wmma_opt_2'
  * @param[out] C  Output matrix of size M × N
@@ -85,8 +123,19 @@ using config_o2 = wmma_config<kernel_type::wmma_opt_2>;
     * @note Uses Hilbert-curve mapping for improved cache locality
     */
 template<>
-__global__ void
-    __launch_bounds__(warp_size* config_o2::total_warps) kernel_hgemm<kernel_type::wmma_opt_2>(
+__global__ void __launch_bounds__(warp_size* wmma_config<kernel_type::wmma_opt_2>::total_warps)
+    kernel_hgemm<kernel_type::wmma_opt_2>(
+        half* C, const half* A, const half* B, int M, int N, int K);
+
+/**
+ * @brief WGP-mode build of the wmma_opt_2 kernel
+ *
+ * Same source as wmma_opt_2 (src/wmma_opt_2_wgp.cpp), compiled without -mcumode and using
+ * wmma_config<kernel_type::wmma_opt_2_wgp> so both modes can be benchmarked side by side.
+ */
+template<>
+__global__ void __launch_bounds__(warp_size* wmma_config<kernel_type::wmma_opt_2_wgp>::total_warps)
+    kernel_hgemm<kernel_type::wmma_opt_2_wgp>(
         half* C, const half* A, const half* B, int M, int N, int K);
 
 /**
@@ -105,4 +154,20 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_opt_2>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream);
 
+/**
+ * Function Definition for calling the WGP-mode WMMA Optimized V2 GEMM kernel
+ *
+ * @tparam K_TYPE The type of kernel, should be 'kernel_type::wmma_opt_2_wgp'
+ * @param C       Output matrix
+ * @param A       Input matrix A (stored in column-major format)
+ * @param B       Input matrix B (stored in row-major format)
+ * @param M       Number of rows in matrices A and C
+ * @param N       Number of columns in matrices B and C
+ * @param K       Number of columns in matrix A/rows in matrix B
+ * @param stream  HIP stream to execute kernel
+ */
+template<>
+__host__ void hgemm_gpu<kernel_type::wmma_opt_2_wgp>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream);
+
 #endif // HIP_WMMA_OPT_2_HPP
@@ -54,7 +54,44 @@ struct wmma_config<kernel_type::wmma_opt_3>
     static constexpr int vector_width = (sizeof(float16) / sizeof(half));
 };
 
-using config_o3 = wmma_config<kernel_type::wmma_opt_3>;
+/**
+ * @brief Configuration of the WGP-mode build of wmma_opt_3
+ *
+ * Sized so that the workgroups resident on a WGP together fill its 128 KB of LDS (see
+ * wgp_lds_budget), which gives a block_k of 32: the register prefetch stage moves twice as much
+ * data per K iteration and the kernel crosses half as many barriers as the CU-mode build.
+ */
+template<>
+struct wmma_config<kernel_type::wmma_opt_3_wgp>
+{
+    static constexpr int warps_m     = 4;
+    static constexpr int warps_n     = 4;
+    static constexpr int total_warps = warps_m * warps_n;
+
+    static constexpr int warp_tile_m = 4;
+    static constexpr int warp_tile_n = 4;
+
+    static constexpr int block_m = warps_m * warp_tile_m * wmma_tile; // 4*4*16 = 256
+    static constexpr int block_n = warps_n * warp_tile_n * wmma_tile; // 4*4*16 = 256
+
+    // Two buffers of A and B tiles per workgroup: 64 KB / (2 * (256 + 256) * 2 B) = 32
+    static constexpr int block_k = wgp_lds_budget::block_k(block_m, block_n);
+
+    // For A (stored column-major), each column has block_m elements.
+    static constexpr int lds_stride_A = block_m;
+    // For B (stored row-major), each row has block_n elements.
+    static constexpr int lds_stride_B = block_n;
+    // Total shared memory size: region for A plus region for B.
+    static constexpr int lds_size = (block_m * block_k) + (block_k * block_n);
+
+    // Vector loading configuration (512-bits = 4 128-bit loads)
+    using vector_type                 = float16;
+    static constexpr int vector_width = (sizeof(float16) / sizeof(half));
+
+    static_assert(2 * lds_size * sizeof(half) == wgp_lds_budget::workgroup_lds_bytes,
+                  "Double-buffered tiles must fill the workgroup's share of the WGP LDS");
+    static_assert(block_k % wmma_tile == 0, "block_k must be a multiple of the WMMA tile");
+};
 
 /**
  * @brief Half-precision GEMM using WMMA with a 3-pipeline using register prefetching
@@ -81,8 +118,19 @@ using config_o3 = wmma_config<kernel_type::wmma_opt_3>;
  * @note Each warp processes a 4×4 grid of 16×16 WMMA tiles
  */
 template<>
-__global__ void
-    __launch_bounds__(warp_size* config_o3::total_warps) kernel_hgemm<kernel_type::wmma_opt_3>(
+__global__ void __launch_bounds__(warp_size* wmma_config<kernel_type::wmma_opt_3>::total_warps)
+    kernel_hgemm<kernel_type::wmma_opt_3>(
+        half* C, const half* A, const half* B, int M, int N, int K);
+
+/**
+ * @brief WGP-mode build of the wmma_opt_3 kernel
+ *
+ * Same source as wmma_opt_3 (src/wmma_opt_3_wgp.cpp), compiled without -mcumode and using
+ * wmma_config<kernel_type::wmma_opt_3_wgp> so both modes can be benchmarked side by side.
+ */
+template<>
+__global__ void __launch_bounds__(warp_size* wmma_config<kernel_type::wmma_opt_3_wgp>::total_warps)
+    kernel_hgemm<kernel_type::wmma_opt_3_wgp>(
         half* C, const half* A, const half* B, int M, int N, int K);
 
 /**
@@ -101,4 +149,20 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_opt_3>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream);
 
+/**
+ * Function Definition for calling the WGP-mode WMMA Optimized V3 GEMM kernel
+ *
+ * @tparam K_TYPE The type of kernel, should be 'kernel_type::wmma_opt_3_wgp'
+ * @param C       Output matrix
+ * @param A       Input matrix A (stored in column-major format)
+ * @param B       Input matrix B (stored in row-major format)
+ * @param M       Number of rows in matrices A and C
+ * @param N       Number of columns in matrices B and C
+ * @param K       Number of columns in matrix A/rows in matrix B
+ * @param stream  HIP stream to execute kernel
+ */
+template<>
+__host__ void hgemm_gpu<kernel_type::wmma_opt_3_wgp>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream);
+
 #endif // HIP_WMMA_OPT_3_HPP
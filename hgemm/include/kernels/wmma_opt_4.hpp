@@ -56,6 +56,47 @@ struct wmma_config<kernel_type::wmma_opt_4>
 
 using config_o4 = wmma_config<kernel_type::wmma_opt_4>;
 
+/**
+ * @brief Configuration of the WGP-mode build of wmma_opt_4
+ *
+ * The WGP-mode build is compiled without -mcumode from the same source, and is sized so that
+ * the workgroups resident on a WGP together fill its 128 KB of LDS (see wgp_lds_budget). This
+ * gives a block_k of 32: half the barriers per K iteration of the CU-mode build.
+ */
+template<>
+struct wmma_config<kernel_type::wmma_opt_4_wgp>
+{
+    static constexpr int warps_m     = 4;
+    static constexpr int warps_n     = 4;
+    static constexpr int total_warps = warps_m * warps_n;
+
+    static constexpr int warp_tile_m = 4;
+    static constexpr int warp_tile_n = 4;
+
+    static constexpr int block_m = warps_m * warp_tile_m * wmma_tile; // 4*4*16 = 256
+    static constexpr int block_n = warps_n * warp_tile_n * wmma_tile; // 4*4*16 = 256
+
+    // Two buffers of A and B tiles per workgroup: 64 KB / (2 * (256 + 256) * 2 B) = 32
+    static constexpr int block_k = wgp_lds_budget::block_k(block_m, block_n);
+
+    // For A (stored column-major), each column has block_m elements.
+    static constexpr int lds_stride_A = block_m;
+    // For B (stored row-major), each row has block_n elements.
+    static constexpr int lds_stride_B = block_n;
+    // Total shared memory size: region for A plus region for B.
+    static constexpr int lds_size = (block_m * block_k) + (block_k * block_n);
+
+    // Vector loading configuration (512-bits = 4 128-bit loads)
+    using vector_type                 = float16;
+    static constexpr int vector_width = (sizeof(float16) / sizeof(half));
+
+    static_assert(2 * lds_size * sizeof(half) == wgp_lds_budget::workgroup_lds_bytes,
+                  "Double-buffered tiles must fill the workgroup's share of the WGP LDS");
+    static_assert(block_k % wmma_tile == 0, "block_k must be a multiple of the WMMA tile");
+};
+
+using config_o4_wgp = wmma_config<kernel_type::wmma_opt_4_wgp>;
+
 /**
  * @brief Half-precision GEMM using WMMA with shared memory, shared double buffering,
  * warp tiling, cooperative loading, Hilbert-curve mapping, and vectorized global 512-bit (4 128-bit) loads/writes
@@ -68,8 +109,9 @@ using config_o4 = wmma_config<kernel_type::wmma_opt_4>;
  * This kernel also re-orders fragment loading to improve efficiency and uses
  * __launch_bounds__ to limit register pressure. -mcumode is also used to compile this kernel.
  * This kernel uses less shared memory than wmma_opt_2 and orders the cooperative loading differently.
- * This kernel relies on buffer load/store instructions for better out-of-bounds access performance; if manual
- * boundary checking is enabled performance takes a hit (prefer wmma_opt_3 in such cases).
+ * Global loads and stores use raw buffer instructions with descriptors sized to each operand
+ * (see kernels/buffer.hpp), so out-of-bounds reads return zero and out-of-bounds writes are dropped
+ * by the hardware instead of being handled with branches.
  *
  * @tparam K_TYPE The type of kernel, should be 'kernel_type::wmma_opt_4'
  * @param[out] C  Output matrix of size M × N
@@ -91,9 +133,86 @@ __global__ void
         half* C, const half* A, const half* B, int M, int N, int K);
 
 /**
- * Function Definition for calling WMMA Optimized V2 GEMM kernel
+ * @brief 64-bit indexed variant of the wmma_opt_4 kernel
+ *
+ * Selected by the launcher when any operand exceeds 2^31 elements (e.g. 65536 × 65536).
+ * Tile coordinates remain 32-bit, only global memory offsets are computed in 64-bit.
+ */
+template<>
+__global__ void __launch_bounds__(warp_size* config_o4::total_warps)
+    kernel_hgemm<kernel_type::wmma_opt_4, int64_t>(
+        half* C, const half* A, const half* B, int64_t M, int64_t N, int64_t K);
+
+/**
+ * @brief WGP-mode build of the wmma_opt_4 kernel
+ *
+ * Same source as wmma_opt_4 (src/wmma_opt_4_wgp.cpp), compiled without -mcumode and using
+ * config_o4_wgp so both modes can be benchmarked side by side.
+ */
+template<>
+__global__ void __launch_bounds__(warp_size* config_o4_wgp::total_warps)
+    kernel_hgemm<kernel_type::wmma_opt_4_wgp>(
+        half* C, const half* A, const half* B, int M, int N, int K);
+
+/**
+ * @brief 64-bit indexed variant of the wmma_opt_4_wgp kernel
+ */
+template<>
+__global__ void __launch_bounds__(warp_size* config_o4_wgp::total_warps)
+    kernel_hgemm<kernel_type::wmma_opt_4_wgp, int64_t>(
+        half* C, const half* A, const half* B, int64_t M, int64_t N, int64_t K);
+
+/**
+ * @brief wmma_opt_4 kernels reading their tile coordinates from a precomputed table
+ *
+ * Launched by execute_hgemm (kernels/plan.hpp); tile_order holds one 16:16 packed
+ * (block row, block column) per workgroup.
+ */
+template<kernel_type K_TYPE, class index_t>
+__global__ void kernel_hgemm_ordered(half*           C,
+                                     const half*     A,
+                                     const half*     B,
+                                     index_t         M,
+                                     index_t         N,
+                                     index_t         K,
+                                     const uint32_t* tile_order);
+
+template<>
+__global__ void __launch_bounds__(warp_size* config_o4::total_warps)
+    kernel_hgemm_ordered<kernel_type::wmma_opt_4, int>(
+        half* C, const half* A, const half* B, int M, int N, int K, const uint32_t* tile_order);
+
+template<>
+__global__ void __launch_bounds__(warp_size* config_o4::total_warps)
+    kernel_hgemm_ordered<kernel_type::wmma_opt_4, int64_t>(half*           C,
+                                                           const half*     A,
+                                                           const half*     B,
+                                                           int64_t         M,
+                                                           int64_t         N,
+                                                           int64_t         K,
+                                                           const uint32_t* tile_order);
+
+template<>
+__global__ void __launch_bounds__(warp_size* config_o4_wgp::total_warps)
+    kernel_hgemm_ordered<kernel_type::wmma_opt_4_wgp, int>(
+        half* C, const half* A, const half* B, int M, int N, int K, const uint32_t* tile_order);
+
+template<>
+__global__ void __launch_bounds__(warp_size* config_o4_wgp::total_warps)
+    kernel_hgemm_ordered<kernel_type::wmma_opt_4_wgp, int64_t>(half*           C,
+                                                               const half*     A,
+                                                               const half*     B,
+                                                               int64_t         M,
+                                                               int64_t         N,
+                                                               int64_t         K,
+                                                               const uint32_t* tile_order);
+
+/**
+ * Function Definition for calling WMMA Optimized V4 GEMM kernel
  *
- * @tparam K_TYPE The type of kernel, should be 'kernel_type::wmma_opt_2'
+ * Dispatches to the 64-bit indexed kernel only when requires_64bit_index() is true.
+ *
+ * @tparam K_TYPE The type of kernel, should be 'kernel_type::wmma_opt_4'
  * @param C       Output matrix
  * @param A       Input matrix A (stored in column-major format)
  * @param B       Input matrix B (stored in row-major format)
@@ -106,4 +225,20 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_opt_4>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream);
 
+/**
+ * Function Definition for calling the WGP-mode WMMA Optimized V4 GEMM kernel
+ *
+ * @tparam K_TYPE The type of kernel, should be 'kernel_type::wmma_opt_4_wgp'
+ * @param C       Output matrix
+ * @param A       Input matrix A (stored in column-major format)
+ * @param B       Input matrix B (stored in row-major format)
+ * @param M       Number of rows in matrices A and C
+ * @param N       Number of columns in matrices B and C
+ * @param K       Number of columns in matrix A/rows in matrix B
+ * @param stream  HIP stream to execute kernel
+ */
+template<>
+__host__ void hgemm_gpu<kernel_type::wmma_opt_4_wgp>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream);
+
 #endif // HIP_WMMA_OPT_4_HPP
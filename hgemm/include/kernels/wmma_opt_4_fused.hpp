@@ -0,0 +1,671 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Adel Johar
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef HIP_WMMA_OPT_4_FUSED_HPP
+#define HIP_WMMA_OPT_4_FUSED_HPP
+
+#include <algorithm>
+#include <hip/hip_runtime.h>
+#include <kernels/buffer.hpp>
+#include <kernels/epilogue.hpp>
+#include <kernels/prologue.hpp>
+#include <kernels/wmma_opt_4.hpp>
+
+/**
+ * @brief Reduce the operand norms accumulated by the wmma_opt_4 loaders into LDS
+ *
+ * Each loader thread holds the squared norms of the A rows (or B columns) of the vectors it
+ * staged. The partials are written to LDS in the layout of the staged tiles, summed over the
+ * block_k rows/columns in a fixed order, and left as floats at lds[0, block_m) for the rows of A
+ * and lds[block_m, block_m + block_n) for the columns of B.
+ *
+ * @tparam config Kernel configuration
+ * @param norms   Per-thread partials, indexed by loader iteration and vector element
+ * @param lds     Shared memory of the kernel (2 * lds_size halves, idle after the main loop)
+ * @param is_a    Whether the thread staged A (otherwise B)
+ * @param cid     Index of the thread within its loader half
+ */
+template<class config, int SLOTS>
+__device__ __forceinline__ void reduce_operand_norms(
+    const float (&norms)[SLOTS][config::vector_width], half* lds, bool is_a, int cid)
+{
+    constexpr int a_elements    = config::block_m * config::block_k;
+    constexpr int b_elements    = config::block_k * config::block_n;
+    constexpr int loader_stride = (warp_size * config::total_warps / 2) * config::vector_width;
+    static_assert(warp_size * config::total_warps >= config::block_m + config::block_n,
+                  "One thread per A row and B column is required");
+
+    float*    partials = reinterpret_cast<float*>(lds);
+    float*    dst      = is_a ? partials : partials + a_elements;
+    const int elements = is_a ? a_elements : b_elements;
+
+    for(int slot = 0; slot < SLOTS; ++slot)
+    {
+        const int i = cid * config::vector_width + slot * loader_stride;
+        if(i < elements)
+        {
+#pragma unroll
+            for(int v = 0; v < config::vector_width; ++v)
+            {
+                dst[i + v] = norms[slot][v];
+            }
+        }
+    }
+    __syncthreads();
+
+    const int tid   = threadIdx.x;
+    float     value = 0.0f;
+    if(tid < config::block_m)
+    {
+        for(int col = 0; col < config::block_k; ++col)
+        {
+            value += partials[col * config::block_m + tid];
+        }
+    }
+    else if(tid < config::block_m + config::block_n)
+    {
+        for(int row = 0; row < config::block_k; ++row)
+        {
+            value += partials[a_elements + row * config::block_n + (tid - config::block_m)];
+        }
+    }
+    __syncthreads();
+
+    if(tid < config::block_m + config::block_n)
+    {
+        partials[tid] = value;
+    }
+    __syncthreads();
+}
+
+/**
+ * @brief B tile loader of the wmma_opt_4 kernels for a contiguous row-major B
+ *
+ * A B loader describes the buffer holding B, maps element (row, col) of B to an offset into
+ * that buffer, and loads the WIDTH elements of row row starting at a vector-aligned column from
+ * that offset. Loaders of contiguous rows use load_vector; others may gather.
+ */
+struct b_loader_dense
+{
+    __host__ __device__ __forceinline__ buffer_resource resource(const half* B,
+                                                                 size_t      K,
+                                                                 size_t      N) const
+    {
+        return make_buffer_resource(B, K * N);
+    }
+
+    template<class index_t>
+    __host__ __device__ __forceinline__ index_t offset(index_t row, index_t col, index_t N) const
+    {
+        return row_major_offset<index_t>(row, col, N);
+    }
+
+    template<int WIDTH, class index_t>
+    __host__ __device__ __forceinline__ void
+        load(half* dst, const buffer_resource& rsrc, index_t offset, index_t valid) const
+    {
+        load_vector<WIDTH, index_t>(dst, rsrc, offset, valid);
+    }
+};
+
+/**
+ * @brief Whether device code of the current translation unit runs in the LDS mode of K_TYPE
+ *
+ * wmma_opt_4 is built for CU mode (-mcumode) and wmma_opt_4_wgp for WGP mode, the gfx11 default.
+ * A kernel defined in a header takes the mode of the translation unit that instantiates it, so
+ * the shared body checks it here. The host pass cannot tell and accepts either.
+ */
+template<kernel_type K_TYPE>
+constexpr bool compiled_for_lds_mode()
+{
+#if defined(__HIP_DEVICE_COMPILE__)
+#if defined(__AMDGCN_CUMODE__)
+    constexpr bool cu_mode = __AMDGCN_CUMODE__;
+#else
+    constexpr bool cu_mode = false;
+#endif
+    return cu_mode == (K_TYPE == kernel_type::wmma_opt_4);
+#else
+    return true;
+#endif
+}
+
+/**
+ * @brief Shared body of the wmma_opt_4 kernels
+ *
+ * @tparam K_TYPE   The type of kernel, selects the wmma_config (CU or WGP mode)
+ * @tparam index_t  Type used for global memory offsets (int or int64_t)
+ * @tparam Prologue Prologue expression tree applied to A in the loaders (see kernels/prologue.hpp)
+ * @tparam Epilogue Epilogue expression tree applied to the accumulators (see kernels/epilogue.hpp)
+ * @param tile_order Optional table of (block row, block column) per workgroup, packed 16:16 in
+ * tile units, replacing the in-kernel Hilbert mapping (see kernels/plan.hpp)
+ * @param b_loader   Addressing of B, e.g. a paged KV-cache (see kernels/paged.hpp)
+ * @param tile_index Optional row-major index of the output tile, for kernels that compute several
+ * tiles per workgroup in a fixed order (see kernels/quantize.hpp); -1 maps blockIdx.x
+ */
+template<kernel_type K_TYPE,
+         class index_t,
+         class Prologue,
+         class Epilogue,
+         class BLoader = b_loader_dense>
+__device__ __forceinline__ void wmma_opt_4_impl(half*           C,
+                                                const half*     A,
+                                                const half*     B,
+                                                index_t         M,
+                                                index_t         N,
+                                                index_t         K,
+                                                const Prologue& prologue,
+                                                const Epilogue& epilogue,
+                                                const uint32_t* tile_order = nullptr,
+                                                const BLoader&  b_loader   = {},
+                                                int             tile_index = -1)
+{
+    static_assert(compiled_for_lds_mode<K_TYPE>(),
+                  "wmma_opt_4 kernels need -mcumode and wmma_opt_4_wgp kernels need WGP mode; "
+                  "kernels instantiated from headers usually want wmma_opt_4_wgp");
+    using config = wmma_config<K_TYPE>;
+
+    // Calculate grid dimensions
+    const int grid_m  = (M + config::block_m - 1) / config::block_m;
+    const int grid_n  = (N + config::block_n - 1) / config::block_n;
+    const int tile_id = blockIdx.x;
+
+    // Get block coordinates from the caller, the plan's table, or using hilbert mapping
+    int block_row, block_col;
+    if(tile_index >= 0)
+    {
+        block_row = (tile_index / grid_n) * config::block_m;
+        block_col = (tile_index % grid_n) * config::block_n;
+    }
+    else if(tile_order != nullptr)
+    {
+        const uint32_t tile = tile_order[tile_id];
+        block_row           = static_cast<int>(tile >> 16) * config::block_m;
+        block_col           = static_cast<int>(tile & 0xffff) * config::block_n;
+    }
+    else
+    {
+        hilbert_tile_mapping<config::block_m, config::block_n>(tile_id,
+                                                               grid_m,
+                                                               grid_n,
+                                                               &block_row,
+                                                               &block_col);
+    }
+
+    // Allocate a unified shared memory buffer.
+    __shared__ half lds_mem[2 * config::lds_size];
+
+    // Partition the shared memory with manual offset calculations:
+    // A tiles occupy the first region in each buffer
+    half* a_tiles_0 = lds_mem;
+    half* a_tiles_1 = lds_mem + config::lds_size;
+    // B tiles start after A's region in each buffer
+    half* b_tiles_0 = lds_mem + (config::block_m * config::block_k);
+    half* b_tiles_1 = lds_mem + config::lds_size + (config::block_m * config::block_k);
+
+    // Each block is launched with a one-dimensional thread block.
+    const int tid         = threadIdx.x;
+    const int num_threads = blockDim.x;
+    const int half_block  = num_threads / 2;
+    const int cid         = tid % half_block;
+
+    // Buffer descriptors covering each operand; out-of-bounds accesses are resolved by the
+    // hardware (zero on load, dropped on store) instead of branches.
+    const buffer_resource rsrc_a = make_buffer_resource(A, static_cast<size_t>(M) * K);
+    const buffer_resource rsrc_b = b_loader.resource(B, K, N);
+    const buffer_resource rsrc_c = make_buffer_resource(C, static_cast<size_t>(M) * N);
+
+    // Compute warp ID from the 1D thread index.
+    const int warp_id  = tid / warp_size;
+    const int warp_row = warp_id / config::warps_n;
+    const int warp_col = warp_id % config::warps_n;
+
+    constexpr int half_warp    = warp_size / 2;
+    const int     lane_id      = (tid % warp_size);
+    const int     half_warp_id = lane_id / half_warp;
+    const int     half_lane    = tid % half_warp;
+
+    // Determine the base offsets for this warp's set of WMMA tiles.
+    const int warp_m_base = warp_row * config::warp_tile_m * wmma_tile;
+    const int warp_n_base = warp_col * config::warp_tile_n * wmma_tile;
+
+    // Declare fragment storage.
+    half16 c_frags[config::warp_tile_m][config::warp_tile_n] = {};
+    half16 a_frag[config::warp_tile_m]                          = {};
+    half16 b_frag[config::warp_tile_n]                          = {};
+
+    // Squared norms of the A rows or B columns staged by this thread, accumulated over K for
+    // distance epilogues (indexed by loader iteration, then by vector element)
+    constexpr int loader_stride = (warp_size * config::total_warps / 2) * config::vector_width;
+    constexpr int norm_slots
+        = (std::max(config::block_m, config::block_n) * config::block_k + loader_stride - 1)
+          / loader_stride;
+    float operand_norms[needs_operand_norms<Epilogue> ? norm_slots : 1][config::vector_width] = {};
+
+    if(tid < half_block)
+    {
+        // Load A tile (of size block_m × block_k) into shared memory.
+        for(int i = cid * config::vector_width; i < (config::block_m * config::block_k);
+            i += half_block * config::vector_width)
+        {
+            const int     col    = i / config::block_m;
+            const int     row    = i % config::block_m;
+            const index_t valid  = col < K ? M - (block_row + row) : 0;
+            const index_t offset = col_major_offset<index_t>(block_row + row, col, M);
+
+            if constexpr(needs_operand_norms<Epilogue>)
+            {
+                load_vector_norms<config::vector_width, index_t>(
+                    a_tiles_0 + i, rsrc_a, offset, valid, operand_norms[i / loader_stride]);
+            }
+            else
+            {
+                load_vector_prologue<config::vector_width, index_t>(
+                    a_tiles_0 + i, rsrc_a, offset, valid, block_row + row, col, prologue);
+            }
+        }
+    }
+    else
+    {
+        // Load B tile (row-major) using vectorized loads
+        for(int i = cid * config::vector_width; i < (config::block_k * config::block_n);
+            i += half_block * config::vector_width)
+        {
+            const int     row    = i / config::block_n;
+            const int     col    = i % config::block_n;
+            const index_t valid  = row < K ? N - (block_col + col) : 0;
+            const index_t offset = b_loader.template offset<index_t>(row, block_col + col, N);
+
+            if constexpr(needs_operand_norms<Epilogue>)
+            {
+                load_vector_norms<config::vector_width, index_t>(
+                    b_tiles_0 + i, rsrc_b, offset, valid, operand_norms[i / loader_stride]);
+            }
+            else
+            {
+                b_loader.template load<config::vector_width, index_t>(
+                    b_tiles_0 + i, rsrc_b, offset, valid);
+            }
+        }
+    }
+    __syncthreads();
+
+    half* current_a = a_tiles_0;
+    half* current_b = b_tiles_0;
+    half* next_a    = a_tiles_1;
+    half* next_b    = b_tiles_1;
+
+    // Main loop over k-dimension
+    for(index_t k_tile = 0; k_tile < K; k_tile += config::block_k)
+    {
+        const index_t k_next = k_tile + config::block_k;
+        if(k_next < K)
+        {
+            if(tid < half_block)
+            {
+                // Load A tile (of size block_m × block_k) into shared memory.
+                for(int i = cid * config::vector_width; i < (config::block_m * config::block_k);
+                    i += half_block * config::vector_width)
+                {
+                    const int     col    = i / config::block_m;
+                    const int     row    = i % config::block_m;
+                    const index_t valid  = (k_next + col) < K ? M - (block_row + row) : 0;
+                    const index_t offset
+                        = col_major_offset<index_t>(block_row + row, k_next + col, M);
+
+                    if constexpr(needs_operand_norms<Epilogue>)
+                    {
+                        load_vector_norms<config::vector_width, index_t>(
+                            next_a + i, rsrc_a, offset, valid, operand_norms[i / loader_stride]);
+                    }
+                    else
+                    {
+                        load_vector_prologue<config::vector_width, index_t>(next_a + i,
+                                                                            rsrc_a,
+                                                                            offset,
+                                                                            valid,
+                                                                            block_row + row,
+                                                                            k_next + col,
+                                                                            prologue);
+                    }
+                }
+            }
+            else
+            {
+                // Load B tile (row-major) using vectorized loads
+                for(int i = cid * config::vector_width; i < (config::block_k * config::block_n);
+                    i += half_block * config::vector_width)
+                {
+                    const int     row    = i / config::block_n;
+                    const int     col    = i % config::block_n;
+                    const index_t valid  = (k_next + row) < K ? N - (block_col + col) : 0;
+                    const index_t offset
+                        = b_loader.template offset<index_t>(k_next + row, block_col + col, N);
+
+                    if constexpr(needs_operand_norms<Epilogue>)
+                    {
+                        load_vector_norms<config::vector_width, index_t>(
+                            next_b + i, rsrc_b, offset, valid, operand_norms[i / loader_stride]);
+                    }
+                    else
+                    {
+                        b_loader.template load<config::vector_width, index_t>(
+                            next_b + i, rsrc_b, offset, valid);
+                    }
+                }
+            }
+        }
+
+        // Process the loaded block_k in wmma_tile chunks
+        for(int k_offset = 0; k_offset < config::block_k; k_offset += wmma_tile)
+        {
+            const half* curr_a
+                = current_a + k_offset * config::lds_stride_A + (warp_m_base + half_lane);
+            const half* curr_b
+                = current_b + k_offset * config::lds_stride_B + (warp_n_base + half_lane);
+
+            for(int i = 0; i < wmma_tile; ++i)
+            {
+                const half* srca = curr_a + (i * config::lds_stride_A);
+#pragma unroll
+                for(int wm = 0; wm < config::warp_tile_m; ++wm)
+                {
+                    a_frag[wm][i] = *srca;
+                    srca += wmma_tile;
+                }
+
+                const half* srcb = curr_b + (i * config::lds_stride_B);
+#pragma unroll
+                for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                {
+                    b_frag[wn][i] = *srcb;
+                    srcb += wmma_tile;
+                }
+            }
+
+            // Compute: each warp performs WMMA on its fragments.
+            for(int wm = 0; wm < config::warp_tile_m; ++wm)
+            {
+                for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                {
+                    c_frags[wm][wn] = __builtin_amdgcn_wmma_f16_16x16x16_f16_w32(a_frag[wm],
+                                                                                 b_frag[wn],
+                                                                                 c_frags[wm][wn],
+                                                                                 false);
+                }
+            }
+        }
+
+        half* temp_a = current_a;
+        half* temp_b = current_b;
+        current_a    = next_a;
+        current_b    = next_b;
+        next_a       = temp_a;
+        next_b       = temp_b;
+        __syncthreads();
+    }
+
+    if constexpr(needs_operand_norms<Epilogue>)
+    {
+        static_assert(is_identity_epilogue<Prologue>,
+                      "Operand norms require the identity prologue");
+        static_assert(std::is_same_v<BLoader, b_loader_dense>, "Operand norms require a dense B");
+        reduce_operand_norms<config>(operand_norms, lds_mem, tid < half_block, cid);
+    }
+
+    // Apply the epilogue to the accumulators, ahead of either store path
+    if constexpr(!is_identity_epilogue<Epilogue>)
+    {
+        for(int wm = 0; wm < config::warp_tile_m; ++wm)
+        {
+            const index_t row_base = block_row + warp_m_base + wm * wmma_tile;
+            for(int wn = 0; wn < config::warp_tile_n; ++wn)
+            {
+                const index_t col = block_col + warp_n_base + wn * wmma_tile + half_lane;
+#pragma unroll
+                for(int i = 0; i < wmma_tile / 2; ++i)
+                {
+                    const index_t row = row_base + i * 2 + half_warp_id;
+                    // Auxiliary tensors are only defined inside C
+                    if(row < M && col < N)
+                    {
+                        const float acc        = static_cast<float>(c_frags[wm][wn][i * 2]);
+                        c_frags[wm][wn][i * 2] = static_cast<half>(epilogue(acc, row, col));
+                    }
+                }
+            }
+        }
+    }
+
+    if constexpr(has_tile_store<Epilogue>)
+    {
+        // The epilogue replaces the store stage (e.g. quantized outputs)
+        epilogue.template store_tile<config, index_t>(c_frags, lds_mem, block_row, block_col, M, N);
+    }
+    else
+    {
+#ifdef USE_SHARED_WRITE
+        // Calculate the total size of the output tile
+        constexpr int total_tile_elements = config::block_m * config::block_n;
+
+        // Maximum shared memory available is the entire shared memory buffer
+        constexpr int max_shared_elements = 2 * config::lds_size;
+
+        // Determine if we need to process in chunks or can handle the entire tile at once
+        constexpr bool needs_chunking = total_tile_elements > max_shared_elements;
+
+        // If chunking is needed, calculate how many rows we can process at once
+        // Otherwise, process the entire tile
+        constexpr int rows_per_chunk
+            = needs_chunking ? max_shared_elements / config::block_n : config::block_m;
+
+        // Reuse shared memory for storing C values
+        half* c_tile = lds_mem;
+
+        // Process the matrix in chunks
+        for(int chunk_idx = 0; chunk_idx < config::block_m; chunk_idx += rows_per_chunk)
+        {
+            // Calculate row range for this chunk
+            const int row_start    = chunk_idx;
+            const int row_end      = min(row_start + rows_per_chunk, config::block_m);
+            const int chunk_height = row_end - row_start;
+
+            // Step 1: Store WMMA fragments to shared memory
+            for(int wm = 0; wm < config::warp_tile_m; ++wm)
+            {
+                const int warp_m_global = warp_m_base + wm * wmma_tile;
+
+                // Skip warps not in the current chunk
+                if(warp_m_global < row_start || warp_m_global >= row_end)
+                {
+                    continue;
+                }
+
+                // Calculate local row offset within current chunk
+                const int warp_m_local = warp_m_global - row_start;
+
+                for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                {
+                    const int warp_n_base_local = warp_n_base + wn * wmma_tile;
+
+        #pragma unroll
+                    for(int i = 0; i < wmma_tile / 2; ++i)
+                    {
+                        const int row_local = warp_m_local + i * 2 + half_warp_id;
+                        const int col_local = warp_n_base_local + half_lane;
+
+                        // Store fragments directly to shared memory
+                        c_tile[row_local * config::block_n + col_local] = c_frags[wm][wn][i * 2];
+                    }
+                }
+            }
+            __syncthreads();
+
+            // Step 2: Perform vectorized writes from shared memory to global memory
+            // Each thread processes multiple vectors
+            for(int i = tid * config::vector_width; i < (chunk_height * config::block_n);
+                i += num_threads * config::vector_width)
+            {
+                const int row_local = i / config::block_n;
+                const int col_local = i % config::block_n;
+
+                // Calculate global position
+                const index_t row_global = block_row + row_start + row_local;
+                const index_t col_global = block_col + col_local;
+
+                // Out-of-bounds rows and columns are dropped by the buffer store
+                store_vector<config::vector_width, index_t>(
+                    c_tile + row_local * config::block_n + col_local,
+                    rsrc_c,
+                    row_major_offset<index_t>(row_global, col_global, N),
+                    row_global < M ? N - col_global : 0);
+            }
+            __syncthreads();
+        }
+#else
+        // Write the computed fragments to global memory.
+        for(int wm = 0; wm < config::warp_tile_m; wm++)
+        {
+            const index_t row_base = block_row + warp_m_base + wm * wmma_tile;
+            for(int wn = 0; wn < config::warp_tile_n; wn++)
+            {
+                const index_t col = block_col + warp_n_base + wn * wmma_tile + half_lane;
+        #pragma unroll
+                for(int i = 0; i < wmma_tile / 2; ++i)
+                {
+                    const index_t row = row_base + i * 2 + half_warp_id;
+                    store_scalar<index_t>(c_frags[wm][wn][i * 2],
+                                          rsrc_c,
+                                          row_major_offset<index_t>(row, col, N),
+                                          row < M && col < N);
+                }
+            }
+        }
+#endif
+    }
+}
+
+/**
+ * @brief wmma_opt_4 kernel with a fused prologue and epilogue
+ *
+ * Instantiated in the including translation unit for each prologue/epilogue pair, so it inherits
+ * that translation unit's compile options rather than the -mcumode used for src/wmma_opt_4.cpp.
+ * Translation units built without -mcumode must use kernel_type::wmma_opt_4_wgp.
+ *
+ * @tparam K_TYPE   The type of kernel, 'kernel_type::wmma_opt_4_wgp', or 'kernel_type::wmma_opt_4'
+ *                  in a translation unit built with -mcumode
+ * @tparam index_t  Type used for global memory offsets (int or int64_t)
+ * @tparam Prologue Prologue expression tree applied to A
+ * @tparam Epilogue Epilogue expression tree applied to the accumulators
+ */
+template<kernel_type K_TYPE, class index_t, class Prologue, class Epilogue>
+__global__ void __launch_bounds__(warp_size* wmma_config<K_TYPE>::total_warps)
+    kernel_hgemm_fused(half*                         C,
+                       const half*                   A,
+                       const half*                   B,
+                       std::type_identity_t<index_t> M,
+                       std::type_identity_t<index_t> N,
+                       std::type_identity_t<index_t> K,
+                       Prologue                      prologue,
+                       Epilogue                      epilogue)
+{
+    wmma_opt_4_impl<K_TYPE, index_t>(C, A, B, M, N, K, prologue, epilogue);
+}
+
+/**
+ * Function Definition for calling WMMA Optimized V4 GEMM kernel with a fused prologue and epilogue
+ *
+ * Computes C(i, j) = epilogue(sum_k prologue(A(i, k), i, k) * B(k, j), i, j). Pointers held by
+ * the prologue and epilogue must be device pointers. The kernel is instantiated in the caller's
+ * translation unit, see kernel_hgemm_fused for the kernel types it accepts.
+ *
+ * @tparam K_TYPE   The type of kernel, 'kernel_type::wmma_opt_4_wgp', or 'kernel_type::wmma_opt_4'
+ *                  in a translation unit built with -mcumode
+ * @tparam Prologue Prologue expression tree (see kernels/prologue.hpp)
+ * @tparam Epilogue Epilogue expression tree (see kernels/epilogue.hpp)
+ * @param C         Output matrix
+ * @param A         Input matrix A (stored in column-major format)
+ * @param B         Input matrix B (stored in row-major format)
+ * @param M         Number of rows in matrices A and C
+ * @param N         Number of columns in matrices B and C
+ * @param K         Number of columns in matrix A/rows in matrix B
+ * @param prologue  Prologue applied to every element of A as it is staged to LDS
+ * @param epilogue  Epilogue applied to every output element
+ * @param stream    HIP stream to execute kernel
+ */
+template<kernel_type K_TYPE, class Prologue, class Epilogue>
+__host__ void hgemm_gpu(half*           C,
+                        half*           A,
+                        half*           B,
+                        size_t          M,
+                        size_t          N,
+                        size_t          K,
+                        const Prologue& prologue,
+                        const Epilogue& epilogue,
+                        hipStream_t&    stream)
+{
+    static_assert(K_TYPE == kernel_type::wmma_opt_4 || K_TYPE == kernel_type::wmma_opt_4_wgp,
+                  "Fused prologues and epilogues are only supported by the wmma_opt_4 kernels");
+    using config = wmma_config<K_TYPE>;
+
+    // Calculate grid dimensions
+    int grid_m       = (M + config::block_m - 1) / config::block_m;
+    int grid_n       = (N + config::block_n - 1) / config::block_n;
+    int total_blocks = grid_m * grid_n;
+
+    dim3 grid_dim(total_blocks);
+    dim3 block_dim(warp_size * config::total_warps);
+
+    if(requires_64bit_index(M, N, K))
+    {
+        kernel_hgemm_fused<K_TYPE, index_policy<true>::type, Prologue, Epilogue>
+            <<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K, prologue, epilogue);
+    }
+    else
+    {
+        kernel_hgemm_fused<K_TYPE, int, Prologue, Epilogue>
+            <<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K, prologue, epilogue);
+    }
+}
+
+/**
+ * Function Definition for calling WMMA Optimized V4 GEMM kernel with a fused epilogue
+ *
+ * Computes C(i, j) = epilogue(A × B, i, j), see the overload taking a prologue.
+ */
+template<kernel_type K_TYPE, class Epilogue>
+__host__ void hgemm_gpu(half*           C,
+                        half*           A,
+                        half*           B,
+                        size_t          M,
+                        size_t          N,
+                        size_t          K,
+                        const Epilogue& epilogue,
+                        hipStream_t&    stream)
+{
+    hgemm_gpu<K_TYPE>(C, A, B, M, N, K, prologue_input{}, epilogue, stream);
+}
+
+#endif // HIP_WMMA_OPT_4_FUSED_HPP
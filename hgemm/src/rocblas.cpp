@@ -1,5 +1,144 @@
+#include <common/hip_utils.hpp>
 #include <hip/hip_runtime.h>
 #include <kernels/rocblas.hpp>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+using rocblas_shape = std::tuple<size_t, size_t, size_t, rocblas_datatype>;
+
+static std::mutex                       solution_mutex;
+static std::map<rocblas_shape, int32_t> solution_cache;
+
+/**
+ * @brief Scalars of the accumulation type, as rocblas_gemm_ex expects alpha and beta
+ */
+struct gemm_ex_scalars
+{
+    float    alpha_f32 = 1.0f;
+    float    beta_f32  = 0.0f;
+    _Float16 alpha_f16 = 1.0f;
+    _Float16 beta_f16  = 0.0f;
+
+    const void* alpha(rocblas_datatype compute) const
+    {
+        return compute == rocblas_datatype_f32_r ? static_cast<const void*>(&alpha_f32)
+                                                 : static_cast<const void*>(&alpha_f16);
+    }
+
+    const void* beta(rocblas_datatype compute) const
+    {
+        return compute == rocblas_datatype_f32_r ? static_cast<const void*>(&beta_f32)
+                                                 : static_cast<const void*>(&beta_f16);
+    }
+};
+
+static void set_stream(hipStream_t stream)
+{
+    if(handle == nullptr)
+    {
+        throw std::runtime_error("rocBLAS not initialized. Call init_rocblas() first.");
+    }
+
+    if(rocblas_set_stream(handle, stream) != rocblas_status_success)
+    {
+        throw std::runtime_error("Failed to set rocBLAS stream");
+    }
+}
+
+/**
+ * @brief rocblas_gemm_ex on the kernel_type::rocblas layouts (col-major A and C, row-major B)
+ */
+static rocblas_status gemm_ex(half*            C,
+                              const half*      A,
+                              const half*      B,
+                              size_t           M,
+                              size_t           N,
+                              size_t           K,
+                              rocblas_datatype compute,
+                              int32_t          solution,
+                              uint32_t         flags)
+{
+    const gemm_ex_scalars scalars;
+    return rocblas_gemm_ex(handle,
+                           rocblas_operation_none, // op(A)
+                           rocblas_operation_transpose, // op(B)
+                           M,
+                           N,
+                           K,
+                           scalars.alpha(compute),
+                           A,
+                           rocblas_datatype_f16_r,
+                           M, // lda
+                           B,
+                           rocblas_datatype_f16_r,
+                           N, // ldb
+                           scalars.beta(compute),
+                           C,
+                           rocblas_datatype_f16_r,
+                           M, // ldc
+                           C,
+                           rocblas_datatype_f16_r,
+                           M, // ldd
+                           compute,
+                           solution == 0 ? rocblas_gemm_algo_standard
+                                         : rocblas_gemm_algo_solution_index,
+                           solution,
+                           flags);
+}
+
+/**
+ * @brief Solution indices rocBLAS can run for the shape
+ */
+static std::vector<int32_t> list_solutions(
+    half* C, const half* A, const half* B, size_t M, size_t N, size_t K, rocblas_datatype compute)
+{
+    const gemm_ex_scalars scalars;
+    auto                  query = [&](int32_t* list, int32_t* size)
+    {
+        return rocblas_gemm_ex_get_solutions(handle,
+                                             rocblas_operation_none,
+                                             rocblas_operation_transpose,
+                                             M,
+                                             N,
+                                             K,
+                                             scalars.alpha(compute),
+                                             A,
+                                             rocblas_datatype_f16_r,
+                                             M,
+                                             B,
+                                             rocblas_datatype_f16_r,
+                                             N,
+                                             scalars.beta(compute),
+                                             C,
+                                             rocblas_datatype_f16_r,
+                                             M,
+                                             C,
+                                             rocblas_datatype_f16_r,
+                                             M,
+                                             compute,
+                                             rocblas_gemm_algo_solution_index,
+                                             rocblas_gemm_flags_none,
+                                             list,
+                                             size);
+    };
+
+    int32_t size = 0;
+    if(query(nullptr, &size) != rocblas_status_success || size <= 0)
+    {
+        return {};
+    }
+    std::vector<int32_t> solutions(size);
+    if(query(solutions.data(), &size) != rocblas_status_success)
+    {
+        return {};
+    }
+    solutions.resize(size);
+    return solutions;
+}
 
 bool init_rocblas()
 {
@@ -67,3 +206,112 @@ __host__ void hgemm_gpu<kernel_type::rocblas>(
         throw std::runtime_error("rocBLAS HGEMM failed");
     }
 }
+
+__host__ void rocblas_hgemm_ex(half*            C,
+                               const half*      A,
+                               const half*      B,
+                               size_t           M,
+                               size_t           N,
+                               size_t           K,
+                               rocblas_datatype compute,
+                               int32_t          solution,
+                               hipStream_t&     stream)
+{
+    if(compute != rocblas_datatype_f32_r && compute != rocblas_datatype_f16_r)
+    {
+        throw std::invalid_argument("rocblas_hgemm_ex supports f32 or f16 compute only");
+    }
+
+    set_stream(stream);
+    if(gemm_ex(C, A, B, M, N, K, compute, solution, rocblas_gemm_flags_none)
+       != rocblas_status_success)
+    {
+        throw std::runtime_error("rocBLAS gemm_ex failed");
+    }
+}
+
+__host__ int32_t rocblas_tune_solution(half*            C,
+                                       const half*      A,
+                                       const half*      B,
+                                       size_t           M,
+                                       size_t           N,
+                                       size_t           K,
+                                       rocblas_datatype compute,
+                                       hipStream_t&     stream)
+{
+    const rocblas_shape key(M, N, K, compute);
+    {
+        std::lock_guard<std::mutex> lock(solution_mutex);
+        auto                        it = solution_cache.find(key);
+        if(it != solution_cache.end())
+        {
+            return it->second;
+        }
+    }
+
+    set_stream(stream);
+
+    // The default heuristic is a candidate too, so tuning never picks a slower solution
+    std::vector<int32_t> candidates = list_solutions(C, A, B, M, N, K, compute);
+    candidates.insert(candidates.begin(), 0);
+
+    constexpr int warmup     = 1;
+    constexpr int iterations = 5;
+
+    gpu_timer timer;
+    int32_t   best      = 0;
+    float     best_time = std::numeric_limits<float>::max();
+    for(int32_t solution : candidates)
+    {
+        const uint32_t flags
+            = solution == 0 ? rocblas_gemm_flags_none : rocblas_gemm_flags_check_solution_index;
+        if(gemm_ex(C, A, B, M, N, K, compute, solution, flags) != rocblas_status_success)
+        {
+            continue;
+        }
+
+        for(int i = 0; i < warmup; ++i)
+        {
+            gemm_ex(C, A, B, M, N, K, compute, solution, rocblas_gemm_flags_none);
+        }
+
+        timer.start(stream);
+        for(int i = 0; i < iterations; ++i)
+        {
+            gemm_ex(C, A, B, M, N, K, compute, solution, rocblas_gemm_flags_none);
+        }
+        const float elapsed = timer.stop(stream);
+
+        if(elapsed < best_time)
+        {
+            best_time = elapsed;
+            best      = solution;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(solution_mutex);
+    solution_cache.emplace(key, best);
+    return best;
+}
+
+size_t rocblas_tuned_shapes()
+{
+    std::lock_guard<std::mutex> lock(solution_mutex);
+    return solution_cache.size();
+}
+
+template<>
+__host__ void hgemm_gpu<kernel_type::rocblas_ex>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
+{
+    rocblas_hgemm_ex(C, A, B, M, N, K, rocblas_datatype_f32_r, 0, stream);
+}
+
+template<>
+__host__ void hgemm_gpu<kernel_type::rocblas_ex_tuned>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
+{
+    const int32_t solution
+        = rocblas_tune_solution(C, A, B, M, N, K, rocblas_datatype_f32_r, stream);
+    rocblas_hgemm_ex(C, A, B, M, N, K, rocblas_datatype_f32_r, solution, stream);
+}
@@ -0,0 +1,237 @@
+#include <hip/hip_runtime.h>
+#include <kernels/rocwmma.hpp>
+#include <stdexcept>
+
+#ifdef HGEMM_HAS_ROCWMMA
+    #include <kernels/buffer.hpp>
+    #include <rocwmma/rocwmma.hpp>
+
+/**
+ * @brief Body of the rocWMMA kernels
+ *
+ * @tparam index_t Type used for global memory offsets (int or int64_t)
+ */
+template<class index_t>
+__device__ __forceinline__ void
+    rocwmma_hgemm_impl(half* C, const half* A, const half* B, index_t M, index_t N, index_t K)
+{
+    using namespace rocwmma;
+    using config = config_rocwmma;
+
+    using frag_a   = fragment<matrix_a, wmma_tile, wmma_tile, wmma_tile, half, col_major>;
+    using frag_b   = fragment<matrix_b, wmma_tile, wmma_tile, wmma_tile, half, row_major>;
+    using frag_acc = fragment<accumulator, wmma_tile, wmma_tile, wmma_tile, half>;
+
+    __shared__ half lds_mem[2 * config::lds_size];
+
+    half* a_tiles_0 = lds_mem;
+    half* b_tiles_0 = lds_mem + config::block_m * config::block_k;
+    half* a_tiles_1 = lds_mem + config::lds_size;
+    half* b_tiles_1 = lds_mem + config::lds_size + config::block_m * config::block_k;
+
+    const int tid      = threadIdx.x;
+    const int lane_id  = tid % warp_size;
+    const int warp_id  = tid / warp_size;
+    const int warp_row = warp_id / config::warps_n;
+    const int warp_col = warp_id % config::warps_n;
+
+    const int warp_m_base = warp_row * config::warp_tile_m * wmma_tile;
+    const int warp_n_base = warp_col * config::warp_tile_n * wmma_tile;
+
+    const index_t block_row = static_cast<index_t>(blockIdx.y) * config::block_m;
+    const index_t block_col = static_cast<index_t>(blockIdx.x) * config::block_n;
+
+    const buffer_resource rsrc_a = make_buffer_resource(A, static_cast<size_t>(M) * K);
+    const buffer_resource rsrc_b = make_buffer_resource(B, static_cast<size_t>(K) * N);
+    const buffer_resource rsrc_c = make_buffer_resource(C, static_cast<size_t>(M) * N);
+
+    // Registers holding the stage in flight; rows/columns/depth past the edges load zeros
+    alignas(16) half a_regs[config::a_loads][config::vector_width];
+    alignas(16) half b_regs[config::b_loads][config::vector_width];
+
+    auto fetch = [&](index_t k)
+    {
+#pragma unroll
+        for(int s = 0; s < config::a_loads; ++s)
+        {
+            const int     i     = (tid + s * config::threads) * config::vector_width;
+            const int     col   = i / config::block_m;
+            const int     row   = i % config::block_m;
+            const index_t valid = (k + col) < K ? M - (block_row + row) : 0;
+            load_vector<config::vector_width, index_t>(
+                a_regs[s], rsrc_a, col_major_offset<index_t>(block_row + row, k + col, M), valid);
+        }
+#pragma unroll
+        for(int s = 0; s < config::b_loads; ++s)
+        {
+            const int     i     = (tid + s * config::threads) * config::vector_width;
+            const int     row   = i / config::block_n;
+            const int     col   = i % config::block_n;
+            const index_t valid = (k + row) < K ? N - (block_col + col) : 0;
+            load_vector<config::vector_width, index_t>(
+                b_regs[s], rsrc_b, row_major_offset<index_t>(k + row, block_col + col, N), valid);
+        }
+    };
+
+    auto commit = [&](half* a_tile, half* b_tile)
+    {
+#pragma unroll
+        for(int s = 0; s < config::a_loads; ++s)
+        {
+            const int i = (tid + s * config::threads) * config::vector_width;
+            *reinterpret_cast<half8*>(a_tile + i) = *reinterpret_cast<const half8*>(a_regs[s]);
+        }
+#pragma unroll
+        for(int s = 0; s < config::b_loads; ++s)
+        {
+            const int i = (tid + s * config::threads) * config::vector_width;
+            *reinterpret_cast<half8*>(b_tile + i) = *reinterpret_cast<const half8*>(b_regs[s]);
+        }
+    };
+
+    fetch(0);
+    commit(a_tiles_0, b_tiles_0);
+    synchronize_workgroup();
+
+    half* current_a = a_tiles_0;
+    half* current_b = b_tiles_0;
+    half* next_a    = a_tiles_1;
+    half* next_b    = b_tiles_1;
+
+    frag_acc accum[config::warp_tile_m][config::warp_tile_n];
+    for(int i = 0; i < config::warp_tile_m; i++)
+    {
+        for(int j = 0; j < config::warp_tile_n; j++)
+        {
+            fill_fragment(accum[i][j], static_cast<half>(0.0f));
+        }
+    }
+
+    // Main loop
+    for(index_t k_tile = 0; k_tile < K; k_tile += config::block_k)
+    {
+        // Load next global data while computing current
+        const bool has_next = k_tile + config::block_k < K;
+        if(has_next)
+        {
+            fetch(k_tile + config::block_k);
+        }
+
+        for(int k_offset = 0; k_offset < config::block_k; k_offset += wmma_tile)
+        {
+            frag_a frags_a[config::warp_tile_m];
+            frag_b frags_b[config::warp_tile_n];
+
+            for(int i = 0; i < config::warp_tile_m; i++)
+            {
+                load_matrix_sync(frags_a[i],
+                                 current_a + k_offset * config::block_m + warp_m_base
+                                     + i * wmma_tile,
+                                 config::block_m);
+            }
+
+            for(int j = 0; j < config::warp_tile_n; j++)
+            {
+                load_matrix_sync(frags_b[j],
+                                 current_b + k_offset * config::block_n + warp_n_base
+                                     + j * wmma_tile,
+                                 config::block_n);
+            }
+
+            // Compute matrix multiply-accumulate with explicit loops
+            for(int i = 0; i < config::warp_tile_m; i++)
+            {
+                for(int j = 0; j < config::warp_tile_n; j++)
+                {
+                    mma_sync(accum[i][j], frags_a[i], frags_b[j], accum[i][j]);
+                }
+            }
+        }
+
+        if(has_next)
+        {
+            commit(next_a, next_b);
+        }
+
+        half* temp_a = current_a;
+        half* temp_b = current_b;
+        current_a    = next_a;
+        current_b    = next_b;
+        next_a       = temp_a;
+        next_b       = temp_b;
+        synchronize_workgroup();
+    }
+
+    // Interior tiles are stored directly, edge tiles through a per-warp LDS scratch tile.
+    // LDS is free after the final barrier, and a wavefront's LDS accesses complete in order.
+    half* scratch = lds_mem + warp_id * wmma_tile * wmma_tile;
+    for(int i = 0; i < config::warp_tile_m; i++)
+    {
+        const index_t row = block_row + warp_m_base + i * wmma_tile;
+        for(int j = 0; j < config::warp_tile_n; j++)
+        {
+            const index_t col = block_col + warp_n_base + j * wmma_tile;
+            if(row + wmma_tile <= M && col + wmma_tile <= N)
+            {
+                store_matrix_sync(C + row_major_offset<index_t>(row, col, N),
+                                  accum[i][j],
+                                  N,
+                                  mem_row_major);
+                continue;
+            }
+
+            store_matrix_sync(scratch, accum[i][j], wmma_tile, mem_row_major);
+            for(int e = lane_id; e < wmma_tile * wmma_tile; e += warp_size)
+            {
+                const index_t r = row + e / wmma_tile;
+                const index_t c = col + e % wmma_tile;
+                store_scalar<index_t>(scratch[e],
+                                      rsrc_c,
+                                      row_major_offset<index_t>(r, c, N),
+                                      r < M && c < N);
+            }
+        }
+    }
+}
+
+template<>
+__global__ void __launch_bounds__(warp_size* config_rocwmma::total_warps)
+    kernel_hgemm<kernel_type::rocwmma>(half* C, const half* A, const half* B, int M, int N, int K)
+{
+    rocwmma_hgemm_impl<int>(C, A, B, M, N, K);
+}
+
+template<>
+__global__ void __launch_bounds__(warp_size* config_rocwmma::total_warps)
+    kernel_hgemm<kernel_type::rocwmma, int64_t>(
+        half* C, const half* A, const half* B, int64_t M, int64_t N, int64_t K)
+{
+    rocwmma_hgemm_impl<int64_t>(C, A, B, M, N, K);
+}
+
+template<>
+__host__ void hgemm_gpu<kernel_type::rocwmma>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
+{
+    dim3 block_dim(config_rocwmma::threads);
+    dim3 grid_dim(ceil_div(N, config_rocwmma::block_n), ceil_div(M, config_rocwmma::block_m));
+
+    // Only pay for 64-bit address arithmetic when an operand exceeds the 32-bit range
+    if(requires_64bit_index(M, N, K))
+    {
+        kernel_hgemm<kernel_type::rocwmma, index_policy<true>::type>
+            <<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K);
+    }
+    else
+    {
+        kernel_hgemm<kernel_type::rocwmma><<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K);
+    }
+}
+#else
+template<>
+__host__ void hgemm_gpu<kernel_type::rocwmma>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
+{
+    throw std::runtime_error("hgemm was built without rocWMMA (HGEMM_HAS_ROCWMMA)");
+}
+#endif
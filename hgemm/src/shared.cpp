@@ -66,6 +66,8 @@ template<>
 __host__ void hgemm_gpu<kernel_type::shared>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index("shared", M, N, K);
+
     dim3 block_dim(shared_tile, shared_tile);
     dim3 grid_dim(ceil_div(N, shared_tile), ceil_div(M, shared_tile));
     kernel_hgemm<kernel_type::shared><<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K);
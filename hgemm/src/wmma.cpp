@@ -35,6 +35,8 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_naive>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index("wmma_naive", M, N, K);
+
     dim3          block_dim(warp_size * 4, 4);
     dim3          grid_dim(ceil_div(M, wmma_tile * block_dim.x / warp_size),
                   ceil_div(N, wmma_tile * block_dim.y));
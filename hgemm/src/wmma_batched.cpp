@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <hip/hip_runtime.h>
+#include <kernels/wmma_batched.hpp>
+#include <stdexcept>
+
+/**
+ * @brief Load one 16-wide K slice of a row of A (or column of B) into a WMMA fragment
+ *
+ * @param frag  Fragment to fill, zero-padded past the end of the line or of K
+ * @param src   First element of the problem's matrix
+ * @param line  Row of A (column of B) owned by this lane
+ * @param k     First K index of the slice
+ * @param lines Number of rows of A (columns of B)
+ * @param depth K, which is also the leading dimension
+ */
+__device__ __forceinline__ void
+    load_batched_fragment(half16& frag, const half* src, int line, int k, int lines, int depth)
+{
+    if(line >= lines)
+    {
+        frag = half16{};
+        return;
+    }
+
+    const half* ptr = src + line * depth + k;
+    // When K is a multiple of 16 every slice is a whole, 32-byte aligned half16
+    if(depth % wmma_tile == 0)
+    {
+        frag = *reinterpret_cast<const half16*>(ptr);
+        return;
+    }
+
+#pragma unroll
+    for(int i = 0; i < wmma_tile; ++i)
+    {
+        frag[i] = (k + i < depth) ? ptr[i] : static_cast<half>(0.0f);
+    }
+}
+
+template<int TILE>
+__global__ void __launch_bounds__(warp_size * batched_config::waves_per_block)
+    kernel_hgemm_batched(half* C, const half* A, const half* B, int M, int N, int K, size_t batch)
+{
+    constexpr int tiles     = TILE / wmma_tile;
+    constexpr int half_warp = warp_size / 2;
+
+    const int half_lane    = threadIdx.x % half_warp;
+    const int half_warp_id = (threadIdx.x % warp_size) / half_warp;
+    // Tiles lying entirely outside M or N are skipped, a uniform branch for the whole wave
+    const int tiles_m = (M + wmma_tile - 1) / wmma_tile;
+    const int tiles_n = (N + wmma_tile - 1) / wmma_tile;
+
+    const size_t first_wave = (static_cast<size_t>(blockIdx.x) * blockDim.x + threadIdx.x)
+                              / warp_size;
+    const size_t total_waves = static_cast<size_t>(gridDim.x) * (blockDim.x / warp_size);
+
+    for(size_t p = first_wave; p < batch; p += total_waves)
+    {
+        const half* a = A + p * M * K;
+        const half* b = B + p * K * N;
+        half*       c = C + p * M * N;
+
+        half16 c_frags[tiles][tiles] = {};
+
+        for(int k = 0; k < K; k += wmma_tile)
+        {
+            half16 a_frags[tiles];
+            half16 b_frags[tiles];
+
+#pragma unroll
+            for(int i = 0; i < tiles; ++i)
+            {
+                load_batched_fragment(a_frags[i], a, i * wmma_tile + half_lane, k, M, K);
+                load_batched_fragment(b_frags[i], b, i * wmma_tile + half_lane, k, N, K);
+            }
+
+#pragma unroll
+            for(int i = 0; i < tiles; ++i)
+            {
+#pragma unroll
+                for(int j = 0; j < tiles; ++j)
+                {
+                    if(i < tiles_m && j < tiles_n)
+                    {
+                        c_frags[i][j] = __builtin_amdgcn_wmma_f16_16x16x16_f16_w32(
+                            a_frags[i], b_frags[j], c_frags[i][j], false);
+                    }
+                }
+            }
+        }
+
+#pragma unroll
+        for(int i = 0; i < tiles; ++i)
+        {
+#pragma unroll
+            for(int j = 0; j < tiles; ++j)
+            {
+                const int col = j * wmma_tile + half_lane;
+#pragma unroll
+                for(int e = 0; e < wmma_tile / 2; ++e)
+                {
+                    const int row = i * wmma_tile + e * 2 + half_warp_id;
+                    if(row < M && col < N)
+                    {
+                        c[row * N + col] = c_frags[i][j][e * 2];
+                    }
+                }
+            }
+        }
+    }
+}
+
+template __global__ void kernel_hgemm_batched<16>(
+    half* C, const half* A, const half* B, int M, int N, int K, size_t batch);
+template __global__ void kernel_hgemm_batched<32>(
+    half* C, const half* A, const half* B, int M, int N, int K, size_t batch);
+template __global__ void kernel_hgemm_batched<64>(
+    half* C, const half* A, const half* B, int M, int N, int K, size_t batch);
+
+__host__ void hgemm_batched_gpu(half*        C,
+                                const half*  A,
+                                const half*  B,
+                                size_t       M,
+                                size_t       N,
+                                size_t       K,
+                                size_t       batch,
+                                hipStream_t& stream)
+{
+    const size_t dim = std::max(M, N);
+    if(dim > batched_config::max_dim)
+    {
+        throw std::invalid_argument("hgemm_batched_gpu: M and N must not exceed 64");
+    }
+    if(batch == 0 || dim == 0)
+    {
+        return;
+    }
+
+    constexpr size_t waves  = batched_config::waves_per_block;
+    const size_t     blocks = std::min((batch + waves - 1) / waves,
+                                   static_cast<size_t>(batched_config::max_blocks));
+
+    dim3 block_dim(warp_size * waves);
+    dim3 grid_dim(blocks);
+
+    if(dim <= 16)
+    {
+        kernel_hgemm_batched<16><<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K, batch);
+    }
+    else if(dim <= 32)
+    {
+        kernel_hgemm_batched<32><<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K, batch);
+    }
+    else
+    {
+        kernel_hgemm_batched<64><<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K, batch);
+    }
+}
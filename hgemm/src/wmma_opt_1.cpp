@@ -340,6 +340,8 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_opt_1>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index("wmma_opt_1", M, N, K);
+
     dim3 block_dim(warp_size * config_o1::total_warps);
     dim3 grid_dim(ceil_div(M, config_o1::block_m), ceil_div(N, config_o1::block_n));
 
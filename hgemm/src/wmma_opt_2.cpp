@@ -1,10 +1,23 @@
 #include <hip/hip_runtime.h>
+#include <kernels/buffer.hpp>
 #include <kernels/wmma_opt_2.hpp>
 
+// This file is compiled twice: as-is with -mcumode for wmma_opt_2, and through
+// wmma_opt_2_wgp.cpp (which defines WGP_MODE) for the WGP-mode wmma_opt_2_wgp variant.
+#ifdef WGP_MODE
+    #define OPT_2_KERNEL kernel_type::wmma_opt_2_wgp
+    #define OPT_2_NAME   "wmma_opt_2_wgp"
+#else
+    #define OPT_2_KERNEL kernel_type::wmma_opt_2
+    #define OPT_2_NAME   "wmma_opt_2"
+#endif
+
+// Configuration of the kernel built by this translation unit
+using config_o2 = wmma_config<OPT_2_KERNEL>;
+
 template<>
-__global__ void
-    __launch_bounds__(warp_size* config_o2::total_warps) kernel_hgemm<kernel_type::wmma_opt_2>(
-        half* C, const half* A, const half* B, int M, int N, int K)
+__global__ void __launch_bounds__(warp_size* config_o2::total_warps)
+    kernel_hgemm<OPT_2_KERNEL>(half* C, const half* A, const half* B, int M, int N, int K)
 {
     // Calculate grid dimensions
     const int grid_m  = (M + config_o2::block_m - 1) / config_o2::block_m;
@@ -36,9 +49,11 @@ __global__ void
     const int half_block  = num_threads / 2;
     const int cid         = tid % half_block;
 
-    const half* A_base = A + block_row; // A is in column-major order
-    const half* B_base = B + block_col; // B is in row-major order
-    half*       C_base = C + block_row * N + block_col;
+    // Buffer descriptors covering each operand; out-of-bounds accesses are resolved by the
+    // hardware (zero on load, dropped on store) instead of branches.
+    const buffer_resource rsrc_a = make_buffer_resource(A, static_cast<size_t>(M) * K);
+    const buffer_resource rsrc_b = make_buffer_resource(B, static_cast<size_t>(K) * N);
+    const buffer_resource rsrc_c = make_buffer_resource(C, static_cast<size_t>(M) * N);
 
     // Compute warp ID from the 1D thread index.
     const int warp_id  = tid / warp_size;
@@ -59,10 +74,6 @@ __global__ void
     half16 a_frag[config_o2::warp_tile_m]                          = {};
     half16 b_frag[config_o2::warp_tile_n]                          = {};
 
-    // Base pointers for the current A and B tiles.
-    const half* A_tile_ptr = A_base;
-    const half* B_tile_ptr = B_base;
-
     if(tid < half_block)
     {
         // Load A tile (of size block_m × block_k) into shared memory.
@@ -72,34 +83,14 @@ __global__ void
             const int col = i / config_o2::block_m;
             const int row = i % config_o2::block_m;
 
-            int gload  = col * M + row;
-            int swrite = col * config_o2::lds_stride_A + row;
+            const int swrite = col * config_o2::lds_stride_A + row;
+            const int valid  = col < K ? M - (block_row + row) : 0;
 
-            #ifdef BOUNDS_CHECK
-            if((block_row + row + config_o2::vector_width - 1) < M && col < K)
-            #endif
-            {
-                // Load full vector
-                *reinterpret_cast<config_o2::vector_type*>(a_tiles_0 + swrite)
-                    = *reinterpret_cast<const config_o2::vector_type*>(A_tile_ptr + gload);
-            }
-            #ifdef BOUNDS_CHECK
-            else
-            {
-                // Handle the boundary case element by element
-                for(int v = 0; v < config_o2::vector_width; v++)
-                {
-                    if(block_row + row + v < M && col < K)
-                    {
-                        a_tiles_0[swrite + v] = A_tile_ptr[gload + v];
-                    }
-                    else
-                    {
-                        a_tiles_0[swrite + v] = static_cast<half>(0.0f);
-                    }
-                }
-            }
-            #endif
+            load_vector<config_o2::vector_width, int>(
+                a_tiles_0 + swrite,
+                rsrc_a,
+                col_major_offset<int>(block_row + row, col, M),
+                valid);
         }
     }
     else
@@ -111,34 +102,14 @@ __global__ void
             const int row = i / config_o2::block_n;
             const int col = i % config_o2::block_n;
 
-            int gload  = row * N + col;
-            int swrite = row * config_o2::lds_stride_B + col;
+            const int swrite = row * config_o2::lds_stride_B + col;
+            const int valid  = row < K ? N - (block_col + col) : 0;
 
-            #ifdef BOUNDS_CHECK
-            if(row < K && (block_col + col + config_o2::vector_width - 1) < N)
-            #endif
-            {
-                // Load full vector
-                *reinterpret_cast<config_o2::vector_type*>(b_tiles_0 + swrite)
-                    = *reinterpret_cast<const config_o2::vector_type*>(B_tile_ptr + gload);
-            }
-            #ifdef BOUNDS_CHECK
-            else
-            {
-                // Handle the boundary case element by element
-                for(int v = 0; v < config_o2::vector_width; v++)
-                {
-                    if(row < K && block_col + col + v < N)
-                    {
-                        b_tiles_0[swrite + v] = B_tile_ptr[gload + v];
-                    }
-                    else
-                    {
-                        b_tiles_0[swrite + v] = static_cast<half>(0.0f);
-                    }
-                }
-            }
-            #endif
+            load_vector<config_o2::vector_width, int>(
+                b_tiles_0 + swrite,
+                rsrc_b,
+                row_major_offset<int>(row, block_col + col, N),
+                valid);
         }
     }
     __syncthreads();
@@ -151,9 +122,9 @@ __global__ void
     // Main loop over k-dimension
     for(int k_tile = 0; k_tile < K; k_tile += config_o2::block_k)
     {
-        if(tid >= half_block && k_tile + config_o2::block_k < K)
+        const int k_next = k_tile + config_o2::block_k;
+        if(tid >= half_block && k_next < K)
         {
-            const half* next_A = A_tile_ptr + M * config_o2::block_k;
             // Load A tile (of size block_m × block_k) into shared memory.
             for(int i = cid * config_o2::vector_width;
                 i < (config_o2::block_m * config_o2::block_k);
@@ -162,33 +133,14 @@ __global__ void
                 const int col = i / config_o2::block_m;
                 const int row = i % config_o2::block_m;
 
-                int gload  = col * M + row;
-                int swrite = col * config_o2::lds_stride_A + row;
+                const int swrite = col * config_o2::lds_stride_A + row;
+                const int valid  = (k_next + col) < K ? M - (block_row + row) : 0;
 
-                #ifdef BOUNDS_CHECK
-                if((block_row + row + config_o2::vector_width - 1) < M
-                   && (k_tile + config_o2::block_k + col) < K)
-                #endif
-                {
-                    *reinterpret_cast<config_o2::vector_type*>(next_a + swrite)
-                        = *reinterpret_cast<const config_o2::vector_type*>(next_A + gload);
-                }
-                #ifdef BOUNDS_CHECK
-                else
-                {
-                    for(int v = 0; v < config_o2::vector_width; v++)
-                    {
-                        if(block_row + row + v < M && k_tile + config_o2::block_k + col < K)
-                        {
-                            next_a[swrite + v] = next_A[gload + v];
-                        }
-                        else
-                        {
-                            next_a[swrite + v] = static_cast<half>(0.0f);
-                        }
-                    }
-                }
-                #endif
+                load_vector<config_o2::vector_width, int>(
+                    next_a + swrite,
+                    rsrc_a,
+                    col_major_offset<int>(block_row + row, k_next + col, M),
+                    valid);
             }
         }
 
@@ -232,9 +184,8 @@ __global__ void
             }
         }
 
-        if(tid < half_block && k_tile + config_o2::block_k < K)
+        if(tid < half_block && k_next < K)
         {
-            const half* next_B = B_tile_ptr + N * config_o2::block_k;
             // Load B tile (row-major) using vectorized loads
             for(int i = cid * config_o2::vector_width;
                 i < (config_o2::block_k * config_o2::block_n);
@@ -243,40 +194,17 @@ __global__ void
                 const int row = i / config_o2::block_n;
                 const int col = i % config_o2::block_n;
 
-                int gload  = row * N + col;
-                int swrite = row * config_o2::lds_stride_B + col;
-
-                #ifdef BOUNDS_CHECK
-                if((k_tile + config_o2::block_k + row) < K
-                   && (block_col + col + config_o2::vector_width - 1) < N)
-                #endif
-                {
-                    *reinterpret_cast<config_o2::vector_type*>(next_b + swrite)
-                        = *reinterpret_cast<const config_o2::vector_type*>(next_B + gload);
-                }
-                #ifdef BOUNDS_CHECK
-                else
-                {
+                const int swrite = row * config_o2::lds_stride_B + col;
+                const int valid  = (k_next + row) < K ? N - (block_col + col) : 0;
 
-                    for(int v = 0; v < config_o2::vector_width; v++)
-                    {
-                        if(k_tile + config_o2::block_k + row < K && block_col + col + v < N)
-                        {
-                            next_b[swrite + v] = next_B[gload + v];
-                        }
-                        else
-                        {
-                            next_b[swrite + v] = static_cast<half>(0.0f);
-                        }
-                    }
-                }
-                #endif
+                load_vector<config_o2::vector_width, int>(
+                    next_b + swrite,
+                    rsrc_b,
+                    row_major_offset<int>(k_next + row, block_col + col, N),
+                    valid);
             }
         }
 
-        // Advance the global pointers for A and B tiles.
-        A_tile_ptr += M * config_o2::block_k;
-        B_tile_ptr += N * config_o2::block_k;
         half* temp_a = current_a;
         half* temp_b = current_b;
         current_a    = next_a;
@@ -354,36 +282,23 @@ __global__ void
             const int row_global = block_row + row_start + row_local;
             const int col_global = block_col + col_local;
 
-            // Check if this vector is entirely within bounds
-            if(row_global < M && col_global + config_o2::vector_width - 1 < N)
-            {
-                // Full vector write
-                *reinterpret_cast<config_o2::vector_type*>(C_base + (row_start + row_local) * N
-                                                           + col_local)
-                    = *reinterpret_cast<const config_o2::vector_type*>(
-                        c_tile + row_local * config_o2::block_n + col_local);
-            }
-            else if(row_global < M)
-            {
-                // Handle boundary case element by element
-                for(int v = 0; v < config_o2::vector_width; v++)
-                {
-                    if(col_global + v < N)
-                    {
-                        C_base[(row_start + row_local) * N + col_local + v]
-                            = c_tile[row_local * config_o2::block_n + col_local + v];
-                    }
-                }
-            }
+            // Out-of-bounds rows and columns are dropped by the buffer store
+            store_vector<config_o2::vector_width, int>(
+                c_tile + row_local * config_o2::block_n + col_local,
+                rsrc_c,
+                row_major_offset<int>(row_global, col_global, N),
+                row_global < M ? N - col_global : 0);
         }
         __syncthreads();
     }
 }
 
 template<>
-__host__ void hgemm_gpu<kernel_type::wmma_opt_2>(
+__host__ void hgemm_gpu<OPT_2_KERNEL>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index(OPT_2_NAME, M, N, K);
+
     // Calculate grid dimensions
     int grid_m       = (M + config_o2::block_m - 1) / config_o2::block_m;
     int grid_n       = (N + config_o2::block_n - 1) / config_o2::block_n;
@@ -392,5 +307,5 @@ __host__ void hgemm_gpu<kernel_type::wmma_opt_2>(
     dim3 grid_dim(total_blocks);
     dim3 block_dim(warp_size * config_o2::total_warps);
 
-    kernel_hgemm<kernel_type::wmma_opt_2><<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K);
+    kernel_hgemm<OPT_2_KERNEL><<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K);
 }
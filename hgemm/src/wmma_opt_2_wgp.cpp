@@ -0,0 +1,3 @@
+// WGP-mode build of wmma_opt_2 (see wmma_config<kernel_type::wmma_opt_2_wgp>)
+#define WGP_MODE
+#include "wmma_opt_2.cpp"
@@ -1,12 +1,24 @@
 #include <hip/hip_runtime.h>
 #include <kernels/wmma_opt_3.hpp>
 
+// This file is compiled twice: as-is with -mcumode for wmma_opt_3, and through
+// wmma_opt_3_wgp.cpp (which defines WGP_MODE) for the WGP-mode wmma_opt_3_wgp variant.
+#ifdef WGP_MODE
+    #define OPT_3_KERNEL kernel_type::wmma_opt_3_wgp
+    #define OPT_3_NAME   "wmma_opt_3_wgp"
+#else
+    #define OPT_3_KERNEL kernel_type::wmma_opt_3
+    #define OPT_3_NAME   "wmma_opt_3"
+#endif
+
+// Configuration of the kernel built by this translation unit
+using config_o3 = wmma_config<OPT_3_KERNEL>;
+
 #define USE_SHARED_WRITE
 
 template<>
-__global__ void
-    __launch_bounds__(warp_size* config_o3::total_warps) kernel_hgemm<kernel_type::wmma_opt_3>(
-        half* C, const half* A, const half* B, int M, int N, int K)
+__global__ void __launch_bounds__(warp_size* config_o3::total_warps)
+    kernel_hgemm<OPT_3_KERNEL>(half* C, const half* A, const half* B, int M, int N, int K)
 {
     // Calculate grid dimensions
     const int grid_m  = (M + config_o3::block_m - 1) / config_o3::block_m;
@@ -350,38 +362,44 @@ __global__ void
             }
         }
 
-        const half* curr_a = current_a + (warp_m_base + half_lane);
-        const half* curr_b = current_b + (warp_n_base + half_lane);
-
-        for(int i = 0; i < wmma_tile; ++i)
+        // Process the loaded block_k in wmma_tile chunks (a single chunk in the CU-mode build)
+        for(int k_offset = 0; k_offset < config_o3::block_k; k_offset += wmma_tile)
         {
-            const half* srca = curr_a + (i * config_o3::lds_stride_A);
-#pragma unroll
-            for(int wm = 0; wm < config_o3::warp_tile_m; ++wm)
+            const half* curr_a
+                = current_a + k_offset * config_o3::lds_stride_A + (warp_m_base + half_lane);
+            const half* curr_b
+                = current_b + k_offset * config_o3::lds_stride_B + (warp_n_base + half_lane);
+
+            for(int i = 0; i < wmma_tile; ++i)
             {
-                a_frag[wm][i] = *srca;
-                srca += wmma_tile;
-            }
+                const half* srca = curr_a + (i * config_o3::lds_stride_A);
+#pragma unroll
+                for(int wm = 0; wm < config_o3::warp_tile_m; ++wm)
+                {
+                    a_frag[wm][i] = *srca;
+                    srca += wmma_tile;
+                }
 
-            const half* srcb = curr_b + (i * config_o3::lds_stride_B);
+                const half* srcb = curr_b + (i * config_o3::lds_stride_B);
 #pragma unroll
-            for(int wn = 0; wn < config_o3::warp_tile_n; ++wn)
-            {
-                b_frag[wn][i] = *srcb;
-                srcb += wmma_tile;
+                for(int wn = 0; wn < config_o3::warp_tile_n; ++wn)
+                {
+                    b_frag[wn][i] = *srcb;
+                    srcb += wmma_tile;
+                }
             }
-        }
 
-        // Compute: each warp performs WMMA on its fragments.
-        for(int wm = 0; wm < config_o3::warp_tile_m; ++wm)
-        {
-            for(int wn = 0; wn < config_o3::warp_tile_n; ++wn)
+            // Compute: each warp performs WMMA on its fragments.
+            for(int wm = 0; wm < config_o3::warp_tile_m; ++wm)
             {
-                //size_t wn_s       = (wm % 2) ? (config_o3::warp_tile_n - wn - 1) : wn;
-                c_frags[wm][wn] = __builtin_amdgcn_wmma_f16_16x16x16_f16_w32(a_frag[wm],
-                                                                             b_frag[wn],
-                                                                             c_frags[wm][wn],
-                                                                             false);
+                for(int wn = 0; wn < config_o3::warp_tile_n; ++wn)
+                {
+                    //size_t wn_s       = (wm % 2) ? (config_o3::warp_tile_n - wn - 1) : wn;
+                    c_frags[wm][wn] = __builtin_amdgcn_wmma_f16_16x16x16_f16_w32(a_frag[wm],
+                                                                                 b_frag[wn],
+                                                                                 c_frags[wm][wn],
+                                                                                 false);
+                }
             }
         }
 
@@ -517,9 +535,11 @@ __global__ void
 }
 
 template<>
-__host__ void hgemm_gpu<kernel_type::wmma_opt_3>(
+__host__ void hgemm_gpu<OPT_3_KERNEL>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index(OPT_3_NAME, M, N, K);
+
     // Calculate grid dimensions
     int grid_m       = (M + config_o3::block_m - 1) / config_o3::block_m;
     int grid_n       = (N + config_o3::block_n - 1) / config_o3::block_n;
@@ -528,5 +548,5 @@ __host__ void hgemm_gpu<kernel_type::wmma_opt_3>(
     dim3 grid_dim(total_blocks);
     dim3 block_dim(warp_size * config_o3::total_warps);
 
-    kernel_hgemm<kernel_type::wmma_opt_3><<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K);
+    kernel_hgemm<OPT_3_KERNEL><<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K);
 }
@@ -0,0 +1,3 @@
+// WGP-mode build of wmma_opt_3 (see wmma_config<kernel_type::wmma_opt_3_wgp>)
+#define WGP_MODE
+#include "wmma_opt_3.cpp"
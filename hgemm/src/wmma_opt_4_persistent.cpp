@@ -0,0 +1,400 @@
+#include <common/hip_utils.hpp>
+#include <hip/hip_runtime.h>
+#include <kernels/buffer.hpp>
+#include <kernels/wmma_opt_4_persistent.hpp>
+
+#define USE_SHARED_WRITE
+
+/**
+ * @brief Issue the global loads of one K stage into registers
+ *
+ * The first half of the workgroup loads the block_m × block_k tile of A, the second half the
+ * block_k × block_n tile of B, with the same vector assignment as wmma_opt_4.
+ */
+template<class index_t>
+__device__ __forceinline__ void
+    fetch_stage(half (&regs)[config_o4p::stage_loads][config_o4p::vector_width],
+                const buffer_resource& rsrc_a,
+                const buffer_resource& rsrc_b,
+                bool                   is_a,
+                int                    cid,
+                index_t                block_row,
+                index_t                block_col,
+                index_t                k,
+                index_t                M,
+                index_t                N,
+                index_t                K)
+{
+    constexpr int step = config_o4p::loader_threads * config_o4p::vector_width;
+#pragma unroll
+    for(int s = 0; s < config_o4p::stage_loads; ++s)
+    {
+        const int i = cid * config_o4p::vector_width + s * step;
+        if(is_a && i < config_o4p::block_m * config_o4p::block_k)
+        {
+            const int     col   = i / config_o4p::block_m;
+            const int     row   = i % config_o4p::block_m;
+            const index_t valid = (k + col) < K ? M - (block_row + row) : 0;
+            load_vector<config_o4p::vector_width, index_t>(
+                regs[s], rsrc_a, col_major_offset<index_t>(block_row + row, k + col, M), valid);
+        }
+        else if(!is_a && i < config_o4p::block_k * config_o4p::block_n)
+        {
+            const int     row   = i / config_o4p::block_n;
+            const int     col   = i % config_o4p::block_n;
+            const index_t valid = (k + row) < K ? N - (block_col + col) : 0;
+            load_vector<config_o4p::vector_width, index_t>(
+                regs[s], rsrc_b, row_major_offset<index_t>(k + row, block_col + col, N), valid);
+        }
+    }
+}
+
+/**
+ * @brief Write a stage fetched by fetch_stage to an LDS buffer
+ */
+__device__ __forceinline__ void
+    commit_stage(const half (&regs)[config_o4p::stage_loads][config_o4p::vector_width],
+                 half* a_tile,
+                 half* b_tile,
+                 bool  is_a,
+                 int   cid)
+{
+    constexpr int step  = config_o4p::loader_threads * config_o4p::vector_width;
+    half*         dst   = is_a ? a_tile : b_tile;
+    const int     limit = is_a ? config_o4p::block_m * config_o4p::block_k
+                               : config_o4p::block_k * config_o4p::block_n;
+#pragma unroll
+    for(int s = 0; s < config_o4p::stage_loads; ++s)
+    {
+        const int i = cid * config_o4p::vector_width + s * step;
+        if(i < limit)
+        {
+#pragma unroll
+            for(int c = 0; c < config_o4p::vector_width; c += 8)
+            {
+                *reinterpret_cast<half8*>(dst + i + c)
+                    = *reinterpret_cast<const half8*>(regs[s] + c);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Body of the persistent wmma_opt_4 kernels
+ *
+ * @tparam index_t Type used for global memory offsets (int or int64_t)
+ */
+template<class index_t>
+__device__ __forceinline__ void wmma_opt_4_persistent_impl(
+    half* C, const half* A, const half* B, index_t M, index_t N, index_t K)
+{
+    using config = config_o4p;
+
+    // Calculate grid dimensions
+    const int grid_m      = (M + config::block_m - 1) / config::block_m;
+    const int grid_n      = (N + config::block_n - 1) / config::block_n;
+    const int total_tiles = grid_m * grid_n;
+
+    int tile_id = blockIdx.x;
+    if(tile_id >= total_tiles)
+    {
+        return;
+    }
+
+    // Allocate a unified shared memory buffer.
+    __shared__ half lds_mem[2 * config::lds_size];
+
+    // Partition the shared memory with manual offset calculations:
+    // A tiles occupy the first region in each buffer
+    half* a_tiles_0 = lds_mem;
+    half* a_tiles_1 = lds_mem + config::lds_size;
+    // B tiles start after A's region in each buffer
+    half* b_tiles_0 = lds_mem + (config::block_m * config::block_k);
+    half* b_tiles_1 = lds_mem + config::lds_size + (config::block_m * config::block_k);
+
+    // Each block is launched with a one-dimensional thread block.
+    const int  tid         = threadIdx.x;
+    const int  num_threads = blockDim.x;
+    const bool is_a        = tid < config::loader_threads;
+    const int  cid         = tid % config::loader_threads;
+
+    // Buffer descriptors covering each operand; out-of-bounds accesses are resolved by the
+    // hardware (zero on load, dropped on store) instead of branches.
+    const buffer_resource rsrc_a = make_buffer_resource(A, static_cast<size_t>(M) * K);
+    const buffer_resource rsrc_b = make_buffer_resource(B, static_cast<size_t>(K) * N);
+    const buffer_resource rsrc_c = make_buffer_resource(C, static_cast<size_t>(M) * N);
+
+    // Compute warp ID from the 1D thread index.
+    const int warp_id  = tid / warp_size;
+    const int warp_row = warp_id / config::warps_n;
+    const int warp_col = warp_id % config::warps_n;
+
+    constexpr int half_warp    = warp_size / 2;
+    const int     lane_id      = (tid % warp_size);
+    const int     half_warp_id = lane_id / half_warp;
+    const int     half_lane    = tid % half_warp;
+
+    // Determine the base offsets for this warp's set of WMMA tiles.
+    const int warp_m_base = warp_row * config::warp_tile_m * wmma_tile;
+    const int warp_n_base = warp_col * config::warp_tile_n * wmma_tile;
+
+    // Declare fragment storage.
+    half16 a_frag[config::warp_tile_m] = {};
+    half16 b_frag[config::warp_tile_n] = {};
+
+    // Registers holding the stage in flight
+    alignas(16) half stage[config::stage_loads][config::vector_width];
+
+    // Get block coordinates using hilbert mapping
+    int block_row, block_col;
+    hilbert_tile_mapping<config::block_m, config::block_n>(tile_id,
+                                                           grid_m,
+                                                           grid_n,
+                                                           &block_row,
+                                                           &block_col);
+
+    // Only the first tile loads its first stage without overlap
+    fetch_stage<index_t>(stage, rsrc_a, rsrc_b, is_a, cid, block_row, block_col, 0, M, N, K);
+    commit_stage(stage, a_tiles_0, b_tiles_0, is_a, cid);
+    __syncthreads();
+
+    half* current_a = a_tiles_0;
+    half* current_b = b_tiles_0;
+    half* next_a    = a_tiles_1;
+    half* next_b    = b_tiles_1;
+
+    while(true)
+    {
+        half16 c_frags[config::warp_tile_m][config::warp_tile_n] = {};
+
+        // Main loop over k-dimension
+        for(index_t k_tile = 0; k_tile < K; k_tile += config::block_k)
+        {
+            // Loads of the next stage are in flight during this stage's WMMAs
+            const index_t k_next   = k_tile + config::block_k;
+            const bool    has_next = k_next < K;
+            if(has_next)
+            {
+                fetch_stage<index_t>(
+                    stage, rsrc_a, rsrc_b, is_a, cid, block_row, block_col, k_next, M, N, K);
+            }
+
+            // Process the loaded block_k in wmma_tile chunks
+            for(int k_offset = 0; k_offset < config::block_k; k_offset += wmma_tile)
+            {
+                const half* curr_a
+                    = current_a + k_offset * config::lds_stride_A + (warp_m_base + half_lane);
+                const half* curr_b
+                    = current_b + k_offset * config::lds_stride_B + (warp_n_base + half_lane);
+
+                for(int i = 0; i < wmma_tile; ++i)
+                {
+                    const half* srca = curr_a + (i * config::lds_stride_A);
+#pragma unroll
+                    for(int wm = 0; wm < config::warp_tile_m; ++wm)
+                    {
+                        a_frag[wm][i] = *srca;
+                        srca += wmma_tile;
+                    }
+
+                    const half* srcb = curr_b + (i * config::lds_stride_B);
+#pragma unroll
+                    for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                    {
+                        b_frag[wn][i] = *srcb;
+                        srcb += wmma_tile;
+                    }
+                }
+
+                // Compute: each warp performs WMMA on its fragments.
+                for(int wm = 0; wm < config::warp_tile_m; ++wm)
+                {
+                    for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                    {
+                        c_frags[wm][wn]
+                            = __builtin_amdgcn_wmma_f16_16x16x16_f16_w32(a_frag[wm],
+                                                                         b_frag[wn],
+                                                                         c_frags[wm][wn],
+                                                                         false);
+                    }
+                }
+            }
+
+            // The next buffer was released by the barrier ending the previous iteration
+            if(has_next)
+            {
+                commit_stage(stage, next_a, next_b, is_a, cid);
+            }
+
+            half* temp_a = current_a;
+            half* temp_b = current_b;
+            current_a    = next_a;
+            current_b    = next_b;
+            next_a       = temp_a;
+            next_b       = temp_b;
+            __syncthreads();
+        }
+
+        // Both buffers are idle: current receives the next tile's first stage, next stages C
+        const int  next_tile = tile_id + gridDim.x;
+        const bool has_tile  = next_tile < total_tiles;
+        int        next_row  = 0;
+        int        next_col  = 0;
+        if(has_tile)
+        {
+            hilbert_tile_mapping<config::block_m, config::block_n>(next_tile,
+                                                                   grid_m,
+                                                                   grid_n,
+                                                                   &next_row,
+                                                                   &next_col);
+            fetch_stage<index_t>(
+                stage, rsrc_a, rsrc_b, is_a, cid, next_row, next_col, 0, M, N, K);
+        }
+
+#ifdef USE_SHARED_WRITE
+        // One buffer of lds_size halves stays reserved for the prefetched stage
+        constexpr int rows_per_chunk = config::lds_size / config::block_n;
+        half*         c_tile         = next_a;
+
+        // Process the matrix in chunks
+        for(int chunk_idx = 0; chunk_idx < config::block_m; chunk_idx += rows_per_chunk)
+        {
+            // Calculate row range for this chunk
+            const int row_start    = chunk_idx;
+            const int row_end      = min(row_start + rows_per_chunk, config::block_m);
+            const int chunk_height = row_end - row_start;
+
+            // Step 1: Store WMMA fragments to shared memory
+            for(int wm = 0; wm < config::warp_tile_m; ++wm)
+            {
+                const int warp_m_global = warp_m_base + wm * wmma_tile;
+
+                // Skip warps not in the current chunk
+                if(warp_m_global < row_start || warp_m_global >= row_end)
+                {
+                    continue;
+                }
+
+                // Calculate local row offset within current chunk
+                const int warp_m_local = warp_m_global - row_start;
+
+                for(int wn = 0; wn < config::warp_tile_n; ++wn)
+                {
+                    const int warp_n_base_local = warp_n_base + wn * wmma_tile;
+
+    #pragma unroll
+                    for(int i = 0; i < wmma_tile / 2; ++i)
+                    {
+                        const int row_local = warp_m_local + i * 2 + half_warp_id;
+                        const int col_local = warp_n_base_local + half_lane;
+
+                        // Store fragments directly to shared memory
+                        c_tile[row_local * config::block_n + col_local] = c_frags[wm][wn][i * 2];
+                    }
+                }
+            }
+            __syncthreads();
+
+            // Step 2: Perform vectorized writes from shared memory to global memory
+            for(int i = tid * config::vector_width; i < (chunk_height * config::block_n);
+                i += num_threads * config::vector_width)
+            {
+                const int row_local = i / config::block_n;
+                const int col_local = i % config::block_n;
+
+                // Calculate global position
+                const index_t row_global = block_row + row_start + row_local;
+                const index_t col_global = block_col + col_local;
+
+                // Out-of-bounds rows and columns are dropped by the buffer store
+                store_vector<config::vector_width, index_t>(
+                    c_tile + row_local * config::block_n + col_local,
+                    rsrc_c,
+                    row_major_offset<index_t>(row_global, col_global, N),
+                    row_global < M ? N - col_global : 0);
+            }
+            __syncthreads();
+        }
+#else
+        // Write the computed fragments to global memory.
+        for(int wm = 0; wm < config::warp_tile_m; wm++)
+        {
+            const index_t row_base = block_row + warp_m_base + wm * wmma_tile;
+            for(int wn = 0; wn < config::warp_tile_n; wn++)
+            {
+                const index_t col = block_col + warp_n_base + wn * wmma_tile + half_lane;
+    #pragma unroll
+                for(int i = 0; i < wmma_tile / 2; ++i)
+                {
+                    const index_t row = row_base + i * 2 + half_warp_id;
+                    store_scalar<index_t>(c_frags[wm][wn][i * 2],
+                                          rsrc_c,
+                                          row_major_offset<index_t>(row, col, N),
+                                          row < M && col < N);
+                }
+            }
+        }
+#endif
+
+        if(!has_tile)
+        {
+            break;
+        }
+
+        // The prefetched loads have had the whole C store to land
+        commit_stage(stage, current_a, current_b, is_a, cid);
+        __syncthreads();
+
+        tile_id   = next_tile;
+        block_row = next_row;
+        block_col = next_col;
+    }
+}
+
+template<>
+__global__ void __launch_bounds__(warp_size* config_o4p::total_warps)
+    kernel_hgemm<kernel_type::wmma_opt_4_persistent>(
+        half* C, const half* A, const half* B, int M, int N, int K)
+{
+    wmma_opt_4_persistent_impl<int>(C, A, B, M, N, K);
+}
+
+template<>
+__global__ void __launch_bounds__(warp_size* config_o4p::total_warps)
+    kernel_hgemm<kernel_type::wmma_opt_4_persistent, int64_t>(
+        half* C, const half* A, const half* B, int64_t M, int64_t N, int64_t K)
+{
+    wmma_opt_4_persistent_impl<int64_t>(C, A, B, M, N, K);
+}
+
+template<>
+__host__ void hgemm_gpu<kernel_type::wmma_opt_4_persistent>(
+    half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
+{
+    using config = config_o4p;
+
+    // Calculate grid dimensions
+    int grid_m       = (M + config::block_m - 1) / config::block_m;
+    int grid_n       = (N + config::block_n - 1) / config::block_n;
+    int total_blocks = grid_m * grid_n;
+
+    dim3 block_dim(warp_size * config::total_warps);
+
+    // Only pay for 64-bit address arithmetic when an operand exceeds the 32-bit range
+    if(requires_64bit_index(M, N, K))
+    {
+        auto kernel = kernel_hgemm<kernel_type::wmma_opt_4_persistent, index_policy<true>::type>;
+        dim3 grid_dim(std::min(total_blocks,
+                               resident_grid_size(reinterpret_cast<const void*>(kernel),
+                                                  block_dim.x)));
+        kernel<<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K);
+    }
+    else
+    {
+        auto kernel = kernel_hgemm<kernel_type::wmma_opt_4_persistent>;
+        dim3 grid_dim(std::min(total_blocks,
+                               resident_grid_size(reinterpret_cast<const void*>(kernel),
+                                                  block_dim.x)));
+        kernel<<<grid_dim, block_dim, 0, stream>>>(C, A, B, M, N, K);
+    }
+}
@@ -305,6 +305,8 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_prefetch>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index("wmma_prefetch", M, N, K);
+
     constexpr int warp_size = 32;
     dim3          block_dim(warp_size * config_p::total_warps);
     dim3          grid_dim(ceil_div(M, config_p::block_m), ceil_div(N, config_p::block_n));
@@ -124,6 +124,8 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_shared>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index("wmma_shared", M, N, K);
+
     dim3 block_dim(warp_size * config_s::warps_m, config_s::warps_n);
     dim3 grid_dim(ceil_div(M, config_s::block_m), ceil_div(N, config_s::block_n));
 
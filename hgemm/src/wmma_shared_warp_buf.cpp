@@ -213,6 +213,8 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_shared_warp_buf>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index("wmma_shared_warp_buf", M, N, K);
+
     dim3 block_dim(warp_size * config_wb::total_warps);
     dim3 grid_dim(ceil_div(M, config_wb::block_m), ceil_div(N, config_wb::block_n));
 
@@ -300,6 +300,8 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_shared_warp_buf_vec>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index("wmma_shared_warp_buf_vec", M, N, K);
+
     dim3 block_dim(warp_size * config_wbv::total_warps);
     dim3 grid_dim(ceil_div(M, config_wbv::block_m), ceil_div(N, config_wbv::block_n));
 
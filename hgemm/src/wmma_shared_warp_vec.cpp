@@ -194,6 +194,8 @@ template<>
 __host__ void hgemm_gpu<kernel_type::wmma_shared_warp_vec>(
     half* C, half* A, half* B, size_t M, size_t N, size_t K, hipStream_t& stream)
 {
+    require_32bit_index("wmma_shared_warp_vec", M, N, K);
+
     dim3 block_dim(warp_size * config_wv::total_warps);
     dim3 grid_dim(ceil_div(M, config_wv::block_m), ceil_div(N, config_wv::block_n));
 
@@ -24,8 +24,13 @@
 
 #include <common/hip_utils.hpp>
 #include <common/matrix.hpp>
+#include <common/tensor_file.hpp>
+#include <filesystem>
 #include <gtest/gtest.h>
 #include <hgemm.hpp>
+#include <kernels/buffer.hpp>
+#include <numeric>
+#include <sys/mman.h>
 
 template<kernel_type K_TYPE>
 struct layout_selector
@@ -59,6 +64,22 @@ struct layout_selector<kernel_type::rocblas>
     static constexpr matrix_layout c_layout = matrix_layout::col_major;
 };
 
+template<>
+struct layout_selector<kernel_type::rocblas_ex>
+{
+    static constexpr matrix_layout a_layout = matrix_layout::col_major;
+    static constexpr matrix_layout b_layout = matrix_layout::row_major;
+    static constexpr matrix_layout c_layout = matrix_layout::col_major;
+};
+
+template<>
+struct layout_selector<kernel_type::rocblas_ex_tuned>
+{
+    static constexpr matrix_layout a_layout = matrix_layout::col_major;
+    static constexpr matrix_layout b_layout = matrix_layout::row_major;
+    static constexpr matrix_layout c_layout = matrix_layout::col_major;
+};
+
 // Helper function to convert kernel type to string
 inline const char* kernel_type_string(kernel_type type)
 {
@@ -78,9 +99,16 @@ inline const char* kernel_type_string(kernel_type type)
         case kernel_type::wmma_prefetch: return "WMMA Prefetch";
         case kernel_type::wmma_opt_1: return "WMMA Optimized V1";
         case kernel_type::wmma_opt_2: return "WMMA Optimized V2";
+        case kernel_type::wmma_opt_2_wgp: return "WMMA Optimized V2 (WGP mode)";
         case kernel_type::wmma_opt_3: return "WMMA Optimized V3";
+        case kernel_type::wmma_opt_3_wgp: return "WMMA Optimized V3 (WGP mode)";
         case kernel_type::wmma_opt_4: return "WMMA Optimized V4";
+        case kernel_type::wmma_opt_4_wgp: return "WMMA Optimized V4 (WGP mode)";
+        case kernel_type::wmma_opt_4_persistent: return "WMMA Optimized V4 (Persistent)";
+        case kernel_type::rocwmma: return "rocWMMA";
         case kernel_type::rocblas: return "rocBLAS";
+        case kernel_type::rocblas_ex: return "rocBLAS gemm_ex (fp32 compute)";
+        case kernel_type::rocblas_ex_tuned: return "rocBLAS gemm_ex (fp32 compute, tuned)";
         default: return "Unknown";
     }
 }
@@ -102,9 +130,16 @@ using WmmaSharedWarpBufVecKernel = KernelTypeWrapper<kernel_type::wmma_shared_wa
 using WmmaPrefetchKernel         = KernelTypeWrapper<kernel_type::wmma_prefetch>;
 using WmmaOpt1Kernel             = KernelTypeWrapper<kernel_type::wmma_opt_1>;
 using WmmaOpt2Kernel             = KernelTypeWrapper<kernel_type::wmma_opt_2>;
+using WmmaOpt2WgpKernel          = KernelTypeWrapper<kernel_type::wmma_opt_2_wgp>;
 using WmmaOpt3Kernel             = KernelTypeWrapper<kernel_type::wmma_opt_3>;
+using WmmaOpt3WgpKernel          = KernelTypeWrapper<kernel_type::wmma_opt_3_wgp>;
 using WmmaOpt4Kernel             = KernelTypeWrapper<kernel_type::wmma_opt_4>;
+using WmmaOpt4WgpKernel          = KernelTypeWrapper<kernel_type::wmma_opt_4_wgp>;
+using WmmaOpt4PersistentKernel   = KernelTypeWrapper<kernel_type::wmma_opt_4_persistent>;
+using RocwmmaKernel              = KernelTypeWrapper<kernel_type::rocwmma>;
 using RocblasKernel              = KernelTypeWrapper<kernel_type::rocblas>;
+using RocblasExKernel            = KernelTypeWrapper<kernel_type::rocblas_ex>;
+using RocblasExTunedKernel       = KernelTypeWrapper<kernel_type::rocblas_ex_tuned>;
 
 // Test fixture for HGEMM testing
 // Modify your test fixture to handle failures for rocBLAS
@@ -113,7 +148,7 @@ class HGEMMTest : public ::testing::Test
 {
 protected:
     static constexpr kernel_type K_TYPE     = KernelTypeT::value;
-    static constexpr bool        is_rocblas = (K_TYPE == kernel_type::rocblas);
+    static constexpr bool        is_rocblas = is_rocblas_kernel(K_TYPE);
 
     void SetUp() override
     {
@@ -219,9 +254,18 @@ using KernelTypes = ::testing::Types<SharedMemoryKernel,
                                      WmmaPrefetchKernel,
                                      WmmaOpt1Kernel,
                                      WmmaOpt2Kernel,
+                                     WmmaOpt2WgpKernel,
                                      WmmaOpt3Kernel,
+                                     WmmaOpt3WgpKernel,
                                      WmmaOpt4Kernel,
-                                     RocblasKernel>;
+                                     WmmaOpt4WgpKernel,
+                                     WmmaOpt4PersistentKernel,
+#ifdef HGEMM_HAS_ROCWMMA
+                                     RocwmmaKernel,
+#endif
+                                     RocblasKernel,
+                                     RocblasExKernel,
+                                     RocblasExTunedKernel>;
 
 TYPED_TEST_SUITE(HGEMMTest, KernelTypes);
 
@@ -410,6 +454,2909 @@ TYPED_TEST(HGEMMTest, Size1024N)
     this->VerifyHGEMM(M, N, K);
 }
 
+/**
+ * @brief Fill a host matrix with uniform values in [-scale, scale]
+ */
+template<matrix_layout L>
+void fill_uniform(matrix<half, L>& m, std::mt19937& gen, float scale)
+{
+    std::uniform_real_distribution<float> dis(-scale, scale);
+    for(size_t i = 0; i < m.m(); ++i)
+    {
+        for(size_t j = 0; j < m.n(); ++j)
+        {
+            m(i, j) = static_cast<half>(dis(gen));
+        }
+    }
+}
+
+void fill_uniform(std::vector<half>& v, std::mt19937& gen, float scale)
+{
+    std::uniform_real_distribution<float> dis(-scale, scale);
+    for(half& x : v)
+    {
+        x = static_cast<half>(dis(gen));
+    }
+}
+
+using host_col = matrix<half, matrix_layout::col_major>;
+using host_row = matrix<half, matrix_layout::row_major>;
+
+/**
+ * @brief Device allocation of count elements of T, freed on destruction
+ *
+ * The vector counterpart of device_matrix, for auxiliary tensors and side outputs.
+ */
+template<class T>
+class device_buffer
+{
+public:
+    explicit device_buffer(size_t count) : count_(count)
+    {
+        HIP_CHECK(hipMalloc(&data_, std::max<size_t>(count, 1) * sizeof(T)));
+    }
+
+    explicit device_buffer(const std::vector<T>& host) : device_buffer(host.size())
+    {
+        HIP_CHECK(hipMemcpy(data_, host.data(), count_ * sizeof(T), hipMemcpyHostToDevice));
+    }
+
+    device_buffer(const device_buffer&)            = delete;
+    device_buffer& operator=(const device_buffer&) = delete;
+
+    device_buffer(device_buffer&& other) noexcept
+        : count_(other.count_), data_(std::exchange(other.data_, nullptr))
+    {}
+
+    ~device_buffer()
+    {
+        if(data_ != nullptr)
+        {
+            HIP_CHECK(hipFree(data_));
+        }
+    }
+
+    /**
+     * @brief Copy the contents to a host vector, resizing it to count elements
+     */
+    void copy_to(std::vector<T>& host) const
+    {
+        host.resize(count_);
+        HIP_CHECK(hipMemcpy(host.data(), data_, count_ * sizeof(T), hipMemcpyDeviceToHost));
+    }
+
+    T* data()
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return count_;
+    }
+
+private:
+    size_t count_;
+    T*     data_ = nullptr;
+};
+
+// Index and bounds handling
+
+TEST(IndexPolicyTest, SelectsWideIndexOnlyWhenRequired)
+{
+    static_assert(std::is_same_v<index_policy<false>::type, int>);
+    static_assert(std::is_same_v<index_policy<true>::type, int64_t>);
+
+    EXPECT_FALSE(requires_64bit_index(8192, 8192, 8192));
+    EXPECT_FALSE(requires_64bit_index(46340, 46340, 128));
+    EXPECT_TRUE(requires_64bit_index(46341, 46341, 128));
+    EXPECT_TRUE(requires_64bit_index(65536, 65536, 64));
+    EXPECT_TRUE(requires_64bit_index(64, 64, size_t(1) << 32));
+
+    // Every operand switches exactly when it reaches 2^31 elements (2^31 - 1 is prime, so a
+    // product can only equal it with a unit dimension)
+    const size_t narrow = size_t(std::numeric_limits<int>::max());
+    EXPECT_FALSE(requires_64bit_index(narrow, 1, 1));
+    EXPECT_TRUE(requires_64bit_index(narrow + 1, 1, 1));
+    EXPECT_FALSE(requires_64bit_index(1, narrow, 1));
+    EXPECT_TRUE(requires_64bit_index(1, narrow + 1, 1));
+    EXPECT_FALSE(requires_64bit_index(1, 1, narrow));
+    EXPECT_TRUE(requires_64bit_index(1, 1, narrow + 1));
+    EXPECT_FALSE(requires_64bit_index(65535, 32768, 1)); // M × N = 2^31 - 2^15
+    EXPECT_TRUE(requires_64bit_index(65536, 32768, 1));  // M × N = 2^31
+    EXPECT_TRUE(requires_64bit_index(65536, 1, 32768));  // M × K = 2^31
+    EXPECT_TRUE(requires_64bit_index(1, 65536, 32768));  // K × N = 2^31
+}
+
+TEST(IndexPolicyTest, HostOffsetsAndVectorsPastIntMax)
+{
+    // int arguments, as kernels pass tile coordinates, must be widened before multiplying
+    const int     row = 40000, col = 40, ld = 65536;
+    const int64_t offset = row_major_offset<int64_t>(row, col, ld);
+    EXPECT_EQ(offset, int64_t(40000) * 65536 + 40);
+    EXPECT_GT(offset, int64_t(std::numeric_limits<int>::max()));
+    EXPECT_EQ(col_major_offset<int64_t>(col, row, ld), offset);
+
+    // Reserve the whole range but only touch the pages around the offset
+    const size_t elements = size_t(offset) + 64;
+    const size_t bytes    = elements * sizeof(half);
+    void*        mapping  = mmap(nullptr,
+                                 bytes,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                 -1,
+                                 0);
+    if(mapping == MAP_FAILED)
+    {
+        GTEST_SKIP() << "Cannot reserve " << (bytes >> 20) << " MiB of address space";
+    }
+    half* base = static_cast<half*>(mapping);
+
+    // The descriptor cannot describe the range, so the 64-bit path must not depend on it
+    const buffer_resource rsrc = make_buffer_resource(base, elements);
+    EXPECT_EQ(rsrc.num_records, UINT32_MAX);
+
+    half src[32];
+    for(int v = 0; v < 32; ++v)
+    {
+        src[v] = static_cast<half>(static_cast<float>(v + 1));
+    }
+    store_vector<32, int64_t>(src, rsrc, offset, 20);
+    for(int v = 0; v < 32; ++v)
+    {
+        const float expected = v < 20 ? static_cast<float>(v + 1) : 0.0f;
+        EXPECT_EQ(static_cast<float>(base[offset + v]), expected);
+    }
+
+    half dst[32];
+    load_vector<32, int64_t>(dst, rsrc, offset, 12);
+    for(int v = 0; v < 32; ++v)
+    {
+        const float expected = v < 12 ? static_cast<float>(v + 1) : 0.0f;
+        EXPECT_EQ(static_cast<float>(dst[v]), expected);
+    }
+
+    munmap(mapping, bytes);
+}
+
+TEST(IndexPolicyTest, LegacyKernelsRejectWideOperands)
+{
+    // The shapes are rejected before anything is launched, so no memory is needed
+    const size_t M = 65536, N = 65536, K = 16;
+    hipStream_t  stream = nullptr;
+
+    EXPECT_THROW(hgemm_gpu<kernel_type::shared>(nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+    EXPECT_THROW(hgemm_gpu<kernel_type::wmma_naive>(nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+    EXPECT_THROW(hgemm_gpu<kernel_type::wmma_shared>(nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+    EXPECT_THROW(
+        hgemm_gpu<kernel_type::wmma_shared_warp>(nullptr, nullptr, nullptr, M, N, K, stream),
+        std::invalid_argument);
+    EXPECT_THROW(
+        hgemm_gpu<kernel_type::wmma_shared_warp_buf>(nullptr, nullptr, nullptr, M, N, K, stream),
+        std::invalid_argument);
+    EXPECT_THROW(
+        hgemm_gpu<kernel_type::wmma_shared_warp_vec>(nullptr, nullptr, nullptr, M, N, K, stream),
+        std::invalid_argument);
+    EXPECT_THROW(hgemm_gpu<kernel_type::wmma_shared_warp_buf_vec>(
+                     nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+    EXPECT_THROW(hgemm_gpu<kernel_type::wmma_prefetch>(nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+    EXPECT_THROW(hgemm_gpu<kernel_type::wmma_opt_1>(nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+    EXPECT_THROW(hgemm_gpu<kernel_type::wmma_opt_2>(nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+    EXPECT_THROW(hgemm_gpu<kernel_type::wmma_opt_2_wgp>(nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+    EXPECT_THROW(hgemm_gpu<kernel_type::wmma_opt_3>(nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+    EXPECT_THROW(hgemm_gpu<kernel_type::wmma_opt_3_wgp>(nullptr, nullptr, nullptr, M, N, K, stream),
+                 std::invalid_argument);
+}
+
+TEST(IndexPolicyTest, OffsetsPastIntMaxOpt4)
+{
+    // A small K keeps A and the reference cheap while C holds more than 2^31 elements
+    const size_t M = (size_t(1) << 21) + 300, N = 1024, K = 16;
+    ASSERT_TRUE(requires_64bit_index(M, N, K));
+
+    size_t free_bytes, total_bytes;
+    HIP_CHECK(hipMemGetInfo(&free_bytes, &total_bytes));
+    const size_t required = (M * K + K * N + M * N) * sizeof(half);
+    if(free_bytes < required + (size_t(256) << 20))
+    {
+        GTEST_SKIP() << "Needs " << (required >> 20) << " MiB of device memory";
+    }
+
+    std::mt19937 gen(51);
+    host_col     a(M, K);
+    host_row     b(K, N);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+
+    device_matrix<matrix_layout::col_major> d_a(a);
+    device_matrix<matrix_layout::row_major> d_b(b);
+    device_matrix<matrix_layout::row_major> d_c(M, N);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_gpu<kernel_type::wmma_opt_4>(d_c.data(), d_a.data(), d_b.data(), M, N, K, stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    // Rows on both sides of the 2^31 offset of C, and the partial last block
+    const size_t boundary = (size_t(1) << 31) / N;
+    const size_t rows[]   = {0, boundary - 1, boundary, boundary + 1, M - 257, M - 1};
+    const size_t count    = sizeof(rows) / sizeof(rows[0]);
+
+    host_row c(count, N);
+    host_row c_ref(count, N);
+    for(size_t r = 0; r < count; ++r)
+    {
+        HIP_CHECK(hipMemcpy(&c(r, 0),
+                            d_c.data() + rows[r] * N,
+                            N * sizeof(half),
+                            hipMemcpyDeviceToHost));
+        for(size_t j = 0; j < N; ++j)
+        {
+            float acc = 0.0f;
+            for(size_t k = 0; k < K; ++k)
+            {
+                acc += static_cast<float>(a(rows[r], k)) * static_cast<float>(b(k, j));
+            }
+            c_ref(r, j) = static_cast<half>(acc);
+        }
+    }
+    ASSERT_TRUE(verify_results(c, c_ref));
+}
+
+// Host emulation of the buffer descriptor range checks used by the optimized kernels
+TEST(BufferResourceTest, LoadsReturnZeroOutOfBounds)
+{
+    std::vector<half> data(40);
+    for(size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<half>(static_cast<float>(i + 1));
+    }
+
+    // Descriptor only covers the first 36 elements
+    const buffer_resource rsrc = make_buffer_resource(data.data(), 36);
+    EXPECT_EQ(rsrc.num_records, 36 * sizeof(half));
+
+    half out[32];
+    load_vector<32, int>(out, rsrc, 0, 32);
+    for(int v = 0; v < 32; ++v)
+    {
+        EXPECT_EQ(static_cast<float>(out[v]), static_cast<float>(v + 1));
+    }
+
+    // Elements 28..35 are inside the descriptor, 36.. are outside even though memory exists
+    load_vector<32, int>(out, rsrc, 28, 36 - 28);
+    for(int v = 0; v < 32; ++v)
+    {
+        const float expected = v < 8 ? static_cast<float>(28 + v + 1) : 0.0f;
+        EXPECT_EQ(static_cast<float>(out[v]), expected);
+    }
+
+    // A predicated-off vector is redirected to num_records and reads back as zero
+    load_vector<32, int>(out, rsrc, 0, 0);
+    for(int v = 0; v < 32; ++v)
+    {
+        EXPECT_EQ(static_cast<float>(out[v]), 0.0f);
+    }
+}
+
+TEST(BufferResourceTest, PartialVectorsAreClampedPerElement)
+{
+    std::vector<half> data(64, static_cast<half>(1.0f));
+    const buffer_resource rsrc = make_buffer_resource(data.data(), data.size());
+
+    // Only 3 leading elements are valid (e.g. a vector straddling the M edge of a column)
+    half out[16];
+    load_vector<16, int>(out, rsrc, 5, 3);
+    for(int v = 0; v < 16; ++v)
+    {
+        EXPECT_EQ(static_cast<float>(out[v]), v < 3 ? 1.0f : 0.0f);
+    }
+
+    // The 64-bit path must produce the same result without a descriptor range check
+    load_vector<16, int64_t>(out, rsrc, int64_t(5), int64_t(3));
+    for(int v = 0; v < 16; ++v)
+    {
+        EXPECT_EQ(static_cast<float>(out[v]), v < 3 ? 1.0f : 0.0f);
+    }
+}
+
+TEST(BufferResourceTest, StoresAreDroppedOutOfBounds)
+{
+    std::vector<half> data(48, static_cast<half>(0.0f));
+    const buffer_resource rsrc = make_buffer_resource(data.data(), 40);
+
+    half src[16];
+    for(int v = 0; v < 16; ++v)
+    {
+        src[v] = static_cast<half>(2.0f);
+    }
+
+    // 5 valid columns, then the row edge
+    store_vector<16, int>(src, rsrc, 0, 5);
+    // Vector crossing the end of the descriptor
+    store_vector<16, int>(src, rsrc, 32, 16);
+    // Scalar stores on either side of the descriptor end
+    store_scalar<int>(static_cast<half>(3.0f), rsrc, 39, true);
+    store_scalar<int>(static_cast<half>(3.0f), rsrc, 40, true);
+    store_scalar<int>(static_cast<half>(3.0f), rsrc, 20, false);
+
+    for(int i = 0; i < 48; ++i)
+    {
+        float expected = 0.0f;
+        if(i < 5 || (i >= 32 && i < 40))
+        {
+            expected = 2.0f;
+        }
+        if(i == 39)
+        {
+            expected = 3.0f;
+        }
+        EXPECT_EQ(static_cast<float>(data[i]), expected) << "at element " << i;
+    }
+}
+
+// Kernel variants
+
+/**
+ * @brief Runs the batched tiny-matrix kernel over packed problems and checks them as one tall
+ * matrix against the CPU reference
+ */
+void verify_batched(size_t M, size_t N, size_t K, size_t batch)
+{
+    matrix<half, matrix_layout::row_major> h_A(batch * M, K);
+    matrix<half, matrix_layout::col_major> h_B(K, batch * N);
+    matrix<half, matrix_layout::row_major> h_C(batch * M, N);
+    matrix<half, matrix_layout::row_major> h_C_ref(batch * M, N);
+
+    init_matrix(h_A);
+    init_matrix(h_B);
+
+    device_matrix<matrix_layout::row_major> d_A(h_A);
+    device_matrix<matrix_layout::col_major> d_B(h_B);
+    device_matrix<matrix_layout::row_major> d_C(batch * M, N);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_batched_gpu(d_C.data(), d_A.data(), d_B.data(), M, N, K, batch, stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_C.copy_to(h_C);
+
+    hgemm_batched_cpu(h_C_ref, h_A, h_B, batch);
+    ASSERT_TRUE(verify_results(h_C, h_C_ref));
+}
+
+TEST(BatchedTest, Batch16x16x16)
+{
+    verify_batched(16, 16, 16, 4099);
+}
+
+TEST(BatchedTest, Batch32x24x40)
+{
+    verify_batched(32, 24, 40, 1001);
+}
+
+TEST(BatchedTest, Batch64x64x64)
+{
+    verify_batched(64, 64, 64, 257);
+}
+
+TEST(BatchedTest, Batch50x7x33)
+{
+    verify_batched(50, 7, 33, 300);
+}
+
+TEST(BatchedTest, RejectsProblemsLargerThanOneWave)
+{
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    EXPECT_THROW(hgemm_batched_gpu(nullptr, nullptr, nullptr, 65, 16, 16, 1, stream),
+                 std::invalid_argument);
+    HIP_CHECK(hipStreamDestroy(stream));
+}
+
+TEST(PersistentTest, MoreTilesThanResidentWorkgroups)
+{
+    // 17 × 18 tiles exceeds CU count × occupancy on current RDNA3 parts, so workgroups loop
+    const size_t M = 4200, N = 4400, K = 72;
+    std::mt19937 gen(59);
+    matrix<half, matrix_layout::col_major> a(M, K);
+    matrix<half, matrix_layout::row_major> b(K, N);
+    matrix<half, matrix_layout::row_major> c(M, N);
+    matrix<half, matrix_layout::row_major> c_ref(M, N);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+    hgemm_cpu(c_ref, a, b);
+
+    device_matrix<matrix_layout::col_major> d_a(a);
+    device_matrix<matrix_layout::row_major> d_b(b);
+    device_matrix<matrix_layout::row_major> d_c(M, N);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_gpu<kernel_type::wmma_opt_4_persistent>(d_c.data(),
+                                                  d_a.data(),
+                                                  d_b.data(),
+                                                  M,
+                                                  N,
+                                                  K,
+                                                  stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_c.copy_to(c);
+    ASSERT_TRUE(verify_results(c, c_ref));
+}
+
+TEST(RocblasTest, TunedSolutionIsCachedPerShape)
+{
+    const size_t M = 512, N = 384, K = 256;
+    std::mt19937 gen(61);
+    matrix<half, matrix_layout::col_major> a(M, K);
+    matrix<half, matrix_layout::row_major> b(K, N);
+    matrix<half, matrix_layout::col_major> c(M, N);
+    matrix<half, matrix_layout::col_major> c_ref(M, N);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+    hgemm_cpu(c_ref, a, b);
+
+    device_matrix<matrix_layout::col_major> d_a(a);
+    device_matrix<matrix_layout::row_major> d_b(b);
+    device_matrix<matrix_layout::col_major> d_c(M, N);
+
+    ASSERT_TRUE(init_rocblas());
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+
+    const size_t  shapes = rocblas_tuned_shapes();
+    const int32_t first  = rocblas_tune_solution(
+        d_c.data(), d_a.data(), d_b.data(), M, N, K, rocblas_datatype_f32_r, stream);
+    const int32_t second = rocblas_tune_solution(
+        d_c.data(), d_a.data(), d_b.data(), M, N, K, rocblas_datatype_f32_r, stream);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(rocblas_tuned_shapes(), shapes + 1);
+
+    // The cached solution still computes the product
+    rocblas_hgemm_ex(
+        d_c.data(), d_a.data(), d_b.data(), M, N, K, rocblas_datatype_f32_r, first, stream);
+    HIP_CHECK(hipStreamSynchronize(stream));
+    d_c.copy_to(c);
+    EXPECT_TRUE(verify_results(c, c_ref));
+
+    // fp16 accumulation is a separate cache entry
+    rocblas_tune_solution(
+        d_c.data(), d_a.data(), d_b.data(), M, N, K, rocblas_datatype_f16_r, stream);
+    EXPECT_EQ(rocblas_tuned_shapes(), shapes + 2);
+
+    HIP_CHECK(hipStreamDestroy(stream));
+    cleanup_rocblas();
+}
+
+#ifdef HGEMM_HAS_ROCWMMA
+TEST(RocwmmaTest, UnalignedSizes)
+{
+    // No dimension is a multiple of the 128 × 128 × 16 block, or of the 16 × 16 WMMA tile
+    const size_t M = 300, N = 203, K = 77;
+    std::mt19937 gen(67);
+    matrix<half, matrix_layout::col_major> a(M, K);
+    matrix<half, matrix_layout::row_major> b(K, N);
+    matrix<half, matrix_layout::row_major> c(M, N);
+    matrix<half, matrix_layout::row_major> c_ref(M, N);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+    hgemm_cpu(c_ref, a, b);
+
+    device_matrix<matrix_layout::col_major> d_a(a);
+    device_matrix<matrix_layout::row_major> d_b(b);
+    device_matrix<matrix_layout::row_major> d_c(M, N);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_gpu<kernel_type::rocwmma>(d_c.data(), d_a.data(), d_b.data(), M, N, K, stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_c.copy_to(c);
+    ASSERT_TRUE(verify_results(c, c_ref));
+}
+#endif
+
+TEST(StrassenTest, WorkspaceAndLevelsFollowSplits)
+{
+    EXPECT_EQ(strassen_levels(1024, 1024, 1024, 1024), 0);
+    EXPECT_EQ(strassen_workspace_size(1024, 1024, 1024, 1024), 0u);
+    EXPECT_EQ(strassen_levels(1024, 1024, 1024, 256), 2);
+    // Odd dimensions stop the recursion
+    EXPECT_EQ(strassen_levels(1026, 1024, 1024, 256), 1);
+    EXPECT_EQ(strassen_workspace_size(512, 512, 512, 128),
+              (8 * 256 * 256 + 8 * 128 * 128) * sizeof(half));
+}
+
+/**
+ * @brief Runs the Strassen–Winograd driver and the plain kernel on random data, bounding the
+ * driver's error against the fp32 CPU reference by the plain kernel's error per level
+ */
+template<kernel_type K_TYPE>
+void verify_strassen(size_t M, size_t N, size_t K, size_t crossover)
+{
+    matrix<half, layout_selector<K_TYPE>::a_layout> h_A(M, K);
+    matrix<half, layout_selector<K_TYPE>::b_layout> h_B(K, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C(M, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C_plain(M, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C_ref(M, N);
+
+    // Signed data, as the Winograd subtractions cancel on the all-positive init_matrix pattern
+    std::mt19937 gen(3);
+    fill_uniform(h_A, gen, 1.0f);
+    fill_uniform(h_B, gen, 1.0f);
+
+    device_matrix<layout_selector<K_TYPE>::a_layout> d_A(h_A);
+    device_matrix<layout_selector<K_TYPE>::b_layout> d_B(h_B);
+    device_matrix<layout_selector<K_TYPE>::c_layout> d_C(M, N);
+    device_matrix<layout_selector<K_TYPE>::c_layout> d_C_plain(M, N);
+    device_buffer<uint8_t> d_ws(strassen_workspace_size(M, N, K, crossover));
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_strassen_gpu<K_TYPE>(
+        d_C.data(), d_A.data(), d_B.data(), M, N, K, crossover, d_ws.data(), stream);
+    HIP_CHECK(hipPeekAtLastError());
+    hgemm_gpu<K_TYPE>(d_C_plain.data(), d_A.data(), d_B.data(), M, N, K, stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_C.copy_to(h_C);
+    d_C_plain.copy_to(h_C_plain);
+
+    hgemm_cpu(h_C_ref, h_A, h_B);
+
+    const int    levels      = strassen_levels(M, N, K, crossover);
+    const double plain_error = relative_error(h_C_plain, h_C_ref);
+    const double error       = relative_error(h_C, h_C_ref);
+    std::cout << "Strassen levels: " << levels << ", relative error: " << error
+              << " (plain kernel: " << plain_error << ")" << std::endl;
+
+    if(levels == 0)
+    {
+        // Below the crossover the driver is exactly the plain kernel
+        ASSERT_EQ(error, plain_error);
+    }
+    EXPECT_LE(error, std::max(plain_error, 1e-3) * std::pow(3.0, levels));
+    ASSERT_TRUE(verify_results(h_C, h_C_ref));
+}
+
+TEST(StrassenTest, BelowCrossoverOpt4Wgp)
+{
+    verify_strassen<kernel_type::wmma_opt_4_wgp>(256, 256, 256, 256);
+}
+
+TEST(StrassenTest, OneLevelOpt4Wgp)
+{
+    verify_strassen<kernel_type::wmma_opt_4_wgp>(512, 512, 512, 256);
+}
+
+TEST(StrassenTest, TwoLevelsOpt4Wgp)
+{
+    verify_strassen<kernel_type::wmma_opt_4_wgp>(512, 512, 512, 128);
+}
+
+TEST(StrassenTest, TwoLevelsRectangularOpt4Wgp)
+{
+    verify_strassen<kernel_type::wmma_opt_4_wgp>(384, 256, 320, 64);
+}
+
+// Fused epilogues, prologues and expressions
+
+TEST(EpilogueTest, HostTreeMatchesExpression)
+{
+    constexpr int m = 4, n = 8;
+
+    std::vector<half> bias(n), scale(m), residual(m * n);
+    for(int j = 0; j < n; ++j)
+    {
+        bias[j] = static_cast<half>(0.25f * j - 1.0f);
+    }
+    for(int i = 0; i < m; ++i)
+    {
+        scale[i] = static_cast<half>(1.0f + 0.5f * i);
+    }
+    for(int i = 0; i < m * n; ++i)
+    {
+        residual[i] = static_cast<half>(0.125f * (i % 5));
+    }
+
+    // relu(alpha * acc + bias[col]) + scale[row] * residual(row, col)
+    const float alpha = 0.5f;
+    const auto  epi   = epilogue_add(
+        epilogue_relu(epilogue_add(epilogue_mul(epilogue_acc{}, epilogue_scalar{alpha}),
+                                   epilogue_col_vector{bias.data()})),
+        epilogue_mul(epilogue_row_vector{scale.data()}, epilogue_matrix{residual.data(), n}));
+
+    static_assert(is_identity_epilogue<epilogue_acc>);
+    static_assert(!is_identity_epilogue<decltype(epi)>);
+
+    const float accs[] = {-3.0f, 0.25f, 7.0f};
+    for(int i = 0; i < m; ++i)
+    {
+        for(int j = 0; j < n; ++j)
+        {
+            for(float acc : accs)
+            {
+                const float expected
+                    = std::max(alpha * acc + static_cast<float>(bias[j]), 0.0f)
+                      + static_cast<float>(scale[i]) * static_cast<float>(residual[i * n + j]);
+                EXPECT_FLOAT_EQ(epi(acc, i, j), expected) << "at (" << i << "," << j << ")";
+            }
+        }
+    }
+
+    EXPECT_FLOAT_EQ(epilogue_clamp(epilogue_acc{}, -1.0f, 2.0f)(5.0f, 0, 0), 2.0f);
+    EXPECT_FLOAT_EQ(epilogue_clamp(epilogue_acc{}, -1.0f, 2.0f)(-5.0f, 0, 0), -1.0f);
+    EXPECT_FLOAT_EQ(epilogue_silu(epilogue_acc{})(0.0f, 0, 0), 0.0f);
+    EXPECT_NEAR(epilogue_gelu(epilogue_acc{})(1.0f, 0, 0), 0.8412f, 1e-4f);
+    EXPECT_FLOAT_EQ(epilogue_cast_to<half>(epilogue_scalar{1.0f / 3.0f})(0.0f, 0, 0),
+                    static_cast<float>(static_cast<half>(1.0f / 3.0f)));
+}
+
+/**
+ * @brief Runs a fused bias/activation/residual epilogue on the GPU and checks it against the
+ * host evaluation of the same expression tree
+ */
+template<kernel_type K_TYPE>
+void verify_fused_epilogue(size_t M, size_t N, size_t K)
+{
+    matrix<half, layout_selector<K_TYPE>::a_layout> h_A(M, K);
+    matrix<half, layout_selector<K_TYPE>::b_layout> h_B(K, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C(M, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C_ref(M, N);
+    init_matrix(h_A);
+    init_matrix(h_B);
+
+    std::vector<half> h_bias(N), h_scale(M), h_residual(M * N);
+    for(size_t j = 0; j < N; ++j)
+    {
+        h_bias[j] = static_cast<half>(0.25f * (j % 7) - 1.0f);
+    }
+    for(size_t i = 0; i < M; ++i)
+    {
+        h_scale[i] = static_cast<half>(1.0f + 0.5f * (i % 3));
+    }
+    for(size_t i = 0; i < M * N; ++i)
+    {
+        h_residual[i] = static_cast<half>(0.125f * (i % 5));
+    }
+
+    device_matrix<layout_selector<K_TYPE>::a_layout> d_A(h_A);
+    device_matrix<layout_selector<K_TYPE>::b_layout> d_B(h_B);
+    device_matrix<layout_selector<K_TYPE>::c_layout> d_C(M, N);
+    device_buffer<half>                              d_bias(h_bias);
+    device_buffer<half>                              d_scale(h_scale);
+    device_buffer<half>                              d_residual(h_residual);
+
+    // The same tree is built twice, once over device pointers and once over host pointers
+    const float alpha     = 0.5f;
+    auto        make_tree = [&](const half* bias, const half* scale, const half* residual)
+    {
+        return epilogue_add(
+            epilogue_relu(epilogue_add(epilogue_mul(epilogue_acc{}, epilogue_scalar{alpha}),
+                                       epilogue_col_vector{bias})),
+            epilogue_mul(epilogue_row_vector{scale},
+                         epilogue_matrix{residual, static_cast<int64_t>(N)}));
+    };
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_gpu<K_TYPE>(d_C.data(),
+                      d_A.data(),
+                      d_B.data(),
+                      M,
+                      N,
+                      K,
+                      make_tree(d_bias.data(), d_scale.data(), d_residual.data()),
+                      stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_C.copy_to(h_C);
+    hgemm_cpu(h_C_ref, h_A, h_B, make_tree(h_bias.data(), h_scale.data(), h_residual.data()));
+
+    ASSERT_TRUE(verify_results(h_C, h_C_ref))
+        << "Fused epilogue verification failed for kernel: " << kernel_type_string(K_TYPE)
+        << " with size " << M << "x" << N << "x" << K;
+}
+
+TEST(EpilogueTest, FusedBiasReluResidualOpt4Wgp)
+{
+    verify_fused_epilogue<kernel_type::wmma_opt_4_wgp>(320, 288, 256);
+}
+
+TEST(PrologueTest, LoaderTransformsOnlyValidElements)
+{
+    std::vector<half> data(64), scale(64), zero_point(64);
+    for(size_t i = 0; i < data.size(); ++i)
+    {
+        data[i]       = static_cast<half>(static_cast<float>(i % 8));
+        scale[i]      = static_cast<half>(0.5f);
+        zero_point[i] = static_cast<half>(2.0f);
+    }
+    const buffer_resource rsrc = make_buffer_resource(data.data(), data.size());
+    const auto pro = prologue_dequant_rows(scale.data(), zero_point.data());
+
+    // 5 valid rows starting at row 8 of column 0; the zero padding must not become -zero * scale
+    alignas(16) half out[16];
+    load_vector_prologue<16, int>(out, rsrc, 8, 5, 8, 0, pro);
+    for(int v = 0; v < 16; ++v)
+    {
+        const float expected = v < 5 ? (static_cast<float>((8 + v) % 8) - 2.0f) * 0.5f : 0.0f;
+        EXPECT_EQ(static_cast<float>(out[v]), expected) << "at element " << v;
+    }
+
+    // The identity prologue is a plain load
+    load_vector_prologue<16, int>(out, rsrc, 8, 16, 8, 0, prologue_input{});
+    for(int v = 0; v < 16; ++v)
+    {
+        EXPECT_EQ(static_cast<float>(out[v]), static_cast<float>(v % 8));
+    }
+}
+
+/**
+ * @brief Runs a fused RMSNorm prologue on the GPU and checks it against the host evaluation of
+ * the same expression tree
+ */
+template<kernel_type K_TYPE>
+void verify_fused_prologue(size_t M, size_t N, size_t K)
+{
+    matrix<half, layout_selector<K_TYPE>::a_layout> h_A(M, K);
+    matrix<half, layout_selector<K_TYPE>::b_layout> h_B(K, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C(M, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C_ref(M, N);
+    init_matrix(h_A);
+    init_matrix(h_B);
+
+    std::vector<half> h_inv_rms(M), h_gamma(K);
+    for(size_t i = 0; i < M; ++i)
+    {
+        h_inv_rms[i] = static_cast<half>(0.5f + 0.25f * (i % 5));
+    }
+    for(size_t k = 0; k < K; ++k)
+    {
+        h_gamma[k] = static_cast<half>(0.75f + 0.125f * (k % 4));
+    }
+
+    device_matrix<layout_selector<K_TYPE>::a_layout> d_A(h_A);
+    device_matrix<layout_selector<K_TYPE>::b_layout> d_B(h_B);
+    device_matrix<layout_selector<K_TYPE>::c_layout> d_C(M, N);
+    device_buffer<half>                              d_inv_rms(h_inv_rms);
+    device_buffer<half>                              d_gamma(h_gamma);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_gpu<K_TYPE>(d_C.data(),
+                      d_A.data(),
+                      d_B.data(),
+                      M,
+                      N,
+                      K,
+                      prologue_rms_norm(d_inv_rms.data(), d_gamma.data()),
+                      epilogue_acc{},
+                      stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_C.copy_to(h_C);
+    hgemm_cpu(h_C_ref,
+              h_A,
+              h_B,
+              prologue_rms_norm(h_inv_rms.data(), h_gamma.data()),
+              epilogue_acc{});
+
+    ASSERT_TRUE(verify_results(h_C, h_C_ref))
+        << "Fused prologue verification failed for kernel: " << kernel_type_string(K_TYPE)
+        << " with size " << M << "x" << N << "x" << K;
+}
+
+TEST(PrologueTest, FusedRmsNormOpt4Wgp)
+{
+    verify_fused_prologue<kernel_type::wmma_opt_4_wgp>(288, 320, 200);
+}
+
+TEST(ExpressionTest, FusabilityIsDecidedAtCompileTime)
+{
+    using A = expr_leaf<host_col>;
+    using B = expr_leaf<host_row>;
+    using P = expr_product<A, B>;
+
+    static_assert(is_fusable_expr<expr_binary<op_mul,
+                                              expr_unary<op_relu, expr_binary<op_add, P, B>>,
+                                              expr_scalar>>);
+    static_assert(!is_fusable_expr<expr_binary<op_add, P, P>>);
+    static_assert(!is_fusable_expr<expr_product<P, B>>);
+    static_assert(!is_fusable_expr<expr_binary<op_add, A, B>>);
+    static_assert(std::is_same_v<decltype(host_col(1, 1) * host_row(1, 1)), P>);
+}
+
+TEST(ExpressionTest, HostFusedMatchesExplicitEpilogue)
+{
+    std::mt19937 gen(21);
+    host_col     a(48, 40);
+    host_row     b(40, 56);
+    host_row     bias(1, 56);
+    host_row     c(48, 56);
+    host_row     c_ref(48, 56);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+    fill_uniform(bias, gen, 1.0f);
+
+    assign(c, relu(a * b + bias) * 0.5f);
+
+    hgemm_cpu(c_ref,
+              a,
+              b,
+              epilogue_mul(epilogue_relu(epilogue_add(epilogue_acc{},
+                                                      epilogue_col_vector{bias.data()})),
+                           epilogue_scalar{0.5f}));
+    for(size_t i = 0; i < c.m(); ++i)
+    {
+        for(size_t j = 0; j < c.n(); ++j)
+        {
+            ASSERT_EQ(static_cast<float>(c(i, j)), static_cast<float>(c_ref(i, j)));
+        }
+    }
+}
+
+TEST(ExpressionTest, HostFallbackRoundsEachProduct)
+{
+    std::mt19937 gen(22);
+    host_col     a(32, 24);
+    host_row     b(24, 16);
+    host_col     d(32, 8);
+    host_row     e(8, 16);
+    host_row     scale(32, 1);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+    fill_uniform(d, gen, 1.0f);
+    fill_uniform(e, gen, 1.0f);
+    fill_uniform(scale, gen, 1.0f);
+
+    host_row c(32, 16);
+    assign(c, hadamard(a * b - d * e, scale));
+
+    host_row ab(32, 16);
+    host_row de(32, 16);
+    hgemm_cpu(ab, a, b);
+    hgemm_cpu(de, d, e);
+    for(size_t i = 0; i < c.m(); ++i)
+    {
+        for(size_t j = 0; j < c.n(); ++j)
+        {
+            const float expected = (static_cast<float>(ab(i, j)) - static_cast<float>(de(i, j)))
+                                   * static_cast<float>(scale(i, 0));
+            ASSERT_EQ(static_cast<float>(c(i, j)), static_cast<float>(static_cast<half>(expected)));
+        }
+    }
+
+    host_row wrong(16, 16);
+    EXPECT_THROW(assign(wrong, a * b), std::invalid_argument);
+    EXPECT_THROW(assign(c, a * a), std::invalid_argument);
+}
+
+TEST(ExpressionTest, BroadcastProductIsNotFused)
+{
+    // x * w is 1 × N, broadcast over the M rows of y, so it cannot be the M × N accumulator
+    std::mt19937 gen(24);
+    host_col     x(1, 40);
+    host_row     w(40, 24);
+    host_row     y(32, 24);
+    fill_uniform(x, gen, 1.0f);
+    fill_uniform(w, gen, 1.0f);
+    fill_uniform(y, gen, 1.0f);
+
+    host_row c(32, 24);
+    assign(c, x * w + y);
+
+    host_row xw(1, 24);
+    hgemm_cpu(xw, x, w);
+    for(size_t i = 0; i < c.m(); ++i)
+    {
+        for(size_t j = 0; j < c.n(); ++j)
+        {
+            const float expected = static_cast<float>(xw(0, j)) + static_cast<float>(y(i, j));
+            ASSERT_EQ(static_cast<float>(c(i, j)), static_cast<float>(static_cast<half>(expected)));
+        }
+    }
+}
+
+/**
+ * @brief Evaluates the same expression on device and host matrices, which must agree
+ */
+template<class Build>
+void verify_expression(Build build, size_t M, size_t N, size_t K)
+{
+    std::mt19937 gen(23);
+    host_col     a(M, K);
+    host_row     a_row(M, K);
+    host_row     b(K, N);
+    host_row     bias(1, N);
+    host_row     residual(M, N);
+    host_row     c(M, N);
+    host_row     c_ref(M, N);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(a_row, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+    fill_uniform(bias, gen, 1.0f);
+    fill_uniform(residual, gen, 1.0f);
+
+    device_matrix<matrix_layout::col_major> d_a(a);
+    device_matrix<matrix_layout::row_major> d_a_row(a_row);
+    device_matrix<matrix_layout::row_major> d_b(b);
+    device_matrix<matrix_layout::row_major> d_bias(bias);
+    device_matrix<matrix_layout::row_major> d_residual(residual);
+    device_matrix<matrix_layout::row_major> d_c(M, N);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    assign(d_c, build(d_a, d_a_row, d_b, d_bias, d_residual), stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+    d_c.copy_to(c);
+
+    assign(c_ref, build(a, a_row, b, bias, residual));
+    ASSERT_TRUE(verify_results(c, c_ref));
+}
+
+TEST(ExpressionTest, FusedBiasReluScaleResidual)
+{
+    verify_expression(
+        [](const auto& a, const auto&, const auto& b, const auto& bias, const auto& residual)
+        { return relu(a * b + bias) * 0.25f + residual; },
+        320,
+        288,
+        256);
+}
+
+TEST(ExpressionTest, FallbackWithTransposedOperand)
+{
+    // Row-major A is transposed for the kernel, and two products cannot share one epilogue
+    verify_expression(
+        [](const auto& a, const auto& a_row, const auto& b, const auto& bias, const auto&)
+        { return gelu(a_row * b) - silu(a * b + bias); },
+        200,
+        300,
+        128);
+}
+
+TEST(ExpressionTest, BroadcastProductWritesEveryRow)
+{
+    const size_t M = 300, N = 256, K = 128;
+    std::mt19937 gen(25);
+    host_col     x(1, K);
+    host_row     w(K, N);
+    host_row     y(M, N);
+    host_row     c(M, N);
+    host_row     c_ref(M, N);
+    fill_uniform(x, gen, 1.0f);
+    fill_uniform(w, gen, 1.0f);
+    fill_uniform(y, gen, 1.0f);
+
+    device_matrix<matrix_layout::col_major> d_x(x);
+    device_matrix<matrix_layout::row_major> d_w(w);
+    device_matrix<matrix_layout::row_major> d_y(y);
+    device_matrix<matrix_layout::row_major> d_c(M, N);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    assign(d_c, d_x * d_w + d_y, stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+    d_c.copy_to(c);
+
+    assign(c_ref, x * w + y);
+    ASSERT_TRUE(verify_results(c, c_ref));
+}
+
+TEST(QuantizeTest, E4m3RoundTripsEveryCode)
+{
+    for(int code = 0; code < 256; ++code)
+    {
+        // Skip NaN and negative zero (which encodes back to +0)
+        if((code & 0x7F) == 0x7F || code == 0x80)
+        {
+            continue;
+        }
+        const float value = e4m3_to_float(static_cast<uint8_t>(code));
+        EXPECT_EQ(float_to_e4m3(value), code) << "code " << code << " value " << value;
+    }
+
+    EXPECT_EQ(e4m3_to_float(0x7E), 448.0f);
+    EXPECT_EQ(e4m3_to_float(0x01), 1.0f / 512.0f);
+    // Ties round to even mantissas
+    EXPECT_EQ(float_to_e4m3(1.0625f), 0x38); // 1.0
+    EXPECT_EQ(float_to_e4m3(1.1875f), 0x3A); // 1.25
+    // Saturation and carry into the next exponent
+    EXPECT_EQ(float_to_e4m3(1000.0f), 0x7E);
+    EXPECT_EQ(float_to_e4m3(-1000.0f), 0xFE);
+    EXPECT_EQ(float_to_e4m3(1.97f), 0x40); // 2.0
+}
+
+TEST(QuantizeTest, CpuReferenceDefinesRounding)
+{
+    // One row spanning two tiles of width 4
+    matrix<half, matrix_layout::row_major> C(1, 6);
+    const float values[] = {1.0f, -2.0f, 0.5f, 4.0f, 0.25f, -0.5f};
+    for(int j = 0; j < 6; ++j)
+    {
+        C(0, j) = static_cast<half>(values[j]);
+    }
+
+    std::vector<int8_t> Q;
+    std::vector<float>  scales;
+    quantize_cpu(C, quant_granularity::per_tile, 4, Q, scales);
+    ASSERT_EQ(scales.size(), 2u);
+    EXPECT_FLOAT_EQ(scales[0], 4.0f / 127.0f);
+    EXPECT_FLOAT_EQ(scales[1], 0.5f / 127.0f);
+    const int per_tile[] = {32, -64, 16, 127, 64, -127}; // 31.75 -> 32, 15.875 -> 16
+    for(int j = 0; j < 6; ++j)
+    {
+        EXPECT_EQ(Q[j], per_tile[j]) << "at column " << j;
+    }
+
+    // Per-row quantizes every column with the row scale
+    quantize_cpu(C, quant_granularity::per_row, 4, Q, scales);
+    ASSERT_EQ(scales.size(), 1u);
+    EXPECT_FLOAT_EQ(scales[0], 4.0f / 127.0f);
+    const int per_row[] = {32, -64, 16, 127, 8, -16};
+    for(int j = 0; j < 6; ++j)
+    {
+        EXPECT_EQ(Q[j], per_row[j]) << "at column " << j;
+    }
+
+    // A single rounding: going through the tile scale first would give 25 -> 9.375 -> 9
+    C(0, 4) = static_cast<half>(1.5f);
+    C(0, 5) = static_cast<half>(0.300048828125f);
+    quantize_cpu(C, quant_granularity::per_row, 4, Q, scales);
+    EXPECT_EQ(Q[4], 48); // 47.625
+    EXPECT_EQ(Q[5], 10); // 9.5265
+}
+
+/**
+ * @brief Runs a quantized GEMM on the GPU and checks it bit-exactly against quantize_cpu applied
+ * to the fp16 output of the same kernel
+ */
+template<kernel_type K_TYPE, class T>
+void verify_quantized(size_t M, size_t N, size_t K, quant_granularity granularity)
+{
+    using config = wmma_config<K_TYPE>;
+
+    matrix<half, layout_selector<K_TYPE>::a_layout> h_A(M, K);
+    matrix<half, layout_selector<K_TYPE>::b_layout> h_B(K, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C(M, N);
+    init_matrix(h_A);
+    init_matrix(h_B);
+
+    const size_t tiles_n    = (N + config::block_n - 1) / config::block_n;
+    const size_t num_scales = granularity == quant_granularity::per_row ? M : M * tiles_n;
+    const size_t ws_size    = quantize_workspace_size<K_TYPE>(M, N, granularity);
+
+    device_matrix<layout_selector<K_TYPE>::a_layout> d_A(h_A);
+    device_matrix<layout_selector<K_TYPE>::b_layout> d_B(h_B);
+    device_matrix<layout_selector<K_TYPE>::c_layout> d_C(M, N);
+    device_buffer<T>                                 d_Q(M * N);
+    device_buffer<float>                             d_scales(num_scales);
+    device_buffer<uint8_t>                           d_ws(ws_size);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_gpu<K_TYPE>(d_C.data(), d_A.data(), d_B.data(), M, N, K, stream);
+    hgemm_quantized_gpu<K_TYPE>(d_Q.data(),
+                                d_scales.data(),
+                                d_A.data(),
+                                d_B.data(),
+                                M,
+                                N,
+                                K,
+                                granularity,
+                                d_ws.data(),
+                                stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    std::vector<T>     h_Q, h_Q_ref;
+    std::vector<float> h_scales, h_scales_ref;
+    d_C.copy_to(h_C);
+    d_Q.copy_to(h_Q);
+    d_scales.copy_to(h_scales);
+
+    quantize_cpu(h_C, granularity, config::block_n, h_Q_ref, h_scales_ref);
+
+    ASSERT_EQ(h_scales, h_scales_ref);
+    size_t mismatches = 0;
+    for(size_t i = 0; i < M * N; ++i)
+    {
+        mismatches += std::memcmp(&h_Q[i], &h_Q_ref[i], sizeof(T)) != 0;
+    }
+    EXPECT_EQ(mismatches, 0u) << "Quantized output mismatch for kernel: "
+                              << kernel_type_string(K_TYPE) << " with size " << M << "x" << N
+                              << "x" << K;
+}
+
+TEST(QuantizeTest, Int8PerTileOpt4Wgp)
+{
+    verify_quantized<kernel_type::wmma_opt_4_wgp, int8_t>(
+        320, 600, 256, quant_granularity::per_tile);
+}
+
+TEST(QuantizeTest, Int8PerRowOpt4Wgp)
+{
+    verify_quantized<kernel_type::wmma_opt_4_wgp, int8_t>(
+        320, 600, 256, quant_granularity::per_row);
+}
+
+TEST(QuantizeTest, Fp8PerRowOpt4Wgp)
+{
+    verify_quantized<kernel_type::wmma_opt_4_wgp, fp8_e4m3>(
+        320, 600, 256, quant_granularity::per_row);
+}
+
+// More tiles than resident workgroups, so the per-row kernel runs several rounds of row bands
+TEST(QuantizeTest, Int8PerRowManyRoundsOpt4Wgp)
+{
+    verify_quantized<kernel_type::wmma_opt_4_wgp, int8_t>(
+        12400, 1000, 64, quant_granularity::per_row);
+}
+
+/**
+ * @brief Runs a GEMM with all reduction side outputs and checks them against reductions of the
+ * fp16 output of the plain kernel
+ */
+template<kernel_type K_TYPE>
+void verify_reductions(size_t M, size_t N, size_t K, bool store_c)
+{
+    matrix<half, layout_selector<K_TYPE>::a_layout> h_A(M, K);
+    matrix<half, layout_selector<K_TYPE>::b_layout> h_B(K, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C(M, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C_fused(M, N);
+    init_matrix(h_A);
+    init_matrix(h_B);
+
+    device_matrix<layout_selector<K_TYPE>::a_layout> d_A(h_A);
+    device_matrix<layout_selector<K_TYPE>::b_layout> d_B(h_B);
+    device_matrix<layout_selector<K_TYPE>::c_layout> d_C(M, N);
+    device_matrix<layout_selector<K_TYPE>::c_layout> d_C_fused(store_c ? M : 0, N);
+    device_buffer<float>                             d_stats(3 * (M + N));
+    device_buffer<uint8_t>                           d_ws(reduce_workspace_size<K_TYPE>(M, N));
+
+    float* const         stats = d_stats.data();
+    const reduce_outputs outputs{
+        stats, stats + M, stats + 2 * M, stats + 3 * M, stats + 3 * M + N, stats + 3 * M + 2 * N};
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_gpu<K_TYPE>(d_C.data(), d_A.data(), d_B.data(), M, N, K, stream);
+    hgemm_reduce_gpu<K_TYPE>(store_c ? d_C_fused.data() : nullptr,
+                             d_A.data(),
+                             d_B.data(),
+                             M,
+                             N,
+                             K,
+                             outputs,
+                             d_ws.data(),
+                             stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    std::vector<float> h_stats;
+    d_C.copy_to(h_C);
+    d_stats.copy_to(h_stats);
+    if(store_c)
+    {
+        d_C_fused.copy_to(h_C_fused);
+    }
+
+    if(store_c)
+    {
+        ASSERT_EQ(std::memcmp(h_C.data(), h_C_fused.data(), M * N * sizeof(half)), 0)
+            << "C stored alongside the reductions differs from the plain kernel";
+    }
+
+    // Reference reductions in double; sums only differ in summation order
+    auto check = [&](const float* gpu, size_t count, size_t length, auto value_at, const char* name)
+    {
+        for(size_t idx = 0; idx < count; ++idx)
+        {
+            double sum = 0.0, sum_sq = 0.0, max = -INFINITY;
+            for(size_t other = 0; other < length; ++other)
+            {
+                const double v = value_at(idx, other);
+                sum += v;
+                sum_sq += v * v;
+                max = std::max(max, v);
+            }
+            EXPECT_NEAR(gpu[idx], sum, 1e-4 * std::abs(sum) + 1e-3) << name << " sum " << idx;
+            EXPECT_EQ(gpu[idx + count], static_cast<float>(max)) << name << " max " << idx;
+            EXPECT_NEAR(gpu[idx + 2 * count], sum_sq, 1e-4 * sum_sq + 1e-3)
+                << name << " sum_sq " << idx;
+        }
+    };
+    check(
+        h_stats.data(),
+        M,
+        N,
+        [&](size_t i, size_t j) { return static_cast<double>(h_C(i, j)); },
+        "row");
+    check(
+        h_stats.data() + 3 * M,
+        N,
+        M,
+        [&](size_t j, size_t i) { return static_cast<double>(h_C(i, j)); },
+        "col");
+}
+
+TEST(ReduceTest, RowColStatsWithCOpt4Wgp)
+{
+    verify_reductions<kernel_type::wmma_opt_4_wgp>(320, 600, 256, true);
+}
+
+TEST(ReduceTest, RowColStatsOnlyOpt4Wgp)
+{
+    verify_reductions<kernel_type::wmma_opt_4_wgp>(600, 320, 128, false);
+}
+
+TEST(TopKTest, InsertKeepsSortedListWithIndexTieBreak)
+{
+    float score[4];
+    int   index[4];
+    topk_init(score, index);
+
+    const float candidates[] = {1.0f, 5.0f, 3.0f, 5.0f, -2.0f, 4.0f, 3.0f};
+    for(int c = 0; c < 7; ++c)
+    {
+        topk_insert(score, index, candidates[c], c);
+    }
+
+    const float expected_score[] = {5.0f, 5.0f, 4.0f, 3.0f};
+    const int   expected_index[] = {1, 3, 5, 2};
+    for(int j = 0; j < 4; ++j)
+    {
+        EXPECT_EQ(score[j], expected_score[j]);
+        EXPECT_EQ(index[j], expected_index[j]);
+    }
+}
+
+/**
+ * @brief Runs the fused GEMM + top-k and checks it against a CPU brute-force top-k of the fp16
+ * output of the plain kernel
+ */
+template<kernel_type K_TYPE, int TOPK>
+void verify_topk(size_t M, size_t N, size_t K)
+{
+    matrix<half, layout_selector<K_TYPE>::a_layout> h_A(M, K);
+    matrix<half, layout_selector<K_TYPE>::b_layout> h_B(K, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_C(M, N);
+
+    // Distinct random scores rather than the repeating init_matrix pattern
+    std::mt19937 gen(42);
+    fill_uniform(h_A, gen, 1.0f);
+    fill_uniform(h_B, gen, 1.0f);
+
+    device_matrix<layout_selector<K_TYPE>::a_layout> d_A(h_A);
+    device_matrix<layout_selector<K_TYPE>::b_layout> d_B(h_B);
+    device_matrix<layout_selector<K_TYPE>::c_layout> d_C(M, N);
+    device_buffer<float>                             d_scores(M * TOPK);
+    device_buffer<int>                               d_indices(M * TOPK);
+    device_buffer<uint8_t>                           d_ws(topk_workspace_size<K_TYPE, TOPK>(M, N));
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_gpu<K_TYPE>(d_C.data(), d_A.data(), d_B.data(), M, N, K, stream);
+    hgemm_topk_gpu<K_TYPE, TOPK>(d_scores.data(),
+                                 d_indices.data(),
+                                 d_A.data(),
+                                 d_B.data(),
+                                 M,
+                                 N,
+                                 K,
+                                 d_ws.data(),
+                                 stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    std::vector<float> h_scores, h_scores_ref;
+    std::vector<int>   h_indices, h_indices_ref;
+    d_C.copy_to(h_C);
+    d_scores.copy_to(h_scores);
+    d_indices.copy_to(h_indices);
+
+    topk_cpu(h_C, TOPK, h_scores_ref, h_indices_ref);
+    EXPECT_EQ(h_scores, h_scores_ref);
+    EXPECT_EQ(h_indices, h_indices_ref);
+}
+
+TEST(TopKTest, Top8Opt4Wgp)
+{
+    verify_topk<kernel_type::wmma_opt_4_wgp, 8>(300, 2000, 128);
+}
+
+TEST(TopKTest, Top16FewerColumnsThanTileOpt4Wgp)
+{
+    verify_topk<kernel_type::wmma_opt_4_wgp, 16>(64, 100, 64);
+}
+
+TEST(TopKTest, Top4Opt4Wgp)
+{
+    verify_topk<kernel_type::wmma_opt_4_wgp, 4>(260, 1500, 256);
+}
+
+/**
+ * @brief Runs the L2 distance GEMM and checks distances and argmin against a direct CPU
+ * evaluation of ||a - b||
+ */
+template<kernel_type K_TYPE>
+void verify_l2_distance(size_t M, size_t N, size_t K, bool take_sqrt)
+{
+    matrix<half, layout_selector<K_TYPE>::a_layout> h_A(M, K);
+    matrix<half, layout_selector<K_TYPE>::b_layout> h_B(K, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_D(M, N);
+    matrix<half, layout_selector<K_TYPE>::c_layout> h_D_ref(M, N);
+
+    std::mt19937 gen(7);
+    fill_uniform(h_A, gen, 1.0f);
+    fill_uniform(h_B, gen, 1.0f);
+
+    device_matrix<layout_selector<K_TYPE>::a_layout> d_A(h_A);
+    device_matrix<layout_selector<K_TYPE>::b_layout> d_B(h_B);
+    device_matrix<layout_selector<K_TYPE>::c_layout> d_D(M, N);
+    device_buffer<int>                               d_argmin(M);
+    device_buffer<uint8_t>                           d_ws(distance_workspace_size<K_TYPE>(M, N));
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    auto run = [&](half* D)
+    {
+        hgemm_l2_distance_gpu<K_TYPE>(D,
+                                      d_argmin.data(),
+                                      nullptr,
+                                      d_A.data(),
+                                      d_B.data(),
+                                      M,
+                                      N,
+                                      K,
+                                      take_sqrt,
+                                      d_ws.data(),
+                                      stream);
+        HIP_CHECK(hipPeekAtLastError());
+        HIP_CHECK(hipStreamSynchronize(stream));
+    };
+
+    std::vector<int> h_argmin;
+    std::vector<int> h_argmin_only;
+    run(d_D.data());
+    d_D.copy_to(h_D);
+    d_argmin.copy_to(h_argmin);
+
+    // Skipping D must not change the assignment
+    run(nullptr);
+    HIP_CHECK(hipStreamDestroy(stream));
+    d_argmin.copy_to(h_argmin_only);
+    EXPECT_EQ(h_argmin, h_argmin_only);
+
+    l2_distance_cpu(h_D_ref, h_A, h_B, take_sqrt);
+    ASSERT_TRUE(verify_results(h_D, h_D_ref));
+
+    for(size_t i = 0; i < M; ++i)
+    {
+        // The argmin must be the minimum of the emitted row, and near-optimal in exact arithmetic
+        ASSERT_GE(h_argmin[i], 0);
+        ASSERT_LT(static_cast<size_t>(h_argmin[i]), N);
+        float row_min = std::numeric_limits<float>::infinity();
+        float ref_min = std::numeric_limits<float>::infinity();
+        for(size_t j = 0; j < N; ++j)
+        {
+            row_min = std::min(row_min, static_cast<float>(h_D(i, j)));
+            ref_min = std::min(ref_min, static_cast<float>(h_D_ref(i, j)));
+        }
+        EXPECT_EQ(static_cast<float>(h_D(i, h_argmin[i])), row_min) << "row " << i;
+        EXPECT_LE(static_cast<float>(h_D_ref(i, h_argmin[i])), ref_min * 1.02f + 0.05f)
+            << "row " << i;
+    }
+}
+
+TEST(DistanceTest, SquaredL2WithArgminOpt4Wgp)
+{
+    verify_l2_distance<kernel_type::wmma_opt_4_wgp>(300, 700, 64, false);
+}
+
+TEST(DistanceTest, L2WithArgminOpt4Wgp)
+{
+    verify_l2_distance<kernel_type::wmma_opt_4_wgp>(520, 300, 100, true);
+}
+
+// Planned GEMMs
+
+TEST(PlanTest, RejectsKernelsWithoutPlans)
+{
+    EXPECT_THROW(hgemm_plan(256,
+                            256,
+                            256,
+                            matrix_layout::col_major,
+                            matrix_layout::row_major,
+                            matrix_layout::row_major,
+                            kernel_type::wmma_naive),
+                 std::invalid_argument);
+    EXPECT_THROW(hgemm_plan(0,
+                            256,
+                            256,
+                            matrix_layout::col_major,
+                            matrix_layout::row_major,
+                            matrix_layout::row_major),
+                 std::invalid_argument);
+}
+
+/**
+ * @brief Executes one plan several times and compares with the CPU reference
+ */
+template<matrix_layout LA, matrix_layout LB, matrix_layout LC>
+void verify_plan(size_t M, size_t N, size_t K, kernel_type kernel = kernel_type::wmma_opt_4)
+{
+    std::mt19937     gen(47);
+    matrix<half, LA> a(M, K);
+    matrix<half, LB> b(K, N);
+    matrix<half, LC> c(M, N);
+    matrix<half, LC> c_ref(M, N);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+    hgemm_cpu(c_ref, a, b);
+
+    device_matrix<LA> d_a(a);
+    device_matrix<LB> d_b(b);
+    device_matrix<LC> d_c(M, N);
+
+    const hgemm_plan plan(M, N, K, LA, LB, LC, kernel);
+    EXPECT_EQ(plan.swapped(), LC == matrix_layout::col_major);
+    EXPECT_EQ(plan.workspace_size(),
+              ((LA == matrix_layout::row_major ? M * K : 0)
+               + (LB == matrix_layout::col_major ? K * N : 0))
+                  * sizeof(half));
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    for(int i = 0; i < 3; ++i)
+    {
+        execute_hgemm(plan, {d_c.data(), d_a.data(), d_b.data()}, stream);
+    }
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_c.copy_to(c);
+    ASSERT_TRUE(verify_results(c, c_ref));
+}
+
+TEST(PlanTest, NativeLayoutsOpt4)
+{
+    verify_plan<matrix_layout::col_major, matrix_layout::row_major, matrix_layout::row_major>(
+        1000, 600, 320);
+}
+
+TEST(PlanTest, ColumnMajorOutputSwapsRolesOpt4)
+{
+    verify_plan<matrix_layout::col_major, matrix_layout::row_major, matrix_layout::col_major>(
+        520, 700, 256);
+}
+
+TEST(PlanTest, TransposedOperandsPackedOpt4)
+{
+    verify_plan<matrix_layout::row_major, matrix_layout::col_major, matrix_layout::row_major>(
+        384, 257, 200);
+    verify_plan<matrix_layout::row_major, matrix_layout::row_major, matrix_layout::col_major>(
+        300, 512, 144);
+}
+
+TEST(PlanTest, AllRepackedOpt4Wgp)
+{
+    verify_plan<matrix_layout::row_major, matrix_layout::col_major, matrix_layout::col_major>(
+        640, 320, 512, kernel_type::wmma_opt_4_wgp);
+}
+
+TEST(PlanTest, PrepackedWeightsIgnoreLaterPointers)
+{
+    const size_t M = 256, N = 384, K = 192;
+    std::mt19937 gen(53);
+    host_row     x(M, K);
+    host_col     w(K, N);
+    host_row     y(M, N);
+    host_row     y_ref(M, N);
+    fill_uniform(x, gen, 1.0f);
+    fill_uniform(w, gen, 1.0f);
+    hgemm_cpu(y_ref, x, w);
+
+    device_matrix<matrix_layout::row_major> d_x(x);
+    device_matrix<matrix_layout::row_major> d_y(M, N);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    hgemm_plan plan(
+        M, N, K, matrix_layout::row_major, matrix_layout::col_major, matrix_layout::row_major);
+    {
+        // The weight can be released once packed
+        device_matrix<matrix_layout::col_major> d_w(w);
+        plan.prepack_b(d_w.data(), stream);
+        HIP_CHECK(hipStreamSynchronize(stream));
+    }
+    execute_hgemm(plan, {d_y.data(), d_x.data(), nullptr}, stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_y.copy_to(y);
+    ASSERT_TRUE(verify_results(y, y_ref));
+}
+
+TEST(BucketTest, RoundsUpToConfiguredBuckets)
+{
+    const bucketed_hgemm gemm({1024, 256, 512, 256},
+                              512,
+                              512,
+                              matrix_layout::col_major,
+                              matrix_layout::row_major,
+                              matrix_layout::row_major,
+                              false);
+    EXPECT_EQ(gemm.buckets(), (std::vector<size_t>{256, 512, 1024}));
+    EXPECT_EQ(gemm.bucket_for(1), 256u);
+    EXPECT_EQ(gemm.bucket_for(256), 256u);
+    EXPECT_EQ(gemm.bucket_for(257), 512u);
+    EXPECT_EQ(gemm.bucket_for(1000), 1024u);
+    // Above the largest bucket M rounds up to whole tiles
+    EXPECT_EQ(gemm.bucket_for(1025), 1280u);
+
+    EXPECT_EQ(default_m_buckets(600), (std::vector<size_t>{256, 512, 768}));
+    EXPECT_EQ(default_m_buckets(512), (std::vector<size_t>{256, 512}));
+
+    auto make = [](std::vector<size_t> buckets, size_t N)
+    {
+        bucketed_hgemm(std::move(buckets),
+                       N,
+                       64,
+                       matrix_layout::col_major,
+                       matrix_layout::row_major,
+                       matrix_layout::row_major);
+    };
+    EXPECT_THROW(make({}, 64), std::invalid_argument);
+    EXPECT_THROW(make({0, 256}, 64), std::invalid_argument);
+    EXPECT_THROW(make({256}, 0), std::invalid_argument);
+}
+
+/**
+ * @brief Runs a sequence of batch sizes through one bucketed GEMM, checking each result, that
+ * rows past M are never written, and the traffic counters
+ */
+template<matrix_layout LA, matrix_layout LB, matrix_layout LC>
+void verify_bucketed(bool tune)
+{
+    const size_t    N = 320, K = 192;
+    const size_t    guard_rows = 64;
+    constexpr float sentinel   = 7.0f;
+
+    std::mt19937     gen(75);
+    matrix<half, LB> b(K, N);
+    fill_uniform(b, gen, 1.0f);
+    device_matrix<LB> d_b(b);
+
+    bucketed_hgemm gemm({256, 512}, N, K, LA, LB, LC, tune);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    for(size_t M : {1, 100, 300, 300, 512, 700})
+    {
+        matrix<half, LA> a(M, K);
+        matrix<half, LC> c(M, N);
+        matrix<half, LC> c_ref(M, N);
+        fill_uniform(a, gen, 1.0f);
+        hgemm_cpu(c_ref, a, b);
+        device_matrix<LA> d_a(a);
+
+        // C is followed by guard rows that the padded rows of the bucket must not reach
+        const size_t      elements = M * N;
+        std::vector<half>   h_c(elements + guard_rows * N, static_cast<half>(sentinel));
+        device_buffer<half> d_c(h_c);
+
+        gemm.execute({d_c.data(), d_a.data(), d_b.data()}, M, stream);
+        HIP_CHECK(hipPeekAtLastError());
+        HIP_CHECK(hipStreamSynchronize(stream));
+        d_c.copy_to(h_c);
+
+        std::copy(h_c.begin(), h_c.begin() + elements, c.data());
+        for(size_t i = elements; i < h_c.size(); ++i)
+        {
+            ASSERT_EQ(static_cast<float>(h_c[i]), sentinel) << "M = " << M;
+        }
+        ASSERT_TRUE(verify_results(c, c_ref)) << "M = " << M;
+    }
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    const bucket_stats stats = gemm.stats();
+    EXPECT_EQ(stats.hits, 3u);
+    EXPECT_EQ(stats.misses, 3u);
+    EXPECT_EQ(stats.overflows, 1u);
+    EXPECT_EQ(stats.rows, 1913u);
+    EXPECT_EQ(stats.padded_rows, 255u + 156u + 2 * 212u + 68u);
+    EXPECT_EQ(gemm.bucket_calls(), (std::map<size_t, size_t>{{256, 2}, {512, 3}, {768, 1}}));
+    if(!tune)
+    {
+        EXPECT_EQ(gemm.bucket_kernel(512), kernel_type::wmma_opt_4);
+    }
+}
+
+TEST(BucketTest, PaddedRowsNativeLayouts)
+{
+    verify_bucketed<matrix_layout::col_major, matrix_layout::row_major, matrix_layout::row_major>(
+        false);
+}
+
+TEST(BucketTest, PaddedRowsRepackedTuned)
+{
+    verify_bucketed<matrix_layout::row_major, matrix_layout::col_major, matrix_layout::col_major>(
+        true);
+}
+
+TEST(BucketTest, RepackedCallsOnConcurrentStreams)
+{
+    // Row-major A and column-major B are packed on every call, into a workspace per stream
+    const size_t  M = 200, N = 320, K = 192;
+    constexpr int streams = 3;
+
+    std::mt19937 gen(76);
+    host_row     a[streams] = {host_row(M, K), host_row(M, K), host_row(M, K)};
+    host_col     b(K, N);
+    fill_uniform(b, gen, 1.0f);
+    device_matrix<matrix_layout::col_major> d_b(b);
+
+    bucketed_hgemm gemm({256},
+                        N,
+                        K,
+                        matrix_layout::row_major,
+                        matrix_layout::col_major,
+                        matrix_layout::row_major,
+                        false);
+
+    std::vector<device_matrix<matrix_layout::row_major>> d_a;
+    std::vector<device_matrix<matrix_layout::row_major>> d_c;
+    hipStream_t                                          stream[streams];
+    for(int s = 0; s < streams; ++s)
+    {
+        fill_uniform(a[s], gen, 1.0f);
+        d_a.emplace_back(a[s]);
+        d_c.emplace_back(M, N);
+        HIP_CHECK(hipStreamCreate(&stream[s]));
+    }
+
+    // Interleave the calls so the streams' packing launches can overlap
+    for(int round = 0; round < 4; ++round)
+    {
+        for(int s = 0; s < streams; ++s)
+        {
+            gemm.execute({d_c[s].data(), d_a[s].data(), d_b.data()}, M, stream[s]);
+        }
+    }
+    HIP_CHECK(hipPeekAtLastError());
+
+    for(int s = 0; s < streams; ++s)
+    {
+        HIP_CHECK(hipStreamSynchronize(stream[s]));
+        HIP_CHECK(hipStreamDestroy(stream[s]));
+
+        host_row c(M, N);
+        host_row c_ref(M, N);
+        d_c[s].copy_to(c);
+        hgemm_cpu(c_ref, a[s], b);
+        EXPECT_TRUE(verify_results(c, c_ref)) << "stream " << s;
+    }
+}
+
+TEST(ContractionTest, ParsesAndClassifiesIndices)
+{
+    const contraction_spec spec = parse_contraction("bhqd, bhkd -> bhqk");
+    EXPECT_EQ(spec.batch, "bh");
+    EXPECT_EQ(spec.m, "q");
+    EXPECT_EQ(spec.n, "k");
+    EXPECT_EQ(spec.k, "d");
+
+    EXPECT_THROW(parse_contraction("ij,jk"), std::invalid_argument);
+    EXPECT_THROW(parse_contraction("ii,ij->j"), std::invalid_argument);
+    EXPECT_THROW(parse_contraction("ij,jk->il"), std::invalid_argument);
+    EXPECT_THROW(parse_contraction("ijx,jk->ik"), std::invalid_argument);
+}
+
+TEST(ContractionTest, PlansPreferMappingsWithoutCopies)
+{
+    // Attention scores on packed tensors are already in the batched kernel's layouts
+    const contraction_plan scores = plan_contraction("bhqd,bhkd->bhqk",
+                                                     {{2, 4, 64, 32}, {}},
+                                                     {{2, 4, 48, 32}, {}},
+                                                     {{2, 4, 64, 48}, {}});
+    EXPECT_EQ(scores.backend, contraction_backend::batched);
+    EXPECT_EQ(scores.copied_elements, 0u);
+    EXPECT_EQ(scores.batch(), 8u);
+
+    // Column-major A and row-major B and C are the opt_4 layouts
+    const contraction_plan nt = plan_contraction(
+        "mk,kn->mn", {{1024, 512}, {1, 1024}}, {{512, 768}, {}}, {{1024, 768}, {}});
+    EXPECT_EQ(nt.backend, contraction_backend::opt_4);
+    EXPECT_FALSE(nt.swapped);
+    EXPECT_EQ(nt.copied_elements, 0u);
+
+    // A column-major output is reached by computing C^T with the operands exchanged
+    const contraction_plan tn = plan_contraction(
+        "mk,kn->mn", {{1024, 512}, {1, 1024}}, {{512, 768}, {}}, {{1024, 768}, {1, 1024}});
+    EXPECT_TRUE(tn.swapped);
+    EXPECT_EQ(tn.copied_elements, 0u);
+    EXPECT_EQ(tn.M, 768u);
+    EXPECT_EQ(tn.N, 1024u);
+
+    // Row-major A with row-major C cannot avoid a transpose, which then covers A only
+    const contraction_plan nn
+        = plan_contraction("mk,kn->mn", {{1024, 512}, {}}, {{512, 768}, {}}, {{1024, 768}, {}});
+    EXPECT_EQ(nn.backend, contraction_backend::opt_4);
+    EXPECT_TRUE(nn.a.copy);
+    EXPECT_FALSE(nn.b.copy);
+    EXPECT_FALSE(nn.c.copy);
+    EXPECT_EQ(nn.workspace_size, 1024u * 512u * sizeof(half));
+
+    EXPECT_THROW(plan_contraction("mk,kn->mn", {{16, 8}, {}}, {{9, 16}, {}}, {{16, 16}, {}}),
+                 std::invalid_argument);
+}
+
+TEST(ContractionTest, CacheReusesPlansPerSpecAndLayout)
+{
+    contraction_cache cache;
+    const tensor_layout a{{256, 128}, {}};
+    const tensor_layout b{{128, 64}, {}};
+    const tensor_layout c{{256, 64}, {}};
+
+    const contraction_plan& first = cache.get("mk,kn->mn", a, b, c);
+    const contraction_plan& again = cache.get("mk,kn->mn", a, b, c);
+    EXPECT_EQ(&first, &again);
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.misses(), 1u);
+
+    cache.get("mk,kn->mn", {{256, 128}, {1, 256}}, b, c);
+    EXPECT_EQ(cache.misses(), 2u);
+}
+
+/**
+ * @brief Number of elements spanned by a strided tensor
+ */
+size_t tensor_span(const tensor_layout& layout)
+{
+    size_t span = 1;
+    for(size_t i = 0; i < layout.shape.size(); ++i)
+    {
+        span += (layout.shape[i] - 1) * static_cast<size_t>(layout.stride(i));
+    }
+    return span;
+}
+
+/**
+ * @brief Plans and runs a contraction on random strided tensors, checking it against the CPU
+ * einsum reference
+ */
+void verify_contraction(const std::string&   spec,
+                        const tensor_layout& lhs_layout,
+                        const tensor_layout& rhs_layout,
+                        const tensor_layout& out_layout,
+                        contraction_backend  expected_backend)
+{
+    std::vector<half> h_lhs(tensor_span(lhs_layout));
+    std::vector<half> h_rhs(tensor_span(rhs_layout));
+    std::vector<half> h_out(tensor_span(out_layout));
+    std::vector<half> h_out_ref(tensor_span(out_layout));
+
+    std::mt19937 gen(11);
+    fill_uniform(h_lhs, gen, 1.0f);
+    fill_uniform(h_rhs, gen, 1.0f);
+
+    contraction_cache       cache;
+    const contraction_plan& plan = cache.get(spec, lhs_layout, rhs_layout, out_layout);
+    EXPECT_EQ(plan.backend, expected_backend);
+
+    device_buffer<half>    d_lhs(h_lhs);
+    device_buffer<half>    d_rhs(h_rhs);
+    device_buffer<half>    d_out(h_out);
+    device_buffer<uint8_t> d_ws(plan.workspace_size);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    execute_contraction<kernel_type::wmma_opt_4_wgp>(
+        plan, d_out.data(), d_lhs.data(), d_rhs.data(), d_ws.data(), stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_out.copy_to(h_out);
+
+    contraction_cpu(spec,
+                    h_out_ref.data(),
+                    out_layout,
+                    h_lhs.data(),
+                    lhs_layout,
+                    h_rhs.data(),
+                    rhs_layout);
+
+    matrix<half, matrix_layout::row_major> gpu(1, h_out.size());
+    matrix<half, matrix_layout::row_major> ref(1, h_out.size());
+    std::copy(h_out.begin(), h_out.end(), gpu.data());
+    std::copy(h_out_ref.begin(), h_out_ref.end(), ref.data());
+    ASSERT_TRUE(verify_results(gpu, ref));
+}
+
+TEST(ContractionTest, AttentionScoresZeroCopyBatched)
+{
+    verify_contraction("bhqd,bhkd->bhqk",
+                       {{2, 3, 64, 40}, {}},
+                       {{2, 3, 48, 40}, {}},
+                       {{2, 3, 64, 48}, {}},
+                       contraction_backend::batched);
+}
+
+TEST(ContractionTest, AttentionValuesWithTransposeOpt4)
+{
+    verify_contraction("bhqk,bhkd->bhqd",
+                       {{2, 3, 96, 128}, {}},
+                       {{2, 3, 128, 80}, {}},
+                       {{2, 3, 96, 80}, {}},
+                       contraction_backend::opt_4);
+}
+
+TEST(ContractionTest, ColumnMajorOutputSwappedOpt4)
+{
+    verify_contraction("mk,kn->mn",
+                       {{200, 128}, {1, 200}},
+                       {{128, 300}, {}},
+                       {{200, 300}, {1, 200}},
+                       contraction_backend::opt_4);
+}
+
+TEST(ContractionTest, PaddedStridesOpt4)
+{
+    verify_contraction("mk,kn->mn",
+                       {{200, 128}, {1, 208}},
+                       {{128, 300}, {304, 1}},
+                       {{200, 300}, {}},
+                       contraction_backend::opt_4);
+}
+
+/**
+ * @brief Cost model charging exactly 2MNK per product and nothing for copies or launches
+ */
+gemm_cost_model flop_cost_model()
+{
+    return {1.0, 1.0, 1.0, 1e-6, std::numeric_limits<double>::infinity(), 0.0};
+}
+
+TEST(ChainTest, DynamicProgramFindsClassicOptimum)
+{
+    // The textbook instance with dimensions 30, 35, 15, 5, 10, 20, 25
+    const size_t             dims[] = {30, 35, 15, 5, 10, 20, 25};
+    std::vector<chain_input> inputs;
+    std::vector<size_t>      term;
+    for(size_t i = 0; i < 6; ++i)
+    {
+        inputs.push_back({dims[i], dims[i + 1], matrix_layout::col_major});
+        term.push_back(i);
+    }
+
+    const chain_plan plan = plan_chain(inputs, {term}, flop_cost_model());
+    EXPECT_DOUBLE_EQ(plan.cost_us, 2.0 * 15125);
+    EXPECT_LT(plan.cost_us, plan.written_cost_us);
+    EXPECT_EQ(std::count_if(plan.steps.begin(),
+                            plan.steps.end(),
+                            [](const chain_step& s) { return !s.transpose; }),
+              5);
+}
+
+TEST(ChainTest, MatrixVectorChainRunsRightToLeft)
+{
+    const std::vector<chain_input> inputs = {{4096, 4096, matrix_layout::col_major},
+                                             {4096, 4096, matrix_layout::col_major},
+                                             {4096, 4096, matrix_layout::col_major},
+                                             {4096, 1, matrix_layout::row_major}};
+
+    const chain_plan plan = plan_chain(
+        inputs, {{0, 1, 2, 3}}, gemm_cost_model::for_kernel<kernel_type::wmma_opt_4>());
+    ASSERT_EQ(plan.steps.size(), 3u);
+    EXPECT_EQ(plan.steps[0].lhs, 2);
+    EXPECT_EQ(plan.steps[0].rhs, 3);
+    EXPECT_EQ(plan.steps[1].lhs, 1);
+    EXPECT_EQ(plan.steps[2].lhs, 0);
+    EXPECT_TRUE(plan.values[plan.steps[2].dst].output);
+    EXPECT_GT(plan.written_cost_us, 5.0 * plan.cost_us);
+    // Each product is freed once consumed, so the intermediates ping-pong between two vectors
+    EXPECT_EQ(plan.arena_size, 2 * 4096 * sizeof(half));
+}
+
+TEST(ChainTest, LoraTermAccumulatesIntoOutput)
+{
+    const std::vector<chain_input> inputs = {{512, 1024, matrix_layout::col_major},
+                                             {1024, 1024, matrix_layout::row_major},
+                                             {1024, 16, matrix_layout::row_major},
+                                             {16, 1024, matrix_layout::row_major}};
+
+    const chain_plan plan = plan_chain(
+        inputs, {{0, 1}, {0, 2, 3}}, gemm_cost_model::for_kernel<kernel_type::wmma_opt_4>());
+    ASSERT_EQ(plan.steps.size(), 3u);
+    EXPECT_FALSE(plan.steps[0].accumulate);
+    // X·L is formed first, in column-major as it is the left factor of the last product
+    EXPECT_EQ(plan.steps[1].lhs, 0);
+    EXPECT_EQ(plan.steps[1].rhs, 2);
+    EXPECT_EQ(plan.values[plan.steps[1].dst].layout, matrix_layout::col_major);
+    EXPECT_TRUE(plan.steps[2].accumulate);
+    EXPECT_TRUE(plan.values[plan.steps[2].dst].output);
+    EXPECT_EQ(plan.arena_size, 512 * 16 * sizeof(half));
+}
+
+TEST(ChainTest, MismatchedLayoutsAreTransposedThroughArena)
+{
+    const std::vector<chain_input> inputs
+        = {{256, 128, matrix_layout::row_major}, {128, 64, matrix_layout::row_major}};
+
+    const chain_plan plan = plan_chain(inputs, {{0, 1}}, flop_cost_model());
+    ASSERT_EQ(plan.steps.size(), 2u);
+    EXPECT_TRUE(plan.steps[0].transpose);
+    EXPECT_EQ(plan.values[plan.steps[0].dst].layout, matrix_layout::col_major);
+    EXPECT_EQ(plan.arena_size, 256 * 128 * sizeof(half));
+
+    EXPECT_THROW(plan_chain(inputs, {{1, 0}}, flop_cost_model()), std::invalid_argument);
+    EXPECT_THROW(plan_chain(inputs, {{0}}, flop_cost_model()), std::invalid_argument);
+}
+
+/**
+ * @brief Plans and runs a sum of chains on random data, checking it against a CPU evaluation in
+ * the written order with fp32 intermediates
+ */
+template<kernel_type K_TYPE>
+void verify_chain(const std::vector<chain_input>&         inputs,
+                  const std::vector<std::vector<size_t>>& terms)
+{
+    std::mt19937                          gen(5);
+    std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+
+    // Host copies in the given layouts, scaled so that products stay near unit magnitude
+    std::vector<std::vector<half>>   h_inputs;
+    std::vector<device_buffer<half>> d_buffers;
+    std::vector<half*>               d_inputs;
+    for(const chain_input& input : inputs)
+    {
+        const float       scale = 1.0f / std::sqrt(static_cast<float>(input.rows));
+        std::vector<half> h(input.rows * input.cols);
+        for(half& v : h)
+        {
+            v = static_cast<half>(dis(gen) * scale);
+        }
+        d_buffers.emplace_back(h);
+        d_inputs.push_back(d_buffers.back().data());
+        h_inputs.push_back(std::move(h));
+    }
+
+    auto element = [&](size_t i, size_t r, size_t c)
+    {
+        const chain_input& input = inputs[i];
+        return static_cast<float>(h_inputs[i][input.layout == matrix_layout::row_major
+                                                  ? r * input.cols + c
+                                                  : c * input.rows + r]);
+    };
+
+    const chain_plan plan = plan_chain(inputs, terms, gemm_cost_model::for_kernel<K_TYPE>());
+
+    matrix<half, matrix_layout::row_major> h_out(plan.rows, plan.cols);
+    matrix<half, matrix_layout::row_major> h_ref(plan.rows, plan.cols);
+    std::vector<float>                     ref(plan.rows * plan.cols, 0.0f);
+    for(const auto& term : terms)
+    {
+        // Row-major product of the term, left to right
+        size_t             cols = inputs[term[0]].cols;
+        std::vector<float> acc(plan.rows * cols);
+        for(size_t r = 0; r < plan.rows; ++r)
+        {
+            for(size_t c = 0; c < cols; ++c)
+            {
+                acc[r * cols + c] = element(term[0], r, c);
+            }
+        }
+        for(size_t t = 1; t < term.size(); ++t)
+        {
+            const size_t       next_cols = inputs[term[t]].cols;
+            std::vector<float> next(plan.rows * next_cols, 0.0f);
+            for(size_t r = 0; r < plan.rows; ++r)
+            {
+                for(size_t k = 0; k < cols; ++k)
+                {
+                    for(size_t c = 0; c < next_cols; ++c)
+                    {
+                        next[r * next_cols + c] += acc[r * cols + k] * element(term[t], k, c);
+                    }
+                }
+            }
+            acc  = std::move(next);
+            cols = next_cols;
+        }
+        for(size_t e = 0; e < ref.size(); ++e)
+        {
+            ref[e] += acc[e];
+        }
+    }
+    for(size_t r = 0; r < plan.rows; ++r)
+    {
+        for(size_t c = 0; c < plan.cols; ++c)
+        {
+            h_ref(r, c) = static_cast<half>(ref[r * plan.cols + c]);
+        }
+    }
+
+    device_matrix<matrix_layout::row_major> d_out(plan.rows, plan.cols);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    gemm_arena arena;
+    // Run twice, so the second execution reuses the arena
+    for(int i = 0; i < 2; ++i)
+    {
+        execute_chain<K_TYPE>(plan, d_out.data(), d_inputs, arena, stream);
+        HIP_CHECK(hipPeekAtLastError());
+    }
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+    EXPECT_EQ(arena.capacity(), std::max<size_t>(plan.arena_size, 1));
+
+    d_out.copy_to(h_out);
+
+    ASSERT_TRUE(verify_results(h_out, h_ref));
+}
+
+TEST(ChainTest, MatrixVectorChainOpt4Wgp)
+{
+    verify_chain<kernel_type::wmma_opt_4_wgp>({{300, 256, matrix_layout::col_major},
+                                               {256, 200, matrix_layout::row_major},
+                                               {200, 8, matrix_layout::row_major}},
+                                              {{0, 1, 2}});
+}
+
+TEST(ChainTest, LoraSumOpt4Wgp)
+{
+    verify_chain<kernel_type::wmma_opt_4_wgp>({{256, 512, matrix_layout::col_major},
+                                               {512, 384, matrix_layout::row_major},
+                                               {512, 16, matrix_layout::row_major},
+                                               {16, 384, matrix_layout::row_major}},
+                                              {{0, 1}, {0, 2, 3}});
+}
+
+// Multi-device execution and tensor files
+
+/**
+ * @brief Runs a plan on simulated devices and compares with the CPU reference
+ */
+void verify_simulated_plan(const parallel_plan& plan, bool exact)
+{
+    std::mt19937 gen(29);
+    host_col     a(plan.M, plan.K);
+    host_row     b(plan.K, plan.N);
+    host_row     c(plan.M, plan.N);
+    host_row     c_ref(plan.M, plan.N);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+
+    simulated_devices devices(plan.devices);
+    devices.execute(plan, c.data(), a.data(), b.data());
+    hgemm_cpu(c_ref, a, b);
+
+    if(exact)
+    {
+        EXPECT_EQ(std::memcmp(c.data(), c_ref.data(), c.size() * sizeof(half)), 0);
+    }
+    else
+    {
+        // Split-K rounds each partial to half before the reduction
+        EXPECT_LT(relative_error(c, c_ref), 1e-3);
+    }
+    EXPECT_EQ(devices.peer_bytes(), plan.peer_bytes);
+}
+
+TEST(ParallelTest, RowAndColumnPartitionsMatchReferenceExactly)
+{
+    const parallel_cost_model model;
+    const parallel_plan       rows = plan_block_cyclic(301, 203, 130, 4, 1, 76, 203, model);
+    const parallel_plan       cols = plan_block_cyclic(301, 203, 130, 1, 3, 301, 68, model);
+    EXPECT_EQ(rows.kind, partition_kind::rows);
+    EXPECT_EQ(cols.kind, partition_kind::cols);
+    verify_simulated_plan(rows, true);
+    verify_simulated_plan(cols, true);
+
+    // Rows: three remote devices receive their A panel and all of B, and return their C panel
+    const size_t remote_rows = 301 - 76;
+    EXPECT_EQ(rows.peer_bytes, (remote_rows * 130 + 3 * 130 * 203 + remote_rows * 203) * 2);
+}
+
+TEST(ParallelTest, RejectsGemmOnRemoteMemory)
+{
+    parallel_plan plan = plan_block_cyclic(128, 96, 64, 2, 1, 64, 96, {});
+    ASSERT_EQ(plan.gemms.size(), 2u);
+    ASSERT_NE(plan.gemms[1].device, plan.buffers[parallel_buffer_a].device);
+
+    // Point the second device's GEMM at the user's A on the home device
+    plan.gemms[1].a        = parallel_buffer_a;
+    plan.gemms[1].a_offset = 0;
+
+    std::vector<half> a(128 * 64), b(64 * 96), c(128 * 96);
+    simulated_devices devices(plan.devices);
+    EXPECT_THROW(devices.execute(plan, c.data(), a.data(), b.data()), std::logic_error);
+}
+
+TEST(ParallelTest, BlockCyclicDealsBlocksAcrossGrid)
+{
+    const parallel_plan plan = plan_block_cyclic(250, 190, 96, 2, 2, 32, 48, {});
+    EXPECT_EQ(plan.kind, partition_kind::block_cyclic);
+    EXPECT_EQ(plan.gemms.size(), 4u);
+
+    // Row blocks 0, 2, 4, 6 go to grid row 0: 4 × 32 rows, the last block of 26 to grid row 1
+    EXPECT_EQ(plan.gemms[0].M, 128u);
+    EXPECT_EQ(plan.gemms[2].M, 122u);
+    EXPECT_EQ(plan.gemms[0].N, 96u);
+    EXPECT_EQ(plan.gemms[1].N, 94u);
+    verify_simulated_plan(plan, true);
+}
+
+TEST(ParallelTest, SplitKReducesPartials)
+{
+    const parallel_plan plan = plan_split_k(128, 96, 200, 3, {});
+    ASSERT_EQ(plan.gemms.size(), 3u);
+    EXPECT_EQ(plan.gemms[0].K, 80u);
+    EXPECT_EQ(plan.gemms[2].K, 40u);
+    EXPECT_EQ(plan.reduce_slices, 3);
+    verify_simulated_plan(plan, false);
+}
+
+TEST(ParallelTest, PlannerFollowsCommunicationCost)
+{
+    parallel_cost_model model;
+    model.link_gbps = 25.0;
+
+    // A tall, thin output keeps B replicated and splits rows; a deep K splits the reduction
+    EXPECT_EQ(plan_parallel_gemm(65536, 256, 1024, 4, model).kind, partition_kind::rows);
+    EXPECT_EQ(plan_parallel_gemm(256, 65536, 1024, 4, model).kind, partition_kind::cols);
+    EXPECT_EQ(plan_parallel_gemm(256, 256, 1 << 20, 4, model).kind, partition_kind::split_k);
+
+    // Every candidate is costed, so the chosen plan is no worse than any fixed one
+    const parallel_plan best = plan_parallel_gemm(8192, 8192, 8192, 4, model);
+    EXPECT_LE(best.cost_us, plan_block_cyclic(8192, 8192, 8192, 4, 1, 2048, 8192, model).cost_us);
+    EXPECT_LE(best.cost_us, plan_split_k(8192, 8192, 8192, 4, model).cost_us);
+    verify_simulated_plan(plan_parallel_gemm(200, 180, 64, 4, model), false);
+}
+
+TEST(ParallelTest, LogicalDevicesOnAvailableGpus)
+{
+    int count;
+    HIP_CHECK(hipGetDeviceCount(&count));
+
+    // Four logical devices, sharing GPUs when fewer are present
+    std::vector<int> ids;
+    for(int d = 0; d < 4; ++d)
+    {
+        ids.push_back(d % count);
+    }
+    device_group<kernel_type::wmma_opt_4> group(ids);
+
+    const size_t M = 512, N = 384, K = 256;
+    std::mt19937 gen(31);
+    host_col     a(M, K);
+    host_row     b(K, N);
+    host_row     c_ref(M, N);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+    hgemm_cpu(c_ref, a, b);
+
+    HIP_CHECK(hipSetDevice(ids[0]));
+    device_matrix<matrix_layout::col_major> d_a(a);
+    device_matrix<matrix_layout::row_major> d_b(b);
+    device_matrix<matrix_layout::row_major> d_c(M, N);
+
+    host_row c(M, N);
+    group.execute(
+        plan_block_cyclic(M, N, K, 2, 2, 64, 128, {}), d_c.data(), d_a.data(), d_b.data());
+    d_c.copy_to(c);
+    ASSERT_TRUE(verify_results(c, c_ref));
+
+    // Split-K rounds each partial to half before the reduction
+    group.execute(plan_split_k(M, N, K, 4, {}), d_c.data(), d_a.data(), d_b.data());
+    d_c.copy_to(c);
+    EXPECT_LT(relative_error(c, c_ref), 5e-3);
+}
+
+/**
+ * @brief A unique path in the temporary directory, removed on destruction
+ */
+struct temp_path
+{
+    explicit temp_path(const std::string& name)
+        : path((std::filesystem::temp_directory_path()
+                / (std::to_string(::getpid()) + "_" + name))
+                   .string())
+    {}
+    ~temp_path()
+    {
+        std::filesystem::remove(path);
+    }
+    std::string path;
+};
+
+TEST(TensorFileTest, SafetensorsViewsPointIntoMapping)
+{
+    std::mt19937 gen(37);
+    host_row     weight(48, 80);
+    fill_uniform(weight, gen, 1.0f);
+    std::vector<float>   bias(48, 0.5f);
+    std::vector<uint8_t> mask(3, 1);
+
+    temp_path file("weights.safetensors");
+    save_safetensors(file.path,
+                     {{"layer.weight", tensor_dtype::f16, {48, 80}, weight.data()},
+                      {"layer.bias", tensor_dtype::f32, {48}, bias.data()},
+                      {"mask", tensor_dtype::u8, {3}, mask.data()}});
+
+    tensor_file tensors(file.path);
+    ASSERT_EQ(tensors.tensors().size(), 3u);
+
+    const tensor_entry& entry = tensors.find("layer.weight");
+    const auto          w     = tensors.view<half, matrix_layout::row_major>("layer.weight");
+    EXPECT_EQ(reinterpret_cast<const std::byte*>(w.data()), tensors.data(entry));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(w.data()) % 8, 0u);
+    EXPECT_EQ(w.m(), 48u);
+    EXPECT_EQ(w.n(), 80u);
+    EXPECT_EQ(std::memcmp(w.data(), weight.data(), weight.size() * sizeof(half)), 0);
+
+    // The transpose of a row-major weight is the same memory read column-major
+    const auto wt = tensors.view_transposed<half, matrix_layout::col_major>("layer.weight");
+    EXPECT_EQ(wt.data(), w.data());
+    EXPECT_EQ(wt.m(), 80u);
+    EXPECT_EQ(static_cast<float>(wt(7, 3)), static_cast<float>(weight(3, 7)));
+
+    const auto b = tensors.view<float, matrix_layout::row_major>("layer.bias");
+    EXPECT_EQ(b.m(), 1u);
+    EXPECT_EQ(b(0, 47), 0.5f);
+
+    EXPECT_THROW((tensors.view<float, matrix_layout::row_major>("layer.weight")),
+                 std::invalid_argument);
+    EXPECT_THROW((tensors.view<half, matrix_layout::col_major>("layer.weight")),
+                 std::invalid_argument);
+    EXPECT_THROW(tensors.find("missing"), std::out_of_range);
+}
+
+TEST(TensorFileTest, NpyKeepsFortranOrder)
+{
+    std::mt19937 gen(41);
+    host_col     a(33, 17);
+    host_row     b(17, 9);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+
+    temp_path a_file("a.npy");
+    temp_path b_file("b.npy");
+    save_npy(a_file.path, a);
+    save_npy(b_file.path, b);
+
+    tensor_file a_tensors(a_file.path);
+    tensor_file b_tensors(b_file.path);
+    const auto  a_view = a_tensors.view<half, matrix_layout::col_major>(
+        a_tensors.tensors()[0].name);
+    const auto b_view = b_tensors.view<half, matrix_layout::row_major>(
+        b_tensors.tensors()[0].name);
+    EXPECT_EQ(a_view.m(), 33u);
+    EXPECT_EQ(a_view.n(), 17u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(a_view.data()) % 64, 0u);
+
+    // Views feed the CPU reference like owning matrices
+    host_row c(33, 9);
+    host_row c_ref(33, 9);
+    hgemm_cpu(c, a_view, b_view);
+    hgemm_cpu(c_ref, a, b);
+    EXPECT_EQ(std::memcmp(c.data(), c_ref.data(), c.size() * sizeof(half)), 0);
+}
+
+TEST(TensorFileTest, RejectsTruncatedFiles)
+{
+    temp_path file("truncated.safetensors");
+    {
+        std::ofstream  out(file.path, std::ios::binary);
+        const char     json[]
+            = "{\"x\":{\"dtype\":\"F16\",\"shape\":[4,4],\"data_offsets\":[0,32]}}";
+        const uint64_t header = sizeof(json) - 1;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(json, header);
+        out.write(json, 8); // 8 of the 32 data bytes
+    }
+    EXPECT_THROW(tensor_file{file.path}, std::runtime_error);
+}
+
+TEST(TensorFileTest, ParsesEscapesAndRejectsMalformedHeaders)
+{
+    temp_path file("escapes.safetensors");
+    auto      write = [&](const std::string& name)
+    {
+        std::ofstream     out(file.path, std::ios::binary);
+        const std::string json
+            = "{\"" + name + "\":{\"dtype\":\"U8\",\"shape\":[2],\"data_offsets\":[0,2]}}";
+        const uint64_t    header = json.size();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(json.data(), header);
+        out.write("ab", 2);
+    };
+
+    // Code points outside ASCII become '?' instead of being truncated to a byte
+    write("\\u004b\\u0141\\u00e9");
+    EXPECT_EQ(tensor_file{file.path}.tensors()[0].name, "K??");
+
+    // Malformed escapes report a malformed header rather than std::stoi's exception
+    write("\\u00zz");
+    EXPECT_THROW(tensor_file{file.path}, std::runtime_error);
+    write("\\u+12a");
+    EXPECT_THROW(tensor_file{file.path}, std::runtime_error);
+
+    // An .npy magic without room for the version and header length
+    temp_path npy("short.npy");
+    {
+        std::ofstream out(npy.path, std::ios::binary);
+        out.write("\x93NUMPY\x01", 7);
+    }
+    EXPECT_THROW(tensor_file{npy.path}, std::runtime_error);
+}
+
+TEST(TensorFileTest, StagedUploadMatchesFile)
+{
+    std::mt19937 gen(43);
+    host_row     weight(257, 130);
+    host_row     embedding(64, 96);
+    fill_uniform(weight, gen, 1.0f);
+    fill_uniform(embedding, gen, 1.0f);
+
+    temp_path file("upload.safetensors");
+    save_safetensors(file.path,
+                     {{"weight", tensor_dtype::f16, {257, 130}, weight.data()},
+                      {"embedding", tensor_dtype::f16, {64, 96}, embedding.data()}});
+    tensor_file tensors(file.path);
+
+    // Small chunks so that every tensor cycles through both staging buffers
+    staged_uploader                         uploader(4096);
+    device_matrix<matrix_layout::row_major> d_weight(257, 130);
+    device_matrix<matrix_layout::row_major> d_embedding(64, 96);
+    uploader.upload(d_weight.data(), tensors, tensors.find("weight"));
+    uploader.upload(d_embedding.data(), tensors, tensors.find("embedding"));
+    uploader.synchronize();
+    EXPECT_EQ(uploader.bytes(), (weight.size() + embedding.size()) * sizeof(half));
+    EXPECT_GT(uploader.throughput_gbps(), 0.0);
+
+    host_row w(257, 130);
+    host_row e(64, 96);
+    d_weight.copy_to(w);
+    d_embedding.copy_to(e);
+    EXPECT_EQ(std::memcmp(w.data(), weight.data(), w.size() * sizeof(half)), 0);
+    EXPECT_EQ(std::memcmp(e.data(), embedding.data(), e.size() * sizeof(half)), 0);
+}
+
+// Attention and adapters
+
+TEST(MaskedTest, CausalLaunchesLowerTriangleOfTiles)
+{
+    const band_tiles tiles = plan_band_tiles<256, 256>(2048, 2048, attention_band{});
+    EXPECT_EQ(tiles.dense_tiles, 64u);
+    EXPECT_EQ(tiles.order.size(), 36u);
+    EXPECT_EQ(tiles.partial, 8u);
+    for(uint32_t tile : tiles.order)
+    {
+        EXPECT_LE(tile & 0xffff, tile >> 16);
+    }
+}
+
+TEST(MaskedTest, SlidingWindowTilesMatchElementwiseBand)
+{
+    constexpr int        block_m = 128, block_n = 96;
+    const size_t         M = 1000, N = 1300;
+    const attention_band band{300, 500};
+    const band_tiles     tiles = plan_band_tiles<block_m, block_n>(M, N, band);
+
+    size_t next = 0, partial = 0;
+    for(size_t tm = 0; tm * block_m < M; ++tm)
+    {
+        for(size_t tn = 0; tn * block_n < N; ++tn)
+        {
+            bool any = false, all = true;
+            for(size_t i = tm * block_m; i < std::min((tm + 1) * block_m, M); ++i)
+            {
+                for(size_t j = tn * block_n; j < std::min((tn + 1) * block_n, N); ++j)
+                {
+                    const bool kept = band.contains(i, j);
+                    any             = any || kept;
+                    all             = all && kept;
+                }
+            }
+            if(any)
+            {
+                ASSERT_LT(next, tiles.order.size());
+                EXPECT_EQ(tiles.order[next++], (tm << 16) | tn);
+                partial += all ? 0 : 1;
+            }
+        }
+    }
+    EXPECT_EQ(next, tiles.order.size());
+    EXPECT_EQ(partial, tiles.partial);
+    EXPECT_LT(tiles.order.size(), tiles.dense_tiles);
+}
+
+TEST(MaskedTest, EpilogueMasksOutsideBand)
+{
+    const auto epi = epilogue_mask(epilogue_mul(epilogue_acc{}, epilogue_scalar{0.5f}),
+                                   attention_band{0, 4});
+    EXPECT_EQ(epi(2.0f, 10, 10), 1.0f);
+    EXPECT_EQ(epi(2.0f, 10, 7), 1.0f);
+    EXPECT_TRUE(std::isinf(epi(2.0f, 10, 6)) && epi(2.0f, 10, 6) < 0.0f);
+    EXPECT_TRUE(std::isinf(epi(2.0f, 10, 11)));
+}
+
+/**
+ * @brief Runs a masked GEMM on a C pre-filled with a sentinel and checks kept, masked and
+ * skipped elements
+ */
+template<kernel_type K_TYPE>
+void verify_masked(size_t M, size_t N, size_t K, attention_band band, float scale)
+{
+    constexpr float sentinel = 7.0f;
+    constexpr float masked   = -1000.0f;
+
+    std::mt19937 gen(71);
+    host_col     a(M, K);
+    host_row     b(K, N);
+    host_row     c(M, N);
+    host_row     ref(M, N);
+    host_row     expected(M, N);
+    fill_uniform(a, gen, 1.0f);
+    fill_uniform(b, gen, 1.0f);
+    hgemm_cpu(ref, a, b);
+    for(size_t i = 0; i < M; ++i)
+    {
+        for(size_t j = 0; j < N; ++j)
+        {
+            c(i, j) = static_cast<half>(sentinel);
+        }
+    }
+
+    const masked_hgemm<K_TYPE> gemm(M, N, K, band, masked);
+    using config = wmma_config<K_TYPE>;
+    const size_t      grid_n = (N + config::block_n - 1) / config::block_n;
+    std::vector<bool> launched(((M + config::block_m - 1) / config::block_m) * grid_n);
+    for(uint32_t tile : gemm.tiles().order)
+    {
+        launched[(tile >> 16) * grid_n + (tile & 0xffff)] = true;
+    }
+    for(size_t i = 0; i < M; ++i)
+    {
+        for(size_t j = 0; j < N; ++j)
+        {
+            float value = sentinel;
+            if(launched[(i / config::block_m) * grid_n + j / config::block_n])
+            {
+                value = band.contains(i, j) ? static_cast<float>(ref(i, j)) * scale : masked;
+            }
+            expected(i, j) = static_cast<half>(value);
+        }
+    }
+
+    device_matrix<matrix_layout::col_major> d_a(a);
+    device_matrix<matrix_layout::row_major> d_b(b);
+    device_matrix<matrix_layout::row_major> d_c(c);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    gemm.execute(d_c.data(),
+                 d_a.data(),
+                 d_b.data(),
+                 stream,
+                 epilogue_mul(epilogue_acc{}, epilogue_scalar{scale}));
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_c.copy_to(c);
+    ASSERT_TRUE(verify_results(c, expected));
+}
+
+TEST(MaskedTest, CausalScoresOpt4Wgp)
+{
+    verify_masked<kernel_type::wmma_opt_4_wgp>(1000, 1000, 64, attention_band{}, 1.0f);
+}
+
+TEST(MaskedTest, SlidingWindowWithKvOffsetOpt4Wgp)
+{
+    verify_masked<kernel_type::wmma_opt_4_wgp>(700, 1200, 128, attention_band{500, 300}, 0.125f);
+}
+
+TEST(DecodeTest, SplitLengthTargetsWarpCount)
+{
+    // 128k keys on 8 heads: 512 keys per warp gives 2048 warps
+    EXPECT_EQ(decode_attention_split_len(8, 131072), 512u);
+    EXPECT_EQ(decode_attention_split_len(1, 1000), 64u);
+    EXPECT_EQ(decode_attention_split_len(1, 100000) % wmma_tile, 0u);
+    EXPECT_EQ(decode_attention_workspace_size(2, 4, 1000, 128, 64), 2u * 16 * 4 * 130 * 4);
+}
+
+TEST(DecodeTest, RejectsUnsupportedShapes)
+{
+    hipStream_t stream = nullptr;
+    auto run = [&](size_t G, size_t D, size_t split_len)
+    {
+        decode_attention_gpu(
+            nullptr, nullptr, nullptr, nullptr, 1, G, 64, D, 1.0f, nullptr, stream, split_len);
+    };
+    EXPECT_THROW(run(17, 64, 0), std::invalid_argument);
+    EXPECT_THROW(run(1, 96, 0), std::invalid_argument);
+    EXPECT_THROW(run(1, 64, 24), std::invalid_argument);
+}
+
+/**
+ * @brief Runs split-KV decode attention and compares with the CPU reference
+ */
+void verify_decode(size_t heads, size_t G, size_t S, size_t D, size_t split_len)
+{
+    std::mt19937 gen(73);
+    host_row     q(heads * G, D);
+    host_row     k(heads * S, D);
+    host_row     v(heads * S, D);
+    host_row     o(heads * G, D);
+    host_row     o_ref(heads * G, D);
+    fill_uniform(q, gen, 1.0f);
+    fill_uniform(k, gen, 1.0f);
+    fill_uniform(v, gen, 1.0f);
+
+    const float scale = 1.0f / std::sqrt(static_cast<float>(D));
+    decode_attention_cpu(o_ref, q, k, v, heads, scale);
+
+    device_matrix<matrix_layout::row_major> d_q(q);
+    device_matrix<matrix_layout::row_major> d_k(k);
+    device_matrix<matrix_layout::row_major> d_v(v);
+    device_matrix<matrix_layout::row_major> d_o(heads * G, D);
+
+    device_buffer<uint8_t> workspace(decode_attention_workspace_size(heads, G, S, D, split_len));
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    decode_attention_gpu(d_o.data(),
+                         d_q.data(),
+                         d_k.data(),
+                         d_v.data(),
+                         heads,
+                         G,
+                         S,
+                         D,
+                         scale,
+                         workspace.data(),
+                         stream,
+                         split_len);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_o.copy_to(o);
+    EXPECT_LT(relative_error(o, o_ref), 1e-2);
+}
+
+TEST(DecodeTest, GroupedQueriesPartialSplits)
+{
+    // 1000 keys leave a partial last block of 16 and a partial last split
+    verify_decode(2, 4, 1000, 128, 64);
+}
+
+TEST(DecodeTest, SingleQueryDefaultSplit)
+{
+    verify_decode(1, 1, 4099, 64, 0);
+    verify_decode(1, 16, 300, 256, 0);
+}
+
+TEST(PagedTest, LoadersResolveBlockTable)
+{
+    const std::vector<int32_t> table = {2, 0, 3};
+    const paged_layout         layout{table.data(), 1000, 40, 4000};
+
+    const b_loader_paged_rows<32> rows{layout};
+    EXPECT_EQ(rows.offset<int>(33, 5, 40), 1 * 40 + 5);
+    EXPECT_EQ(rows.offset<int64_t>(70, 7, 40), 3 * 1000 + 6 * 40 + 7);
+
+    const b_loader_paged_cols<32> cols{layout};
+    EXPECT_EQ(cols.offset<int>(3, 40, 80), 3 * 40 + 8);
+    EXPECT_EQ(cols.offset<int>(2, 64, 80), 3 * 1000 + 2 * 40);
+    // Columns past N do not index the block table
+    EXPECT_EQ(cols.offset<int>(1, 96, 80), 40);
+
+    const b_loader_paged_token_major<32> tokens{layout};
+    EXPECT_EQ(tokens.offset<int>(3, 40, 80), 8 * 40 + 3);
+    EXPECT_EQ(tokens.offset<int64_t>(2, 64, 80), 3 * 1000 + 2);
+    EXPECT_EQ(tokens.offset<int>(1, 96, 80), 1);
+}
+
+TEST(PagedTest, TokenMajorLoaderGathersAcrossRows)
+{
+    // One page of 32 tokens with 4 channels; B(row, col) is channel row of token col
+    std::vector<half> pool(32 * 4);
+    for(size_t i = 0; i < pool.size(); ++i)
+    {
+        pool[i] = static_cast<half>(static_cast<float>(i));
+    }
+    const int32_t                        table[] = {0};
+    const b_loader_paged_token_major<32> loader{{table, 128, 4, pool.size()}};
+    const buffer_resource                rsrc = loader.resource(pool.data(), 4, 32);
+
+    for(bool wide : {false, true})
+    {
+        half dst[32];
+        if(wide)
+        {
+            loader.load<32, int64_t>(dst, rsrc, loader.offset<int64_t>(2, 0, 20), 20);
+        }
+        else
+        {
+            loader.load<32, int>(dst, rsrc, loader.offset<int>(2, 0, 20), 20);
+        }
+        for(int v = 0; v < 32; ++v)
+        {
+            // Tokens at or past N = 20 are zero-filled
+            EXPECT_EQ(static_cast<float>(dst[v]), v < 20 ? v * 4 + 2 : 0.0f) << "token " << v;
+        }
+    }
+}
+
+TEST(PagedTest, RejectsNarrowPages)
+{
+    hipStream_t        stream = nullptr;
+    const paged_layout layout{nullptr, 4096, 128, 1 << 20};
+    EXPECT_THROW((paged_values_gpu<kernel_type::wmma_opt_4_wgp, 32>(
+                     nullptr, nullptr, nullptr, 16, 64, 256, layout, stream)),
+                 std::invalid_argument);
+    EXPECT_THROW((paged_scores_gpu<kernel_type::wmma_opt_4_wgp, 256>(
+                     nullptr, nullptr, nullptr, 16, 64, 128, layout, stream)),
+                 std::invalid_argument);
+    EXPECT_THROW((paged_scores_gpu<kernel_type::wmma_opt_4_wgp, 32, paged_key_layout::token_major>(
+                     nullptr, nullptr, nullptr, 16, 64, 256, layout, stream)),
+                 std::invalid_argument);
+}
+
+/**
+ * @brief Check paged Q·Kᵀ and P·V against contiguous GEMMs
+ *
+ * The sequence is scattered over a shuffled set of pool pages shared by two heads, and the GEMMs
+ * run on the second head so that both the page stride and the row stride differ from a dense
+ * layout. Key pages are written in the layout KEYS.
+ */
+template<kernel_type K_TYPE, int PAGE_SIZE, paged_key_layout KEYS = paged_key_layout::transposed>
+void verify_paged(size_t M, size_t S, size_t D)
+{
+    constexpr size_t heads         = 2;
+    const size_t     pages         = (S + PAGE_SIZE - 1) / PAGE_SIZE;
+    const size_t     pool_pages    = pages + 3;
+    const size_t     page_elements = heads * PAGE_SIZE * D;
+
+    std::mt19937 gen(74);
+    host_col     q(M, D);
+    host_row     kt(D, S);
+    host_col     p(M, S);
+    host_row     v(S, D);
+    host_row     scores(M, S);
+    host_row     scores_ref(M, S);
+    host_row     o(M, D);
+    host_row     o_ref(M, D);
+    fill_uniform(q, gen, 1.0f);
+    fill_uniform(kt, gen, 1.0f);
+    fill_uniform(p, gen, 1.0f);
+    fill_uniform(v, gen, 1.0f);
+    hgemm_cpu(scores_ref, q, kt);
+    hgemm_cpu(o_ref, p, v);
+
+    std::vector<int32_t> pool_order(pool_pages);
+    std::iota(pool_order.begin(), pool_order.end(), 0);
+    std::shuffle(pool_order.begin(), pool_order.end(), gen);
+    const std::vector<int32_t> table(pool_order.begin(), pool_order.begin() + pages);
+
+    // Unused pages and the first head hold garbage that must never be read
+    std::uniform_real_distribution<float> garbage(100.0f, 200.0f);
+    std::vector<half>                     key_pool(pool_pages * page_elements);
+    std::vector<half>                     value_pool(pool_pages * page_elements);
+    for(size_t i = 0; i < key_pool.size(); ++i)
+    {
+        key_pool[i]   = static_cast<half>(garbage(gen));
+        value_pool[i] = static_cast<half>(garbage(gen));
+    }
+
+    // Transposed key pages are [head][D][PAGE_SIZE], token-major key pages and value pages are
+    // [PAGE_SIZE][head][D]
+    constexpr bool token_major = KEYS == paged_key_layout::token_major;
+    const size_t   head_keys   = token_major ? D : PAGE_SIZE * D;
+    const size_t   key_ld      = token_major ? heads * D : PAGE_SIZE;
+    const size_t   head_values = D;
+    for(size_t s = 0; s < S; ++s)
+    {
+        const size_t page = static_cast<size_t>(table[s / PAGE_SIZE]) * page_elements;
+        for(size_t d = 0; d < D; ++d)
+        {
+            const size_t key = token_major ? (s % PAGE_SIZE) * key_ld + d
+                                           : d * key_ld + s % PAGE_SIZE;
+            key_pool[page + head_keys + key]                                 = kt(d, s);
+            value_pool[page + head_values + (s % PAGE_SIZE) * heads * D + d] = v(s, d);
+        }
+    }
+
+    device_buffer<half>    d_keys(key_pool);
+    device_buffer<half>    d_values(value_pool);
+    device_buffer<int32_t> d_table(table);
+
+    const paged_layout key_layout{d_table.data(),
+                                  static_cast<int64_t>(page_elements),
+                                  static_cast<int64_t>(key_ld),
+                                  key_pool.size() - head_keys};
+    const paged_layout value_layout{d_table.data(),
+                                    static_cast<int64_t>(page_elements),
+                                    static_cast<int64_t>(heads * D),
+                                    value_pool.size() - head_values};
+
+    device_matrix<matrix_layout::col_major> d_q(q);
+    device_matrix<matrix_layout::col_major> d_p(p);
+    device_matrix<matrix_layout::row_major> d_scores(M, S);
+    device_matrix<matrix_layout::row_major> d_o(M, D);
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    paged_scores_gpu<K_TYPE, PAGE_SIZE, KEYS>(
+        d_scores.data(), d_q.data(), d_keys.data() + head_keys, M, S, D, key_layout, stream);
+    HIP_CHECK(hipPeekAtLastError());
+    paged_values_gpu<K_TYPE, PAGE_SIZE>(
+        d_o.data(), d_p.data(), d_values.data() + head_values, M, S, D, value_layout, stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_scores.copy_to(scores);
+    d_o.copy_to(o);
+    ASSERT_TRUE(verify_results(scores, scores_ref));
+    ASSERT_TRUE(verify_results(o, o_ref));
+}
+
+TEST(PagedTest, BlockSizedPagesOpt4Wgp)
+{
+    // 1000 tokens leave a partial last page
+    verify_paged<kernel_type::wmma_opt_4_wgp, 256>(300, 1000, 128);
+}
+
+TEST(PagedTest, SmallPagesOpt4Wgp)
+{
+    verify_paged<kernel_type::wmma_opt_4_wgp, 32>(64, 777, 64);
+}
+
+TEST(PagedTest, TokenMajorKeysOpt4Wgp)
+{
+    verify_paged<kernel_type::wmma_opt_4_wgp, 32, paged_key_layout::token_major>(64, 777, 64);
+    verify_paged<kernel_type::wmma_opt_4_wgp, 256, paged_key_layout::token_major>(300, 1000, 128);
+}
+
+TEST(LoraTest, TilesFollowSegments)
+{
+    const std::vector<lora_tile> tiles = plan_lora_tiles({0, 20, 20, 25, 40}, {1, 2, -1, 0});
+    ASSERT_EQ(tiles.size(), 3u);
+    EXPECT_EQ(tiles[0].row, 0);
+    EXPECT_EQ(tiles[0].rows, 16);
+    EXPECT_EQ(tiles[0].adapter, 1);
+    EXPECT_EQ(tiles[1].row, 16);
+    EXPECT_EQ(tiles[1].rows, 4);
+    EXPECT_EQ(tiles[1].adapter, 1);
+    // The empty segment and the rows without an adapter produce no tiles
+    EXPECT_EQ(tiles[2].row, 25);
+    EXPECT_EQ(tiles[2].rows, 15);
+    EXPECT_EQ(tiles[2].adapter, 0);
+}
+
+TEST(LoraTest, RejectsUnsupportedShapes)
+{
+    const std::vector<int32_t> starts   = {0, 4};
+    const std::vector<int32_t> adapters = {-1};
+    EXPECT_THROW(lora_segmented(starts, adapters, 1024, 1024, 0), std::invalid_argument);
+    EXPECT_THROW(lora_segmented(starts, adapters, 1024, 1024, 65), std::invalid_argument);
+    EXPECT_THROW(lora_segmented(starts, adapters, 1000, 1024, 16), std::invalid_argument);
+    EXPECT_THROW(plan_lora_tiles({1, 4}, {0}), std::invalid_argument);
+    EXPECT_THROW(plan_lora_tiles({0, 8, 4}, {0, 1}), std::invalid_argument);
+    EXPECT_THROW(plan_lora_tiles({0, 4}, {0, 1}), std::invalid_argument);
+}
+
+/**
+ * @brief Check the segmented shrink/expand pair against the CPU reference, including the rows
+ * without an adapter that must keep their base output
+ */
+void verify_lora(const std::vector<int32_t>& starts,
+                 const std::vector<int32_t>& adapters,
+                 size_t                      num_adapters,
+                 size_t                      H_in,
+                 size_t                      H_out,
+                 size_t                      rank)
+{
+    const size_t T     = starts.back();
+    const float  scale = 0.5f;
+
+    std::mt19937 gen(74);
+    host_row     x(T, H_in);
+    host_row     a(num_adapters * rank, H_in);
+    host_row     b(num_adapters * H_out, rank);
+    host_row     y(T, H_out);
+    host_row     y_ref(T, H_out);
+    fill_uniform(x, gen, 1.0f);
+    fill_uniform(a, gen, 0.1f);
+    fill_uniform(b, gen, 0.1f);
+    fill_uniform(y, gen, 1.0f);
+    for(size_t i = 0; i < T; ++i)
+    {
+        for(size_t j = 0; j < H_out; ++j)
+        {
+            y_ref(i, j) = y(i, j);
+        }
+    }
+    lora_segmented_cpu(y_ref, x, a, b, starts, adapters, scale);
+
+    device_matrix<matrix_layout::row_major> d_x(x);
+    device_matrix<matrix_layout::row_major> d_a(a);
+    device_matrix<matrix_layout::row_major> d_b(b);
+    device_matrix<matrix_layout::row_major> d_y(y);
+
+    const lora_segmented   lora(starts, adapters, H_in, H_out, rank);
+    device_buffer<uint8_t> workspace(lora.workspace_size());
+
+    hipStream_t stream;
+    HIP_CHECK(hipStreamCreate(&stream));
+    lora.execute(d_y.data(), d_x.data(), d_a.data(), d_b.data(), scale, workspace.data(), stream);
+    HIP_CHECK(hipPeekAtLastError());
+    HIP_CHECK(hipStreamSynchronize(stream));
+    HIP_CHECK(hipStreamDestroy(stream));
+
+    d_y.copy_to(y);
+    EXPECT_LT(relative_error(y, y_ref), 1e-2);
+}
+
+TEST(LoraTest, MixedSegmentsRank16)
+{
+    // Partial tiles, an empty segment, rows without an adapter and a partial column group
+    verify_lora({0, 37, 37, 50, 130, 131}, {2, 0, -1, 1, 3}, 4, 1024, 768, 16);
+}
+
+TEST(LoraTest, DecodeRowsUnalignedRanks)
+{
+    // One row per request, few tiles, so H_in is split across workgroups
+    const std::vector<int32_t> starts   = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+    const std::vector<int32_t> adapters = {0, 3, 1, 3, 2, 0, 1, 2};
+    verify_lora(starts, adapters, 4, 4096, 512, 8);
+    verify_lora(starts, adapters, 4, 4096, 512, 40);
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);